@@ -6,6 +6,7 @@
 
 #include "db/filename.h"
 #include "db/dbformat.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "db/version_edit.h"
 #include "leveldb/db.h"
@@ -19,13 +20,16 @@ Status BuildTable(const std::string& dbname,
                   const Options& options,
                   TableCache* table_cache,
                   Iterator* iter,
+                  Iterator* range_del_iter,
                   FileMetaData* meta) {
   Status s;
   meta->file_size = 0;
+  meta->has_range_deletions = false;
   iter->SeekToFirst();
+  range_del_iter->SeekToFirst();
 
   std::string fname = TableFileName(dbname, meta->number);
-  if (iter->Valid()) {
+  if (iter->Valid() || range_del_iter->Valid()) {
     WritableFile* file;
     s = env->NewWritableFile(fname, &file);
     if (!s.ok()) {
@@ -33,12 +37,28 @@ Status BuildTable(const std::string& dbname,
     }
 
     TableBuilder* builder = new TableBuilder(options, file);
-    meta->smallest.DecodeFrom(iter->key());
+    bool empty = true;
+    if (iter->Valid()) {
+      meta->smallest.DecodeFrom(iter->key());
+      empty = false;
+    }
     for (; iter->Valid(); iter->Next()) {
       Slice key = iter->key();
       meta->largest.DecodeFrom(key);
       builder->Add(key, iter->value());
     }
+    // The options of a DB order keys with its internal key comparator
+    const InternalKeyComparator* icmp =
+        static_cast<const InternalKeyComparator*>(options.comparator);
+    for (; range_del_iter->Valid(); range_del_iter->Next()) {
+      builder->AddRangeTombstone(range_del_iter->key(),
+                                 range_del_iter->value());
+      ExtendRangeForTombstone(*icmp, range_del_iter->key(),
+                              range_del_iter->value(), empty,
+                              &meta->smallest, &meta->largest);
+      empty = false;
+      meta->has_range_deletions = true;
+    }
 
     // Finish and check for builder errors
     if (s.ok()) {
@@ -66,7 +86,8 @@ Status BuildTable(const std::string& dbname,
       // Verify that the table is usable
       Iterator* it = table_cache->NewIterator(ReadOptions(),
                                               meta->number,
-                                              meta->file_size);
+                                              meta->file_size,
+                                              0);
       s = it->status();
       delete it;
     }
@@ -75,6 +96,8 @@ Status BuildTable(const std::string& dbname,
   // Check for input iterator errors
   if (!iter->status().ok()) {
     s = iter->status();
+  } else if (!range_del_iter->status().ok()) {
+    s = range_del_iter->status();
   }
 
   if (s.ok() && meta->file_size > 0) {
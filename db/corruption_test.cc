@@ -260,6 +260,45 @@ TEST(CorruptionTest, TableFileRepair) {
   Check(95, 99);
 }
 
+TEST(CorruptionTest, MultiGetTableBlock) {
+  options_.block_size = 2 * kValueSize;  // Limit scope of corruption
+  options_.compression = kNoCompression;
+  Reopen();
+  Build(10);
+  DBImpl* dbi = reinterpret_cast<DBImpl*>(db_);
+  dbi->TEST_CompactMemTable();
+  Corrupt(kTableFile, 5 * kValueSize, 1);  // A block in the middle
+
+  // Only the keys of the corrupted block fail, as with Get()
+  ReadOptions options;
+  options.verify_checksums = true;
+  std::vector<std::string> key_space(10);
+  std::vector<Slice> keys;
+  for (int i = 0; i < 10; i++) {
+    keys.push_back(Key(i, &key_space[i]));
+  }
+  std::vector<std::string> values;
+  std::vector<Status> statuses;
+  db_->MultiGet(options, keys, &values, &statuses);
+  ASSERT_EQ(10, statuses.size());
+  int failed = 0;
+  for (int i = 0; i < 10; i++) {
+    std::string value;
+    Status s = db_->Get(options, keys[i], &value);
+    ASSERT_EQ(s.ToString(), statuses[i].ToString());
+    if (s.ok()) {
+      ASSERT_EQ(value, values[i]);
+    } else {
+      ASSERT_TRUE(s.IsCorruption());
+      failed++;
+    }
+  }
+  ASSERT_GE(failed, 1);
+  ASSERT_LE(failed, 3);
+  ASSERT_TRUE(statuses[0].ok());
+  ASSERT_TRUE(statuses[9].ok());
+}
+
 TEST(CorruptionTest, TableFileIndexData) {
   Build(10000);  // Enough to build multiple Tables
   DBImpl* dbi = reinterpret_cast<DBImpl*>(db_);
@@ -2,6 +2,7 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
+#include <algorithm>
 #include <sys/types.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -10,6 +11,8 @@
 #include "leveldb/cache.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/memtablerep.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/write_batch.h"
 #include "port/port.h"
 #include "util/crc32c.h"
@@ -30,6 +33,7 @@
 //      readseq       -- read N times sequentially
 //      readreverse   -- read N times in reverse order
 //      readrandom    -- read N times in random order
+//      multireadrandom -- read N times in random order, 100 keys per MultiGet
 //      readmissing   -- read N missing keys in random order
 //      readhot       -- read N times in random order from 1% section of DB
 //      seekrandom    -- N random seeks
@@ -84,6 +88,18 @@ static bool FLAGS_histogram = false;
 // (initialized to default value by "main")
 static int FLAGS_write_buffer_size = 0;
 
+// Number of memtables (active plus waiting to be compacted) to keep
+// in memory
+// (initialized to default value by "main")
+static int FLAGS_max_write_buffer_number = 0;
+
+// Size of the blocks that memtable memory is allocated in
+// (initialized to default value by "main")
+static int FLAGS_arena_block_size = 0;
+
+// If non-zero, map memtable blocks from huge pages of this size
+static int FLAGS_memtable_huge_page_size = 0;
+
 // Number of bytes to use as a cache of uncompressed data.
 // Negative means use default settings.
 static int FLAGS_cache_size = -1;
@@ -95,6 +111,9 @@ static int FLAGS_open_files = 0;
 // Negative means use default settings.
 static int FLAGS_bloom_bits = -1;
 
+// If true, tables hold one filter for all their keys.
+static bool FLAGS_full_filter = false;
+
 // If true, do not destroy the existing database.  If you set this
 // flag and also specify a benchmark that wants a fresh database, that
 // benchmark will fail.
@@ -103,6 +122,42 @@ static bool FLAGS_use_existing_db = false;
 // If true, reuse existing log/MANIFEST files when re-opening a database.
 static bool FLAGS_reuse_logs = false;
 
+// If true, writes skip the log.
+static bool FLAGS_disable_wal = false;
+
+// Number of obsolete log files to keep around for reuse.
+static int FLAGS_recycle_log_file_num = 0;
+
+// If true, overlap log writes of one write group with the memtable
+// insertion of the previous one.
+static bool FLAGS_pipelined_write = false;
+
+// If true, each writer of a batch group inserts its own batch into the
+// memtable in parallel with the others.
+static bool FLAGS_concurrent_memtable_write = false;
+
+// If true, puts overwrite values of the same or larger size in the
+// active memtable in place.
+static bool FLAGS_inplace_update_support = false;
+
+// If non-zero, iterators read ahead in chunks of this many bytes
+// instead of adapting the chunk size to the scan.
+static int FLAGS_readahead_size = 0;
+
+// If true, sync writes wait for a background thread to sync the log
+// instead of syncing it themselves.
+static bool FLAGS_wal_sync_thread = false;
+
+// If true, buffer log records in memory until a sync write or until the
+// buffer is full.
+static bool FLAGS_manual_wal_flush = false;
+
+// Memtable representation: "skiplist", "hash_skiplist" or "vector"
+static const char* FLAGS_memtablerep = "skiplist";
+
+// Length of the key prefix that hash_skiplist buckets keys by
+static int FLAGS_prefix_size = 16;
+
 // Use the db with the following name.
 static const char* FLAGS_db = NULL;
 
@@ -309,6 +364,8 @@ class Benchmark {
  private:
   Cache* cache_;
   const FilterPolicy* filter_policy_;
+  const SliceTransform* prefix_extractor_;
+  MemTableRepFactory* memtable_factory_;
   DB* db_;
   int num_;
   int value_size_;
@@ -397,6 +454,8 @@ class Benchmark {
     filter_policy_(FLAGS_bloom_bits >= 0
                    ? NewBloomFilterPolicy(FLAGS_bloom_bits)
                    : NULL),
+    prefix_extractor_(NewFixedPrefixTransform(FLAGS_prefix_size)),
+    memtable_factory_(NULL),
     db_(NULL),
     num_(FLAGS_num),
     value_size_(FLAGS_value_size),
@@ -413,12 +472,23 @@ class Benchmark {
     if (!FLAGS_use_existing_db) {
       DestroyDB(FLAGS_db, Options());
     }
+    if (strcmp(FLAGS_memtablerep, "hash_skiplist") == 0) {
+      memtable_factory_ = NewHashSkipListRepFactory(prefix_extractor_,
+                                                    1000000);
+    } else if (strcmp(FLAGS_memtablerep, "vector") == 0) {
+      memtable_factory_ = NewVectorRepFactory(0);
+    } else if (strcmp(FLAGS_memtablerep, "skiplist") != 0) {
+      fprintf(stderr, "unknown memtablerep '%s'\n", FLAGS_memtablerep);
+      exit(1);
+    }
   }
 
   ~Benchmark() {
     delete db_;
     delete cache_;
     delete filter_policy_;
+    delete memtable_factory_;
+    delete prefix_extractor_;
   }
 
   void Run() {
@@ -443,6 +513,7 @@ class Benchmark {
       value_size_ = FLAGS_value_size;
       entries_per_batch_ = 1;
       write_options_ = WriteOptions();
+      write_options_.disable_wal = FLAGS_disable_wal;
 
       void (Benchmark::*method)(ThreadState*) = NULL;
       bool fresh_db = false;
@@ -469,6 +540,7 @@ class Benchmark {
         fresh_db = true;
         num_ /= 1000;
         write_options_.sync = true;
+        write_options_.disable_wal = false;  // Sync writes need the log
         method = &Benchmark::WriteRandom;
       } else if (name == Slice("fill100K")) {
         fresh_db = true;
@@ -481,6 +553,8 @@ class Benchmark {
         method = &Benchmark::ReadReverse;
       } else if (name == Slice("readrandom")) {
         method = &Benchmark::ReadRandom;
+      } else if (name == Slice("multireadrandom")) {
+        method = &Benchmark::MultiReadRandom;
       } else if (name == Slice("readmissing")) {
         method = &Benchmark::ReadMissing;
       } else if (name == Slice("seekrandom")) {
@@ -703,9 +777,20 @@ class Benchmark {
     options.create_if_missing = !FLAGS_use_existing_db;
     options.block_cache = cache_;
     options.write_buffer_size = FLAGS_write_buffer_size;
+    options.max_write_buffer_number = FLAGS_max_write_buffer_number;
+    options.arena_block_size = FLAGS_arena_block_size;
+    options.memtable_huge_page_size = FLAGS_memtable_huge_page_size;
     options.max_open_files = FLAGS_open_files;
     options.filter_policy = filter_policy_;
+    options.full_filter = FLAGS_full_filter;
     options.reuse_logs = FLAGS_reuse_logs;
+    options.recycle_log_file_num = FLAGS_recycle_log_file_num;
+    options.enable_pipelined_write = FLAGS_pipelined_write;
+    options.allow_concurrent_memtable_write = FLAGS_concurrent_memtable_write;
+    options.inplace_update_support = FLAGS_inplace_update_support;
+    options.enable_wal_sync_thread = FLAGS_wal_sync_thread;
+    options.manual_wal_flush = FLAGS_manual_wal_flush;
+    options.memtable_factory = memtable_factory_;
     Status s = DB::Open(options, FLAGS_db, &db_);
     if (!s.ok()) {
       fprintf(stderr, "open error: %s\n", s.ToString().c_str());
@@ -760,7 +845,9 @@ class Benchmark {
   }
 
   void ReadSequential(ThreadState* thread) {
-    Iterator* iter = db_->NewIterator(ReadOptions());
+    ReadOptions options;
+    options.readahead_size = FLAGS_readahead_size;
+    Iterator* iter = db_->NewIterator(options);
     int i = 0;
     int64_t bytes = 0;
     for (iter->SeekToFirst(); i < reads_ && iter->Valid(); iter->Next()) {
@@ -773,7 +860,9 @@ class Benchmark {
   }
 
   void ReadReverse(ThreadState* thread) {
-    Iterator* iter = db_->NewIterator(ReadOptions());
+    ReadOptions options;
+    options.readahead_size = FLAGS_readahead_size;
+    Iterator* iter = db_->NewIterator(options);
     int i = 0;
     int64_t bytes = 0;
     for (iter->SeekToLast(); i < reads_ && iter->Valid(); iter->Prev()) {
@@ -803,6 +892,38 @@ class Benchmark {
     thread->stats.AddMessage(msg);
   }
 
+  void MultiReadRandom(ThreadState* thread) {
+    ReadOptions options;
+    const int kBatchSize = 100;
+    std::vector<std::string> keys(kBatchSize);
+    std::vector<Slice> key_slices(kBatchSize);
+    std::vector<std::string> values;
+    std::vector<Status> statuses;
+    int found = 0;
+    for (int i = 0; i < reads_; i += kBatchSize) {
+      const int n = std::min(kBatchSize, reads_ - i);
+      keys.resize(n);
+      key_slices.resize(n);
+      for (int j = 0; j < n; j++) {
+        char key[100];
+        const int k = thread->rand.Next() % FLAGS_num;
+        snprintf(key, sizeof(key), "%016d", k);
+        keys[j] = key;
+        key_slices[j] = keys[j];
+      }
+      db_->MultiGet(options, key_slices, &values, &statuses);
+      for (int j = 0; j < n; j++) {
+        if (statuses[j].ok()) {
+          found++;
+        }
+        thread->stats.FinishedSingleOp();
+      }
+    }
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%d of %d found)", found, num_);
+    thread->stats.AddMessage(msg);
+  }
+
   void ReadMissing(ThreadState* thread) {
     ReadOptions options;
     std::string value;
@@ -943,6 +1064,8 @@ class Benchmark {
 
 int main(int argc, char** argv) {
   FLAGS_write_buffer_size = leveldb::Options().write_buffer_size;
+  FLAGS_max_write_buffer_number = leveldb::Options().max_write_buffer_number;
+  FLAGS_arena_block_size = leveldb::Options().arena_block_size;
   FLAGS_open_files = leveldb::Options().max_open_files;
   std::string default_db_path;
 
@@ -963,6 +1086,27 @@ int main(int argc, char** argv) {
     } else if (sscanf(argv[i], "--reuse_logs=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_reuse_logs = n;
+    } else if (sscanf(argv[i], "--disable_wal=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_disable_wal = n;
+    } else if (sscanf(argv[i], "--recycle_log_file_num=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_recycle_log_file_num = n;
+    } else if (sscanf(argv[i], "--pipelined_write=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_pipelined_write = n;
+    } else if (sscanf(argv[i], "--concurrent_memtable_write=%d%c",
+                      &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_concurrent_memtable_write = n;
+    } else if (sscanf(argv[i], "--inplace_update_support=%d%c",
+                      &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_inplace_update_support = n;
+    } else if (sscanf(argv[i], "--wal_sync_thread=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_wal_sync_thread = n;
+    } else if (sscanf(argv[i], "--manual_wal_flush=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_manual_wal_flush = n;
     } else if (sscanf(argv[i], "--num=%d%c", &n, &junk) == 1) {
       FLAGS_num = n;
     } else if (sscanf(argv[i], "--reads=%d%c", &n, &junk) == 1) {
@@ -973,12 +1117,29 @@ int main(int argc, char** argv) {
       FLAGS_value_size = n;
     } else if (sscanf(argv[i], "--write_buffer_size=%d%c", &n, &junk) == 1) {
       FLAGS_write_buffer_size = n;
+    } else if (sscanf(argv[i], "--max_write_buffer_number=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_max_write_buffer_number = n;
+    } else if (sscanf(argv[i], "--arena_block_size=%d%c", &n, &junk) == 1) {
+      FLAGS_arena_block_size = n;
+    } else if (sscanf(argv[i], "--readahead_size=%d%c", &n, &junk) == 1) {
+      FLAGS_readahead_size = n;
+    } else if (sscanf(argv[i], "--memtable_huge_page_size=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_memtable_huge_page_size = n;
     } else if (sscanf(argv[i], "--cache_size=%d%c", &n, &junk) == 1) {
       FLAGS_cache_size = n;
     } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
       FLAGS_bloom_bits = n;
+    } else if (sscanf(argv[i], "--full_filter=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_full_filter = n;
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
+    } else if (strncmp(argv[i], "--memtablerep=", 14) == 0) {
+      FLAGS_memtablerep = argv[i] + 14;
+    } else if (sscanf(argv[i], "--prefix_size=%d%c", &n, &junk) == 1) {
+      FLAGS_prefix_size = n;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
       FLAGS_db = argv[i] + 5;
     } else {
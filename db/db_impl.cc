@@ -17,9 +17,12 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/merge_helper.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
+#include "db/write_callback.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/status.h"
@@ -42,10 +45,46 @@ struct DBImpl::Writer {
   Status status;
   WriteBatch* batch;
   bool sync;
+  bool disable_wal;
+  bool exclusive;  // Queued by FlushWAL() or ingestion; has no batch
   bool done;
+  ParallelInsert* parallel;  // Non-NULL while this writer must apply batch
+  WriteCallback* check;      // From WriteWithCallback(); leads its own group
+
+  // Set for writers queued by WriteAsync(); invoked on completion
+  // instead of signalling cv.
+  void (*callback)(void* arg, const Status& s);
+  void* callback_arg;
+
+  port::CondVar cv;
+
+  explicit Writer(port::Mutex* mu)
+      : exclusive(false), parallel(NULL), check(NULL), callback(NULL),
+        callback_arg(NULL), cv(mu) { }
+};
+
+// State shared by the writers of a batch group that apply their own
+// batches to the memtable in parallel.
+struct DBImpl::ParallelInsert {
+  MemTable* const mem;
+  int pending;       // Followers that have not finished inserting
+  Status status;     // First insertion error, if any
+  port::CondVar cv;  // Signalled when pending drops to zero
+
+  ParallelInsert(port::Mutex* mu, MemTable* m)
+      : mem(m), pending(0), cv(mu) { }
+};
+
+// A batch group that has been appended to the log and is waiting for,
+// or performing, its memtable insertion (pipelined write mode only).
+struct DBImpl::WriteGroup {
+  std::vector<Writer*> followers;  // Completed along with the group
+  WriteBatch* updates;
+  SequenceNumber last_sequence;
   port::CondVar cv;
 
-  explicit Writer(port::Mutex* mu) : cv(mu) { }
+  explicit WriteGroup(port::Mutex* mu)
+      : updates(NULL), last_sequence(0), cv(mu) { }
 };
 
 struct DBImpl::CompactionState {
@@ -62,6 +101,7 @@ struct DBImpl::CompactionState {
     uint64_t number;
     uint64_t file_size;
     InternalKey smallest, largest;
+    bool has_range_deletions;
   };
   std::vector<Output> outputs;
 
@@ -71,13 +111,31 @@ struct DBImpl::CompactionState {
 
   uint64_t total_bytes;
 
+  // Range tombstones to write to the outputs.  Each output gets the part
+  // of them that falls in [tombstone_lower, first key of the next output).
+  std::vector<RangeTombstone> tombstones;
+  std::string tombstone_lower;
+  bool has_tombstone_lower;
+
   Output* current_output() { return &outputs[outputs.size()-1]; }
 
+  // Returns true if part of "tombstones" has yet to be written.
+  bool HasTombstonesLeft(const Comparator* ucmp) const {
+    for (size_t i = 0; i < tombstones.size(); i++) {
+      if (!has_tombstone_lower ||
+          ucmp->Compare(tombstones[i].end, tombstone_lower) > 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
   explicit CompactionState(Compaction* c)
       : compaction(c),
         outfile(NULL),
         builder(NULL),
-        total_bytes(0) {
+        total_bytes(0),
+        has_tombstone_lower(false) {
   }
 };
 
@@ -90,13 +148,25 @@ static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
 Options SanitizeOptions(const std::string& dbname,
                         const InternalKeyComparator* icmp,
                         const InternalFilterPolicy* ipolicy,
+                        const InternalKeySliceTransform* iprefix,
                         const Options& src) {
   Options result = src;
   result.comparator = icmp;
   result.filter_policy = (src.filter_policy != NULL) ? ipolicy : NULL;
+  result.prefix_extractor = (src.prefix_extractor != NULL) ? iprefix : NULL;
   ClipToRange(&result.max_open_files,    64 + kNumNonTableCacheFiles, 50000);
   ClipToRange(&result.write_buffer_size, 64<<10,                      1<<30);
+  // A memtable looks fuller than it is by up to a block
+  ClipToRange(&result.arena_block_size,  size_t(4<<10),
+              result.write_buffer_size / 8);
   ClipToRange(&result.block_size,        1<<10,                       4<<20);
+  ClipToRange(&result.max_write_buffer_number, 2,                     64);
+  ClipToRange(&result.memtable_bloom_size_ratio, 0.0,                 0.25);
+  if (result.memtable_factory != NULL &&
+      !result.memtable_factory->IsInsertConcurrentlySupported()) {
+    // Memtables cannot be written by several threads at once
+    result.allow_concurrent_memtable_write = false;
+  }
   if (result.info_log == NULL) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -117,8 +187,10 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
     : env_(raw_options.env),
       internal_comparator_(raw_options.comparator),
       internal_filter_policy_(raw_options.filter_policy),
+      internal_prefix_extractor_(raw_options.prefix_extractor),
       options_(SanitizeOptions(dbname, &internal_comparator_,
-                               &internal_filter_policy_, raw_options)),
+                               &internal_filter_policy_,
+                               &internal_prefix_extractor_, raw_options)),
       owns_info_log_(options_.info_log != raw_options.info_log),
       owns_cache_(options_.block_cache != raw_options.block_cache),
       dbname_(dbname),
@@ -126,14 +198,33 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       shutting_down_(NULL),
       bg_cv_(&mutex_),
       mem_(NULL),
-      imm_(NULL),
+      mem_start_sequence_(0),
+      mem_iterators_(0),
+      inplace_writers_(0),
+      inplace_cv_(&mutex_),
       logfile_(NULL),
       logfile_number_(0),
       log_(NULL),
+      min_recyclable_log_(0),
       seed_(0),
       tmp_batch_(new WriteBatch),
+      async_cv_(&mutex_),
+      async_pending_(0),
+      async_thread_running_(false),
+      async_thread_stop_(false),
+      wal_sync_cv_(&mutex_),
+      wal_sync_thread_running_(false),
+      wal_sync_thread_stop_(false),
+      wal_syncing_(false),
+      wal_logged_sequence_(0),
+      wal_sync_requested_(0),
+      wal_synced_sequence_(0),
+      wal_syncs_(0),
       bg_compaction_scheduled_(false),
-      manual_compaction_(NULL) {
+      bg_compaction_paused_(0),
+      ingested_sequence_(0),
+      manual_compaction_(NULL),
+      write_controller_(options_.delayed_write_rate) {
   has_imm_.Release_Store(NULL);
 
   // Reserve ten files or so for other uses and give the rest to TableCache.
@@ -145,8 +236,24 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
 }
 
 DBImpl::~DBImpl() {
-  // Wait for background work to finish
+  // Let queued async writes finish before shutting down, since applying
+  // them may require background compaction to make room.
   mutex_.Lock();
+  while (async_pending_ > 0) {
+    async_cv_.Wait();
+  }
+  async_thread_stop_ = true;
+  async_cv_.SignalAll();
+  while (async_thread_running_) {
+    async_cv_.Wait();
+  }
+  wal_sync_thread_stop_ = true;
+  wal_sync_cv_.SignalAll();
+  while (wal_sync_thread_running_) {
+    wal_sync_cv_.Wait();
+  }
+
+  // Wait for background work to finish
   shutting_down_.Release_Store(this);  // Any non-NULL value is ok
   while (bg_compaction_scheduled_) {
     bg_cv_.Wait();
@@ -159,8 +266,13 @@ DBImpl::~DBImpl() {
 
   delete versions_;
   if (mem_ != NULL) mem_->Unref();
-  if (imm_ != NULL) imm_->Unref();
+  for (size_t i = 0; i < imm_.size(); i++) {
+    imm_[i].mem->Unref();
+  }
   delete tmp_batch_;
+  if (log_ != NULL) {
+    log_->WriteBuffer();
+  }
   delete log_;
   delete logfile_;
   delete table_cache_;
@@ -235,7 +347,18 @@ void DBImpl::DeleteObsoleteFiles() {
       switch (type) {
         case kLogFile:
           keep = ((number >= versions_->LogNumber()) ||
-                  (number == versions_->PrevLogNumber()));
+                  (number == versions_->PrevLogNumber()) ||
+                  (std::find(log_recycle_files_.begin(),
+                             log_recycle_files_.end(), number) !=
+                   log_recycle_files_.end()));
+          if (!keep && min_recyclable_log_ != 0 &&
+              number >= min_recyclable_log_ &&
+              log_recycle_files_.size() < options_.recycle_log_file_num) {
+            Log(options_.info_log, "Keep log #%llu for recycling\n",
+                static_cast<unsigned long long>(number));
+            log_recycle_files_.push_back(number);
+            keep = true;
+          }
           break;
         case kDescriptorFile:
           // Keep my manifest file, and any newer incarnations'
@@ -399,7 +522,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
   // to be skipped instead of propagating bad information (like overly
   // large sequence numbers).
   log::Reader reader(file, &reporter, true/*checksum*/,
-                     0/*initial_offset*/);
+                     0/*initial_offset*/, log_number);
   Log(options_.info_log, "Recovering log #%llu",
       (unsigned long long) log_number);
 
@@ -419,10 +542,12 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     WriteBatchInternal::SetContents(&batch, record);
 
     if (mem == NULL) {
-      mem = new MemTable(internal_comparator_);
+      mem = new MemTable(internal_comparator_, options_);
       mem->Ref();
     }
-    status = WriteBatchInternal::InsertInto(&batch, mem);
+    // No snapshot exists yet, so values may be updated in place.
+    status = WriteBatchInternal::InsertInto(&batch, mem,
+                                            options_.inplace_update_support);
     MaybeIgnoreError(&status);
     if (!status.ok()) {
       break;
@@ -437,7 +562,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
       compactions++;
       *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, NULL);
+      status = WriteLevel0Table(std::vector<MemTable*>(1, mem), edit, NULL);
       mem->Unref();
       mem = NULL;
       if (!status.ok()) {
@@ -451,7 +576,9 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
   delete file;
 
   // See if we should keep reusing the last log file.
-  if (status.ok() && options_.reuse_logs && last_log && compactions == 0) {
+  // A recyclable log may have a stale tail, so it is never appended to.
+  if (status.ok() && options_.reuse_logs && last_log && compactions == 0 &&
+      options_.recycle_log_file_num == 0) {
     assert(logfile_ == NULL);
     assert(log_ == NULL);
     assert(mem_ == NULL);
@@ -460,13 +587,16 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
         env_->NewAppendableFile(fname, &logfile_).ok()) {
       Log(options_.info_log, "Reusing old log %s \n", fname.c_str());
       log_ = new log::Writer(logfile_, lfile_size);
+      if (options_.manual_wal_flush) {
+        log_->SetManualFlush(options_.wal_buffer_size);
+      }
       logfile_number_ = log_number;
       if (mem != NULL) {
         mem_ = mem;
         mem = NULL;
       } else {
         // mem can be NULL if lognum exists but was empty.
-        mem_ = new MemTable(internal_comparator_);
+        mem_ = new MemTable(internal_comparator_, options_);
         mem_->Ref();
       }
     }
@@ -476,7 +606,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     // mem did not get reused; compact it.
     if (status.ok()) {
       *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, NULL);
+      status = WriteLevel0Table(std::vector<MemTable*>(1, mem), edit, NULL);
     }
     mem->Unref();
   }
@@ -484,21 +614,33 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
   return status;
 }
 
-Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
-                                Version* base) {
+Status DBImpl::WriteLevel0Table(const std::vector<MemTable*>& mems,
+                                VersionEdit* edit, Version* base) {
   mutex_.AssertHeld();
+  assert(!mems.empty());
   const uint64_t start_micros = env_->NowMicros();
   FileMetaData meta;
   meta.number = versions_->NewFileNumber();
   pending_outputs_.insert(meta.number);
-  Iterator* iter = mem->NewIterator();
-  Log(options_.info_log, "Level-0 table #%llu: started",
-      (unsigned long long) meta.number);
+  std::vector<Iterator*> list;
+  std::vector<Iterator*> range_del_list;
+  for (size_t i = 0; i < mems.size(); i++) {
+    list.push_back(mems[i]->NewIterator());
+    range_del_list.push_back(mems[i]->NewRangeTombstoneIterator());
+  }
+  Iterator* iter =
+      NewMergingIterator(&internal_comparator_, &list[0], list.size());
+  Iterator* range_del_iter =
+      NewMergingIterator(&internal_comparator_, &range_del_list[0],
+                         range_del_list.size());
+  Log(options_.info_log, "Level-0 table #%llu: started (%d memtables)",
+      (unsigned long long) meta.number, static_cast<int>(mems.size()));
 
   Status s;
   {
     mutex_.Unlock();
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    s = BuildTable(dbname_, env_, options_, table_cache_, iter,
+                   range_del_iter, &meta);
     mutex_.Lock();
   }
 
@@ -507,6 +649,7 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       (unsigned long long) meta.file_size,
       s.ToString().c_str());
   delete iter;
+  delete range_del_iter;
   pending_outputs_.erase(meta.number);
 
 
@@ -519,8 +662,7 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
     if (base != NULL) {
       level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
     }
-    edit->AddFile(level, meta.number, meta.file_size,
-                  meta.smallest, meta.largest);
+    edit->AddFile(level, meta);
   }
 
   CompactionStats stats;
@@ -532,13 +674,20 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
 
 void DBImpl::CompactMemTable() {
   mutex_.AssertHeld();
-  assert(imm_ != NULL);
+  assert(!imm_.empty());
 
-  // Save the contents of the memtable as a new Table
+  // Save the contents of all the immutable memtables as a single new
+  // Table.  Memtables that fill up while the table is being written are
+  // left for the next compaction.
+  std::vector<MemTable*> mems;
+  for (size_t i = 0; i < imm_.size(); i++) {
+    mems.push_back(imm_[i].mem);
+  }
+  const uint64_t next_log_number = imm_.back().next_log_number;
   VersionEdit edit;
   Version* base = versions_->current();
   base->Ref();
-  Status s = WriteLevel0Table(imm_, &edit, base);
+  Status s = WriteLevel0Table(mems, &edit, base);
   base->Unref();
 
   if (s.ok() && shutting_down_.Acquire_Load()) {
@@ -548,15 +697,20 @@ void DBImpl::CompactMemTable() {
   // Replace immutable memtable with the generated Table
   if (s.ok()) {
     edit.SetPrevLogNumber(0);
-    edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
+    edit.SetLogNumber(next_log_number);  // Earlier logs no longer needed
     s = versions_->LogAndApply(&edit, &mutex_);
   }
 
   if (s.ok()) {
     // Commit to the new state
-    imm_->Unref();
-    imm_ = NULL;
-    has_imm_.Release_Store(NULL);
+    for (size_t i = 0; i < mems.size(); i++) {
+      assert(imm_.front().mem == mems[i]);
+      imm_.front().mem->Unref();
+      imm_.pop_front();
+    }
+    if (imm_.empty()) {
+      has_imm_.Release_Store(NULL);
+    }
     DeleteObsoleteFiles();
   } else {
     RecordBackgroundError(s);
@@ -618,26 +772,366 @@ void DBImpl::TEST_CompactRange(int level, const Slice* begin,const Slice* end) {
 }
 
 Status DBImpl::TEST_CompactMemTable() {
+  return Flush();
+}
+
+Status DBImpl::Flush() {
   // NULL batch means just wait for earlier writes to be done
   Status s = Write(WriteOptions(), NULL);
   if (s.ok()) {
     // Wait until the compaction completes
     MutexLock l(&mutex_);
-    while (imm_ != NULL && bg_error_.ok()) {
+    while (!imm_.empty() && bg_error_.ok()) {
       bg_cv_.Wait();
     }
-    if (imm_ != NULL) {
+    if (!imm_.empty()) {
       s = bg_error_;
     }
   }
   return s;
 }
 
+Status DBImpl::FlushWAL() {
+  Writer w(&mutex_);
+  w.batch = NULL;
+  w.sync = false;
+  w.disable_wal = false;
+  w.exclusive = true;
+  w.done = false;
+
+  MutexLock l(&mutex_);
+  writers_.push_back(&w);
+  while (&w != writers_.front()) {
+    w.cv.Wait();
+  }
+
+  // Being at the front of writers_ keeps other writers off log_.
+  mutex_.Unlock();
+  Status s = log_->WriteBuffer();
+  mutex_.Lock();
+  if (!s.ok()) {
+    // Part of the buffer may or may not have reached the file.
+    RecordBackgroundError(s);
+  }
+  writers_.pop_front();
+  NotifyWriteQueueHead();
+  return s;
+}
+
+// Store in *meta the size and key range of the external table "fname".
+static Status ReadExternalFile(Env* env, const Options& options,
+                               const std::string& fname,
+                               FileMetaData* meta) {
+  Status s = env->GetFileSize(fname, &meta->file_size);
+  RandomAccessFile* file = NULL;
+  if (s.ok()) {
+    s = env->NewRandomAccessFile(fname, &file);
+  }
+  Table* table = NULL;
+  if (s.ok()) {
+    s = Table::Open(options, file, meta->file_size, &table);
+  }
+  if (s.ok()) {
+    Iterator* iter = table->NewIterator(ReadOptions());
+    ParsedInternalKey first, last;
+    iter->SeekToFirst();
+    if (iter->Valid() && ParseInternalKey(iter->key(), &first)) {
+      meta->smallest.DecodeFrom(iter->key());
+      iter->SeekToLast();
+    }
+    if (!iter->Valid() || !ParseInternalKey(iter->key(), &last)) {
+      s = iter->status().ok() ? Status::Corruption(fname, "bad table")
+                              : iter->status();
+    } else if (first.sequence != 0 || last.sequence != 0) {
+      s = Status::InvalidArgument(fname, "not built by SstFileWriter");
+    } else {
+      meta->largest.DecodeFrom(iter->key());
+    }
+    delete iter;
+  }
+  delete table;
+  delete file;
+  return s;
+}
+
+static Status CopyFile(Env* env, const std::string& src,
+                       const std::string& dst) {
+  SequentialFile* in;
+  Status s = env->NewSequentialFile(src, &in);
+  if (!s.ok()) {
+    return s;
+  }
+  WritableFile* out;
+  s = env->NewWritableFile(dst, &out);
+  if (s.ok()) {
+    const size_t kBufferSize = 1 << 20;
+    char* buffer = new char[kBufferSize];
+    while (s.ok()) {
+      Slice data;
+      s = in->Read(kBufferSize, &data, buffer);
+      if (!s.ok() || data.empty()) {
+        break;
+      }
+      s = out->Append(data);
+    }
+    delete[] buffer;
+    if (s.ok()) {
+      s = out->Sync();
+    }
+    if (s.ok()) {
+      s = out->Close();
+    }
+    delete out;
+  }
+  delete in;
+  return s;
+}
+
+// Returns true iff "mem" holds an entry whose user key is in
+// [smallest,largest].
+static bool MemTableOverlaps(MemTable* mem, const Comparator* ucmp,
+                             const Slice& smallest, const Slice& largest) {
+  Iterator* iter = mem->NewIterator();
+  iter->Seek(InternalKey(smallest, kMaxSequenceNumber,
+                         kValueTypeForSeek).Encode());
+  bool overlap = iter->Valid() &&
+      ucmp->Compare(ExtractUserKey(iter->key()), largest) <= 0;
+  delete iter;
+  if (!overlap && mem->HasRangeTombstones()) {
+    // A tombstone would delete the ingested entries if they kept
+    // sequence number zero.
+    iter = mem->NewRangeTombstoneIterator();
+    for (iter->SeekToFirst(); !overlap && iter->Valid(); iter->Next()) {
+      if (ucmp->Compare(ExtractUserKey(iter->key()), largest) > 0) {
+        break;
+      }
+      overlap = ucmp->Compare(smallest, iter->value()) < 0;
+    }
+    delete iter;
+  }
+  return overlap;
+}
+
+static InternalKey WithSequence(const InternalKey& key, SequenceNumber seq) {
+  ParsedInternalKey parsed;
+  ParseInternalKey(key.Encode(), &parsed);  // Checked by ReadExternalFile()
+  return InternalKey(parsed.user_key, seq, parsed.type);
+}
+
+Status DBImpl::IngestExternalFiles(const std::vector<std::string>& files,
+                                   const IngestExternalFileOptions& options) {
+  const Comparator* ucmp = user_comparator();
+  std::vector<FileMetaData> metas(files.size());
+  Status s;
+  for (size_t i = 0; s.ok() && i < files.size(); i++) {
+    s = ReadExternalFile(env_, options_, files[i], &metas[i]);
+  }
+  for (size_t i = 0; s.ok() && i < metas.size(); i++) {
+    for (size_t j = i + 1; j < metas.size(); j++) {
+      if (ucmp->Compare(metas[i].largest.user_key(),
+                        metas[j].smallest.user_key()) >= 0 &&
+          ucmp->Compare(metas[j].largest.user_key(),
+                        metas[i].smallest.user_key()) >= 0) {
+        s = Status::InvalidArgument(files[i], "overlaps " + files[j]);
+        break;
+      }
+    }
+  }
+  if (!s.ok() || files.empty()) {
+    return s;
+  }
+
+  // Bring the files in under new table file numbers
+  {
+    MutexLock l(&mutex_);
+    for (size_t i = 0; i < metas.size(); i++) {
+      metas[i].number = versions_->NewFileNumber();
+      pending_outputs_.insert(metas[i].number);
+    }
+  }
+  size_t added = 0;
+  for (; s.ok() && added < metas.size(); added++) {
+    const std::string fname = TableFileName(dbname_, metas[added].number);
+    if (options.move_files) {
+      s = env_->RenameFile(files[added], fname);
+    } else {
+      s = CopyFile(env_, files[added], fname);
+      if (!s.ok()) {
+        env_->DeleteFile(fname);
+      }
+    }
+  }
+
+  MutexLock l(&mutex_);
+  if (s.ok()) {
+    s = InstallExternalFiles(&metas);
+  }
+  if (!s.ok()) {
+    for (size_t i = 0; i < added; i++) {
+      const std::string fname = TableFileName(dbname_, metas[i].number);
+      if (options.move_files) {
+        env_->RenameFile(fname, files[i]);
+      } else {
+        env_->DeleteFile(fname);
+      }
+    }
+  }
+  for (size_t i = 0; i < metas.size(); i++) {
+    pending_outputs_.erase(metas[i].number);
+  }
+  return s;
+}
+
+Status DBImpl::InstallExternalFiles(std::vector<FileMetaData>* metas) {
+  mutex_.AssertHeld();
+  const Comparator* ucmp = user_comparator();
+
+  // Keep writers out until the files are installed
+  Writer w(&mutex_);
+  w.batch = NULL;
+  w.sync = false;
+  w.disable_wal = false;
+  w.exclusive = true;
+  w.done = false;
+  writers_.push_back(&w);
+  while (&w != writers_.front()) {
+    w.cv.Wait();
+  }
+  while (!memtable_writers_.empty()) {
+    bg_cv_.Wait();
+  }
+
+  // Memtable entries are older than the ingested ones but would be found
+  // first, so overlapping memtables are written out beforehand.
+  bool overlap = false;
+  for (size_t i = 0; i < metas->size(); i++) {
+    const Slice smallest = (*metas)[i].smallest.user_key();
+    const Slice largest = (*metas)[i].largest.user_key();
+    overlap = overlap || MemTableOverlaps(mem_, ucmp, smallest, largest);
+    for (size_t j = 0; j < imm_.size(); j++) {
+      overlap = overlap ||
+          MemTableOverlaps(imm_[j].mem, ucmp, smallest, largest);
+    }
+  }
+  Status s = bg_error_;
+  if (s.ok() && overlap) {
+    s = MakeRoomForWrite(true /* force */, 0);
+    while (s.ok() && !imm_.empty()) {
+      if (!bg_error_.ok()) {
+        s = bg_error_;
+      } else {
+        bg_cv_.Wait();
+      }
+    }
+  }
+
+  // A running compaction could add overlapping files to the levels the
+  // ingested files are placed in.
+  bg_compaction_paused_++;
+  while (bg_compaction_scheduled_) {
+    bg_cv_.Wait();
+  }
+
+  if (s.ok()) {
+    Version* current = versions_->current();
+    for (size_t i = 0; !overlap && i < metas->size(); i++) {
+      const Slice smallest = (*metas)[i].smallest.user_key();
+      const Slice largest = (*metas)[i].largest.user_key();
+      for (int level = 0; level < config::kNumLevels; level++) {
+        overlap = overlap ||
+            current->OverlapInLevel(level, &smallest, &largest);
+      }
+    }
+
+    // Entries can keep sequence number zero if nothing could be hidden by
+    // them, and no snapshot predates them.
+    SequenceNumber seq = 0;
+    if (overlap || !snapshots_.empty()) {
+      seq = versions_->LastSequence() + 1;
+      versions_->SetLastSequence(seq);
+      ingested_sequence_ = seq;
+    }
+
+    VersionEdit edit;
+    std::vector<int> levels;
+    for (size_t i = 0; i < metas->size(); i++) {
+      FileMetaData* f = &(*metas)[i];
+      const Slice smallest = f->smallest.user_key();
+      const Slice largest = f->largest.user_key();
+      int level = 0;
+      if (!current->OverlapInLevel(0, &smallest, &largest)) {
+        while (level + 1 < config::kNumLevels &&
+               !current->OverlapInLevel(level + 1, &smallest, &largest)) {
+          level++;
+        }
+      }
+      levels.push_back(level);
+      edit.AddFile(level, f->number, f->file_size,
+                   WithSequence(f->smallest, seq),
+                   WithSequence(f->largest, seq), seq);
+    }
+    s = versions_->LogAndApply(&edit, &mutex_);
+    for (size_t i = 0; s.ok() && i < metas->size(); i++) {
+      Log(options_.info_log, "Ingested #%llu at level-%d: %lld bytes, "
+          "sequence %llu",
+          static_cast<unsigned long long>((*metas)[i].number), levels[i],
+          static_cast<long long>((*metas)[i].file_size),
+          static_cast<unsigned long long>(seq));
+    }
+  }
+
+  bg_compaction_paused_--;
+  MaybeScheduleCompaction();
+  writers_.pop_front();
+  NotifyWriteQueueHead();
+  return s;
+}
+
+Status DBImpl::DeleteFilesInRange(const Slice* begin, const Slice* end) {
+  MutexLock l(&mutex_);
+
+  // A running compaction could copy the entries of the files into its
+  // outputs.
+  bg_compaction_paused_++;
+  while (bg_compaction_scheduled_) {
+    bg_cv_.Wait();
+  }
+
+  Status s = bg_error_;
+  if (s.ok()) {
+    VersionEdit edit;
+    std::vector<FileMetaData*> files;
+    uint64_t bytes = 0;
+    for (int level = 1; level < config::kNumLevels; level++) {
+      files.clear();
+      versions_->current()->GetFilesInRange(level, begin, end, &files);
+      for (size_t i = 0; i < files.size(); i++) {
+        edit.DeleteFile(level, files[i]->number);
+        bytes += files[i]->file_size;
+      }
+    }
+    s = versions_->LogAndApply(&edit, &mutex_);
+    if (s.ok()) {
+      DeleteObsoleteFiles();
+    }
+    VersionSet::LevelSummaryStorage tmp;
+    Log(options_.info_log, "Deleted files in range: %lld bytes %s: %s\n",
+        static_cast<long long>(bytes),
+        s.ToString().c_str(),
+        versions_->LevelSummary(&tmp));
+  }
+
+  bg_compaction_paused_--;
+  MaybeScheduleCompaction();
+  return s;
+}
+
 void DBImpl::RecordBackgroundError(const Status& s) {
   mutex_.AssertHeld();
   if (bg_error_.ok()) {
     bg_error_ = s;
     bg_cv_.SignalAll();
+    wal_sync_cv_.SignalAll();  // Sync writers give up on bg_error_
   }
 }
 
@@ -645,11 +1139,13 @@ void DBImpl::MaybeScheduleCompaction() {
   mutex_.AssertHeld();
   if (bg_compaction_scheduled_) {
     // Already scheduled
+  } else if (bg_compaction_paused_ > 0) {
+    // IngestExternalFiles() or DeleteFilesInRange() reschedules when done
   } else if (shutting_down_.Acquire_Load()) {
     // DB is being deleted; no more background compactions
   } else if (!bg_error_.ok()) {
     // Already got an error; no more changes
-  } else if (imm_ == NULL &&
+  } else if (imm_.empty() &&
              manual_compaction_ == NULL &&
              !versions_->NeedsCompaction()) {
     // No work to be done
@@ -685,7 +1181,7 @@ void DBImpl::BackgroundCall() {
 void DBImpl::BackgroundCompaction() {
   mutex_.AssertHeld();
 
-  if (imm_ != NULL) {
+  if (!imm_.empty()) {
     CompactMemTable();
     return;
   }
@@ -718,8 +1214,7 @@ void DBImpl::BackgroundCompaction() {
     assert(c->num_input_files(0) == 1);
     FileMetaData* f = c->input(0, 0);
     c->edit()->DeleteFile(c->level(), f->number);
-    c->edit()->AddFile(c->level() + 1, f->number, f->file_size,
-                       f->smallest, f->largest);
+    c->edit()->AddFile(c->level() + 1, *f);
     status = versions_->LogAndApply(c->edit(), &mutex_);
     if (!status.ok()) {
       RecordBackgroundError(status);
@@ -796,6 +1291,7 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
     out.number = file_number;
     out.smallest.Clear();
     out.largest.Clear();
+    out.has_range_deletions = false;
     compact->outputs.push_back(out);
     mutex_.Unlock();
   }
@@ -820,7 +1316,11 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
 
   // Check for iterator errors
   Status s = input->status();
-  const uint64_t current_entries = compact->builder->NumEntries();
+  if (s.ok()) {
+    AddRangeTombstonesToOutput(compact, input);
+  }
+  const uint64_t current_entries = compact->builder->NumEntries() +
+      compact->builder->NumRangeTombstones();
   if (s.ok()) {
     s = compact->builder->Finish();
   } else {
@@ -846,7 +1346,8 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
     // Verify that the table is usable
     Iterator* iter = table_cache_->NewIterator(ReadOptions(),
                                                output_number,
-                                               current_bytes);
+                                               current_bytes,
+                                               0);
     s = iter->status();
     delete iter;
     if (s.ok()) {
@@ -862,6 +1363,105 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
 }
 
 
+Status DBImpl::AddToCompactionOutput(CompactionState* compact,
+                                     const Slice& key,
+                                     const Slice& value) {
+  Status s;
+  // Open output file if necessary
+  if (compact->builder == NULL) {
+    s = OpenCompactionOutputFile(compact);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  if (compact->builder->NumEntries() == 0) {
+    compact->current_output()->smallest.DecodeFrom(key);
+  }
+  compact->current_output()->largest.DecodeFrom(key);
+  compact->builder->Add(key, value);
+  return s;
+}
+
+namespace {
+struct TombstoneLess {
+  const InternalKeyComparator* icmp;
+  bool operator()(const std::pair<InternalKey, std::string>& a,
+                  const std::pair<InternalKey, std::string>& b) const {
+    return icmp->Compare(a.first, b.first) < 0;
+  }
+};
+}  // namespace
+
+void DBImpl::AddRangeTombstonesToOutput(CompactionState* compact,
+                                        Iterator* input) {
+  // The next output starts at the key "input" is positioned at, so
+  // "upper" bounds the tombstones of the current one.  Splitting
+  // tombstones at the output boundaries keeps the key ranges of the
+  // outputs disjoint.
+  const Comparator* ucmp = user_comparator();
+  const bool has_upper = input->Valid();
+  const Slice upper = has_upper ? ExtractUserKey(input->key()) : Slice();
+  std::vector<std::pair<InternalKey, std::string> > clipped;
+  for (size_t i = 0; i < compact->tombstones.size(); i++) {
+    const RangeTombstone& t = compact->tombstones[i];
+    Slice begin = t.begin;
+    Slice end = t.end;
+    if (compact->has_tombstone_lower &&
+        ucmp->Compare(begin, compact->tombstone_lower) < 0) {
+      begin = compact->tombstone_lower;
+    }
+    if (has_upper && ucmp->Compare(end, upper) > 0) {
+      end = upper;
+    }
+    if (ucmp->Compare(begin, end) < 0) {
+      clipped.push_back(std::make_pair(
+          InternalKey(begin, t.sequence, kTypeRangeDeletion),
+          end.ToString()));
+    }
+  }
+  TombstoneLess less = { &internal_comparator_ };
+  std::sort(clipped.begin(), clipped.end(), less);
+
+  CompactionState::Output* out = compact->current_output();
+  for (size_t i = 0; i < clipped.size(); i++) {
+    const Slice key = clipped[i].first.Encode();
+    ExtendRangeForTombstone(
+        internal_comparator_, key, clipped[i].second,
+        compact->builder->NumEntries() == 0 && !out->has_range_deletions,
+        &out->smallest, &out->largest);
+    compact->builder->AddRangeTombstone(key, clipped[i].second);
+    out->has_range_deletions = true;
+  }
+  if (has_upper) {
+    compact->tombstone_lower = upper.ToString();
+    compact->has_tombstone_lower = true;
+  }
+}
+
+Status DBImpl::DropObsoleteParentInputs(CompactionState* compact) {
+  // The entries of a level+1 input are older than the tombstones of the
+  // level inputs for the same keys, so the file is obsolete if tombstones
+  // that every snapshot sees cover its whole key range.
+  Compaction* c = compact->compaction;
+  RangeDelAggregator range_del(user_comparator(), compact->smallest_snapshot);
+  Status s = c->AddRangeTombstones(0, &range_del);
+  if (!s.ok() || range_del.empty()) {
+    return s;
+  }
+  for (int i = 0; i < c->num_input_files(1); ) {
+    FileMetaData* f = c->input(1, i);
+    if (range_del.CoversRange(f->smallest.user_key(),
+                              f->largest.user_key())) {
+      Log(options_.info_log, "Dropping #%llu@%d: deleted by range tombstones",
+          static_cast<unsigned long long>(f->number), c->level() + 1);
+      c->DropParentInput(i);
+    } else {
+      i++;
+    }
+  }
+  return s;
+}
+
 Status DBImpl::InstallCompactionResults(CompactionState* compact) {
   mutex_.AssertHeld();
   Log(options_.info_log,  "Compacted %d@%d + %d@%d files => %lld bytes",
@@ -876,9 +1476,13 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
   const int level = compact->compaction->level();
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     const CompactionState::Output& out = compact->outputs[i];
-    compact->compaction->edit()->AddFile(
-        level + 1,
-        out.number, out.file_size, out.smallest, out.largest);
+    FileMetaData f;
+    f.number = out.number;
+    f.file_size = out.file_size;
+    f.smallest = out.smallest;
+    f.largest = out.largest;
+    f.has_range_deletions = out.has_range_deletions;
+    compact->compaction->edit()->AddFile(level + 1, f);
   }
   return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
 }
@@ -905,19 +1509,43 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   // Release mutex while we're actually doing the compaction work
   mutex_.Unlock();
 
+  RangeDelAggregator range_del(user_comparator(), compact->smallest_snapshot);
+  Status status = DropObsoleteParentInputs(compact);
+  if (status.ok()) {
+    status = compact->compaction->AddRangeTombstones(0, &range_del);
+  }
+  if (status.ok()) {
+    status = compact->compaction->AddRangeTombstones(1, &range_del);
+  }
+  if (!status.ok()) {
+    mutex_.Lock();
+    return status;
+  }
+  // Tombstones that no snapshot needs are dropped at the base level
+  // together with the entries they delete.
+  for (size_t i = 0; i < range_del.tombstones().size(); i++) {
+    const RangeTombstone& t = range_del.tombstones()[i];
+    if (t.sequence > compact->smallest_snapshot ||
+        !compact->compaction->IsBaseLevelForRange(t.begin, t.end)) {
+      compact->tombstones.push_back(t);
+    }
+  }
+
   Iterator* input = versions_->MakeInputIterator(compact->compaction);
   input->SeekToFirst();
-  Status status;
+  MergeHelper merge(user_comparator(), options_.merge_operator,
+                    options_.info_log);
   ParsedInternalKey ikey;
   std::string current_user_key;
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
+  bool stop_pending = false;
   for (; input->Valid() && !shutting_down_.Acquire_Load(); ) {
     // Prioritize immutable compaction work
     if (has_imm_.NoBarrier_Load() != NULL) {
       const uint64_t imm_start = env_->NowMicros();
       mutex_.Lock();
-      if (imm_ != NULL) {
+      if (!imm_.empty()) {
         CompactMemTable();
         bg_cv_.SignalAll();  // Wakeup MakeRoomForWrite() if necessary
       }
@@ -926,8 +1554,22 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     }
 
     Slice key = input->key();
-    if (compact->compaction->ShouldStopBefore(key) &&
-        compact->builder != NULL) {
+    if (compact->compaction->ShouldStopBefore(key)) {
+      stop_pending = true;
+    }
+    if (compact->builder != NULL &&
+        compact->builder->FileSize() >=
+            compact->compaction->MaxOutputFileSize()) {
+      stop_pending = true;
+    }
+    // All the entries for a user key go to the same output, which keeps
+    // the range tombstones split at output boundaries apart.
+    if (stop_pending && compact->builder != NULL &&
+        (key.size() < 8 ||
+         user_comparator()->Compare(
+             ExtractUserKey(key),
+             compact->current_output()->largest.user_key()) != 0)) {
+      stop_pending = false;
       status = FinishCompactionOutputFile(compact, input);
       if (!status.ok()) {
         break;
@@ -954,7 +1596,8 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       if (last_sequence_for_key <= compact->smallest_snapshot) {
         // Hidden by an newer entry for same user key
         drop = true;    // (A)
-      } else if (ikey.type == kTypeDeletion &&
+      } else if ((ikey.type == kTypeDeletion ||
+                  ikey.type == kTypeSingleDeletion) &&
                  ikey.sequence <= compact->smallest_snapshot &&
                  compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
         // For this user key:
@@ -965,9 +1608,63 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         //     few iterations of this loop (by rule (A) above).
         // Therefore this deletion marker is obsolete and can be dropped.
         drop = true;
+      } else if (range_del.ShouldDelete(ikey.user_key, ikey.sequence)) {
+        // Deleted by a range tombstone for every snapshot
+        drop = true;
+      }
+
+      if (!drop && ikey.type == kTypeMerge &&
+          ikey.sequence <= compact->smallest_snapshot &&
+          options_.merge_operator != NULL) {
+        // No snapshot can tell apart this operand and the older entries
+        // for the key, so fold them together.
+        status = merge.MergeUntil(
+            input, &range_del,
+            compact->compaction->IsBaseLevelForKey(ikey.user_key));
+        for (size_t i = 0; status.ok() && i < merge.keys().size(); i++) {
+          status = AddToCompactionOutput(compact, merge.keys()[i],
+                                         merge.values()[i]);
+        }
+        if (!status.ok()) {
+          break;
+        }
+        // Older entries for the key, if any are left, are hidden
+        last_sequence_for_key = ikey.sequence;
+        continue;
       }
 
-      last_sequence_for_key = ikey.sequence;
+      if (!drop && ikey.type == kTypeSingleDeletion &&
+          ikey.sequence <= compact->smallest_snapshot) {
+        // The key was put at most once, so if the put is the next entry,
+        // no snapshot sees it and the deletion has nothing else to hide:
+        // both can be dropped, whatever the level.
+        const SequenceNumber sequence = ikey.sequence;
+        const std::string deletion = key.ToString();
+        const std::string deletion_value = input->value().ToString();
+        input->Next();
+        ParsedInternalKey next;
+        if (input->Valid() && ParseInternalKey(input->key(), &next) &&
+            next.type == kTypeValue &&
+            user_comparator()->Compare(next.user_key,
+                                       Slice(current_user_key)) == 0) {
+          input->Next();
+        } else {
+          status = AddToCompactionOutput(compact, deletion, deletion_value);
+          if (!status.ok()) {
+            break;
+          }
+        }
+        // Older entries for the key, if any are left, are hidden
+        last_sequence_for_key = sequence;
+        continue;
+      }
+
+      if (ikey.type == kTypeMerge) {
+        // An operand does not hide the entries it applies to
+        last_sequence_for_key = kMaxSequenceNumber;
+      } else {
+        last_sequence_for_key = ikey.sequence;
+      }
     }
 #if 0
     Log(options_.info_log,
@@ -980,26 +1677,9 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
 #endif
 
     if (!drop) {
-      // Open output file if necessary
-      if (compact->builder == NULL) {
-        status = OpenCompactionOutputFile(compact);
-        if (!status.ok()) {
-          break;
-        }
-      }
-      if (compact->builder->NumEntries() == 0) {
-        compact->current_output()->smallest.DecodeFrom(key);
-      }
-      compact->current_output()->largest.DecodeFrom(key);
-      compact->builder->Add(key, input->value());
-
-      // Close output file if it is big enough
-      if (compact->builder->FileSize() >=
-          compact->compaction->MaxOutputFileSize()) {
-        status = FinishCompactionOutputFile(compact, input);
-        if (!status.ok()) {
-          break;
-        }
+      status = AddToCompactionOutput(compact, key, input->value());
+      if (!status.ok()) {
+        break;
       }
     }
 
@@ -1009,6 +1689,10 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   if (status.ok() && shutting_down_.Acquire_Load()) {
     status = Status::IOError("Deleting DB during compaction");
   }
+  if (status.ok() && compact->builder == NULL &&
+      compact->HasTombstonesLeft(user_comparator())) {
+    status = OpenCompactionOutputFile(compact);
+  }
   if (status.ok() && compact->builder != NULL) {
     status = FinishCompactionOutputFile(compact, input);
   }
@@ -1049,34 +1733,65 @@ struct IterState {
   port::Mutex* mu;
   Version* version;
   MemTable* mem;
-  MemTable* imm;
+  std::vector<MemTable*> imm;
+  MemTable* const* active_mem;  // &DBImpl::mem_
+  int* active_mem_iterators;    // &DBImpl::mem_iterators_
 };
 
 static void CleanupIteratorState(void* arg1, void* arg2) {
   IterState* state = reinterpret_cast<IterState*>(arg1);
   state->mu->Lock();
+  if (state->mem == *state->active_mem) {
+    // mem is still referenced, so mem_ cannot be a new memtable that
+    // happens to have the same address.
+    (*state->active_mem_iterators)--;
+  }
   state->mem->Unref();
-  if (state->imm != NULL) state->imm->Unref();
+  for (size_t i = 0; i < state->imm.size(); i++) {
+    state->imm[i]->Unref();
+  }
   state->version->Unref();
   state->mu->Unlock();
   delete state;
 }
 }  // namespace
 
-Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
-                                      SequenceNumber* latest_snapshot,
-                                      uint32_t* seed) {
-  IterState* cleanup = new IterState;
-  mutex_.Lock();
+void DBImpl::RefImmutableMemTables(std::vector<MemTable*>* mems) {
+  mutex_.AssertHeld();
+  for (size_t i = imm_.size(); i > 0; i--) {
+    MemTable* imm = imm_[i - 1].mem;
+    imm->Ref();
+    mems->push_back(imm);
+  }
+}
+
+static Status AddMemTableTombstones(MemTable* mem,
+                                   RangeDelAggregator* range_del) {
+  if (!mem->HasRangeTombstones()) {
+    return Status::OK();
+  }
+  Iterator* iter = mem->NewRangeTombstoneIterator();
+  Status s = range_del->AddTombstones(iter);
+  delete iter;
+  return s;
+}
+
+Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
+                                      SequenceNumber* latest_snapshot,
+                                      uint32_t* seed,
+                                      RangeDelAggregator** range_del) {
+  IterState* cleanup = new IterState;
+  mutex_.Lock();
+  WaitForInplaceWrites();
   *latest_snapshot = versions_->LastSequence();
 
   // Collect together all needed child iterators
   std::vector<Iterator*> list;
   list.push_back(mem_->NewIterator());
   mem_->Ref();
-  if (imm_ != NULL) {
-    list.push_back(imm_->NewIterator());
-    imm_->Ref();
+  RefImmutableMemTables(&cleanup->imm);
+  for (size_t i = 0; i < cleanup->imm.size(); i++) {
+    list.push_back(cleanup->imm[i]->NewIterator());
   }
   versions_->current()->AddIterators(options, &list);
   Iterator* internal_iter =
@@ -1085,12 +1800,41 @@ Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
 
   cleanup->mu = &mutex_;
   cleanup->mem = mem_;
-  cleanup->imm = imm_;
   cleanup->version = versions_->current();
+  cleanup->active_mem = &mem_;
+  cleanup->active_mem_iterators = &mem_iterators_;
+  mem_iterators_++;
   internal_iter->RegisterCleanup(CleanupIteratorState, cleanup, NULL);
 
   *seed = ++seed_;
   mutex_.Unlock();
+
+  if (range_del != NULL) {
+    // The iterator keeps the memtables and the version alive
+    *range_del = NULL;
+    RangeDelAggregator* tombstones = new RangeDelAggregator(
+        user_comparator(),
+        (options.snapshot != NULL
+         ? reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_
+         : *latest_snapshot));
+    Status s = AddMemTableTombstones(cleanup->mem, tombstones);
+    for (size_t i = 0; s.ok() && i < cleanup->imm.size(); i++) {
+      s = AddMemTableTombstones(cleanup->imm[i], tombstones);
+    }
+    if (s.ok()) {
+      s = cleanup->version->AddRangeTombstones(tombstones);
+    }
+    if (!s.ok()) {
+      delete tombstones;
+      delete internal_iter;
+      return NewErrorIterator(s);
+    }
+    if (tombstones->empty()) {
+      delete tombstones;
+    } else {
+      *range_del = tombstones;
+    }
+  }
   return internal_iter;
 }
 
@@ -1118,10 +1862,10 @@ Status DBImpl::Get(const ReadOptions& options,
   }
 
   MemTable* mem = mem_;
-  MemTable* imm = imm_;
+  std::vector<MemTable*> imm;
   Version* current = versions_->current();
   mem->Ref();
-  if (imm != NULL) imm->Ref();
+  RefImmutableMemTables(&imm);
   current->Ref();
 
   bool have_stat_update = false;
@@ -1130,14 +1874,16 @@ Status DBImpl::Get(const ReadOptions& options,
   // Unlock while reading from files and memtables
   {
     mutex_.Unlock();
-    // First look in the memtable, then in the immutable memtable (if any).
+    // First look in the memtable, then in the immutable memtables from
+    // newest to oldest.
     LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
-      // Done
-    } else if (imm != NULL && imm->Get(lkey, value, &s)) {
-      // Done
-    } else {
-      s = current->Get(options, lkey, value, &stats);
+    MergeContext merge(options_.merge_operator, options_.info_log);
+    bool done = mem->Get(lkey, value, &s, &merge);
+    for (size_t i = 0; !done && i < imm.size(); i++) {
+      done = imm[i]->Get(lkey, value, &s, &merge);
+    }
+    if (!done) {
+      s = current->Get(options, lkey, value, &stats, &merge);
       have_stat_update = true;
     }
     mutex_.Lock();
@@ -1147,17 +1893,120 @@ Status DBImpl::Get(const ReadOptions& options,
     MaybeScheduleCompaction();
   }
   mem->Unref();
-  if (imm != NULL) imm->Unref();
+  for (size_t i = 0; i < imm.size(); i++) {
+    imm[i]->Unref();
+  }
   current->Unref();
   return s;
 }
 
+namespace {
+// Orders the indices of keys by the keys
+struct KeyIndexLess {
+  const Comparator* ucmp;
+  const std::vector<Slice>* keys;
+  bool operator()(size_t a, size_t b) const {
+    return ucmp->Compare((*keys)[a], (*keys)[b]) < 0;
+  }
+};
+}  // namespace
+
+void DBImpl::MultiGet(const ReadOptions& options,
+                      const std::vector<Slice>& keys,
+                      std::vector<std::string>* values,
+                      std::vector<Status>* statuses) {
+  const size_t n = keys.size();
+  values->resize(n);
+  statuses->assign(n, Status());
+
+  MutexLock l(&mutex_);
+  SequenceNumber snapshot;
+  if (options.snapshot != NULL) {
+    snapshot = reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_;
+  } else {
+    snapshot = versions_->LastSequence();
+  }
+
+  MemTable* mem = mem_;
+  std::vector<MemTable*> imm;
+  Version* current = versions_->current();
+  mem->Ref();
+  RefImmutableMemTables(&imm);
+  current->Ref();
+
+  std::vector<Version::GetRequest> requests(n);
+  std::vector<Version::GetRequest*> pending;
+
+  // Unlock while reading from files and memtables
+  {
+    mutex_.Unlock();
+    // Sorted keys let each table be searched once for all of them
+    std::vector<size_t> order(n);
+    for (size_t i = 0; i < n; i++) {
+      order[i] = i;
+    }
+    KeyIndexLess less = { user_comparator(), &keys };
+    std::sort(order.begin(), order.end(), less);
+
+    std::vector<LookupKey*> lkeys(n);
+    std::vector<MergeContext> merges(
+        n, MergeContext(options_.merge_operator, options_.info_log));
+    for (size_t j = 0; j < n; j++) {
+      const size_t i = order[j];
+      lkeys[i] = new LookupKey(keys[i], snapshot);
+      std::string* value = &(*values)[i];
+      Status* s = &(*statuses)[i];
+      bool done = mem->Get(*lkeys[i], value, s, &merges[i]);
+      for (size_t k = 0; !done && k < imm.size(); k++) {
+        done = imm[k]->Get(*lkeys[i], value, s, &merges[i]);
+      }
+      if (!done) {
+        Version::GetRequest* r = &requests[i];
+        r->key = lkeys[i];
+        r->value = value;
+        r->merge = &merges[i];
+        pending.push_back(r);
+      }
+    }
+    if (!pending.empty()) {
+      current->MultiGet(options, pending);
+    }
+    for (size_t i = 0; i < pending.size(); i++) {
+      (*statuses)[pending[i] - &requests[0]] = pending[i]->status;
+    }
+    for (size_t i = 0; i < n; i++) {
+      delete lkeys[i];
+    }
+    mutex_.Lock();
+  }
+
+  bool schedule = false;
+  for (size_t i = 0; i < pending.size(); i++) {
+    if (current->UpdateStats(pending[i]->stats)) {
+      schedule = true;
+    }
+  }
+  if (schedule) {
+    MaybeScheduleCompaction();
+  }
+  mem->Unref();
+  for (size_t i = 0; i < imm.size(); i++) {
+    imm[i]->Unref();
+  }
+  current->Unref();
+}
+
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
   SequenceNumber latest_snapshot;
   uint32_t seed;
-  Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed);
+  RangeDelAggregator* range_del;
+  Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed,
+                                       &range_del);
   return NewDBIterator(
-      this, user_comparator(), iter,
+      this, user_comparator(), options_.merge_operator, options_.info_log,
+      options.prefix_same_as_start
+          ? internal_prefix_extractor_.user_transform() : NULL,
+      iter, range_del,
       (options.snapshot != NULL
        ? reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_
        : latest_snapshot),
@@ -1173,6 +2022,7 @@ void DBImpl::RecordReadSample(Slice key) {
 
 const Snapshot* DBImpl::GetSnapshot() {
   MutexLock l(&mutex_);
+  WaitForInplaceWrites();
   return snapshots_.New(versions_->LastSequence());
 }
 
@@ -1190,46 +2040,360 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
   return DB::Delete(options, key);
 }
 
+Status DBImpl::Merge(const WriteOptions& options, const Slice& key,
+                     const Slice& value) {
+  if (options_.merge_operator == NULL) {
+    return Status::NotSupported("Merge() requires Options::merge_operator");
+  }
+  return DB::Merge(options, key, value);
+}
+
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
+  return WriteWithCallback(options, my_batch, NULL);
+}
+
+Status DBImpl::WriteWithCallback(const WriteOptions& options,
+                                 WriteBatch* my_batch,
+                                 WriteCallback* callback) {
+  assert(callback == NULL || my_batch != NULL);
+  if (options.sync && options.disable_wal) {
+    return Status::InvalidArgument("sync write with disable_wal");
+  }
   Writer w(&mutex_);
   w.batch = my_batch;
   w.sync = options.sync;
+  w.disable_wal = options.disable_wal;
+  w.check = callback;
   w.done = false;
 
   MutexLock l(&mutex_);
   writers_.push_back(&w);
-  while (!w.done && &w != writers_.front()) {
+  // In pipelined write mode followers are removed from writers_ before
+  // their group is applied, so writers_ may be empty while we wait here.
+  while (!w.done && (writers_.empty() || &w != writers_.front())) {
     w.cv.Wait();
+    if (w.parallel != NULL) {
+      ApplyParallelInsert(&w);
+    }
   }
   if (w.done) {
     return w.status;
   }
+  return LeadWriteGroup(&w);
+}
+
+Status DBImpl::CheckKeyUnchangedSince(const Slice& key,
+                                     SequenceNumber sequence) {
+  mutex_.AssertHeld();
+  // Every write after "floor" is in a memtable.
+  SequenceNumber floor =
+      imm_.empty() ? mem_start_sequence_ : imm_.front().start_sequence;
+  if (floor < ingested_sequence_) {
+    floor = ingested_sequence_;
+  }
+  if (sequence < floor) {
+    return Status::Busy("memtables do not reach back to sequence");
+  }
+
+  SequenceNumber latest;
+  bool found = mem_->GetLatestSequence(key, &latest);
+  for (size_t i = imm_.size(); !found && i > 0; i--) {
+    found = imm_[i - 1].mem->GetLatestSequence(key, &latest);
+  }
+  if (found && latest > sequence) {
+    return Status::Busy("write conflict");
+  }
+  return Status::OK();
+}
+
+void DBImpl::WriteAsync(const WriteOptions& options, WriteBatch* my_batch,
+                        void (*callback)(void* arg, const Status& s),
+                        void* arg) {
+  assert(my_batch != NULL);
+  if (options.sync && options.disable_wal) {
+    (*callback)(arg, Status::InvalidArgument("sync write with disable_wal"));
+    return;
+  }
+  Writer* w = new Writer(&mutex_);
+  w->batch = my_batch;
+  w->sync = options.sync;
+  w->disable_wal = options.disable_wal;
+  w->done = false;
+  w->callback = callback;
+  w->callback_arg = arg;
+
+  MutexLock l(&mutex_);
+  if (!async_thread_running_) {
+    async_thread_running_ = true;
+    env_->StartThread(&DBImpl::AsyncWriteWork, this);
+  }
+  async_pending_++;
+  writers_.push_back(w);
+  if (w == writers_.front()) {
+    async_cv_.SignalAll();
+  }
+}
+
+void DBImpl::AsyncWriteWork(void* db) {
+  reinterpret_cast<DBImpl*>(db)->AsyncWriteCall();
+}
+
+// Body of the thread that leads batch groups whose first writer came
+// from WriteAsync(), and that runs the completion callbacks of async
+// writers outside of mutex_.
+void DBImpl::AsyncWriteCall() {
+  MutexLock l(&mutex_);
+  while (true) {
+    if (!async_completions_.empty()) {
+      std::deque<Writer*> ready;
+      ready.swap(async_completions_);
+      mutex_.Unlock();
+      for (size_t i = 0; i < ready.size(); i++) {
+        Writer* w = ready[i];
+        (*w->callback)(w->callback_arg, w->status);
+        delete w;
+      }
+      mutex_.Lock();
+      async_pending_ -= ready.size();
+      async_cv_.SignalAll();  // ~DBImpl() may be waiting for async_pending_
+    } else if (!writers_.empty() && writers_.front()->callback != NULL) {
+      Writer* w = writers_.front();
+      Status s = LeadWriteGroup(w);
+      CompleteWriter(w, s);
+    } else if (async_thread_stop_) {
+      break;
+    } else {
+      async_cv_.Wait();
+    }
+  }
+  async_thread_running_ = false;
+  async_cv_.SignalAll();
+}
+
+// Mark *w as finished with status s and wake whoever is waiting for it.
+void DBImpl::CompleteWriter(Writer* w, const Status& s) {
+  mutex_.AssertHeld();
+  w->status = s;
+  w->done = true;
+  if (w->callback != NULL) {
+    async_completions_.push_back(w);
+    async_cv_.SignalAll();
+  } else {
+    w->cv.Signal();
+  }
+}
+
+// Wake the writer at the front of writers_, if any, so it can lead the
+// next group.
+void DBImpl::NotifyWriteQueueHead() {
+  mutex_.AssertHeld();
+  if (!writers_.empty()) {
+    if (writers_.front()->callback != NULL) {
+      async_cv_.SignalAll();
+    } else {
+      writers_.front()->cv.Signal();
+    }
+  }
+}
+
+bool DBImpl::BeginInplaceWrite() {
+  mutex_.AssertHeld();
+  // Updating in place would change what existing snapshots and
+  // iterators see.
+  if (!options_.inplace_update_support || !snapshots_.empty() ||
+      mem_iterators_ > 0) {
+    return false;
+  }
+  // The updates keep the sequence numbers of the entries they replace,
+  // so snapshots and iterators must not be taken until the sequence
+  // numbers of the group are published.
+  inplace_writers_++;
+  return true;
+}
+
+void DBImpl::EndInplaceWrite() {
+  mutex_.AssertHeld();
+  assert(inplace_writers_ > 0);
+  if (--inplace_writers_ == 0) {
+    inplace_cv_.SignalAll();
+  }
+}
+
+void DBImpl::WaitForInplaceWrites() {
+  mutex_.AssertHeld();
+  while (inplace_writers_ > 0) {
+    inplace_cv_.Wait();
+  }
+}
+
+Status DBImpl::NewLogFile(uint64_t number, WritableFile** result) {
+  mutex_.AssertHeld();
+  const std::string fname = LogFileName(dbname_, number);
+  Status s;
+  *result = NULL;
+  if (!log_recycle_files_.empty()) {
+    const uint64_t old_number = log_recycle_files_.front();
+    log_recycle_files_.pop_front();
+    const std::string old_fname = LogFileName(dbname_, old_number);
+    s = env_->ReuseWritableFile(fname, old_fname, result);
+    if (s.ok()) {
+      Log(options_.info_log, "Recycling log #%llu as #%llu\n",
+          static_cast<unsigned long long>(old_number),
+          static_cast<unsigned long long>(number));
+    } else {
+      Log(options_.info_log, "Cannot recycle log #%llu: %s\n",
+          static_cast<unsigned long long>(old_number), s.ToString().c_str());
+      env_->DeleteFile(old_fname);
+    }
+  }
+  if (*result == NULL) {
+    s = env_->NewWritableFile(fname, result);
+  }
+  if (s.ok()) {
+    if (options_.recycle_log_file_num > 0 && min_recyclable_log_ == 0) {
+      min_recyclable_log_ = number;
+    }
+    // A log normally grows to about the size of its memtable.
+    (*result)->SetPreallocationBlockSize(
+        options_.write_buffer_size + options_.write_buffer_size / 10);
+  }
+  return s;
+}
+
+Status DBImpl::StartWALSyncThread() {
+  mutex_.AssertHeld();
+  assert(!wal_sync_thread_running_);
+  Status s = logfile_->SyncFlushed();
+  if (s.IsNotSupportedError()) {
+    Log(options_.info_log, "Log files cannot be synced in the background; "
+        "sync writes will sync the log themselves\n");
+    return Status::OK();
+  }
+  if (s.ok()) {
+    wal_logged_sequence_ = versions_->LastSequence();
+    wal_sync_requested_ = wal_logged_sequence_;
+    wal_synced_sequence_ = wal_logged_sequence_;
+    wal_sync_thread_running_ = true;
+    env_->StartThread(&DBImpl::WALSyncWork, this);
+  }
+  return s;
+}
+
+void DBImpl::WALSyncWork(void* db) {
+  reinterpret_cast<DBImpl*>(db)->WALSyncCall();
+}
+
+// Body of the WAL sync thread.  Each pass syncs everything appended to
+// the log so far, so the requests of all groups logged while the
+// previous SyncFlushed() was running are covered by a single fsync.
+void DBImpl::WALSyncCall() {
+  MutexLock l(&mutex_);
+  while (true) {
+    if (wal_synced_sequence_ < wal_sync_requested_ && bg_error_.ok()) {
+      const SequenceNumber target = wal_logged_sequence_;
+      WritableFile* file = logfile_;
+      wal_syncing_ = true;
+      mutex_.Unlock();
+      Status s = file->SyncFlushed();
+      mutex_.Lock();
+      wal_syncing_ = false;
+      if (s.ok()) {
+        wal_synced_sequence_ = target;
+        wal_syncs_++;
+      } else {
+        // Same as a failed inline sync: the log is in an unknown state.
+        RecordBackgroundError(s);
+      }
+      wal_sync_cv_.SignalAll();
+    } else if (wal_sync_thread_stop_) {
+      break;
+    } else {
+      wal_sync_cv_.Wait();
+    }
+  }
+  wal_sync_thread_running_ = false;
+  wal_sync_cv_.SignalAll();
+}
+
+void DBImpl::RequestWALSync(SequenceNumber sequence) {
+  mutex_.AssertHeld();
+  assert(sequence <= wal_logged_sequence_);
+  if (sequence > wal_sync_requested_) {
+    wal_sync_requested_ = sequence;
+    wal_sync_cv_.SignalAll();
+  }
+}
+
+Status DBImpl::WaitForWALSync(SequenceNumber sequence) {
+  mutex_.AssertHeld();
+  while (wal_synced_sequence_ < sequence && bg_error_.ok()) {
+    wal_sync_cv_.Wait();
+  }
+  if (wal_synced_sequence_ < sequence) {
+    return bg_error_;
+  }
+  return Status::OK();
+}
+
+// REQUIRES: w is at the front of writers_
+Status DBImpl::LeadWriteGroup(Writer* w) {
+  mutex_.AssertHeld();
+  if (w->check != NULL) {
+    // The callback must see every earlier write in the memtables.
+    while (!memtable_writers_.empty()) {
+      bg_cv_.Wait();
+    }
+    Status s = w->check->Callback(this);
+    if (!s.ok()) {
+      writers_.pop_front();
+      NotifyWriteQueueHead();
+      return s;
+    }
+  }
+  if (options_.enable_pipelined_write) {
+    return LeadPipelinedWriteGroup(w);
+  }
 
   // May temporarily unlock and wait.
-  Status status = MakeRoomForWrite(my_batch == NULL);
+  Status status = MakeRoomForWrite(
+      w->batch == NULL,
+      w->batch == NULL ? 0 : WriteBatchInternal::ByteSize(w->batch));
   uint64_t last_sequence = versions_->LastSequence();
-  Writer* last_writer = &w;
-  if (status.ok() && my_batch != NULL) {  // NULL batch is for compactions
-    WriteBatch* updates = BuildBatchGroup(&last_writer);
+  Writer* last_writer = w;
+  bool wait_for_sync = false;
+  if (status.ok() && w->batch != NULL) {  // NULL batch is for compactions
+    WriteBatch* updates = BuildBatchGroup(&last_writer, tmp_batch_);
     WriteBatchInternal::SetSequence(updates, last_sequence + 1);
+    const bool concurrent = options_.allow_concurrent_memtable_write;
+    if (concurrent) {
+      AssignBatchSequences(last_writer, last_sequence + 1);
+    }
+    const bool inplace_update = !concurrent && BeginInplaceWrite();
     last_sequence += WriteBatchInternal::Count(updates);
 
     // Add to log and apply to memtable.  We can release the lock
-    // during this phase since &w is currently responsible for logging
+    // during this phase since w is currently responsible for logging
     // and protects against concurrent loggers and concurrent writes
     // into mem_.
+    const bool sync_inline = w->sync && !wal_sync_thread_running_;
     {
       mutex_.Unlock();
-      status = log_->AddRecord(WriteBatchInternal::Contents(updates));
+      if (!w->disable_wal) {
+        status = log_->AddRecord(WriteBatchInternal::Contents(updates));
+        if (status.ok() && w->sync) {
+          // Buffered records must reach the file before it is synced.
+          status = log_->WriteBuffer();
+        }
+      }
       bool sync_error = false;
-      if (status.ok() && options.sync) {
+      if (status.ok() && sync_inline) {
         status = logfile_->Sync();
         if (!status.ok()) {
           sync_error = true;
         }
       }
-      if (status.ok()) {
-        status = WriteBatchInternal::InsertInto(updates, mem_);
+      if (status.ok() && !concurrent) {
+        status = WriteBatchInternal::InsertInto(updates, mem_, inplace_update);
       }
       mutex_.Lock();
       if (sync_error) {
@@ -1239,33 +2403,257 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
         RecordBackgroundError(status);
       }
     }
+    if (status.ok() && !w->disable_wal) {
+      wal_logged_sequence_ = last_sequence;
+      if (sync_inline) {
+        wal_syncs_++;
+      } else if (w->sync) {
+        RequestWALSync(last_sequence);
+        wait_for_sync = true;
+      }
+    }
+    if (status.ok() && concurrent) {
+      std::vector<Writer*> group;
+      for (std::deque<Writer*>::iterator iter = writers_.begin(); ; ++iter) {
+        group.push_back(*iter);
+        if (*iter == last_writer) break;
+      }
+      status = InsertGroupConcurrently(group, mem_);
+    }
     if (updates == tmp_batch_) tmp_batch_->Clear();
 
     versions_->SetLastSequence(last_sequence);
+    if (inplace_update) {
+      EndInplaceWrite();
+    }
   }
 
+  // Followers of a group that waits for the WAL sync thread are only
+  // completed once the log is durable, but the next group may start
+  // right away.
+  std::vector<Writer*> followers;
   while (true) {
     Writer* ready = writers_.front();
     writers_.pop_front();
-    if (ready != &w) {
-      ready->status = status;
-      ready->done = true;
-      ready->cv.Signal();
+    if (ready != w) {
+      if (wait_for_sync && status.ok()) {
+        followers.push_back(ready);
+      } else {
+        CompleteWriter(ready, status);
+      }
     }
     if (ready == last_writer) break;
   }
 
   // Notify new head of write queue
-  if (!writers_.empty()) {
-    writers_.front()->cv.Signal();
+  NotifyWriteQueueHead();
+
+  if (wait_for_sync && status.ok()) {
+    status = WaitForWALSync(last_sequence);
+    for (size_t i = 0; i < followers.size(); i++) {
+      CompleteWriter(followers[i], status);
+    }
+  }
+  return status;
+}
+
+// Same as LeadWriteGroup(), but the writer queue is only held while the
+// group is appended to the log.  Memtable insertion then proceeds in log
+// order through memtable_writers_, so that the next group can be logged
+// while this one is still being applied.
+//
+// REQUIRES: w is at the front of writers_
+Status DBImpl::LeadPipelinedWriteGroup(Writer* w) {
+  mutex_.AssertHeld();
+
+  // May temporarily unlock and wait.
+  Status status = MakeRoomForWrite(
+      w->batch == NULL,
+      w->batch == NULL ? 0 : WriteBatchInternal::ByteSize(w->batch));
+  Writer* last_writer = w;
+  WriteGroup group(&mutex_);
+  WriteBatch group_batch;
+  bool wait_for_sync = false;
+  if (status.ok() && w->batch != NULL) {  // NULL batch is for compactions
+    // Groups that are logged but not yet applied have already consumed
+    // sequence numbers beyond versions_->LastSequence().
+    SequenceNumber last_sequence =
+        memtable_writers_.empty() ? versions_->LastSequence()
+                                  : memtable_writers_.back()->last_sequence;
+    group.updates = BuildBatchGroup(&last_writer, &group_batch);
+    WriteBatchInternal::SetSequence(group.updates, last_sequence + 1);
+    if (options_.allow_concurrent_memtable_write) {
+      AssignBatchSequences(last_writer, last_sequence + 1);
+    }
+    group.last_sequence =
+        last_sequence + WriteBatchInternal::Count(group.updates);
+    memtable_writers_.push_back(&group);
+
+    // Add to log unless the group skips it.  w is at the front of
+    // writers_, which protects against concurrent loggers.
+    const bool sync_inline = w->sync && !wal_sync_thread_running_;
+    if (!w->disable_wal) {
+      mutex_.Unlock();
+      status = log_->AddRecord(WriteBatchInternal::Contents(group.updates));
+      if (status.ok() && w->sync) {
+        // Buffered records must reach the file before it is synced.
+        status = log_->WriteBuffer();
+      }
+      bool sync_error = false;
+      if (status.ok() && sync_inline) {
+        status = logfile_->Sync();
+        if (!status.ok()) {
+          sync_error = true;
+        }
+      }
+      mutex_.Lock();
+      if (sync_error) {
+        // The state of the log file is indeterminate: the log record we
+        // just added may or may not show up when the DB is re-opened.
+        // So we force the DB into a mode where all future writes fail.
+        RecordBackgroundError(status);
+      }
+    }
+    if (status.ok() && !w->disable_wal) {
+      wal_logged_sequence_ = group.last_sequence;
+      if (sync_inline) {
+        wal_syncs_++;
+      } else if (w->sync) {
+        // Start syncing now so the fsync overlaps the memtable insert.
+        RequestWALSync(group.last_sequence);
+        wait_for_sync = true;
+      }
+    }
+  }
+
+  // Let the next group start logging.  Followers stay blocked until the
+  // group has been applied to the memtable.
+  while (true) {
+    Writer* ready = writers_.front();
+    writers_.pop_front();
+    if (ready != w) {
+      group.followers.push_back(ready);
+    }
+    if (ready == last_writer) break;
+  }
+  NotifyWriteQueueHead();
+  if (group.updates == NULL) {
+    return status;
+  }
+
+  // Apply to the memtable in log order.  MakeRoomForWrite() does not
+  // switch mem_ while memtable_writers_ is non-empty, and mem_ is only
+  // written by the group at the front, so no lock is needed while
+  // inserting.
+  while (memtable_writers_.front() != &group) {
+    group.cv.Wait();
+  }
+  bool inplace_update = false;
+  if (status.ok() && options_.allow_concurrent_memtable_write) {
+    std::vector<Writer*> members(1, w);
+    members.insert(members.end(),
+                   group.followers.begin(), group.followers.end());
+    status = InsertGroupConcurrently(members, mem_);
+  } else if (status.ok()) {
+    MemTable* mem = mem_;
+    inplace_update = BeginInplaceWrite();
+    mutex_.Unlock();
+    status = WriteBatchInternal::InsertInto(group.updates, mem,
+                                            inplace_update);
+    mutex_.Lock();
+  }
+  versions_->SetLastSequence(group.last_sequence);
+  if (inplace_update) {
+    EndInplaceWrite();
   }
+  memtable_writers_.pop_front();
 
+  if (!memtable_writers_.empty()) {
+    memtable_writers_.front()->cv.Signal();
+  } else {
+    bg_cv_.SignalAll();  // Wakeup MakeRoomForWrite() if necessary
+  }
+  if (wait_for_sync && status.ok()) {
+    status = WaitForWALSync(group.last_sequence);
+  }
+  for (size_t i = 0; i < group.followers.size(); i++) {
+    CompleteWriter(group.followers[i], status);
+  }
   return status;
 }
 
+void DBImpl::AssignBatchSequences(Writer* last_writer,
+                                  SequenceNumber sequence) {
+  mutex_.AssertHeld();
+  for (std::deque<Writer*>::iterator iter = writers_.begin(); ; ++iter) {
+    WriteBatch* batch = (*iter)->batch;
+    if (batch != NULL) {
+      WriteBatchInternal::SetSequence(batch, sequence);
+      sequence += WriteBatchInternal::Count(batch);
+    }
+    if (*iter == last_writer) break;
+  }
+}
+
+// REQUIRES: group[0] is the calling leader
+// REQUIRES: AssignBatchSequences() has been called for the group
+Status DBImpl::InsertGroupConcurrently(const std::vector<Writer*>& group,
+                                       MemTable* mem) {
+  mutex_.AssertHeld();
+  ParallelInsert state(&mutex_, mem);
+  // Writers from WriteAsync() have no thread of their own, so the
+  // leader applies their batches along with its own.
+  std::vector<WriteBatch*> own_batches(1, group[0]->batch);
+  for (size_t i = 1; i < group.size(); i++) {
+    Writer* follower = group[i];
+    if (follower->batch == NULL) {
+      // Nothing to apply
+    } else if (follower->callback != NULL) {
+      own_batches.push_back(follower->batch);
+    } else {
+      follower->parallel = &state;
+      state.pending++;
+      follower->cv.Signal();
+    }
+  }
+
+  mutex_.Unlock();
+  Status s;
+  for (size_t i = 0; i < own_batches.size() && s.ok(); i++) {
+    s = WriteBatchInternal::InsertIntoConcurrently(own_batches[i], mem);
+  }
+  mutex_.Lock();
+
+  while (state.pending > 0) {
+    state.cv.Wait();
+  }
+  if (s.ok()) {
+    s = state.status;
+  }
+  return s;
+}
+
+void DBImpl::ApplyParallelInsert(Writer* w) {
+  mutex_.AssertHeld();
+  ParallelInsert* state = w->parallel;
+  w->parallel = NULL;
+
+  mutex_.Unlock();
+  Status s = WriteBatchInternal::InsertIntoConcurrently(w->batch, state->mem);
+  mutex_.Lock();
+
+  if (!s.ok() && state->status.ok()) {
+    state->status = s;
+  }
+  if (--state->pending == 0) {
+    state->cv.Signal();
+  }
+}
+
 // REQUIRES: Writer list must be non-empty
 // REQUIRES: First writer must have a non-NULL batch
-WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
+WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer,
+                                    WriteBatch* tmp_batch) {
   assert(!writers_.empty());
   Writer* first = writers_.front();
   WriteBatch* result = first->batch;
@@ -1280,6 +2668,11 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
   if (size <= (128<<10)) {
     max_size = size + (128<<10);
   }
+  if (write_controller_.IsDelayed()) {
+    // Only the leader's batch was charged against the write controller,
+    // so let the other writers lead (and be charged for) their own groups.
+    max_size = size;
+  }
 
   *last_writer = first;
   std::deque<Writer*>::iterator iter = writers_.begin();
@@ -1291,6 +2684,21 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
       break;
     }
 
+    if (w->disable_wal != first->disable_wal) {
+      // The whole group is either logged or not.
+      break;
+    }
+
+    if (w->exclusive) {
+      // FlushWAL() and IngestExternalFiles() run alone.
+      break;
+    }
+
+    if (w->check != NULL) {
+      // Its callback runs before anything of its group is written.
+      break;
+    }
+
     if (w->batch != NULL) {
       size += WriteBatchInternal::ByteSize(w->batch);
       if (size > max_size) {
@@ -1301,7 +2709,7 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
       // Append to *result
       if (result == first->batch) {
         // Switch to temporary batch instead of disturbing caller's batch
-        result = tmp_batch_;
+        result = tmp_batch;
         assert(WriteBatchInternal::Count(result) == 0);
         WriteBatchInternal::Append(result, first->batch);
       }
@@ -1314,48 +2722,70 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
 
 // REQUIRES: mutex_ is held
 // REQUIRES: this thread is currently at the front of the writer queue
-Status DBImpl::MakeRoomForWrite(bool force) {
+Status DBImpl::MakeRoomForWrite(bool force, size_t write_bytes) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
   bool allow_delay = !force;
   Status s;
   while (true) {
+    write_controller_.UpdatePressure(versions_->NumLevelFiles(0),
+                                     versions_->PendingCompactionBytes());
     if (!bg_error_.ok()) {
       // Yield previous error
       s = bg_error_;
       break;
-    } else if (
-        allow_delay &&
-        versions_->NumLevelFiles(0) >= config::kL0_SlowdownWritesTrigger) {
-      // We are getting close to hitting a hard limit on the number of
-      // L0 files.  Rather than delaying a single write by several
-      // seconds when we hit the hard limit, start delaying each
-      // individual write by 1ms to reduce latency variance.  Also,
-      // this delay hands over some CPU to the compaction thread in
-      // case it is sharing the same core as the writer.
-      mutex_.Unlock();
-      env_->SleepForMicroseconds(1000);
+    } else if (allow_delay && write_controller_.IsDelayed()) {
+      // Compaction is falling behind.  Rather than delaying a single
+      // write by several seconds when we hit the hard limit on L0 files,
+      // admit writes at a rate that drops as the backlog grows to
+      // reduce latency variance.  The delay also hands over some CPU
+      // to the compaction thread in case it is sharing the same core
+      // as the writer.
       allow_delay = false;  // Do not delay a single write more than once
-      mutex_.Lock();
+      const uint64_t start = env_->NowMicros();
+      const uint64_t delay = write_controller_.GetDelay(start, write_bytes);
+      if (delay > 0) {
+        mutex_.Unlock();
+        env_->SleepForMicroseconds(static_cast<int>(delay));
+        mutex_.Lock();
+        RecordWriteStall(kStallDelayed, start);
+      }
     } else if (!force &&
                (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
       // There is room in current memtable
       break;
-    } else if (imm_ != NULL) {
-      // We have filled up the current memtable, but the previous
-      // one is still being compacted, so we wait.
+    } else if (imm_.size() + 1 >=
+               static_cast<size_t>(options_.max_write_buffer_number)) {
+      // We have filled up the current memtable, but the immutable
+      // memtables before it are still being compacted, so we wait.
       Log(options_.info_log, "Current memtable full; waiting...\n");
+      const uint64_t start = env_->NowMicros();
       bg_cv_.Wait();
+      RecordWriteStall(kStallMemTableFull, start);
     } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
       // There are too many level-0 files.
       Log(options_.info_log, "Too many L0 files; waiting...\n");
+      const uint64_t start = env_->NowMicros();
+      bg_cv_.Wait();
+      RecordWriteStall(kStallLevel0Stop, start);
+    } else if (!memtable_writers_.empty()) {
+      // Logged groups are still being applied to mem_ (pipelined write
+      // mode), so wait for them before retiring it.
       bg_cv_.Wait();
+    } else if (wal_syncing_ || wal_synced_sequence_ < wal_sync_requested_) {
+      // The WAL sync thread still has to sync the current log file.
+      wal_sync_cv_.Wait();
     } else {
       // Attempt to switch to a new memtable and trigger compaction of old
       assert(versions_->PrevLogNumber() == 0);
+      s = log_->WriteBuffer();
+      if (!s.ok()) {
+        RecordBackgroundError(s);
+        break;
+      }
       uint64_t new_log_number = versions_->NewFileNumber();
       WritableFile* lfile = NULL;
-      s = env_->NewWritableFile(LogFileName(dbname_, new_log_number), &lfile);
+      s = NewLogFile(new_log_number, &lfile);
       if (!s.ok()) {
         // Avoid chewing through file number space in a tight loop.
         versions_->ReuseFileNumber(new_log_number);
@@ -1365,11 +2795,22 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       delete logfile_;
       logfile_ = lfile;
       logfile_number_ = new_log_number;
-      log_ = new log::Writer(lfile);
-      imm_ = mem_;
-      has_imm_.Release_Store(imm_);
-      mem_ = new MemTable(internal_comparator_);
+      log_ = new log::Writer(lfile, new_log_number,
+                             options_.recycle_log_file_num > 0);
+      if (options_.manual_wal_flush) {
+        log_->SetManualFlush(options_.wal_buffer_size);
+      }
+      mem_->MarkImmutable();
+      ImmutableMemTable imm;
+      imm.mem = mem_;
+      imm.next_log_number = new_log_number;
+      imm.start_sequence = mem_start_sequence_;
+      imm_.push_back(imm);
+      has_imm_.Release_Store(mem_);
+      mem_ = new MemTable(internal_comparator_, options_);
       mem_->Ref();
+      mem_start_sequence_ = versions_->LastSequence();
+      mem_iterators_ = 0;
       force = false;   // Do not force another compaction if have room
       MaybeScheduleCompaction();
     }
@@ -1377,6 +2818,12 @@ Status DBImpl::MakeRoomForWrite(bool force) {
   return s;
 }
 
+void DBImpl::RecordWriteStall(WriteStallCause cause, uint64_t start_micros) {
+  mutex_.AssertHeld();
+  stall_stats_[cause].count++;
+  stall_stats_[cause].micros += env_->NowMicros() - start_micros;
+}
+
 bool DBImpl::GetProperty(const Slice& property, std::string* value) {
   value->clear();
 
@@ -1423,6 +2870,48 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
       }
     }
     return true;
+  } else if (in == "write-stall-stats") {
+    static const char* kStallNames[kNumStallCauses] = {
+      "delayed", "memtable-full", "level0-stop"
+    };
+    char buf[200];
+    snprintf(buf, sizeof(buf),
+             "Write stalls     Count Time(sec)\n"
+             "--------------------------------\n");
+    value->append(buf);
+    for (int i = 0; i < kNumStallCauses; i++) {
+      snprintf(buf, sizeof(buf), "%-14s %7lld %9.3f\n",
+               kStallNames[i],
+               static_cast<long long>(stall_stats_[i].count),
+               stall_stats_[i].micros / 1e6);
+      value->append(buf);
+    }
+    return true;
+  } else if (in == "num-wal-syncs") {
+    char buf[50];
+    snprintf(buf, sizeof(buf), "%llu",
+             static_cast<unsigned long long>(wal_syncs_));
+    value->append(buf);
+    return true;
+  } else if (in == "num-immutable-mem-table") {
+    char buf[50];
+    snprintf(buf, sizeof(buf), "%d", static_cast<int>(imm_.size()));
+    value->append(buf);
+    return true;
+  } else if (in == "delayed-write-rate") {
+    char buf[50];
+    snprintf(buf, sizeof(buf), "%llu",
+             static_cast<unsigned long long>(
+                 write_controller_.delayed_write_rate()));
+    value->append(buf);
+    return true;
+  } else if (in == "pending-compaction-bytes") {
+    char buf[50];
+    snprintf(buf, sizeof(buf), "%llu",
+             static_cast<unsigned long long>(
+                 versions_->PendingCompactionBytes()));
+    value->append(buf);
+    return true;
   } else if (in == "sstables") {
     *value = versions_->current()->DebugString();
     return true;
@@ -1431,8 +2920,8 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
     if (mem_) {
       total_usage += mem_->ApproximateMemoryUsage();
     }
-    if (imm_) {
-      total_usage += imm_->ApproximateMemoryUsage();
+    for (size_t i = 0; i < imm_.size(); i++) {
+      total_usage += imm_[i].mem->ApproximateMemoryUsage();
     }
     char buf[50];
     snprintf(buf, sizeof(buf), "%llu",
@@ -1484,6 +2973,68 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+Status DB::Merge(const WriteOptions& opt, const Slice& key,
+                 const Slice& value) {
+  WriteBatch batch;
+  batch.Merge(key, value);
+  return Write(opt, &batch);
+}
+
+Status DB::SingleDelete(const WriteOptions& opt, const Slice& key) {
+  WriteBatch batch;
+  batch.SingleDelete(key);
+  return Write(opt, &batch);
+}
+
+Status DB::DeleteRange(const WriteOptions& opt, const Slice& begin_key,
+                       const Slice& end_key) {
+  WriteBatch batch;
+  batch.DeleteRange(begin_key, end_key);
+  return Write(opt, &batch);
+}
+
+void DB::WriteAsync(const WriteOptions& opt, WriteBatch* updates,
+                    void (*callback)(void* arg, const Status& s),
+                    void* arg) {
+  Status s = Write(opt, updates);
+  (*callback)(arg, s);
+}
+
+void DB::MultiGet(const ReadOptions& options,
+                  const std::vector<Slice>& keys,
+                  std::vector<std::string>* values,
+                  std::vector<Status>* statuses) {
+  values->resize(keys.size());
+  statuses->resize(keys.size());
+  ReadOptions opt = options;
+  if (opt.snapshot == NULL) {
+    opt.snapshot = GetSnapshot();
+  }
+  for (size_t i = 0; i < keys.size(); i++) {
+    (*statuses)[i] = Get(opt, keys[i], &(*values)[i]);
+  }
+  if (options.snapshot == NULL) {
+    ReleaseSnapshot(opt.snapshot);
+  }
+}
+
+Status DB::Flush() {
+  return Status::NotSupported("Flush");
+}
+
+Status DB::FlushWAL() {
+  return Status::NotSupported("FlushWAL");
+}
+
+Status DB::IngestExternalFiles(const std::vector<std::string>& files,
+                               const IngestExternalFileOptions& options) {
+  return Status::NotSupported("IngestExternalFiles");
+}
+
+Status DB::DeleteFilesInRange(const Slice* begin, const Slice* end) {
+  return Status::NotSupported("DeleteFilesInRange");
+}
+
 DB::~DB() { }
 
 Status DB::Open(const Options& options, const std::string& dbname,
@@ -1500,22 +3051,32 @@ Status DB::Open(const Options& options, const std::string& dbname,
     // Create new log and a corresponding memtable.
     uint64_t new_log_number = impl->versions_->NewFileNumber();
     WritableFile* lfile;
-    s = options.env->NewWritableFile(LogFileName(dbname, new_log_number),
-                                     &lfile);
+    s = impl->NewLogFile(new_log_number, &lfile);
     if (s.ok()) {
       edit.SetLogNumber(new_log_number);
       impl->logfile_ = lfile;
       impl->logfile_number_ = new_log_number;
-      impl->log_ = new log::Writer(lfile);
-      impl->mem_ = new MemTable(impl->internal_comparator_);
+      impl->log_ = new log::Writer(lfile, new_log_number,
+                                   impl->options_.recycle_log_file_num > 0);
+      if (impl->options_.manual_wal_flush) {
+        impl->log_->SetManualFlush(impl->options_.wal_buffer_size);
+      }
+      impl->mem_ = new MemTable(impl->internal_comparator_, impl->options_);
       impl->mem_->Ref();
     }
   }
+  if (s.ok()) {
+    // A memtable kept from recovery may hold older entries too.
+    impl->mem_start_sequence_ = impl->versions_->LastSequence();
+  }
   if (s.ok() && save_manifest) {
     edit.SetPrevLogNumber(0);  // No older logs needed after recovery.
     edit.SetLogNumber(impl->logfile_number_);
     s = impl->versions_->LogAndApply(&edit, &impl->mutex_);
   }
+  if (s.ok() && impl->options_.enable_wal_sync_thread) {
+    s = impl->StartWALSyncThread();
+  }
   if (s.ok()) {
     impl->DeleteObsoleteFiles();
     impl->MaybeScheduleCompaction();
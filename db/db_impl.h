@@ -7,9 +7,11 @@
 
 #include <deque>
 #include <set>
+#include <vector>
 #include "db/dbformat.h"
 #include "db/log_writer.h"
 #include "db/snapshot.h"
+#include "db/write_controller.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "port/port.h"
@@ -17,11 +19,14 @@
 
 namespace leveldb {
 
+struct FileMetaData;
 class MemTable;
+class RangeDelAggregator;
 class TableCache;
 class Version;
 class VersionEdit;
 class VersionSet;
+class WriteCallback;
 
 class DBImpl : public DB {
  public:
@@ -31,16 +36,44 @@ class DBImpl : public DB {
   // Implementations of the DB interface
   virtual Status Put(const WriteOptions&, const Slice& key, const Slice& value);
   virtual Status Delete(const WriteOptions&, const Slice& key);
+  virtual Status Merge(const WriteOptions&, const Slice& key,
+                       const Slice& value);
   virtual Status Write(const WriteOptions& options, WriteBatch* updates);
+  virtual void WriteAsync(const WriteOptions& options, WriteBatch* updates,
+                          void (*callback)(void* arg, const Status& s),
+                          void* arg);
   virtual Status Get(const ReadOptions& options,
                      const Slice& key,
                      std::string* value);
+  virtual void MultiGet(const ReadOptions& options,
+                        const std::vector<Slice>& keys,
+                        std::vector<std::string>* values,
+                        std::vector<Status>* statuses);
   virtual Iterator* NewIterator(const ReadOptions&);
   virtual const Snapshot* GetSnapshot();
   virtual void ReleaseSnapshot(const Snapshot* snapshot);
   virtual bool GetProperty(const Slice& property, std::string* value);
   virtual void GetApproximateSizes(const Range* range, int n, uint64_t* sizes);
   virtual void CompactRange(const Slice* begin, const Slice* end);
+  virtual Status Flush();
+  virtual Status FlushWAL();
+  virtual Status IngestExternalFiles(const std::vector<std::string>& files,
+                                     const IngestExternalFileOptions& options);
+  virtual Status DeleteFilesInRange(const Slice* begin, const Slice* end);
+
+  // Extra methods that are not in the public DB interface
+
+  // Same as Write(), but callback->Callback() decides whether "updates"
+  // is written.  See db/write_callback.h.
+  Status WriteWithCallback(const WriteOptions& options, WriteBatch* updates,
+                           WriteCallback* callback);
+
+  // Returns OK if "key" has not been written since "sequence", and Busy
+  // if it has or if the memtables no longer hold every write made since
+  // "sequence", so that the answer is unknown.  For use by a
+  // WriteCallback.
+  Status CheckKeyUnchangedSince(const Slice& key, SequenceNumber sequence)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   // Extra methods (for testing) that are not in the public DB interface
 
@@ -68,10 +101,16 @@ class DBImpl : public DB {
   friend class DB;
   struct CompactionState;
   struct Writer;
+  struct WriteGroup;
+  struct ParallelInsert;
 
+  // If "range_del" is non-NULL, *range_del is set to the range
+  // tombstones visible to the reads of "options", or to NULL if there
+  // are none.
   Iterator* NewInternalIterator(const ReadOptions&,
                                 SequenceNumber* latest_snapshot,
-                                uint32_t* seed);
+                                uint32_t* seed,
+                                RangeDelAggregator** range_del = NULL);
 
   Status NewDB();
 
@@ -95,12 +134,97 @@ class DBImpl : public DB {
                         VersionEdit* edit, SequenceNumber* max_sequence)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
+  // Write the merged contents of "mems" to a single new table.
+  Status WriteLevel0Table(const std::vector<MemTable*>& mems,
+                          VersionEdit* edit, Version* base)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Store in *mems the immutable memtables, newest first, with a
+  // reference held on each.
+  void RefImmutableMemTables(std::vector<MemTable*>* mems)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // "write_bytes" is the size of the write that is about to be made, and
+  // is charged against the write controller when writes are delayed.
+  Status MakeRoomForWrite(bool force /* compact even if there is room? */,
+                          size_t write_bytes)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Reasons for which MakeRoomForWrite() may hold up a write
+  enum WriteStallCause {
+    kStallDelayed,        // Rate limited by write_controller_
+    kStallMemTableFull,   // Waiting for the immutable memtable to flush
+    kStallLevel0Stop,     // Too many level-0 files
+    kNumStallCauses
+  };
+  void RecordWriteStall(WriteStallCause cause, uint64_t start_micros)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  WriteBatch* BuildBatchGroup(Writer** last_writer, WriteBatch* tmp_batch);
+
+  // Apply the batch group headed by *w, which must be at the front of
+  // writers_, and complete every other writer in the group.
+  Status LeadWriteGroup(Writer* w) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // LeadWriteGroup() implementation used when
+  // options_.enable_pipelined_write is set.
+  Status LeadPipelinedWriteGroup(Writer* w) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  void CompleteWriter(Writer* w, const Status& s)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void NotifyWriteQueueHead() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Returns true if a write group may update mem_ in place, in which
+  // case EndInplaceWrite() must be called once its sequence numbers are
+  // published.
+  bool BeginInplaceWrite() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void EndInplaceWrite() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Wait until no write group may update mem_ in place, before taking
+  // a snapshot or creating an iterator.
+  void WaitForInplaceWrites() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  static void AsyncWriteWork(void* db);
+  void AsyncWriteCall();
+
+  // Create the file for log number "number", reusing an obsolete log
+  // file if one was kept for recycling.
+  Status NewLogFile(uint64_t number, WritableFile** result)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Start the WAL sync thread if the log file supports SyncFlushed().
+  Status StartWALSyncThread() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  static void WALSyncWork(void* db);
+  void WALSyncCall();
+
+  // Ask the WAL sync thread to make the log durable up to "sequence",
+  // which must already have been appended to log_.
+  void RequestWALSync(SequenceNumber sequence)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Wait until an earlier RequestWALSync(sequence) has been satisfied.
+  Status WaitForWALSync(SequenceNumber sequence)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Give every batch in the group ending at *last_writer its own starting
+  // sequence number, beginning at "sequence", so that each writer can
+  // insert its batch separately.
+  void AssignBatchSequences(Writer* last_writer, SequenceNumber sequence)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status MakeRoomForWrite(bool force /* compact even if there is room? */)
+  // Apply the batches of "group" (leader first) to "mem", each from its
+  // own writer's thread.  Returns once every batch has been applied.
+  Status InsertGroupConcurrently(const std::vector<Writer*>& group,
+                                 MemTable* mem)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Called by a follower woken by InsertGroupConcurrently().
+  void ApplyParallelInsert(Writer* w) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Add the external files described by "metas", already present under
+  // their table file numbers, to the current version.
+  Status InstallExternalFiles(std::vector<FileMetaData>* metas)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
-  WriteBatch* BuildBatchGroup(Writer** last_writer);
 
   void RecordBackgroundError(const Status& s);
 
@@ -115,6 +239,10 @@ class DBImpl : public DB {
 
   Status OpenCompactionOutputFile(CompactionState* compact);
   Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
+  void AddRangeTombstonesToOutput(CompactionState* compact, Iterator* input);
+  Status DropObsoleteParentInputs(CompactionState* compact);
+  Status AddToCompactionOutput(CompactionState* compact,
+                               const Slice& key, const Slice& value);
   Status InstallCompactionResults(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
@@ -122,6 +250,7 @@ class DBImpl : public DB {
   Env* const env_;
   const InternalKeyComparator internal_comparator_;
   const InternalFilterPolicy internal_filter_policy_;
+  const InternalKeySliceTransform internal_prefix_extractor_;
   const Options options_;  // options_.comparator == &internal_comparator_
   bool owns_info_log_;
   bool owns_cache_;
@@ -138,17 +267,61 @@ class DBImpl : public DB {
   port::AtomicPointer shutting_down_;
   port::CondVar bg_cv_;          // Signalled when background work finishes
   MemTable* mem_;
-  MemTable* imm_;                // Memtable being compacted
-  port::AtomicPointer has_imm_;  // So bg thread can detect non-NULL imm_
+  SequenceNumber mem_start_sequence_;  // Later writes went to mem_
+  int mem_iterators_;  // Number of live iterators over mem_
+  int inplace_writers_;  // Write groups between Begin/EndInplaceWrite()
+  port::CondVar inplace_cv_;  // Signalled when inplace_writers_ drops to 0
+
+  // Memtables that have filled up and are waiting to be compacted,
+  // oldest first.  Each is paired with the number of the log file that
+  // was started when it filled up: once it and every older memtable
+  // have been written out, earlier logs are no longer needed.
+  struct ImmutableMemTable {
+    MemTable* mem;
+    uint64_t next_log_number;
+    SequenceNumber start_sequence;  // Value of mem_start_sequence_ for mem
+  };
+  std::deque<ImmutableMemTable> imm_;
+  port::AtomicPointer has_imm_;  // So bg thread can detect non-empty imm_
   WritableFile* logfile_;
   uint64_t logfile_number_;
   log::Writer* log_;
+
+  // Obsolete log files kept for reuse by NewLogFile(), oldest first.
+  // Only logs this DBImpl wrote in the recyclable format, numbered
+  // min_recyclable_log_ or above, are kept.
+  std::deque<uint64_t> log_recycle_files_;
+  uint64_t min_recyclable_log_;
   uint32_t seed_;                // For sampling.
 
   // Queue of writers.
   std::deque<Writer*> writers_;
   WriteBatch* tmp_batch_;
 
+  // Logged batch groups waiting to be applied to mem_, in log order.
+  // Only used in pipelined write mode.
+  std::deque<WriteGroup*> memtable_writers_;
+
+  // State for writes queued by WriteAsync().  The async write thread
+  // leads groups headed by an async writer and runs the callbacks of
+  // completed async writers, which are parked in async_completions_.
+  port::CondVar async_cv_;
+  std::deque<Writer*> async_completions_;
+  size_t async_pending_;         // Async writers not yet called back
+  bool async_thread_running_;
+  bool async_thread_stop_;
+
+  // State for options_.enable_wal_sync_thread.  Every record with a
+  // sequence number <= wal_synced_sequence_ is durable in the log.
+  port::CondVar wal_sync_cv_;
+  bool wal_sync_thread_running_;
+  bool wal_sync_thread_stop_;
+  bool wal_syncing_;                        // SyncFlushed() in progress
+  SequenceNumber wal_logged_sequence_;      // Last sequence appended to log_
+  SequenceNumber wal_sync_requested_;       // Highest sequence waited on
+  SequenceNumber wal_synced_sequence_;
+  uint64_t wal_syncs_;                      // Number of SyncFlushed() calls
+
   SnapshotList snapshots_;
 
   // Set of table files to protect from deletion because they are
@@ -158,6 +331,14 @@ class DBImpl : public DB {
   // Has a background compaction been scheduled or is running?
   bool bg_compaction_scheduled_;
 
+  // Number of IngestExternalFiles() and DeleteFilesInRange() calls that
+  // keep compactions from starting
+  int bg_compaction_paused_;
+
+  // Sequence number given to the last ingested files, whose entries do
+  // not go through the memtables.
+  SequenceNumber ingested_sequence_;
+
   // Information for a manual compaction
   struct ManualCompaction {
     int level;
@@ -190,6 +371,19 @@ class DBImpl : public DB {
   };
   CompactionStats stats_[config::kNumLevels];
 
+  // Paces writes while compaction is behind
+  WriteController write_controller_;
+
+  // Per-cause count and total duration of write stalls, for
+  // the "leveldb.write-stall-stats" property.
+  struct WriteStallStats {
+    int64_t count;
+    int64_t micros;
+
+    WriteStallStats() : count(0), micros(0) { }
+  };
+  WriteStallStats stall_stats_[kNumStallCauses];
+
   // No copying allowed
   DBImpl(const DBImpl&);
   void operator=(const DBImpl&);
@@ -204,6 +398,7 @@ class DBImpl : public DB {
 extern Options SanitizeOptions(const std::string& db,
                                const InternalKeyComparator* icmp,
                                const InternalFilterPolicy* ipolicy,
+                               const InternalKeySliceTransform* iprefix,
                                const Options& src);
 
 }  // namespace leveldb
@@ -7,6 +7,8 @@
 #include "db/filename.h"
 #include "db/db_impl.h"
 #include "db/dbformat.h"
+#include "db/merge_helper.h"
+#include "db/range_del.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "port/port.h"
@@ -40,7 +42,9 @@ class DBIter: public Iterator {
  public:
   // Which direction is the iterator currently moving?
   // (1) When moving forward, the internal iterator is positioned at
-  //     the exact entry that yields this->key(), this->value()
+  //     the exact entry that yields this->key(), this->value(), unless
+  //     the value was merged from several entries: then it is
+  //     positioned after the entries that were merged.
   // (2) When moving backwards, the internal iterator is positioned
   //     just before all entries whose user key == this->key().
   enum Direction {
@@ -48,28 +52,40 @@ class DBIter: public Iterator {
     kReverse
   };
 
-  DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
+  DBIter(DBImpl* db, const Comparator* cmp,
+         const MergeOperator* merge_operator, Logger* logger,
+         const SliceTransform* prefix_extractor,
+         Iterator* iter, RangeDelAggregator* range_del, SequenceNumber s,
          uint32_t seed)
       : db_(db),
         user_comparator_(cmp),
+        merge_operator_(merge_operator),
+        logger_(logger),
+        prefix_extractor_(prefix_extractor),
         iter_(iter),
+        range_del_(range_del),
         sequence_(s),
         direction_(kForward),
         valid_(false),
+        merged_(false),
+        prefix_bounded_(false),
         rnd_(seed),
         bytes_counter_(RandomPeriod()) {
   }
   virtual ~DBIter() {
     delete iter_;
+    delete range_del_;
   }
   virtual bool Valid() const { return valid_; }
   virtual Slice key() const {
     assert(valid_);
-    return (direction_ == kForward) ? ExtractUserKey(iter_->key()) : saved_key_;
+    return (direction_ == kForward && !merged_) ?
+        ExtractUserKey(iter_->key()) : saved_key_;
   }
   virtual Slice value() const {
     assert(valid_);
-    return (direction_ == kForward) ? iter_->value() : saved_value_;
+    return (direction_ == kForward && !merged_) ?
+        iter_->value() : saved_value_;
   }
   virtual Status status() const {
     if (status_.ok()) {
@@ -88,7 +104,15 @@ class DBIter: public Iterator {
  private:
   void FindNextUserEntry(bool skipping, std::string* skip);
   void FindPrevUserEntry();
+  void MergeValuesNewToOld();
   bool ParseKey(ParsedInternalKey* key);
+  bool ReverseNotSupported();
+
+  // Returns true if "user_key" has the prefix of the last Seek() target.
+  bool InPrefix(const Slice& user_key) const {
+    return prefix_extractor_->InDomain(user_key) &&
+           prefix_extractor_->Transform(user_key) == Slice(prefix_);
+  }
 
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
@@ -110,7 +134,11 @@ class DBIter: public Iterator {
 
   DBImpl* db_;
   const Comparator* const user_comparator_;
+  const MergeOperator* const merge_operator_;
+  Logger* const logger_;
+  const SliceTransform* const prefix_extractor_;  // NULL if not bounded
   Iterator* const iter_;
+  RangeDelAggregator* const range_del_;
   SequenceNumber const sequence_;
 
   Status status_;
@@ -118,6 +146,9 @@ class DBIter: public Iterator {
   std::string saved_value_;   // == current raw value when direction_==kReverse
   Direction direction_;
   bool valid_;
+  bool merged_;  // Forward, and saved_key_/saved_value_ hold the current entry
+  bool prefix_bounded_;  // Only keys with prefix_ are yielded
+  std::string prefix_;
 
   Random rnd_;
   ssize_t bytes_counter_;
@@ -133,12 +164,24 @@ inline bool DBIter::ParseKey(ParsedInternalKey* ikey) {
   bytes_counter_ -= n;
   while (bytes_counter_ < 0) {
     bytes_counter_ += RandomPeriod();
-    db_->RecordReadSample(k);
+    if (db_ != NULL) {
+      db_->RecordReadSample(k);
+    }
   }
   if (!ParseInternalKey(k, ikey)) {
     status_ = Status::Corruption("corrupted internal key in DBIter");
     return false;
   } else {
+    if (ikey->type == kTypeSingleDeletion) {
+      // Only compactions tell the two kinds of deletion apart
+      ikey->type = kTypeDeletion;
+    }
+    if (range_del_ != NULL && ikey->sequence <= sequence_ &&
+        range_del_->ShouldDelete(ikey->user_key, ikey->sequence)) {
+      // Deleted by a range tombstone, which hides the older entries for
+      // the key as well
+      ikey->type = kTypeDeletion;
+    }
     return true;
   }
 }
@@ -162,6 +205,15 @@ void DBIter::Next() {
       return;
     }
     // saved_key_ already contains the key to skip past.
+  } else if (merged_) {
+    // saved_key_ already contains the key to skip past, and iter_ is
+    // past the entries that were merged.
+    merged_ = false;
+    if (!iter_->Valid()) {
+      valid_ = false;
+      saved_key_.clear();
+      return;
+    }
   } else {
     // Store in saved_key_ the current key so we skip it below.
     SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
@@ -174,9 +226,14 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   // Loop until we hit an acceptable entry to yield
   assert(iter_->Valid());
   assert(direction_ == kForward);
+  merged_ = false;
   do {
     ParsedInternalKey ikey;
-    if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+    const bool parsed = ParseKey(&ikey);
+    if (parsed && prefix_bounded_ && !InPrefix(ikey.user_key)) {
+      break;  // Past the keys with the prefix
+    }
+    if (parsed && ikey.sequence <= sequence_) {
       switch (ikey.type) {
         case kTypeDeletion:
           // Arrange to skip all upcoming entries for this key since
@@ -194,6 +251,18 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
             return;
           }
           break;
+        case kTypeMerge:
+          if (skipping &&
+              user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
+            // Entry hidden
+          } else {
+            MergeValuesNewToOld();
+            return;
+          }
+          break;
+        case kTypeRangeDeletion:
+        case kTypeSingleDeletion:
+          break;  // Not yielded by internal iterators, or by ParseKey()
       }
     }
     iter_->Next();
@@ -202,26 +271,88 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   valid_ = false;
 }
 
+// Apply the merge operand at iter_ and the older operands for its user
+// key to the value or deletion that follows them, if any.  Leaves the
+// result in saved_key_ and saved_value_, and iter_ past the operands.
+void DBIter::MergeValuesNewToOld() {
+  std::deque<std::string> operands;
+  SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+  operands.push_front(iter_->value().ToString());
+  Slice base;
+  bool has_base = false;
+  for (iter_->Next(); iter_->Valid(); iter_->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseKey(&ikey) ||
+        user_comparator_->Compare(ikey.user_key, saved_key_) != 0) {
+      break;
+    }
+    if (ikey.type != kTypeMerge) {
+      // Older entries are hidden; Next() skips this one
+      if (ikey.type == kTypeValue) {
+        base = iter_->value();
+        has_base = true;
+      }
+      break;
+    }
+    operands.push_front(iter_->value().ToString());
+  }
+  Status s = ApplyMergeOperands(merge_operator_, logger_, saved_key_,
+                                has_base ? &base : NULL, operands,
+                                &saved_value_);
+  if (s.ok()) {
+    valid_ = true;
+    merged_ = true;
+  } else {
+    status_ = s;
+    valid_ = false;
+    saved_key_.clear();
+    ClearSavedValue();
+  }
+}
+
+// Iterators bounded by a prefix skip the tables that hold no key with
+// it, which are then not positioned correctly for a reverse scan.
+bool DBIter::ReverseNotSupported() {
+  if (prefix_extractor_ == NULL) {
+    return false;
+  }
+  status_ = Status::NotSupported(
+      "reverse iteration with prefix_same_as_start");
+  valid_ = false;
+  saved_key_.clear();
+  ClearSavedValue();
+  return true;
+}
+
 void DBIter::Prev() {
   assert(valid_);
+  if (ReverseNotSupported()) {
+    return;
+  }
 
   if (direction_ == kForward) {  // Switch directions?
-    // iter_ is pointing at the current entry.  Scan backwards until
-    // the key changes so we can use the normal reverse scanning code.
-    assert(iter_->Valid());  // Otherwise valid_ would have been false
-    SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
-    while (true) {
-      iter_->Prev();
+    // iter_ is pointing at the current entry, or past it if the value
+    // was merged.  Scan backwards until the key changes so we can use
+    // the normal reverse scanning code.
+    if (merged_) {
+      merged_ = false;
       if (!iter_->Valid()) {
-        valid_ = false;
-        saved_key_.clear();
-        ClearSavedValue();
-        return;
-      }
-      if (user_comparator_->Compare(ExtractUserKey(iter_->key()),
-                                    saved_key_) < 0) {
-        break;
+        iter_->SeekToLast();
       }
+    } else {
+      assert(iter_->Valid());  // Otherwise valid_ would have been false
+      SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    }
+    while (iter_->Valid() &&
+           user_comparator_->Compare(ExtractUserKey(iter_->key()),
+                                     saved_key_) >= 0) {
+      iter_->Prev();
+    }
+    if (!iter_->Valid()) {
+      valid_ = false;
+      saved_key_.clear();
+      ClearSavedValue();
+      return;
     }
     direction_ = kReverse;
   }
@@ -233,6 +364,10 @@ void DBIter::FindPrevUserEntry() {
   assert(direction_ == kReverse);
 
   ValueType value_type = kTypeDeletion;
+  // Merge operands newer than the value or deletion of saved_key_, and
+  // whether they apply to a value (in saved_value_).
+  std::deque<std::string> operands;
+  bool has_base = false;
   if (iter_->Valid()) {
     do {
       ParsedInternalKey ikey;
@@ -242,10 +377,20 @@ void DBIter::FindPrevUserEntry() {
           // We encountered a non-deleted value in entries for previous keys,
           break;
         }
+        const ValueType last_type = value_type;
         value_type = ikey.type;
+        if (value_type != kTypeMerge) {
+          operands.clear();
+        }
         if (value_type == kTypeDeletion) {
           saved_key_.clear();
           ClearSavedValue();
+        } else if (value_type == kTypeMerge) {
+          if (operands.empty()) {
+            has_base = (last_type == kTypeValue);
+            SaveKey(ikey.user_key, &saved_key_);
+          }
+          operands.push_back(iter_->value().ToString());
         } else {
           Slice raw_value = iter_->value();
           if (saved_value_.capacity() > raw_value.size() + 1048576) {
@@ -260,6 +405,19 @@ void DBIter::FindPrevUserEntry() {
     } while (iter_->Valid());
   }
 
+  if (value_type == kTypeMerge) {
+    std::string value;
+    Slice base(saved_value_);
+    Status s = ApplyMergeOperands(merge_operator_, logger_, saved_key_,
+                                  has_base ? &base : NULL, operands, &value);
+    if (s.ok()) {
+      saved_value_.swap(value);
+    } else {
+      status_ = s;
+      value_type = kTypeDeletion;
+    }
+  }
+
   if (value_type == kTypeDeletion) {
     // End
     valid_ = false;
@@ -273,7 +431,14 @@ void DBIter::FindPrevUserEntry() {
 
 void DBIter::Seek(const Slice& target) {
   direction_ = kForward;
+  merged_ = false;
   ClearSavedValue();
+  prefix_bounded_ = (prefix_extractor_ != NULL &&
+                     prefix_extractor_->InDomain(target));
+  if (prefix_bounded_) {
+    Slice prefix = prefix_extractor_->Transform(target);
+    prefix_.assign(prefix.data(), prefix.size());
+  }
   saved_key_.clear();
   AppendInternalKey(
       &saved_key_, ParsedInternalKey(target, sequence_, kValueTypeForSeek));
@@ -287,7 +452,9 @@ void DBIter::Seek(const Slice& target) {
 
 void DBIter::SeekToFirst() {
   direction_ = kForward;
+  merged_ = false;
   ClearSavedValue();
+  prefix_bounded_ = false;
   iter_->SeekToFirst();
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
@@ -297,7 +464,11 @@ void DBIter::SeekToFirst() {
 }
 
 void DBIter::SeekToLast() {
+  if (ReverseNotSupported()) {
+    return;
+  }
   direction_ = kReverse;
+  merged_ = false;
   ClearSavedValue();
   iter_->SeekToLast();
   FindPrevUserEntry();
@@ -308,10 +479,16 @@ void DBIter::SeekToLast() {
 Iterator* NewDBIterator(
     DBImpl* db,
     const Comparator* user_key_comparator,
+    const MergeOperator* merge_operator,
+    Logger* logger,
+    const SliceTransform* prefix_extractor,
     Iterator* internal_iter,
+    RangeDelAggregator* range_del,
     SequenceNumber sequence,
     uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+  return new DBIter(db, user_key_comparator, merge_operator, logger,
+                    prefix_extractor, internal_iter, range_del, sequence,
+                    seed);
 }
 
 }  // namespace leveldb
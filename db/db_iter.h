@@ -12,14 +12,27 @@
 namespace leveldb {
 
 class DBImpl;
+class Logger;
+class MergeOperator;
+class RangeDelAggregator;
+class SliceTransform;
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys.  Merge operands are combined with
+// "merge_operator", and entries deleted by the tombstones of
+// "*range_del" are skipped.  The iterator takes ownership of
+// "range_del", which may be NULL.  If "db" is NULL, no read samples are
+// recorded.  If "prefix_extractor" is non-NULL, the iterator behaves as
+// described for ReadOptions::prefix_same_as_start.
 extern Iterator* NewDBIterator(
     DBImpl* db,
     const Comparator* user_key_comparator,
+    const MergeOperator* merge_operator,
+    Logger* logger,
+    const SliceTransform* prefix_extractor,
     Iterator* internal_iter,
+    RangeDelAggregator* range_del,
     SequenceNumber sequence,
     uint32_t seed);
 
@@ -10,6 +10,10 @@
 #include "db/write_batch_internal.h"
 #include "leveldb/cache.h"
 #include "leveldb/env.h"
+#include "leveldb/memtablerep.h"
+#include "leveldb/merge_operator.h"
+#include "leveldb/slice_transform.h"
+#include "leveldb/sst_file_writer.h"
 #include "leveldb/table.h"
 #include "util/hash.h"
 #include "util/logging.h"
@@ -119,6 +123,15 @@ class SpecialEnv : public EnvWrapper {
         }
         return base_->Sync();
       }
+      Status SyncFlushed() {
+        if (env_->data_sync_error_.Acquire_Load() != NULL) {
+          return Status::IOError("simulated data sync error");
+        }
+        while (env_->delay_data_sync_.Acquire_Load() != NULL) {
+          DelayMilliseconds(100);
+        }
+        return base_->SyncFlushed();
+      }
     };
     class ManifestFile : public WritableFile {
      private:
@@ -176,6 +189,11 @@ class SpecialEnv : public EnvWrapper {
         counter_->Increment();
         return target_->Read(offset, n, result, scratch);
       }
+      virtual Status MultiRead(ReadRequest* reqs, size_t n) const {
+        // Counts as a single read
+        counter_->Increment();
+        return target_->MultiRead(reqs, n);
+      }
     };
 
     Status s = target()->NewRandomAccessFile(f, r);
@@ -189,13 +207,23 @@ class SpecialEnv : public EnvWrapper {
 class DBTest {
  private:
   const FilterPolicy* filter_policy_;
+  const SliceTransform* prefix_extractor_;
+  MemTableRepFactory* hash_skiplist_factory_;
+  MemTableRepFactory* vector_factory_;
 
   // Sequence of option configurations to try
   enum OptionConfig {
     kDefault,
     kReuse,
     kFilter,
+    kFullFilter,
     kUncompressed,
+    kPipelinedWrite,
+    kConcurrentMemTableWrite,
+    kHashSkipListRep,
+    kVectorRep,
+    kWALSyncThread,
+    kMemTableBloom,
     kEnd
   };
   int option_config_;
@@ -210,6 +238,9 @@ class DBTest {
   DBTest() : option_config_(kDefault),
              env_(new SpecialEnv(Env::Default())) {
     filter_policy_ = NewBloomFilterPolicy(10);
+    prefix_extractor_ = NewFixedPrefixTransform(1);
+    hash_skiplist_factory_ = NewHashSkipListRepFactory(prefix_extractor_, 16);
+    vector_factory_ = NewVectorRepFactory(0);
     dbname_ = test::TmpDir() + "/db_test";
     DestroyDB(dbname_, Options());
     db_ = NULL;
@@ -221,6 +252,9 @@ class DBTest {
     DestroyDB(dbname_, Options());
     delete env_;
     delete filter_policy_;
+    delete hash_skiplist_factory_;
+    delete vector_factory_;
+    delete prefix_extractor_;
   }
 
   // Switch to a fresh database with the next option configuration to
@@ -246,9 +280,32 @@ class DBTest {
       case kFilter:
         options.filter_policy = filter_policy_;
         break;
+      case kFullFilter:
+        options.filter_policy = filter_policy_;
+        options.full_filter = true;
+        break;
       case kUncompressed:
         options.compression = kNoCompression;
         break;
+      case kPipelinedWrite:
+        options.enable_pipelined_write = true;
+        break;
+      case kConcurrentMemTableWrite:
+        options.allow_concurrent_memtable_write = true;
+        break;
+      case kHashSkipListRep:
+        options.memtable_factory = hash_skiplist_factory_;
+        break;
+      case kVectorRep:
+        options.memtable_factory = vector_factory_;
+        options.allow_concurrent_memtable_write = true;
+        break;
+      case kWALSyncThread:
+        options.enable_wal_sync_thread = true;
+        break;
+      case kMemTableBloom:
+        options.memtable_bloom_size_ratio = 0.02;
+        break;
       default:
         break;
     }
@@ -298,6 +355,14 @@ class DBTest {
     return db_->Delete(WriteOptions(), k);
   }
 
+  Status Merge(const std::string& k, const std::string& v) {
+    return db_->Merge(WriteOptions(), k, v);
+  }
+
+  Status DeleteRange(const std::string& begin, const std::string& end) {
+    return db_->DeleteRange(WriteOptions(), begin, end);
+  }
+
   std::string Get(const std::string& k, const Snapshot* snapshot = NULL) {
     ReadOptions options;
     options.snapshot = snapshot;
@@ -310,6 +375,29 @@ class DBTest {
     }
     return result;
   }
+  // Return the results of a MultiGet() of "keys", separated by commas.
+  std::string MultiGet(const std::vector<std::string>& keys,
+                       const Snapshot* snapshot = NULL) {
+    ReadOptions options;
+    options.snapshot = snapshot;
+    std::vector<Slice> key_slices(keys.begin(), keys.end());
+    std::vector<std::string> values;
+    std::vector<Status> statuses;
+    db_->MultiGet(options, key_slices, &values, &statuses);
+    std::string result;
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (i > 0) result += ",";
+      if (statuses[i].IsNotFound()) {
+        result += "NOT_FOUND";
+      } else if (!statuses[i].ok()) {
+        result += statuses[i].ToString();
+      } else {
+        result += values[i];
+      }
+    }
+    return result;
+  }
+
 
   // Return a string that contains all key,value pairs in order,
   // formatted like "(k1->v1)(k2->v2)".
@@ -367,6 +455,15 @@ class DBTest {
             case kTypeDeletion:
               result += "DEL";
               break;
+            case kTypeMerge:
+              result += "+" + iter->value().ToString();
+              break;
+            case kTypeRangeDeletion:
+              result += "RANGEDEL";
+              break;
+            case kTypeSingleDeletion:
+              result += "SDEL";
+              break;
           }
         }
         iter->Next();
@@ -396,6 +493,12 @@ class DBTest {
     return result;
   }
 
+  uint64_t NumWALSyncs() {
+    std::string property;
+    ASSERT_TRUE(db_->GetProperty("leveldb.num-wal-syncs", &property));
+    return strtoull(property.c_str(), NULL, 10);
+  }
+
   // Return spread of files per level
   std::string FilesPerLevel() {
     std::string result;
@@ -506,6 +609,24 @@ class DBTest {
     }
     return files_renamed;
   }
+
+  // Returns the size of the newest log file.
+  uint64_t NewestLogFileSize() {
+    std::vector<std::string> filenames;
+    ASSERT_OK(env_->GetChildren(dbname_, &filenames));
+    uint64_t number;
+    FileType type;
+    uint64_t newest = 0;
+    for (size_t i = 0; i < filenames.size(); i++) {
+      if (ParseFileName(filenames[i], &number, &type) && type == kLogFile &&
+          number > newest) {
+        newest = number;
+      }
+    }
+    uint64_t size = 0;
+    ASSERT_OK(env_->GetFileSize(LogFileName(dbname_, newest), &size));
+    return size;
+  }
 };
 
 TEST(DBTest, Empty) {
@@ -555,6 +676,44 @@ TEST(DBTest, GetFromImmutableLayer) {
   } while (ChangeOptions());
 }
 
+TEST(DBTest, GetFromMultipleImmutableLayers) {
+  do {
+    Options options = CurrentOptions();
+    options.env = env_;
+    options.write_buffer_size = 100000;  // Small write buffer
+    options.max_write_buffer_number = 4;
+    Reopen(&options);
+
+    env_->delay_data_sync_.Release_Store(env_);      // Block sync calls
+    ASSERT_OK(Put("foo", "v1"));
+    ASSERT_OK(Put("k1", std::string(100000, 'x')));  // Fill memtable
+    ASSERT_OK(Put("bar", "v2"));                     // Trigger compaction
+    ASSERT_OK(Put("k2", std::string(100000, 'y')));  // Fill memtable
+    ASSERT_OK(Put("foo", "v3"));                     // Does not wait
+    std::string num;
+    ASSERT_TRUE(db_->GetProperty("leveldb.num-immutable-mem-table", &num));
+    ASSERT_EQ("2", num);
+    ASSERT_EQ("v3", Get("foo"));
+    ASSERT_EQ("v2", Get("bar"));
+    ASSERT_EQ(std::string(100000, 'x'), Get("k1"));
+    ASSERT_EQ(std::string(100000, 'y'), Get("k2"));
+    ASSERT_EQ("(bar->v2)(foo->v3)(k1->" + std::string(100000, 'x') +
+              ")(k2->" + std::string(100000, 'y') + ")", Contents());
+    env_->delay_data_sync_.Release_Store(NULL);      // Release sync calls
+
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_TRUE(db_->GetProperty("leveldb.num-immutable-mem-table", &num));
+    ASSERT_EQ("0", num);
+    ASSERT_EQ("v3", Get("foo"));
+    ASSERT_EQ("v2", Get("bar"));
+
+    // The immutable memtables were compacted and their logs dropped
+    Reopen(&options);
+    ASSERT_EQ("v3", Get("foo"));
+    ASSERT_EQ(std::string(100000, 'y'), Get("k2"));
+  } while (ChangeOptions());
+}
+
 TEST(DBTest, GetFromVersions) {
   do {
     ASSERT_OK(Put("foo", "v1"));
@@ -574,6 +733,19 @@ TEST(DBTest, GetMemUsage) {
   } while (ChangeOptions());
 }
 
+TEST(DBTest, GetWriteStallProperties) {
+  ASSERT_OK(Put("foo", "v1"));
+  std::string val;
+  ASSERT_TRUE(db_->GetProperty("leveldb.delayed-write-rate", &val));
+  ASSERT_EQ("0", val);
+  ASSERT_TRUE(db_->GetProperty("leveldb.pending-compaction-bytes", &val));
+  ASSERT_EQ("0", val);
+  ASSERT_TRUE(db_->GetProperty("leveldb.write-stall-stats", &val));
+  ASSERT_TRUE(val.find("delayed") != std::string::npos) << val;
+  ASSERT_TRUE(val.find("memtable-full") != std::string::npos) << val;
+  ASSERT_TRUE(val.find("level0-stop") != std::string::npos) << val;
+}
+
 TEST(DBTest, GetSnapshot) {
   do {
     // Try with both a short key and a long key
@@ -634,6 +806,42 @@ TEST(DBTest, GetPicksCorrectFile) {
   } while (ChangeOptions());
 }
 
+TEST(DBTest, MultiGet) {
+  do {
+    // Spread the keys over the memtable, level-0 and other levels
+    ASSERT_OK(Put("a", "va"));
+    ASSERT_OK(Put("c", "vc"));
+    ASSERT_OK(Put("e", "ve"));
+    Compact("a", "e");
+    ASSERT_OK(Put("x", "vx"));
+    Compact("x", "y");
+    ASSERT_OK(Put("c", "vc2"));
+    ASSERT_OK(Delete("e"));
+    dbfull()->TEST_CompactMemTable();
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_OK(Put("a", "va2"));
+    ASSERT_OK(Put("g", "vg"));
+    ASSERT_OK(Delete("x"));
+
+    // Unsorted, repeated and missing keys
+    std::vector<std::string> keys;
+    keys.push_back("x");
+    keys.push_back("a");
+    keys.push_back("e");
+    keys.push_back("b");
+    keys.push_back("c");
+    keys.push_back("g");
+    keys.push_back("a");
+    keys.push_back("z");
+    ASSERT_EQ("NOT_FOUND,va2,NOT_FOUND,NOT_FOUND,vc2,vg,va2,NOT_FOUND",
+              MultiGet(keys));
+    ASSERT_EQ("vx,va,NOT_FOUND,NOT_FOUND,vc2,NOT_FOUND,va,NOT_FOUND",
+              MultiGet(keys, snapshot));
+    db_->ReleaseSnapshot(snapshot);
+    ASSERT_EQ("", MultiGet(std::vector<std::string>()));
+  } while (ChangeOptions());
+}
+
 TEST(DBTest, GetEncountersEmptyLevel) {
   do {
     // Arrange for the following to happen:
@@ -1228,6 +1436,10 @@ TEST(DBTest, HiddenValuesAreRemoved) {
   do {
     Random rnd(301);
     FillLevels("a", "z");
+    // FillLevels() leaves enough level-0 files to trigger an automatic
+    // compaction; finish it now so that it cannot pick up the table
+    // built below while the snapshot is still held.
+    dbfull()->TEST_CompactRange(0, NULL, NULL);
 
     std::string big = RandomString(&rnd, 50000);
     Put("foo", big);
@@ -1697,6 +1909,223 @@ TEST(DBTest, StillReadSST) {
   ASSERT_EQ("bar", Get("foo"));
 }
 
+TEST(DBTest, MultiGetReadsBlocksOnce) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  Reopen(&options);
+
+  const int N = 100;
+  std::vector<std::string> keys;
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), "v"));
+    keys.push_back(Key(i));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("v", Get(Key(0)));  // Opens the table
+
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("v", Get(Key(i)));
+  }
+  ASSERT_EQ(N, env_->random_read_counter_.Read());
+
+  // All the keys lie in a single data block
+  env_->random_read_counter_.Reset();
+  std::string expected;
+  for (int i = 0; i < N; i++) {
+    expected += (i > 0 ? ",v" : "v");
+  }
+  ASSERT_EQ(expected, MultiGet(keys));
+  ASSERT_EQ(1, env_->random_read_counter_.Read());
+
+  Close();
+  delete options.block_cache;
+}
+
+TEST(DBTest, MultiGetReadsBlocksAtOnce) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_size = 256;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  Reopen(&options);
+
+  const int N = 100;
+  std::vector<std::string> keys;
+  std::string expected;
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), std::string(100, 'a' + (i % 26))));
+    keys.push_back(Key(i));
+    expected += (i > 0 ? "," : "") + std::string(100, 'a' + (i % 26));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(std::string(100, 'a'), Get(Key(0)));  // Opens the table
+
+  // The keys span many data blocks, which are read with one MultiRead()
+  env_->random_read_counter_.Reset();
+  ASSERT_EQ(expected, MultiGet(keys));
+  ASSERT_EQ(1, env_->random_read_counter_.Read());
+
+  Close();
+  delete options.block_cache;
+}
+
+TEST(DBTest, IteratorReadsAhead) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_size = 256;
+  options.compression = kNoCompression;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  Reopen(&options);
+
+  // About 400 data blocks, 100KB
+  const int N = 1000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), std::string(100, 'a' + (i % 26))));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(std::string(100, 'a'), Get(Key(0)));  // Opens the table
+
+  // The chunks grow from 8KB, so a full scan takes a handful of reads
+  env_->random_read_counter_.Reset();
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ASSERT_EQ(Key(count), iter->key().ToString());
+    ASSERT_EQ(std::string(100, 'a' + (count % 26)), iter->value().ToString());
+    count++;
+  }
+  ASSERT_OK(iter->status());
+  ASSERT_EQ(N, count);
+  delete iter;
+  ASSERT_LE(env_->random_read_counter_.Read(), 10);
+
+  // Seeks elsewhere read a block at a time
+  env_->random_read_counter_.Reset();
+  iter = db_->NewIterator(ReadOptions());
+  for (int i = 0; i < 10; i++) {
+    iter->Seek(Key(i * 97));
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(Key(i * 97), iter->key().ToString());
+  }
+  delete iter;
+  ASSERT_EQ(10, env_->random_read_counter_.Read());
+
+  // A fixed readahead size applies from the first block
+  env_->random_read_counter_.Reset();
+  ReadOptions ropts;
+  ropts.readahead_size = 32 * 1024;
+  iter = db_->NewIterator(ropts);
+  count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  delete iter;
+  ASSERT_EQ(N, count);
+  ASSERT_LE(env_->random_read_counter_.Read(), 5);
+
+  Close();
+  delete options.block_cache;
+}
+
+static std::string UserKey(int user, int i) {
+  char buf[100];
+  snprintf(buf, sizeof(buf), "user%04d:%04d", user, i);
+  return std::string(buf);
+}
+
+static std::string UserPrefix(int user) {
+  return UserKey(user, 0).substr(0, 9);
+}
+
+TEST(DBTest, PrefixSameAsStart) {
+  env_->count_random_reads_ = true;
+  const SliceTransform* prefix_extractor = NewFixedPrefixTransform(9);
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.prefix_extractor = prefix_extractor;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  Reopen(&options);
+
+  // One table holds the even users, another the multiples of 3, and the
+  // memtable user 7.
+  for (int user = 0; user < 100; user += 2) {
+    for (int i = 0; i < 10; i++) {
+      ASSERT_OK(Put(UserKey(user, i), "even"));
+    }
+  }
+  dbfull()->TEST_CompactMemTable();
+  for (int user = 0; user < 100; user += 3) {
+    ASSERT_OK(Put(UserKey(user, 10), "three"));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Put(UserKey(7, 0), "seven"));
+
+  ReadOptions ropts;
+  ropts.prefix_same_as_start = true;
+  // Opens the tables
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->Seek(UserPrefix(0));
+  delete iter;
+
+  // Only the keys of the user are yielded
+  iter = db_->NewIterator(ropts);
+  int count = 0;
+  for (iter->Seek(UserPrefix(6)); iter->Valid(); iter->Next()) {
+    ASSERT_EQ(UserKey(6, count), iter->key().ToString());
+    ASSERT_EQ(count < 10 ? "even" : "three", iter->value().ToString());
+    count++;
+  }
+  ASSERT_OK(iter->status());
+  ASSERT_EQ(11, count);
+  iter->Seek(UserPrefix(7));
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(UserKey(7, 0), iter->key().ToString());
+  iter->Next();
+  ASSERT_TRUE(!iter->Valid());
+  delete iter;
+
+  // A user in no table reads no data block
+  env_->random_read_counter_.Reset();
+  iter = db_->NewIterator(ropts);
+  iter->Seek(UserPrefix(7));
+  ASSERT_TRUE(iter->Valid());
+  iter->Next();
+  ASSERT_TRUE(!iter->Valid());
+  iter->Seek(UserPrefix(11));
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_OK(iter->status());
+  delete iter;
+  ASSERT_LE(env_->random_read_counter_.Read(), 1);  // Filter false positive
+
+  // Without the option, the seeks read a block in each table
+  env_->random_read_counter_.Reset();
+  iter = db_->NewIterator(ReadOptions());
+  iter->Seek(UserPrefix(11));
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(UserKey(12, 0), iter->key().ToString());
+  delete iter;
+  ASSERT_EQ(2, env_->random_read_counter_.Read());
+
+  // Bounded iterators only move forward
+  iter = db_->NewIterator(ropts);
+  iter->Seek(UserPrefix(6));
+  ASSERT_TRUE(iter->Valid());
+  iter->Prev();
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_TRUE(iter->status().IsNotSupportedError());
+  delete iter;
+
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+  delete prefix_extractor;
+}
+
 TEST(DBTest, FilesDeletedAfterCompaction) {
   ASSERT_OK(Put("foo", "v2"));
   Compact("a", "z");
@@ -1755,6 +2184,819 @@ TEST(DBTest, BloomFilter) {
   delete options.filter_policy;
 }
 
+namespace {
+struct AsyncWriteState {
+  port::Mutex mu;
+  port::CondVar cv;
+  int completed;
+  int failed;
+  AsyncWriteState() : cv(&mu), completed(0), failed(0) { }
+};
+
+static void AsyncWriteDone(void* arg, const Status& s) {
+  AsyncWriteState* state = reinterpret_cast<AsyncWriteState*>(arg);
+  MutexLock l(&state->mu);
+  state->completed++;
+  if (!s.ok()) {
+    state->failed++;
+  }
+  state->cv.Signal();
+}
+}  // namespace
+
+TEST(DBTest, WriteAsync) {
+  do {
+    Options options = CurrentOptions();
+    options.write_buffer_size = 100000;  // Force memtable switches
+    Reopen(&options);
+
+    const int kNum = 1000;
+    std::vector<WriteBatch> batches(kNum);
+    AsyncWriteState state;
+    for (int i = 0; i < kNum; i++) {
+      batches[i].Put(Key(i % 100), std::string(1000, 'a' + (i % 26)));
+      batches[i].Put("last", Key(i));
+      db_->WriteAsync(WriteOptions(), &batches[i], &AsyncWriteDone, &state);
+      if (i % 10 == 0) {
+        // Synchronous writes are ordered after earlier async ones
+        ASSERT_OK(Put("sync", Key(i)));
+      }
+    }
+    {
+      MutexLock l(&state.mu);
+      while (state.completed < kNum) {
+        state.cv.Wait();
+      }
+    }
+    ASSERT_EQ(0, state.failed);
+    ASSERT_EQ(Key(kNum - 1), Get("last"));
+    ASSERT_EQ(Key(990), Get("sync"));
+    for (int i = kNum - 100; i < kNum; i++) {
+      ASSERT_EQ(std::string(1000, 'a' + (i % 26)), Get(Key(i % 100)));
+    }
+
+    // Queued writes are applied before the DB is closed
+    for (int i = 0; i < 100; i++) {
+      batches[i].Clear();
+      batches[i].Put(Key(i), "closed");
+      db_->WriteAsync(WriteOptions(), &batches[i], &AsyncWriteDone, &state);
+    }
+    Reopen(&options);
+    ASSERT_EQ(kNum + 100, state.completed);
+    for (int i = 0; i < 100; i++) {
+      ASSERT_EQ("closed", Get(Key(i)));
+    }
+  } while (ChangeOptions());
+}
+
+namespace {
+struct SyncWriteThread {
+  DB* db;
+  int id;
+  port::AtomicPointer done;
+};
+
+static void SyncWriteThreadBody(void* arg) {
+  SyncWriteThread* t = reinterpret_cast<SyncWriteThread*>(arg);
+  WriteOptions options;
+  options.sync = true;
+  char key[20];
+  snprintf(key, sizeof(key), "sync%d", t->id);
+  ASSERT_OK(t->db->Put(options, key, "v"));
+  t->done.Release_Store(t);
+}
+}  // namespace
+
+TEST(DBTest, DisableWAL) {
+  do {
+    WriteOptions no_wal;
+    no_wal.disable_wal = true;
+    ASSERT_OK(Put("foo", "v1"));
+    ASSERT_OK(db_->Put(no_wal, "foo", "v2"));
+    ASSERT_OK(db_->Put(no_wal, "bar", "v1"));
+    ASSERT_OK(Put("baz", "v1"));
+    ASSERT_EQ("v2", Get("foo"));
+    ASSERT_EQ("v1", Get("bar"));
+
+    // Only the logged writes are recovered
+    Reopen();
+    ASSERT_EQ("v1", Get("foo"));
+    ASSERT_EQ("NOT_FOUND", Get("bar"));
+    ASSERT_EQ("v1", Get("baz"));
+
+    // Flush() makes unlogged writes durable
+    ASSERT_OK(db_->Put(no_wal, "bar", "v2"));
+    ASSERT_OK(db_->Flush());
+    Reopen();
+    ASSERT_EQ("v2", Get("bar"));
+
+    WriteOptions sync_no_wal;
+    sync_no_wal.sync = true;
+    sync_no_wal.disable_wal = true;
+    ASSERT_TRUE(db_->Put(sync_no_wal, "foo", "v3").IsInvalidArgument());
+    ASSERT_EQ("v1", Get("foo"));
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, ManualWALFlush) {
+  do {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.manual_wal_flush = true;
+    options.wal_buffer_size = 10000;
+    DestroyAndReopen(&options);
+
+    ASSERT_OK(Put("foo", "v1"));
+    ASSERT_EQ(0, NewestLogFileSize());
+    ASSERT_OK(db_->FlushWAL());
+    uint64_t size = NewestLogFileSize();
+    ASSERT_GT(size, 0);
+
+    // Sync writes write out the buffer first
+    ASSERT_OK(Put("bar", "v1"));
+    ASSERT_EQ(size, NewestLogFileSize());
+    WriteOptions sync;
+    sync.sync = true;
+    ASSERT_OK(db_->Put(sync, "baz", "v1"));
+    ASSERT_GT(NewestLogFileSize(), size);
+
+    // So does filling the buffer
+    size = NewestLogFileSize();
+    ASSERT_OK(Put("big", std::string(options.wal_buffer_size, 'x')));
+    ASSERT_GT(NewestLogFileSize(), size + options.wal_buffer_size);
+
+    // Buffered writes are written out on close
+    ASSERT_OK(Put("foo", "v2"));
+    Reopen(&options);
+    ASSERT_EQ("v2", Get("foo"));
+    ASSERT_EQ("v1", Get("bar"));
+    ASSERT_EQ("v1", Get("baz"));
+    ASSERT_EQ(std::string(options.wal_buffer_size, 'x'), Get("big"));
+  } while (ChangeOptions());
+}
+
+// Build the external table "fname", mapping Key(i) to Key(i) + suffix
+// for every i in [from,to).
+static Status BuildExternalFile(const Options& options,
+                                const std::string& fname,
+                                int from, int to,
+                                const std::string& suffix) {
+  SstFileWriter writer(options);
+  Status s = writer.Open(fname);
+  for (int i = from; s.ok() && i < to; i++) {
+    s = writer.Put(Key(i), Key(i) + suffix);
+  }
+  if (s.ok()) {
+    s = writer.Finish();
+  }
+  return s;
+}
+
+TEST(DBTest, IngestExternalFiles) {
+  const std::string f1 = test::TmpDir() + "/db_test_ext1.sst";
+  const std::string f2 = test::TmpDir() + "/db_test_ext2.sst";
+  do {
+    Options options = CurrentOptions();
+    ASSERT_OK(BuildExternalFile(options, f1, 0, 100, "a"));
+    ASSERT_OK(BuildExternalFile(options, f2, 200, 300, "a"));
+
+    // Nothing overlaps the files, so they go to the last level
+    std::vector<std::string> files;
+    files.push_back(f1);
+    files.push_back(f2);
+    ASSERT_OK(db_->IngestExternalFiles(files, IngestExternalFileOptions()));
+    ASSERT_EQ(2, NumTableFilesAtLevel(config::kNumLevels - 1));
+    ASSERT_TRUE(env_->FileExists(f1));
+    ASSERT_EQ(Key(0) + "a", Get(Key(0)));
+    ASSERT_EQ(Key(299) + "a", Get(Key(299)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(100)));
+
+    // Ingested entries are newer than the memtable and table entries
+    // they overlap
+    ASSERT_OK(Put(Key(50), "v1"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_OK(Put(Key(250), "v1"));
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_OK(BuildExternalFile(options, f1, 40, 260, "b"));
+    files.resize(1);
+    ASSERT_OK(db_->IngestExternalFiles(files, IngestExternalFileOptions()));
+    ASSERT_EQ(Key(10) + "a", Get(Key(10)));
+    ASSERT_EQ(Key(50) + "b", Get(Key(50)));
+    ASSERT_EQ(Key(150) + "b", Get(Key(150)));
+    ASSERT_EQ(Key(250) + "b", Get(Key(250)));
+    ASSERT_EQ("v1", Get(Key(50), snapshot));
+    ASSERT_EQ("NOT_FOUND", Get(Key(150), snapshot));
+    ASSERT_EQ(Key(260) + "a", Get(Key(260)));
+    db_->ReleaseSnapshot(snapshot);
+
+    // Later writes win over ingested entries
+    ASSERT_OK(Put(Key(60), "v2"));
+    ASSERT_EQ("v2", Get(Key(60)));
+
+    for (int pass = 0; pass < 2; pass++) {
+      if (pass == 1) {
+        db_->CompactRange(NULL, NULL);
+      }
+      Reopen();
+      Iterator* iter = db_->NewIterator(ReadOptions());
+      int i = 0;
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next(), i++) {
+        ASSERT_EQ(Key(i), iter->key().ToString());
+        const char* suffix = (i >= 40 && i < 260) ? "b" : "a";
+        ASSERT_EQ(i == 60 ? "v2" : Key(i) + suffix, iter->value().ToString());
+      }
+      ASSERT_EQ(300, i);
+      delete iter;
+    }
+  } while (ChangeOptions());
+  env_->DeleteFile(f1);
+  env_->DeleteFile(f2);
+}
+
+TEST(DBTest, IngestExternalFilesErrors) {
+  const std::string f1 = test::TmpDir() + "/db_test_ext1.sst";
+  const std::string f2 = test::TmpDir() + "/db_test_ext2.sst";
+  Options options = CurrentOptions();
+  {
+    SstFileWriter writer(options);
+    ASSERT_TRUE(writer.Put("a", "v").IsInvalidArgument());
+    ASSERT_OK(writer.Open(f1));
+    ASSERT_TRUE(writer.Finish().IsInvalidArgument());
+    ASSERT_OK(writer.Put("b", "v"));
+    ASSERT_TRUE(writer.Put("a", "v").IsInvalidArgument());
+    ASSERT_TRUE(writer.Delete("b").IsInvalidArgument());
+    ASSERT_OK(writer.Delete("c"));
+    ASSERT_OK(writer.Finish());
+    ASSERT_GT(writer.FileSize(), 0);
+  }
+
+  // Files that overlap each other are rejected
+  ASSERT_OK(BuildExternalFile(options, f1, 0, 100, "a"));
+  ASSERT_OK(BuildExternalFile(options, f2, 99, 200, "a"));
+  std::vector<std::string> files;
+  files.push_back(f1);
+  files.push_back(f2);
+  ASSERT_TRUE(db_->IngestExternalFiles(
+      files, IngestExternalFileOptions()).IsInvalidArgument());
+  ASSERT_EQ("NOT_FOUND", Get(Key(0)));
+
+  files.push_back(test::TmpDir() + "/db_test_missing.sst");
+  files.erase(files.begin() + 1);
+  ASSERT_TRUE(!db_->IngestExternalFiles(
+      files, IngestExternalFileOptions()).ok());
+  ASSERT_EQ("NOT_FOUND", Get(Key(0)));
+
+  // Moved files leave their original location
+  files.resize(1);
+  IngestExternalFileOptions move;
+  move.move_files = true;
+  ASSERT_OK(db_->IngestExternalFiles(files, move));
+  ASSERT_TRUE(!env_->FileExists(f1));
+  ASSERT_EQ(Key(0) + "a", Get(Key(0)));
+  env_->DeleteFile(f2);
+}
+
+TEST(DBTest, RecycleLogFiles) {
+  do {
+    Options options = CurrentOptions();
+    options.write_buffer_size = 100000;
+    options.recycle_log_file_num = 2;
+    options.paranoid_checks = true;  // Stale log tails must not look corrupt
+    Reopen(&options);
+
+    const int kNum = 500;
+    for (int i = 0; i < kNum; i++) {
+      ASSERT_OK(Put(Key(i), std::string(1000, 'a' + (i % 26))));
+    }
+    dbfull()->TEST_CompactMemTable();
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_OK(Put("foo", "v1"));
+    ASSERT_OK(Delete(Key(0)));
+
+    // The current log reuses an older one, whose records are still
+    // behind the ones just written.
+    ASSERT_GT(NewestLogFileSize(), 50000);
+
+    Reopen(&options);
+    ASSERT_EQ("v1", Get("foo"));
+    ASSERT_EQ("NOT_FOUND", Get(Key(0)));
+    for (int i = 1; i < kNum; i++) {
+      ASSERT_EQ(std::string(1000, 'a' + (i % 26)), Get(Key(i)));
+    }
+
+    ASSERT_OK(Put("foo", "v2"));
+    Reopen(&options);
+    ASSERT_EQ("v2", Get("foo"));
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, WALSyncThread) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.enable_wal_sync_thread = true;
+  Reopen(&options);
+  ASSERT_OK(Put("foo", "v1"));
+  uint64_t syncs_before = NumWALSyncs();
+
+  // Hold up the first sync; every writer that logs meanwhile must be
+  // covered by the next one.
+  env_->delay_data_sync_.Release_Store(env_);
+  const int kThreads = 4;
+  SyncWriteThread threads[kThreads];
+  for (int i = 0; i < kThreads; i++) {
+    threads[i].db = db_;
+    threads[i].id = i;
+    threads[i].done.Release_Store(NULL);
+    env_->StartThread(SyncWriteThreadBody, &threads[i]);
+  }
+  // Writes are visible once applied, before they are durable.
+  for (int i = 0; i < kThreads; i++) {
+    char key[20];
+    snprintf(key, sizeof(key), "sync%d", i);
+    while (Get(key) != "v") {
+      DelayMilliseconds(10);
+    }
+    ASSERT_TRUE(threads[i].done.Acquire_Load() == NULL);
+  }
+  env_->delay_data_sync_.Release_Store(NULL);
+  for (int i = 0; i < kThreads; i++) {
+    while (threads[i].done.Acquire_Load() == NULL) {
+      DelayMilliseconds(10);
+    }
+  }
+  ASSERT_LE(NumWALSyncs(), syncs_before + 2);
+
+  // Survives a reopen
+  Reopen(&options);
+  ASSERT_EQ("v", Get("sync3"));
+
+  // A failed background sync fails the waiting write and stops further
+  // writes, like a failed inline sync.
+  env_->data_sync_error_.Release_Store(env_);
+  WriteOptions w;
+  w.sync = true;
+  ASSERT_TRUE(!db_->Put(w, "k1", "v1").ok());
+  env_->data_sync_error_.Release_Store(NULL);
+  ASSERT_TRUE(!db_->Put(WriteOptions(), "k2", "v2").ok());
+}
+
+namespace {
+// Joins the value and the operands with commas.
+class AppendOperator : public MergeOperator {
+ public:
+  virtual const char* Name() const { return "test.AppendOperator"; }
+
+  virtual bool FullMerge(const Slice& key,
+                         const Slice* existing_value,
+                         const std::deque<std::string>& operands,
+                         std::string* new_value,
+                         Logger* logger) const {
+    if (existing_value != NULL) {
+      new_value->assign(existing_value->data(), existing_value->size());
+    }
+    for (size_t i = 0; i < operands.size(); i++) {
+      if (!new_value->empty()) {
+        new_value->push_back(',');
+      }
+      new_value->append(operands[i]);
+    }
+    return true;
+  }
+
+  virtual bool PartialMerge(const Slice& key,
+                            const Slice& older_operand,
+                            const Slice& newer_operand,
+                            std::string* new_value,
+                            Logger* logger) const {
+    new_value->assign(older_operand.data(), older_operand.size());
+    new_value->push_back(',');
+    new_value->append(newer_operand.data(), newer_operand.size());
+    return true;
+  }
+};
+}  // namespace
+
+TEST(DBTest, Merge) {
+  ASSERT_TRUE(Merge("a", "1").IsNotSupportedError());
+
+  AppendOperator append;
+  do {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.merge_operator = &append;
+    DestroyAndReopen(&options);
+
+    ASSERT_OK(Merge("a", "1"));
+    ASSERT_OK(Put("b", "x"));
+    ASSERT_OK(Merge("b", "1"));
+    ASSERT_OK(Merge("b", "2"));
+    ASSERT_OK(Merge("c", "1"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_OK(Merge("c", "2"));
+    ASSERT_OK(Put("d", "x"));
+    ASSERT_OK(Delete("d"));
+    ASSERT_OK(Merge("d", "1"));
+    ASSERT_OK(Merge("e", "1"));
+    ASSERT_OK(Delete("e"));
+
+    for (int i = 0; i < 2; i++) {
+      ASSERT_EQ("1", Get("a"));
+      ASSERT_EQ("x,1,2", Get("b"));
+      ASSERT_EQ("1,2", Get("c"));
+      ASSERT_EQ("1", Get("d"));
+      ASSERT_EQ("NOT_FOUND", Get("e"));
+      ASSERT_EQ("(a->1)(b->x,1,2)(c->1,2)(d->1)", Contents());
+
+      // Switch direction on a merged entry
+      Iterator* iter = db_->NewIterator(ReadOptions());
+      iter->Seek("b");
+      ASSERT_EQ("b->x,1,2", IterStatus(iter));
+      iter->Prev();
+      ASSERT_EQ("a->1", IterStatus(iter));
+      iter->Next();
+      ASSERT_EQ("b->x,1,2", IterStatus(iter));
+      iter->SeekToLast();
+      iter->Next();
+      ASSERT_EQ("(invalid)", IterStatus(iter));
+      iter->Seek("d");
+      iter->Prev();
+      ASSERT_EQ("c->1,2", IterStatus(iter));
+      ASSERT_OK(iter->status());
+      delete iter;
+
+      Reopen(&options);
+    }
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, MergeCompaction) {
+  AppendOperator append;
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.merge_operator = &append;
+  DestroyAndReopen(&options);
+
+  ASSERT_OK(Put("a", "x"));
+  ASSERT_OK(Merge("a", "1"));
+  dbfull()->TEST_CompactMemTable();
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(Merge("a", "2"));
+  ASSERT_OK(Merge("a", "3"));
+  ASSERT_OK(Merge("b", "1"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+  ASSERT_EQ("[ +3, +2, +1, x ]", AllEntriesFor("a"));
+
+  // Operands the snapshot sees apart are kept
+  dbfull()->TEST_CompactRange(1, NULL, NULL);
+  ASSERT_EQ("[ +3, +2, x,1 ]", AllEntriesFor("a"));
+  ASSERT_EQ("[ +1 ]", AllEntriesFor("b"));
+  ASSERT_EQ("x,1", Get("a", snapshot));
+  ASSERT_EQ("x,1,2,3", Get("a"));
+  db_->ReleaseSnapshot(snapshot);
+
+  ASSERT_OK(Merge("a", "4"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+  dbfull()->TEST_CompactRange(1, NULL, NULL);
+  ASSERT_EQ("[ x,1,2,3,4 ]", AllEntriesFor("a"));
+  ASSERT_EQ("[ 1 ]", AllEntriesFor("b"));
+  ASSERT_EQ("x,1,2,3,4", Get("a"));
+}
+
+TEST(DBTest, DeleteRange) {
+  do {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    DestroyAndReopen(&options);
+
+    ASSERT_OK(Put("a", "1"));
+    ASSERT_OK(Put("b", "2"));
+    ASSERT_OK(Put("c", "3"));
+    ASSERT_OK(Put("d", "4"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_OK(Put("e", "5"));
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_OK(DeleteRange("b", "d"));
+    ASSERT_OK(Put("c", "3b"));
+    ASSERT_OK(DeleteRange("e", "a"));  // Empty range
+
+    for (int i = 0; i < 2; i++) {
+      ASSERT_EQ("1", Get("a"));
+      ASSERT_EQ("NOT_FOUND", Get("b"));
+      ASSERT_EQ("3b", Get("c"));
+      ASSERT_EQ("4", Get("d"));
+      ASSERT_EQ("5", Get("e"));
+      ASSERT_EQ("2", Get("b", snapshot));
+      ASSERT_EQ("3", Get("c", snapshot));
+      ASSERT_EQ("(a->1)(c->3b)(d->4)(e->5)", Contents());
+
+      Iterator* iter = db_->NewIterator(ReadOptions());
+      iter->Seek("b");
+      ASSERT_EQ("c->3b", IterStatus(iter));
+      iter->Prev();
+      ASSERT_EQ("a->1", IterStatus(iter));
+      delete iter;
+
+      ReadOptions options;
+      options.snapshot = snapshot;
+      iter = db_->NewIterator(options);
+      iter->Seek("b");
+      ASSERT_EQ("b->2", IterStatus(iter));
+      delete iter;
+
+      // Move the tombstones from the memtable to a table
+      dbfull()->TEST_CompactMemTable();
+    }
+    db_->ReleaseSnapshot(snapshot);
+
+    Reopen(&options);
+    ASSERT_EQ("(a->1)(c->3b)(d->4)(e->5)", Contents());
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, DeleteRangeCompaction) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+
+  ASSERT_OK(Put("a", "1"));
+  ASSERT_OK(Put("b", "2"));
+  ASSERT_OK(Put("c", "3"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Put("c", "3b"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(DeleteRange("a", "c"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+
+  // The snapshot still sees the deleted entries
+  dbfull()->TEST_CompactRange(1, NULL, NULL);
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+  ASSERT_EQ("[ 1 ]", AllEntriesFor("a"));
+  ASSERT_EQ("(c->3b)", Contents());
+  ASSERT_EQ("1", Get("a", snapshot));
+  db_->ReleaseSnapshot(snapshot);
+
+  // Push the table down and compact the tombstone into it
+  dbfull()->TEST_CompactRange(2, NULL, NULL);
+  ASSERT_EQ("[ ]", AllEntriesFor("a"));
+  ASSERT_EQ("[ ]", AllEntriesFor("b"));
+  ASSERT_EQ("[ 3b ]", AllEntriesFor("c"));
+  ASSERT_EQ("(c->3b)", Contents());
+}
+
+TEST(DBTest, DeleteRangeDropsCoveredFiles) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  env_->count_random_reads_ = true;
+  DestroyAndReopen(&options);
+
+  // A level-2 table of many blocks, all deleted by a tombstone
+  Random rnd(301);
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_OK(Put(Key(i), RandomString(&rnd, 1000)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Put("a", "x"));
+  ASSERT_OK(DeleteRange(Key(0), "z"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+
+  env_->random_read_counter_.Reset();
+  dbfull()->TEST_CompactRange(1, NULL, NULL);
+  ASSERT_LE(env_->random_read_counter_.Read(), 20);
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+  ASSERT_EQ("(a->x)", Contents());
+  ASSERT_EQ("NOT_FOUND", Get(Key(0)));
+}
+
+TEST(DBTest, SingleDelete) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+
+  // Data in level 3 keeps ordinary deletions from being dropped
+  ASSERT_OK(Put("0", "v"));
+  ASSERT_OK(Put("z", "v"));
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_CompactRange(2, NULL, NULL);
+  ASSERT_OK(Put("a", "1"));
+  ASSERT_OK(Put("c", "3"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(db_->SingleDelete(WriteOptions(), "a"));
+  ASSERT_OK(Delete("c"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("0,1,1,1", FilesPerLevel());
+  ASSERT_EQ("[ SDEL, 1 ]", AllEntriesFor("a"));
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+  ASSERT_EQ("(0->v)(z->v)", Contents());
+
+  dbfull()->TEST_CompactRange(1, NULL, NULL);
+  ASSERT_EQ("[ ]", AllEntriesFor("a"));
+  ASSERT_EQ("[ DEL ]", AllEntriesFor("c"));
+  ASSERT_EQ("(0->v)(z->v)", Contents());
+
+  // A snapshot between the put and the deletion keeps both
+  ASSERT_OK(Put("e", "5"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(db_->SingleDelete(WriteOptions(), "e"));
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_CompactRange(2, NULL, NULL);
+  ASSERT_EQ("[ SDEL, 5 ]", AllEntriesFor("e"));
+  ASSERT_EQ("5", Get("e", snapshot));
+  ASSERT_EQ("NOT_FOUND", Get("e"));
+  db_->ReleaseSnapshot(snapshot);
+  dbfull()->TEST_CompactRange(3, NULL, NULL);
+  ASSERT_EQ("[ ]", AllEntriesFor("e"));
+  ASSERT_EQ("(0->v)(z->v)", Contents());
+}
+
+TEST(DBTest, InplaceUpdate) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.inplace_update_support = true;
+  DestroyAndReopen(&options);
+
+  // Values no larger than the one in the memtable replace it
+  for (int i = 0; i < 100; i++) {
+    char buf[10];
+    snprintf(buf, sizeof(buf), "v%03d", i);
+    ASSERT_OK(Put("a", buf));
+  }
+  ASSERT_OK(Put("a", "v1"));
+  ASSERT_EQ("[ v1 ]", AllEntriesFor("a"));
+  ASSERT_EQ("v1", Get("a"));
+
+  // Larger values, and values put while a snapshot is held, are added
+  ASSERT_OK(Put("a", "value2"));
+  ASSERT_EQ("[ value2, v1 ]", AllEntriesFor("a"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(Put("a", "v3"));
+  ASSERT_EQ("[ v3, value2, v1 ]", AllEntriesFor("a"));
+  ASSERT_EQ("value2", Get("a", snapshot));
+  db_->ReleaseSnapshot(snapshot);
+
+  // So are values put while an iterator is alive, which keeps seeing the
+  // old value
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  ASSERT_OK(Put("a", "v9"));
+  iter->Seek("a");
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("v3", iter->value().ToString());
+  delete iter;
+  ASSERT_EQ("[ v9, v3, value2, v1 ]", AllEntriesFor("a"));
+  ASSERT_OK(Put("a", "v0"));
+  ASSERT_EQ("[ v0, v3, value2, v1 ]", AllEntriesFor("a"));
+
+  // Neither deletions nor values hidden by range tombstones are replaced
+  ASSERT_OK(Delete("a"));
+  ASSERT_OK(Put("a", "v4"));
+  ASSERT_EQ("v4", Get("a"));
+  ASSERT_OK(Put("b", "v5"));
+  ASSERT_OK(DeleteRange("b", "c"));
+  ASSERT_OK(Put("b", "v6"));
+  ASSERT_EQ("v6", Get("b"));
+  ASSERT_EQ("(a->v4)(b->v6)", Contents());
+
+  // Recovery from the log updates in place too
+  ASSERT_OK(Put("c", "v7"));
+  ASSERT_OK(Put("c", "v8"));
+  Reopen(&options);
+  ASSERT_EQ("[ v8 ]", AllEntriesFor("c"));
+  ASSERT_EQ("(a->v4)(b->v6)(c->v8)", Contents());
+}
+
+namespace {
+struct SnapshotThread {
+  DB* db;
+  const Snapshot* snapshot;
+  std::string value;  // Value of "sync0" read when the snapshot was taken
+  port::AtomicPointer done;
+};
+
+static void SnapshotThreadBody(void* arg) {
+  SnapshotThread* t = reinterpret_cast<SnapshotThread*>(arg);
+  t->snapshot = t->db->GetSnapshot();
+  ReadOptions options;
+  options.snapshot = t->snapshot;
+  ASSERT_OK(t->db->Get(options, "sync0", &t->value));
+  t->done.Release_Store(t);
+}
+}  // namespace
+
+TEST(DBTest, InplaceUpdateConcurrentSnapshot) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.inplace_update_support = true;
+  Reopen(&options);
+  ASSERT_OK(Put("sync0", "x"));
+
+  // Take a snapshot while an in-place write is held up in its log sync
+  env_->delay_data_sync_.Release_Store(env_);
+  SyncWriteThread writer;
+  writer.db = db_;
+  writer.id = 0;
+  writer.done.Release_Store(NULL);
+  env_->StartThread(SyncWriteThreadBody, &writer);
+  DelayMilliseconds(100);  // Let the writer reach the sync
+  SnapshotThread reader;
+  reader.db = db_;
+  reader.done.Release_Store(NULL);
+  env_->StartThread(SnapshotThreadBody, &reader);
+  DelayMilliseconds(100);
+  env_->delay_data_sync_.Release_Store(NULL);
+  while (writer.done.Acquire_Load() == NULL ||
+         reader.done.Acquire_Load() == NULL) {
+    DelayMilliseconds(10);
+  }
+
+  // The write was done in place, and the snapshot still reads the value
+  // it read when taken.
+  ASSERT_EQ("[ v ]", AllEntriesFor("sync0"));
+  ReadOptions ropts;
+  ropts.snapshot = reader.snapshot;
+  std::string value;
+  ASSERT_OK(db_->Get(ropts, "sync0", &value));
+  ASSERT_EQ(reader.value, value);
+  db_->ReleaseSnapshot(reader.snapshot);
+}
+
+TEST(DBTest, LargeArenaBlocks) {
+  // Blocks as large as the write buffer would make every write switch to
+  // a new memtable, which fails while no file can be created.
+  for (int huge_pages = 0; huge_pages < 2; huge_pages++) {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.env = env_;
+    options.write_buffer_size = 1 << 20;
+    options.arena_block_size = 64 << 20;
+    options.memtable_huge_page_size = huge_pages ? (2 << 20) : 0;
+    DestroyAndReopen(&options);
+    env_->non_writable_.Release_Store(env_);
+    for (int i = 0; i < 100; i++) {
+      char key[10];
+      snprintf(key, sizeof(key), "key%03d", i);
+      ASSERT_OK(Put(key, std::string(100, 'v')));
+    }
+    env_->non_writable_.Release_Store(NULL);
+  }
+}
+
+TEST(DBTest, DeleteFilesInRange) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+
+  ASSERT_OK(Put("a", "1"));
+  ASSERT_OK(Put("b", "2"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Put("c", "3"));
+  ASSERT_OK(Put("d", "4"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Put("e", "5"));
+  ASSERT_OK(Put("f", "6"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Put("e", "5b"));
+  ASSERT_EQ("0,0,3", FilesPerLevel());
+
+  // Files that cross the bounds and memtables are left alone
+  Slice begin("b"), end("f");
+  ASSERT_OK(db_->DeleteFilesInRange(&begin, &end));
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+  ASSERT_EQ("(a->1)(b->2)(e->5b)", Contents());
+
+  Reopen(&options);
+  ASSERT_EQ("(a->1)(b->2)(e->5b)", Contents());
+  ASSERT_OK(db_->DeleteFilesInRange(NULL, NULL));
+  ASSERT_EQ("1", FilesPerLevel());
+  ASSERT_EQ("(e->5b)", Contents());
+}
+
+TEST(DBTest, DeleteFilesInRangeExposesOlderValues) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+
+  ASSERT_OK(Put("a", "1"));
+  ASSERT_OK(Put("k", "v1"));
+  ASSERT_OK(Put("z", "1"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Put("k", "v2"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+  ASSERT_EQ("v2", Get("k"));
+
+  // Only the newer file lies inside the range; the older value it hid
+  // becomes visible again
+  Slice begin("j"), end("l");
+  ASSERT_OK(db_->DeleteFilesInRange(&begin, &end));
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+  ASSERT_EQ("v1", Get("k"));
+  ASSERT_EQ("(a->1)(k->v1)(z->1)", Contents());
+}
+
 // Multi-threaded test:
 namespace {
 
@@ -1907,6 +3149,12 @@ class ModelDB: public DB {
       virtual void Delete(const Slice& key) {
         map_->erase(key.ToString());
       }
+      virtual void DeleteRange(const Slice& begin_key, const Slice& end_key) {
+        if (begin_key.compare(end_key) < 0) {
+          map_->erase(map_->lower_bound(begin_key.ToString()),
+                      map_->lower_bound(end_key.ToString()));
+        }
+      }
     };
     Handler handler;
     handler.map_ = &map_;
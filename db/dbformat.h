@@ -10,6 +10,7 @@
 #include "leveldb/db.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/slice.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table_builder.h"
 #include "util/coding.h"
 #include "util/logging.h"
@@ -30,6 +31,12 @@ static const int kL0_SlowdownWritesTrigger = 8;
 // Maximum number of level-0 files.  We stop writes at this point.
 static const int kL0_StopWritesTrigger = 12;
 
+// Writes are slowed down once the levels above level-0 exceed their size
+// targets by this many bytes in total, and are admitted at the slowest
+// rate once they exceed them by kPendingCompactionBytesLimit.
+static const uint64_t kPendingCompactionBytesSlowdown = 64 << 20;
+static const uint64_t kPendingCompactionBytesLimit = 256 << 20;
+
 // Maximum level to which a new compacted memtable is pushed if it
 // does not create overlap.  We try to push to level 2 to avoid the
 // relatively expensive level 0=>1 compactions and to avoid some
@@ -50,7 +57,10 @@ class InternalKey;
 // data structures.
 enum ValueType {
   kTypeDeletion = 0x0,
-  kTypeValue = 0x1
+  kTypeValue = 0x1,
+  kTypeMerge = 0x2,   // An operand for Options::merge_operator
+  kTypeRangeDeletion = 0x3,  // Deletes a key range; see db/range_del.h
+  kTypeSingleDeletion = 0x4  // Deletes a key put at most once
 };
 // kValueTypeForSeek defines the ValueType that should be passed when
 // constructing a ParsedInternalKey object for seeking to a particular
@@ -58,7 +68,7 @@ enum ValueType {
 // and the value type is embedded as the low 8 bits in the sequence
 // number in internal keys, we need to use the highest-numbered
 // ValueType, not the lowest).
-static const ValueType kValueTypeForSeek = kTypeValue;
+static const ValueType kValueTypeForSeek = kTypeSingleDeletion;
 
 typedef uint64_t SequenceNumber;
 
@@ -138,6 +148,23 @@ class InternalFilterPolicy : public FilterPolicy {
   virtual bool KeyMayMatch(const Slice& key, const Slice& filter) const;
 };
 
+// A prefix extractor wrapper that applies the user's to internal keys.
+// An internal key is mapped to an internal key whose user key is the
+// prefix: the prefix followed by the 8 bytes after it, which
+// InternalFilterPolicy ignores like any other sequence and type.
+class InternalKeySliceTransform : public SliceTransform {
+ private:
+  const SliceTransform* const user_transform_;
+ public:
+  explicit InternalKeySliceTransform(const SliceTransform* t)
+      : user_transform_(t) { }
+  virtual const char* Name() const;
+  virtual Slice Transform(const Slice& key) const;
+  virtual bool InDomain(const Slice& key) const;
+
+  const SliceTransform* user_transform() const { return user_transform_; }
+};
+
 // Modules in this directory should keep internal keys wrapped inside
 // the following class instead of plain strings so that we do not
 // incorrectly use string comparisons instead of an InternalKeyComparator.
@@ -182,7 +209,7 @@ inline bool ParseInternalKey(const Slice& internal_key,
   result->sequence = num >> 8;
   result->type = static_cast<ValueType>(c);
   result->user_key = Slice(internal_key.data(), n - 8);
-  return (c <= static_cast<unsigned char>(kTypeValue));
+  return (c <= static_cast<unsigned char>(kTypeSingleDeletion));
 }
 
 // A helper class useful for DBImpl::Get()
@@ -392,13 +392,16 @@ class FaultInjectionTest {
   }
 
   void Build(int start_idx, int num_vals) {
+    Build(start_idx, num_vals, WriteOptions());
+  }
+
+  void Build(int start_idx, int num_vals, const WriteOptions& options) {
     std::string key_space, value_space;
     WriteBatch batch;
     for (int i = start_idx; i < start_idx + num_vals; i++) {
       Slice key = Key(i, &key_space);
       batch.Clear();
       batch.Put(key, Value(i, &value_space));
-      WriteOptions options;
       ASSERT_OK(db_->Write(options, &batch));
     }
   }
@@ -547,6 +550,41 @@ TEST(FaultInjectionTest, FaultTestWithLogReuse) {
   DoTest();
 }
 
+TEST(FaultInjectionTest, FaultTestMixedWALAndNoWAL) {
+  WriteOptions no_wal;
+  no_wal.disable_wal = true;
+  WriteOptions sync;
+  sync.sync = true;
+
+  // Unlogged writes are lost in a crash, logged ones around them are not
+  ReuseLogs(false);
+  ASSERT_OK(OpenDB());
+  Build(0, 100, no_wal);
+  Build(100, 100, sync);
+  Build(200, 100, no_wal);
+  Build(300, 1, sync);
+  env_->SetFilesystemActive(false);
+  CloseDB();
+  ResetDBState(RESET_DROP_UNSYNCED_DATA);
+  ASSERT_OK(OpenDB());
+  ASSERT_OK(Verify(0, 100, VAL_EXPECT_ERROR));
+  ASSERT_OK(Verify(100, 100, VAL_EXPECT_NO_ERROR));
+  ASSERT_OK(Verify(200, 100, VAL_EXPECT_ERROR));
+  ASSERT_OK(Verify(300, 1, VAL_EXPECT_NO_ERROR));
+
+  // Flush() makes unlogged writes durable
+  Build(400, 100, no_wal);
+  ASSERT_OK(db_->Flush());
+  Build(500, 100, no_wal);
+  env_->SetFilesystemActive(false);
+  CloseDB();
+  ResetDBState(RESET_DROP_UNSYNCED_DATA);
+  ASSERT_OK(OpenDB());
+  ASSERT_OK(Verify(100, 100, VAL_EXPECT_NO_ERROR));
+  ASSERT_OK(Verify(400, 100, VAL_EXPECT_NO_ERROR));
+  ASSERT_OK(Verify(500, 100, VAL_EXPECT_ERROR));
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -0,0 +1,198 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/memtablerep.h"
+
+#include <new>
+#include "db/dbformat.h"
+#include "db/skiplist.h"
+#include "leveldb/slice_transform.h"
+#include "port/port.h"
+#include "util/arena.h"
+#include "util/coding.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+namespace {
+
+class HashSkipListRep : public MemTableRep {
+ public:
+  HashSkipListRep(const MemTableRep::KeyComparator& cmp, Arena* arena,
+                  const SliceTransform* transform, size_t bucket_count);
+  virtual ~HashSkipListRep();
+
+  virtual void Insert(const char* entry);
+
+  virtual size_t ApproximateMemoryUsage() {
+    // Bucket lists are allocated from the arena.  The bucket array is a
+    // fixed per-memtable cost and is not counted.
+    return 0;
+  }
+
+  virtual MemTableRep::Iterator* GetIterator();
+  virtual const char* Lookup(const Slice& internal_key,
+                             const char* memtable_key);
+
+ private:
+  typedef SkipList<const char*, const MemTableRep::KeyComparator&> Bucket;
+
+  class Iterator;
+
+  const MemTableRep::KeyComparator& compare_;
+  Arena* const arena_;
+  const SliceTransform* const transform_;
+  const size_t bucket_count_;
+
+  // Array of bucket_count_ Bucket pointers.  A bucket is created by the
+  // first Insert() that hashes to it and published with a release store
+  // so that concurrent readers see it fully constructed.
+  port::AtomicPointer* buckets_;
+
+  // Return the part of "user_key" that selects its bucket
+  Slice BucketKey(const Slice& user_key) const {
+    return transform_->InDomain(user_key) ?
+        transform_->Transform(user_key) : user_key;
+  }
+
+  size_t BucketIndex(const Slice& user_key) const {
+    Slice k = BucketKey(user_key);
+    return Hash(k.data(), k.size(), 0) % bucket_count_;
+  }
+
+  Bucket* GetBucket(size_t i) const {
+    return reinterpret_cast<Bucket*>(buckets_[i].Acquire_Load());
+  }
+
+  static Slice EntryUserKey(const char* entry) {
+    uint32_t len;
+    const char* p = GetVarint32Ptr(entry, entry + 5, &len);
+    return ExtractUserKey(Slice(p, len));
+  }
+
+  // No copying allowed
+  HashSkipListRep(const HashSkipListRep&);
+  void operator=(const HashSkipListRep&);
+};
+
+// Iterates over a merged copy of every bucket.
+class HashSkipListRep::Iterator : public MemTableRep::Iterator {
+ public:
+  // Takes ownership of "list" and of "arena", from which it is allocated
+  Iterator(Bucket* list, Arena* arena)
+      : list_(list), arena_(arena), iter_(list) {
+  }
+
+  virtual ~Iterator() {
+    delete list_;
+    delete arena_;
+  }
+
+  virtual bool Valid() const { return iter_.Valid(); }
+  virtual const char* key() const { return iter_.key(); }
+  virtual void Next() { iter_.Next(); }
+  virtual void Prev() { iter_.Prev(); }
+  virtual void SeekToFirst() { iter_.SeekToFirst(); }
+  virtual void SeekToLast() { iter_.SeekToLast(); }
+  virtual void Seek(const Slice& internal_key, const char* memtable_key) {
+    iter_.Seek(memtable_key);
+  }
+
+ private:
+  Bucket* const list_;
+  Arena* const arena_;
+  Bucket::Iterator iter_;
+};
+
+HashSkipListRep::HashSkipListRep(const MemTableRep::KeyComparator& cmp,
+                                 Arena* arena,
+                                 const SliceTransform* transform,
+                                 size_t bucket_count)
+    : compare_(cmp),
+      arena_(arena),
+      transform_(transform),
+      bucket_count_(bucket_count > 0 ? bucket_count : 1) {
+  buckets_ = new port::AtomicPointer[bucket_count_];
+  for (size_t i = 0; i < bucket_count_; i++) {
+    buckets_[i].NoBarrier_Store(NULL);
+  }
+}
+
+HashSkipListRep::~HashSkipListRep() {
+  // The buckets themselves live in the arena
+  for (size_t i = 0; i < bucket_count_; i++) {
+    Bucket* bucket = GetBucket(i);
+    if (bucket != NULL) {
+      bucket->~Bucket();
+    }
+  }
+  delete[] buckets_;
+}
+
+void HashSkipListRep::Insert(const char* entry) {
+  const size_t i = BucketIndex(EntryUserKey(entry));
+  Bucket* bucket = GetBucket(i);
+  if (bucket == NULL) {
+    char* mem = arena_->AllocateAligned(sizeof(Bucket));
+    bucket = new (mem) Bucket(compare_, arena_);
+    buckets_[i].Release_Store(bucket);
+  }
+  bucket->Insert(entry);
+}
+
+MemTableRep::Iterator* HashSkipListRep::GetIterator() {
+  // Merge every bucket into a new list that the iterator owns
+  Arena* arena = new Arena;
+  Bucket* list = new Bucket(compare_, arena);
+  for (size_t i = 0; i < bucket_count_; i++) {
+    Bucket* bucket = GetBucket(i);
+    if (bucket != NULL) {
+      Bucket::Iterator iter(bucket);
+      for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+        list->Insert(iter.key());
+      }
+    }
+  }
+  return new Iterator(list, arena);
+}
+
+const char* HashSkipListRep::Lookup(const Slice& internal_key,
+                                    const char* memtable_key) {
+  // Only the bucket of the lookup key can hold entries for its user key
+  Bucket* bucket = GetBucket(BucketIndex(ExtractUserKey(internal_key)));
+  if (bucket == NULL) {
+    return NULL;
+  }
+  Bucket::Iterator iter(bucket);
+  iter.Seek(memtable_key);
+  return iter.Valid() ? iter.key() : NULL;
+}
+
+class HashSkipListRepFactory : public MemTableRepFactory {
+ public:
+  HashSkipListRepFactory(const SliceTransform* transform, size_t bucket_count)
+      : transform_(transform),
+        bucket_count_(bucket_count) {
+  }
+
+  virtual const char* Name() const { return "HashSkipListRepFactory"; }
+
+  virtual MemTableRep* CreateMemTableRep(
+      const MemTableRep::KeyComparator& cmp, Arena* arena) const {
+    return new HashSkipListRep(cmp, arena, transform_, bucket_count_);
+  }
+
+ private:
+  const SliceTransform* const transform_;
+  const size_t bucket_count_;
+};
+
+}  // namespace
+
+MemTableRepFactory* NewHashSkipListRepFactory(
+    const SliceTransform* transform, size_t bucket_count) {
+  return new HashSkipListRepFactory(transform, bucket_count);
+}
+
+}  // namespace leveldb
@@ -40,8 +40,12 @@ class Reader {
   //
   // The Reader will start reading at the first record located at physical
   // position >= initial_offset within the file.
+  //
+  // "log_number" is the number of the log being read.  Recyclable
+  // records tagged with any other number were left behind by an earlier
+  // use of the file and mark the end of the log.
   Reader(SequentialFile* file, Reporter* reporter, bool checksum,
-         uint64_t initial_offset);
+         uint64_t initial_offset, uint64_t log_number);
 
   ~Reader();
 
@@ -78,6 +82,13 @@ class Reader {
   // skipped in this mode
   bool resyncing_;
 
+  uint64_t const log_number_;
+
+  // True once a recyclable record of this log has been read.  From then
+  // on a record that fails to parse is taken to be the stale tail of a
+  // recycled file rather than a corruption.
+  bool recycled_;
+
   // Extend record types with the following special values
   enum {
     kEof = kMaxRecordType + 1,
@@ -86,7 +97,10 @@ class Reader {
     // * The record has an invalid CRC (ReadPhysicalRecord reports a drop)
     // * The record is a 0-length record (No drop is reported)
     // * The record is below constructor's initial_offset (No drop is reported)
-    kBadRecord = kMaxRecordType + 2
+    kBadRecord = kMaxRecordType + 2,
+    // Returned when we find a record left behind by an earlier use of a
+    // recycled log file.  Treated as the end of the log.
+    kOldRecord = kMaxRecordType + 3
   };
 
   // Skips all blocks that are completely before "initial_offset_".
@@ -106,6 +106,7 @@ class LogTest {
   bool reading_;
   Writer* writer_;
   Reader* reader_;
+  std::string stale_contents_;  // Left behind by a recycled log
 
   // Record metadata for testing initial offset functionality
   static size_t initial_offset_record_sizes_[];
@@ -115,7 +116,7 @@ class LogTest {
   LogTest() : reading_(false),
               writer_(new Writer(&dest_)),
               reader_(new Reader(&source_, &report_, true/*checksum*/,
-                      0/*initial_offset*/)) {
+                      0/*initial_offset*/, 0/*log_number*/)) {
   }
 
   ~LogTest() {
@@ -128,11 +129,41 @@ class LogTest {
     writer_ = new Writer(&dest_, dest_.contents_.size());
   }
 
+  // Start over with an empty log numbered "log_number" that uses the
+  // recyclable format.
+  void UseRecyclableFormat(uint64_t log_number) {
+    delete writer_;
+    delete reader_;
+    dest_.contents_.clear();
+    writer_ = new Writer(&dest_, log_number, true);
+    reader_ = new Reader(&source_, &report_, true/*checksum*/,
+                         0/*initial_offset*/, log_number);
+  }
+
+  // Reuse the current log as log number "log_number": new records
+  // overwrite the old ones from the start of the file.
+  void RecycleLog(uint64_t log_number) {
+    stale_contents_ = dest_.contents_;
+    UseRecyclableFormat(log_number);
+  }
+
   void Write(const std::string& msg) {
     ASSERT_TRUE(!reading_) << "Write() after starting to read";
     writer_->AddRecord(Slice(msg));
   }
 
+  void SetManualFlush(size_t flush_threshold) {
+    writer_->SetManualFlush(flush_threshold);
+  }
+
+  Status WriteBuffer() {
+    return writer_->WriteBuffer();
+  }
+
+  size_t BufferedBytes() const {
+    return writer_->BufferedBytes();
+  }
+
   size_t WrittenBytes() const {
     return dest_.contents_.size();
   }
@@ -140,6 +171,10 @@ class LogTest {
   std::string Read() {
     if (!reading_) {
       reading_ = true;
+      if (stale_contents_.size() > dest_.contents_.size()) {
+        dest_.contents_.append(stale_contents_, dest_.contents_.size(),
+                               std::string::npos);
+      }
       source_.contents_ = Slice(dest_.contents_);
     }
     std::string scratch;
@@ -201,7 +236,8 @@ class LogTest {
 
   void StartReadingAt(uint64_t initial_offset) {
     delete reader_;
-    reader_ = new Reader(&source_, &report_, true/*checksum*/, initial_offset);
+    reader_ = new Reader(&source_, &report_, true/*checksum*/, initial_offset,
+                         0/*log_number*/);
   }
 
   void CheckOffsetPastEndReturnsNoRecords(uint64_t offset_past_end) {
@@ -209,7 +245,8 @@ class LogTest {
     reading_ = true;
     source_.contents_ = Slice(dest_.contents_);
     Reader* offset_reader = new Reader(&source_, &report_, true/*checksum*/,
-                                       WrittenBytes() + offset_past_end);
+                                       WrittenBytes() + offset_past_end,
+                                       0/*log_number*/);
     Slice record;
     std::string scratch;
     ASSERT_TRUE(!offset_reader->ReadRecord(&record, &scratch));
@@ -222,7 +259,7 @@ class LogTest {
     reading_ = true;
     source_.contents_ = Slice(dest_.contents_);
     Reader* offset_reader = new Reader(&source_, &report_, true/*checksum*/,
-                                       initial_offset);
+                                       initial_offset, 0/*log_number*/);
     Slice record;
     std::string scratch;
     ASSERT_TRUE(offset_reader->ReadRecord(&record, &scratch));
@@ -561,6 +598,95 @@ TEST(LogTest, ReadPastEnd) {
   CheckOffsetPastEndReturnsNoRecords(5);
 }
 
+TEST(LogTest, RecyclableFormat) {
+  UseRecyclableFormat(7);
+  Write("small");
+  Write(BigString("medium", 50000));
+  Write(BigString("large", 100000));
+  Write("");
+  ASSERT_EQ("small", Read());
+  ASSERT_EQ(BigString("medium", 50000), Read());
+  ASSERT_EQ(BigString("large", 100000), Read());
+  ASSERT_EQ("", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST(LogTest, RecyclableBlockTrailer) {
+  // Leave fewer than kRecyclableHeaderSize bytes in the first block
+  UseRecyclableFormat(7);
+  const int n = kBlockSize - 2*kRecyclableHeaderSize + 4;
+  Write(BigString("foo", n));
+  ASSERT_EQ(kBlockSize - kRecyclableHeaderSize + 4, WrittenBytes());
+  Write("");
+  Write("bar");
+  ASSERT_EQ(BigString("foo", n), Read());
+  ASSERT_EQ("", Read());
+  ASSERT_EQ("bar", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST(LogTest, RecycledLogIgnoresStaleTail) {
+  UseRecyclableFormat(7);
+  for (int i = 0; i < 10; i++) {
+    Write(BigString(NumberString(i), 9000));
+  }
+  RecycleLog(8);
+  Write("new1");
+  Write(BigString("new2", 40000));
+  ASSERT_EQ("new1", Read());
+  ASSERT_EQ(BigString("new2", 40000), Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST(LogTest, RecycledLogTornWrite) {
+  // The stale tail starts in the middle of an old record
+  UseRecyclableFormat(7);
+  Write(BigString("old", 100000));
+  RecycleLog(8);
+  Write("new1");
+  Write("new2");
+  ASSERT_EQ("new1", Read());
+  ASSERT_EQ("new2", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST(LogTest, RecyclableChecksumCoversLogNumber) {
+  UseRecyclableFormat(7);
+  Write("foo");
+  IncrementByte(kHeaderSize, 1);  // First byte of the log number
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(kRecyclableHeaderSize + 3, DroppedBytes());
+  ASSERT_EQ("OK", MatchError("checksum mismatch"));
+}
+
+TEST(LogTest, ManualFlush) {
+  SetManualFlush(2 * kBlockSize);
+  Write("foo");
+  Write(BigString("bar", 10000));
+  ASSERT_EQ(0, WrittenBytes());
+  ASSERT_OK(WriteBuffer());
+  ASSERT_EQ(2 * kHeaderSize + 10003, WrittenBytes());
+  ASSERT_EQ(0, BufferedBytes());
+
+  // Going over the threshold writes the buffer out
+  Write(BigString("baz", 2 * kBlockSize));
+  ASSERT_EQ(0, BufferedBytes());
+  Write("qux");
+  ASSERT_EQ(kHeaderSize + 3, BufferedBytes());
+  ASSERT_OK(WriteBuffer());
+
+  ASSERT_EQ("foo", Read());
+  ASSERT_EQ(BigString("bar", 10000), Read());
+  ASSERT_EQ(BigString("baz", 2 * kBlockSize), Read());
+  ASSERT_EQ("qux", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
 }  // namespace log
 }  // namespace leveldb
 
@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_DB_LOG_WRITER_H_
 
 #include <stdint.h>
+#include <string>
 #include "db/log_format.h"
 #include "leveldb/slice.h"
 #include "leveldb/status.h"
@@ -28,13 +29,37 @@ class Writer {
   // "*dest" must remain live while this Writer is in use.
   Writer(WritableFile* dest, uint64_t dest_length);
 
+  // Create a writer that will write data to "*dest" from its start,
+  // using the recyclable record format if "recycle_log_files" is true.
+  // Recyclable records are tagged with "log_number", so that a Reader
+  // ignores whatever a previous use of the file left behind the new
+  // records.  "*dest" must remain live while this Writer is in use.
+  Writer(WritableFile* dest, uint64_t log_number, bool recycle_log_files);
+
   ~Writer();
 
   Status AddRecord(const Slice& slice);
 
+  // Keep records in memory instead of flushing "*dest" after each one.
+  // Buffered records are handed to "*dest" by WriteBuffer(), or by
+  // AddRecord() once at least "flush_threshold" bytes are buffered.
+  // Must be called before the first AddRecord().
+  void SetManualFlush(size_t flush_threshold);
+
+  // Append all buffered records to "*dest" and flush it.
+  Status WriteBuffer();
+
+  // Number of bytes added but not yet handed to "*dest".
+  size_t BufferedBytes() const { return buffer_.size(); }
+
  private:
   WritableFile* dest_;
   int block_offset_;       // Current offset in block
+  uint64_t log_number_;
+  bool recycle_log_files_;
+  bool manual_flush_;
+  size_t flush_threshold_;
+  std::string buffer_;     // Records not yet appended to dest_
 
   // crc32c values for all supported record types.  These are
   // pre-computed to reduce the overhead of computing the crc of the
@@ -42,6 +67,7 @@ class Writer {
   uint32_t type_crc_[kMaxRecordType + 1];
 
   Status EmitPhysicalRecord(RecordType type, const char* ptr, size_t length);
+  Status Append(const Slice& data);
 
   // No copying allowed
   Writer(const Writer&);
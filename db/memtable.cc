@@ -1,9 +1,15 @@
 #include "db/memtable.h"
 #include "db/dbformat.h"
+#include "db/merge_helper.h"
+#include "db/range_del.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "port/port.h"
 #include "util/coding.h"
+#include "util/dynamic_bloom.h"
+#include "util/hash.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
@@ -20,28 +26,67 @@ static Slice GetLengthPrefixedSlice(const char* data) {
     //
     // 所以，前32bit位(4-byte,< 5)记录中data的长度(key或value)
 
-    // for debug
-    printf("%s:%d p: %s\n",__FILE__,__LINE__,p);
-
     p = GetVarint32Ptr(p, p+5, &len);
+    return Slice(p, len);
+}
 
-    // for debug
-    printf("%s:%d Getvarint32ptr-p: %s, len:%d\n",__FILE__,__LINE__,p,len);
+static port::OnceType once = LEVELDB_ONCE_INIT;
+static const MemTableRepFactory* default_factory;
 
-    return Slice(p, len);
+static void InitModule() {
+    default_factory = NewSkipListRepFactory();
 }
 
 MemTable::MemTable(const InternalKeyComparator& cmp)
     : comparator_(cmp),
       refs_(0),
-      table_(comparator_, &arena_) {
+      has_range_tombstones_(NULL),
+      stripes_(NULL),
+      bloom_(NULL) {
+    port::InitOnce(&once, InitModule);
+    table_ = default_factory->CreateMemTableRep(comparator_, &arena_);
+    range_del_table_ = default_factory->CreateMemTableRep(comparator_, &arena_);
+}
+
+MemTable::MemTable(const InternalKeyComparator& cmp, const Options& options)
+    : comparator_(cmp),
+      refs_(0),
+      arena_(options.arena_block_size, options.memtable_huge_page_size),
+      has_range_tombstones_(NULL),
+      stripes_(NULL),
+      bloom_(NULL) {
+    port::InitOnce(&once, InitModule);
+    const MemTableRepFactory* factory = options.memtable_factory;
+    if (factory == NULL) {
+        factory = default_factory;
+    }
+    if (options.inplace_update_support) {
+        stripes_ = new UpdateStripe[kNumUpdateStripes];
+    }
+    if (options.memtable_bloom_size_ratio > 0) {
+        // Six probes suit the ten or so bits per key that a ratio of a
+        // few percent leaves for small entries.
+        const size_t bits = static_cast<size_t>(
+            options.write_buffer_size * options.memtable_bloom_size_ratio *
+            8);
+        bloom_ = new DynamicBloom(&arena_, bits, 6);
+    }
+    table_ = factory->CreateMemTableRep(comparator_, &arena_);
+    range_del_table_ = default_factory->CreateMemTableRep(comparator_, &arena_);
 }
 
 MemTable::~MemTable() {
     assert(refs_ == 0);
+    delete table_;
+    delete range_del_table_;
+    delete[] stripes_;
+    delete bloom_;
 }
 
-size_t MemTable::ApproximateMemoryUsage() { return arena_.MemoryUsage(); }
+size_t MemTable::ApproximateMemoryUsage() {
+    return arena_.MemoryUsage() + table_->ApproximateMemoryUsage() +
+           range_del_table_->ApproximateMemoryUsage();
+}
 
 int MemTable::KeyComparator::operator()(const char* aptr,const char* bptr)
     const {
@@ -56,22 +101,33 @@ int MemTable::KeyComparator::operator()(const char* aptr,const char* bptr)
 static const char* EncodeKey(std::string* scratch, const Slice& target) {
     scratch->clear();
     PutVarint32(scratch, target.size());
+    scratch->append(target.data(), target.size());
     return scratch->data();
 }
 
 class MemTableIterator: public Iterator {
 public:
-    explicit MemTableIterator(MemTable::Table* table) : iter_(table) { }
-
-    virtual bool Valid() const { return iter_.Valid(); }
-    virtual void Seek(const Slice& k) { iter_.Seek(EncodeKey(&tmp_, k)); }
-    virtual void SeekToFirst() { iter_.SeekToFirst(); }
-    virtual void SeekToLast() { iter_.SeekToLast(); }
-    virtual void Next() { iter_.Next(); }
-    virtual void Prev() { iter_.Prev(); }
-    virtual Slice key() const { return GetLengthPrefixedSlice(iter_.key()); }
+    // If "mem" is not NULL, values are copied under the lock of their
+    // stripe, since they may be updated in place.
+    MemTableIterator(MemTableRep* table, const MemTable* mem)
+        : iter_(table->GetIterator()), mem_(mem) { }
+    virtual ~MemTableIterator() { delete iter_; }
+
+    virtual bool Valid() const { return iter_->Valid(); }
+    virtual void Seek(const Slice& k) { iter_->Seek(k, EncodeKey(&tmp_, k)); }
+    virtual void SeekToFirst() { iter_->SeekToFirst(); }
+    virtual void SeekToLast() { iter_->SeekToLast(); }
+    virtual void Next() { iter_->Next(); }
+    virtual void Prev() { iter_->Prev(); }
+    virtual Slice key() const { return GetLengthPrefixedSlice(iter_->key()); }
     virtual Slice value() const {
-        Slice key_slice = GetLengthPrefixedSlice(iter_.key());
+        Slice key_slice = GetLengthPrefixedSlice(iter_->key());
+        if (mem_ != NULL) {
+            MutexLock l(&mem_->GetStripe(ExtractUserKey(key_slice))->mu);
+            value_ = GetLengthPrefixedSlice(
+                key_slice.data() + key_slice.size()).ToString();
+            return value_;
+        }
         // 在write_batch.cc中定义
         return GetLengthPrefixedSlice(key_slice.data() + key_slice.size());
     }
@@ -79,20 +135,32 @@ public:
     virtual Status status() const { return Status::OK(); }
 
 private:
-    MemTable::Table::Iterator iter_;
+    MemTableRep::Iterator* iter_;
+    const MemTable* mem_;
     std::string tmp_;
+    mutable std::string value_;
 
     MemTableIterator(const MemTableIterator&);
     void operator=(const MemTableIterator&);
 };
 
 Iterator* MemTable::NewIterator() {
-    return new MemTableIterator(&table_);
+    return new MemTableIterator(table_, stripes_ != NULL ? this : NULL);
 }
 
-void MemTable::Add(SequenceNumber s, ValueType type,
-                   const Slice& key,
-                   const Slice& value) {
+Iterator* MemTable::NewRangeTombstoneIterator() {
+    return new MemTableIterator(range_del_table_, NULL);
+}
+
+MemTable::UpdateStripe* MemTable::GetStripe(const Slice& user_key) const {
+    return &stripes_[Hash(user_key.data(), user_key.size(), 0) %
+                     kNumUpdateStripes];
+}
+
+char* MemTable::EncodeEntry(SequenceNumber s, ValueType type,
+                            const Slice& key,
+                            const Slice& value,
+                            bool concurrent) {
      // Format of an entry is concatenation of:
      // key_size     : varint32 of internal_key.size()
      // key bytes    : char[internal_key.size()]
@@ -106,7 +174,8 @@ void MemTable::Add(SequenceNumber s, ValueType type,
     const size_t encoded_len =
         VarintLength(internal_key_size) + internal_key_size + 
         VarintLength(val_size) + val_size;
-    char* buf = arena_.Allocate(encoded_len);
+    char* buf = concurrent ? arena_.AllocateConcurrently(encoded_len)
+                           : arena_.Allocate(encoded_len);
     char* p = EncodeVarint32(buf, internal_key_size);
     memcpy(p, key.data(), key_size);
     p += key_size;
@@ -115,43 +184,224 @@ void MemTable::Add(SequenceNumber s, ValueType type,
     p = EncodeVarint32(p, val_size);
     memcpy(p, value.data(), val_size);
     assert((p + val_size) - buf == encoded_len);
-    table_.Insert(buf); // Insert(.) defined in skiplist.h
+    return buf;
 }
 
-bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
+void MemTable::Add(SequenceNumber s, ValueType type,
+                   const Slice& key,
+                   const Slice& value) {
+    if (type == kTypeRangeDeletion) {
+        range_del_table_->Insert(EncodeEntry(s, type, key, value, false));
+        has_range_tombstones_.Release_Store(this);
+    } else {
+        // The filter is updated first, so readers that find the entry
+        // also find its key in the filter.
+        if (bloom_ != NULL) {
+            bloom_->Add(key);
+        }
+        table_->Insert(EncodeEntry(s, type, key, value, false));
+    }
+}
+
+void MemTable::AddConcurrently(SequenceNumber s, ValueType type,
+                               const Slice& key,
+                               const Slice& value) {
+    if (type == kTypeRangeDeletion) {
+        range_del_table_->InsertConcurrently(
+            EncodeEntry(s, type, key, value, true));
+        has_range_tombstones_.Release_Store(this);
+    } else {
+        if (bloom_ != NULL) {
+            bloom_->AddConcurrently(key);
+        }
+        table_->InsertConcurrently(EncodeEntry(s, type, key, value, true));
+    }
+}
+
+bool MemTable::Update(SequenceNumber s, const Slice& key,
+                      const Slice& value) {
+    assert(stripes_ != NULL);
+    if (bloom_ != NULL && !bloom_->MayContain(key)) {
+        return false;
+    }
+    LookupKey lkey(key, kMaxSequenceNumber);
+    Slice memkey = lkey.memtable_key();
+    const char* entry = table_->Lookup(lkey.internal_key(), memkey.data());
+    if (entry == NULL) {
+        return false;
+    }
+    uint32_t key_length;
+    const char* key_ptr = GetVarint32Ptr(entry, entry+5, &key_length);
+    if (comparator_.comparator.user_comparator()->Compare(
+            Slice(key_ptr, key_length - 8), key) != 0) {
+        return false;
+    }
+    const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
+    if (static_cast<ValueType>(tag & 0xff) != kTypeValue ||
+        MaxCoveringTombstone(key, kMaxSequenceNumber) > (tag >> 8)) {
+        return false;
+    }
+    Slice prev = GetLengthPrefixedSlice(key_ptr + key_length);
+    if (value.size() > prev.size()) {
+        return false;
+    }
+    // A shorter length may take fewer varint bytes; readers find the
+    // value right after it, so the value moves down with it.
+    UpdateStripe* stripe = GetStripe(key);
+    MutexLock l(&stripe->mu);
+    char* p = EncodeVarint32(const_cast<char*>(key_ptr) + key_length,
+                             value.size());
+    memcpy(p, value.data(), value.size());
+    if (s > stripe->sequence) {
+        stripe->sequence = s;
+    }
+    return true;
+}
+
+// Returns the sequence number of the newest range tombstone that covers
+// "user_key" and is no newer than "snapshot", or zero.
+SequenceNumber MemTable::MaxCoveringTombstone(const Slice& user_key,
+                                              SequenceNumber snapshot) {
+    if (!HasRangeTombstones()) {
+        return 0;
+    }
+    Iterator* iter = NewRangeTombstoneIterator();
+    SequenceNumber result = leveldb::MaxCoveringTombstone(
+        iter, comparator_.comparator.user_comparator(), user_key, snapshot);
+    delete iter;
+    return result;
+}
+
+// Store the result of a lookup that ends at a deletion.
+static void SaveDeletion(const Slice& user_key, std::string* value,
+                         Status* s, MergeContext* merge) {
+    if (merge->operands.empty()) {
+        *s = Status::NotFound(Slice());
+    } else {
+        *s = ApplyMergeOperands(merge->merge_operator, merge->logger,
+                                user_key, NULL, merge->operands, value);
+    }
+}
+
+bool MemTable::Get(const LookupKey& key, std::string* value, Status* s,
+                   MergeContext* merge) {
+    if (stripes_ == NULL) {
+        return GetUnlocked(key, value, s, merge);
+    }
+    MutexLock l(&GetStripe(key.user_key())->mu);
+    return GetUnlocked(key, value, s, merge);
+}
+
+bool MemTable::GetUnlocked(const LookupKey& key, std::string* value,
+                           Status* s, MergeContext* merge) {
     Slice memkey = key.memtable_key();
-    Table::Iterator iter(&table_);
-     iter.Seek(memkey.data());
-     if (iter.Valid()) {
-     // entry format is:
-     // klength  varint32
-     // userkey  char[klength]
-     // tag      uint64
-     // vlength  varint32
-     // value    char[vlength]
-     // Check that it belongs to same user key.  We do not check the
-     // sequence number since the Seek() call above should have skipped
-     // all entries with overly large sequence numbers.
-     const char* entry = iter.key();
-     uint32_t key_length;
-     const char* key_ptr = GetVarint32Ptr(entry, entry+5, &key_length);
-     if (comparator_.comparator.user_comparator()->Compare(
-            Slice(key_ptr, key_length - 8),
-            key.user_key()) == 0) {
-         // Correct user key
-         const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
-         switch (static_cast<ValueType>(tag & 0xff)) {
-            case kTypeValue: {
-                Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
-                value->assign(v.data(), v.size());
+    const Slice ikey = key.internal_key();
+    // Entries older than this are deleted
+    const SequenceNumber tombstone = MaxCoveringTombstone(
+        key.user_key(), DecodeFixed64(ikey.data() + ikey.size() - 8) >> 8);
+    const char* entry = NULL;
+    if (bloom_ == NULL || bloom_->MayContain(key.user_key())) {
+        entry = table_->Lookup(ikey, memkey.data());
+    }
+    while (entry != NULL) {
+        // entry format is:
+        // klength  varint32
+        // userkey  char[klength]
+        // tag      uint64
+        // vlength  varint32
+        // value    char[vlength]
+        // Check that it belongs to same user key.  We do not check the
+        // sequence number since the Lookup() call above should have skipped
+        // all entries with overly large sequence numbers.
+        uint32_t key_length;
+        const char* key_ptr = GetVarint32Ptr(entry, entry+5, &key_length);
+        if (comparator_.comparator.user_comparator()->Compare(
+                Slice(key_ptr, key_length - 8),
+                key.user_key()) != 0) {
+            break;
+        }
+        // Correct user key
+        const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
+        Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
+        ValueType type = static_cast<ValueType>(tag & 0xff);
+        if ((tag >> 8) < tombstone) {
+            type = kTypeDeletion;
+        }
+        switch (type) {
+            case kTypeValue:
+                if (merge->operands.empty()) {
+                    value->assign(v.data(), v.size());
+                } else {
+                    *s = ApplyMergeOperands(merge->merge_operator,
+                                            merge->logger, key.user_key(),
+                                            &v, merge->operands, value);
+                }
                 return true;
-            }
             case kTypeDeletion:
-                *s = Status::NotFound(Slice());
+            case kTypeSingleDeletion:
+                SaveDeletion(key.user_key(), value, s, merge);
                 return true;
-         }
-     }
- }
- return false;
+            case kTypeMerge: {
+                // Keep looking for older entries
+                merge->operands.push_front(v.ToString());
+                const SequenceNumber seq = tag >> 8;
+                entry = NULL;
+                if (seq > 0) {
+                    LookupKey older(key.user_key(), seq - 1);
+                    Slice older_memkey = older.memtable_key();
+                    entry = table_->Lookup(older.internal_key(),
+                                           older_memkey.data());
+                }
+                break;
+            }
+            case kTypeRangeDeletion:
+                assert(false);  // Kept in range_del_table_
+                return false;
+        }
+    }
+    if (tombstone != 0) {
+        SaveDeletion(key.user_key(), value, s, merge);
+        return true;
+    }
+    return false;
+}
+
+bool MemTable::GetLatestSequence(const Slice& user_key, SequenceNumber* seq) {
+    if (stripes_ == NULL) {
+        return GetLatestSequenceUnlocked(user_key, seq);
+    }
+    UpdateStripe* stripe = GetStripe(user_key);
+    MutexLock l(&stripe->mu);
+    const bool found = GetLatestSequenceUnlocked(user_key, seq);
+    // Updates in place keep the old sequence number of the entry, so
+    // assume that the key was updated as late as any key of its stripe.
+    if (found && stripe->sequence > *seq) {
+        *seq = stripe->sequence;
+    }
+    return found;
+}
+
+bool MemTable::GetLatestSequenceUnlocked(const Slice& user_key,
+                                         SequenceNumber* seq) {
+    *seq = MaxCoveringTombstone(user_key, kMaxSequenceNumber);
+    if (bloom_ != NULL && !bloom_->MayContain(user_key)) {
+        return *seq != 0;
+    }
+    LookupKey key(user_key, kMaxSequenceNumber);
+    Slice memkey = key.memtable_key();
+    const char* entry = table_->Lookup(key.internal_key(), memkey.data());
+    if (entry != NULL) {
+        uint32_t key_length;
+        const char* key_ptr = GetVarint32Ptr(entry, entry+5, &key_length);
+        if (comparator_.comparator.user_comparator()->Compare(
+                Slice(key_ptr, key_length - 8), user_key) == 0) {
+            const SequenceNumber latest =
+                DecodeFixed64(key_ptr + key_length - 8) >> 8;
+            if (latest > *seq) {
+                *seq = latest;
+            }
+        }
+    }
+    return *seq != 0;
 }
 } // namespace leveldb
@@ -3,15 +3,18 @@
 
 #include <string>
 #include "leveldb/db.h"
+#include "leveldb/memtablerep.h"
 #include "db/dbformat.h"
-#include "db/skiplist.h"
+#include "port/port.h"
 #include "util/arena.h"
 
 namespace leveldb {
 
+class DynamicBloom;
 class InternalKeyComparator;
 class Mutex;
 class MemTableIterator;
+struct MergeContext;
 
 class MemTable {
 public:
@@ -19,6 +22,14 @@ public:
     // is zero and the caller must call Ref() at least once.
     explicit MemTable(const InternalKeyComparator& comparator);
 
+    // Same as above, but configured by "options": the entries are
+    // indexed by a representation created by options.memtable_factory
+    // in memory allocated as options.arena_block_size and
+    // options.memtable_huge_page_size say, Update() may be used if
+    // options.inplace_update_support, and lookups are filtered if
+    // options.memtable_bloom_size_ratio > 0.
+    MemTable(const InternalKeyComparator& comparator, const Options& options);
+
     void Ref() { ++ refs_; }
 
     void Unref() {
@@ -31,7 +42,13 @@ public:
 
     size_t ApproximateMemoryUsage();
 
-    // 该类只是作为一个接口，成员函数最终都是调用了skiplist类中的函数
+    // Called once no more entries will be added.
+    void MarkImmutable() {
+        table_->MarkReadOnly();
+        range_del_table_->MarkReadOnly();
+    }
+
+    // 该类只是作为一个接口，成员函数最终都是调用了MemTableRep中的函数
 
     // Return an iterator that yields the contents of the memtable.
     //
@@ -41,37 +58,107 @@ public:
     // db/format.{h,cc} module.
     Iterator* NewIterator();
 
+    // Return an iterator that yields the range tombstones of the memtable,
+    // in the format described in db/range_del.h.  Same requirements as
+    // NewIterator().
+    Iterator* NewRangeTombstoneIterator();
+
+    // Returns true if a range tombstone has been added.
+    bool HasRangeTombstones() const {
+        return has_range_tombstones_.Acquire_Load() != NULL;
+    }
+
     // Add an entry into memtable that maps key to value at the
     // specified sequence number and with the specified type.
-    // Typically value will be empty if type==kTypeDeletion.
+    // Typically value will be empty if type==kTypeDeletion.  For
+    // type==kTypeRangeDeletion, key and value are the bounds of the range.
     void Add(SequenceNumber seq, ValueType type,
              const Slice& key,
              const Slice& value);
 
+    // Same as Add(), but may be called from several threads at once.
+    // REQUIRES: no concurrent call to Add().
+    // REQUIRES: IsInsertConcurrentlySupported()
+    void AddConcurrently(SequenceNumber seq, ValueType type,
+                         const Slice& key,
+                         const Slice& value);
+
+    // If the newest entry for key is a value, no range tombstone of the
+    // memtable is newer, and "value" fits in its place, overwrite it with
+    // "value" and return true.  The entry keeps its sequence number, so
+    // readers of older snapshots will see the new value.  Else, return
+    // false and leave the memtable unchanged.
+    // REQUIRES: the memtable was created with inplace_update_support.
+    // REQUIRES: no concurrent call to Add() or Update().
+    bool Update(SequenceNumber seq, const Slice& key, const Slice& value);
+
+    // Returns true if AddConcurrently() may be used.
+    bool IsInsertConcurrentlySupported() const {
+        return table_->IsInsertConcurrentlySupported();
+    }
+
     // If memtable contains a value for key, store it in *value and return true.
-    // If memtable contains a deletion for key, store a NotFound() error
-    // in *status and return true.
+    // If memtable contains a deletion for key, or a range tombstone that
+    // covers it, store a NotFound() error in *status and return true.
     // Else, return false.
-    bool Get(const LookupKey& key, std::string* value, Status* s);
+    //
+    // Merge operands for key that are newer than the value or deletion
+    // are added to merge->operands; if there is a value or deletion, the
+    // operands are applied to it, and *status holds the merge result.
+    bool Get(const LookupKey& key, std::string* value, Status* s,
+             MergeContext* merge);
+
+    // If memtable contains an entry for user_key, or a range tombstone
+    // that covers it, store the sequence number of the latest one in
+    // *seq and return true.
+    // Else, return false.
+    bool GetLatestSequence(const Slice& user_key, SequenceNumber* seq);
 
 private:
     ~MemTable();
 
-    struct KeyComparator {
+    struct KeyComparator : public MemTableRep::KeyComparator {
         const InternalKeyComparator comparator;
         explicit KeyComparator(const InternalKeyComparator& c) : comparator(c) { }
-        int operator()(const char* a, const char* b) const;
+        virtual int operator()(const char* a, const char* b) const;
+    };
+
+    // Entries updated in place are guarded by the stripe of their user
+    // key.  "sequence" is the newest sequence number of the updates made
+    // to the keys of the stripe.
+    struct UpdateStripe {
+        port::Mutex mu;
+        SequenceNumber sequence;
+        UpdateStripe() : sequence(0) { }
     };
+    enum { kNumUpdateStripes = 1024 };
+
+    UpdateStripe* GetStripe(const Slice& user_key) const;
+
+    bool GetUnlocked(const LookupKey& key, std::string* value, Status* s,
+                     MergeContext* merge);
+    bool GetLatestSequenceUnlocked(const Slice& user_key,
+                                   SequenceNumber* seq);
+
+    SequenceNumber MaxCoveringTombstone(const Slice& user_key,
+                                        SequenceNumber snapshot);
+
+    // Encode an entry into memory allocated from arena_.
+    char* EncodeEntry(SequenceNumber seq, ValueType type,
+                      const Slice& key, const Slice& value,
+                      bool concurrent);
 
     friend class MemTableIterator;
     friend class MemTableBackwardIterator;
 
-    typedef SkipList<const char*, KeyComparator> Table;
-
     KeyComparator comparator_;
     int refs_;
     Arena arena_;
-    Table table_;
+    MemTableRep* table_;
+    MemTableRep* range_del_table_;  // Always a skiplist
+    port::AtomicPointer has_range_tombstones_;
+    UpdateStripe* stripes_;         // NULL unless inplace_update_support
+    DynamicBloom* bloom_;           // User keys of table_, or NULL
 
     // no copying aollowed
     MemTable(const MemTable&);
@@ -0,0 +1,213 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/memtablerep.h"
+
+#include <map>
+#include <string>
+#include "db/dbformat.h"
+#include "db/memtable.h"
+#include "db/merge_helper.h"
+#include "leveldb/comparator.h"
+#include "leveldb/slice_transform.h"
+#include "util/random.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class MemTableRepTest {
+ public:
+  InternalKeyComparator cmp_;
+  const SliceTransform* prefix_extractor_;
+
+  MemTableRepTest()
+      : cmp_(BytewiseComparator()),
+        prefix_extractor_(NewFixedPrefixTransform(2)) {
+  }
+
+  ~MemTableRepTest() {
+    delete prefix_extractor_;
+  }
+
+  static std::string Get(MemTable* mem, const std::string& k,
+                         SequenceNumber seq) {
+    std::string value;
+    Status s;
+    MergeContext merge(NULL, NULL);
+    if (!mem->Get(LookupKey(k, seq), &value, &s, &merge)) {
+      return "MISSING";
+    } else if (s.IsNotFound()) {
+      return "NOT_FOUND";
+    }
+    return value;
+  }
+
+  void Check(MemTableRepFactory* factory) {
+    Options options;
+    options.memtable_factory = factory;
+    Check(options);
+  }
+
+  // Fill a memtable configured by "options" with random puts and
+  // deletes, and compare lookups and iteration against a model, before
+  // and after the memtable is marked immutable.
+  void Check(const Options& options) {
+    MemTable* mem = new MemTable(cmp_, options);
+    mem->Ref();
+
+    // Model of the newest value of each key; "" stands for a deletion
+    std::map<std::string, std::string> model;
+    Random rnd(301);
+    const int kNum = 2000;
+    for (int i = 1; i <= kNum; i++) {
+      // Short keys fall outside of the prefix extractor's domain
+      std::string key = NumberToString(rnd.Uniform(500));
+      if (rnd.OneIn(10)) {
+        mem->Add(i, kTypeDeletion, key, Slice());
+        model[key] = "";
+      } else {
+        std::string value = "v" + NumberToString(i);
+        mem->Add(i, kTypeValue, key, value);
+        model[key] = value;
+      }
+    }
+
+    for (int pass = 0; pass < 2; pass++) {
+      for (int k = 0; k < 600; k++) {
+        std::string key = NumberToString(k);
+        std::map<std::string, std::string>::const_iterator it = model.find(key);
+        std::string expected = "MISSING";
+        if (it != model.end()) {
+          expected = it->second.empty() ? "NOT_FOUND" : it->second;
+        }
+        ASSERT_EQ(expected, Get(mem, key, kMaxSequenceNumber));
+      }
+      ASSERT_EQ("MISSING", Get(mem, "", kMaxSequenceNumber));
+      ASSERT_EQ("MISSING", Get(mem, "zz", kMaxSequenceNumber));
+
+      // Entries come out in internal key order
+      Iterator* iter = mem->NewIterator();
+      std::string last;
+      int count = 0;
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        if (count > 0) {
+          ASSERT_LT(cmp_.Compare(last, iter->key()), 0);
+        }
+        last = iter->key().ToString();
+        count++;
+      }
+      ASSERT_EQ(kNum, count);
+
+      // Seek lands on the newest version of the key
+      for (std::map<std::string, std::string>::const_iterator it =
+               model.begin(); it != model.end(); ++it) {
+        iter->Seek(LookupKey(it->first, kMaxSequenceNumber).internal_key());
+        ASSERT_TRUE(iter->Valid());
+        ParsedInternalKey ikey;
+        ASSERT_TRUE(ParseInternalKey(iter->key(), &ikey));
+        ASSERT_EQ(it->first, ikey.user_key.ToString());
+        ASSERT_EQ(it->second, iter->value().ToString());
+      }
+      iter->SeekToLast();
+      ASSERT_TRUE(iter->Valid());
+      ASSERT_EQ(last, iter->key().ToString());
+      iter->Prev();
+      ASSERT_TRUE(iter->Valid());
+      ASSERT_LT(cmp_.Compare(iter->key(), last), 0);
+      delete iter;
+
+      mem->MarkImmutable();
+    }
+    mem->Unref();
+  }
+};
+
+TEST(MemTableRepTest, SkipList) {
+  MemTableRepFactory* factory = NewSkipListRepFactory();
+  ASSERT_TRUE(factory->IsInsertConcurrentlySupported());
+  Check(factory);
+  delete factory;
+}
+
+TEST(MemTableRepTest, DefaultIsSkipList) {
+  Check(NULL);
+}
+
+TEST(MemTableRepTest, HashSkipList) {
+  MemTableRepFactory* factory =
+      NewHashSkipListRepFactory(prefix_extractor_, 7);
+  ASSERT_TRUE(!factory->IsInsertConcurrentlySupported());
+  Check(factory);
+  delete factory;
+}
+
+TEST(MemTableRepTest, HashSkipListOneBucket) {
+  MemTableRepFactory* factory =
+      NewHashSkipListRepFactory(prefix_extractor_, 1);
+  Check(factory);
+  delete factory;
+}
+
+TEST(MemTableRepTest, Vector) {
+  MemTableRepFactory* factory = NewVectorRepFactory(100);
+  ASSERT_TRUE(factory->IsInsertConcurrentlySupported());
+  Check(factory);
+
+  // Reads between inserts merge the new entries into the sorted copy
+  Options options;
+  options.memtable_factory = factory;
+  MemTable* mem = new MemTable(cmp_, options);
+  mem->Ref();
+  mem->Add(1, kTypeValue, "b", "v1");
+  mem->Add(2, kTypeValue, "d", "v2");
+  ASSERT_EQ("v1", Get(mem, "b", kMaxSequenceNumber));
+  Iterator* iter = mem->NewIterator();
+  mem->Add(3, kTypeValue, "a", "v3");
+  mem->Add(4, kTypeValue, "b", "v4");
+  ASSERT_EQ("v4", Get(mem, "b", kMaxSequenceNumber));
+  ASSERT_EQ("v3", Get(mem, "a", kMaxSequenceNumber));
+  ASSERT_EQ("v1", Get(mem, "b", 1));
+  mem->Add(5, kTypeValue, "c", "v5");
+  Iterator* iter2 = mem->NewIterator();
+  std::string result;
+  for (iter2->SeekToFirst(); iter2->Valid(); iter2->Next()) {
+    result += iter2->value().ToString() + " ";
+  }
+  ASSERT_EQ("v3 v4 v1 v5 v2 ", result);
+  delete iter2;
+
+  // Older iterators keep the entries they were created with
+  result.clear();
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    result += iter->value().ToString() + " ";
+  }
+  ASSERT_EQ("v1 v2 ", result);
+  delete iter;
+  mem->Unref();
+  delete factory;
+}
+
+TEST(MemTableRepTest, Bloom) {
+  Options options;
+  options.memtable_bloom_size_ratio = 0.01;
+  Check(options);
+
+  // A filter of two blocks lets through most of the misses
+  options.write_buffer_size = 64 << 10;
+  options.memtable_bloom_size_ratio = 0.001;
+  Check(options);
+}
+
+TEST(MemTableRepTest, HugePageArena) {
+  Options options;
+  options.arena_block_size = 2 << 20;
+  options.memtable_huge_page_size = 2 << 20;
+  Check(options);
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
@@ -0,0 +1,113 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/merge_helper.h"
+
+#include "db/dbformat.h"
+#include "db/range_del.h"
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+#include "leveldb/merge_operator.h"
+
+namespace leveldb {
+
+Status ApplyMergeOperands(const MergeOperator* merge_operator,
+                          Logger* logger,
+                          const Slice& user_key,
+                          const Slice* existing_value,
+                          const std::deque<std::string>& operands,
+                          std::string* value) {
+  if (merge_operator == NULL) {
+    return Status::InvalidArgument("merge operand found but no "
+                                   "merge_operator is set");
+  }
+  value->clear();
+  if (!merge_operator->FullMerge(user_key, existing_value, operands,
+                                 value, logger)) {
+    return Status::Corruption("merge operator failed for ", user_key);
+  }
+  return Status::OK();
+}
+
+Status MergeHelper::MergeUntil(Iterator* iter, RangeDelAggregator* range_del,
+                               bool at_bottom) {
+  keys_.clear();
+  values_.clear();
+
+  ParsedInternalKey newest;
+  if (!ParseInternalKey(iter->key(), &newest)) {
+    return Status::Corruption("corrupted internal key in MergeUntil");
+  }
+  assert(newest.type == kTypeMerge);
+  const std::string user_key = newest.user_key.ToString();
+  const SequenceNumber sequence = newest.sequence;
+
+  std::deque<std::string> operands;  // Oldest first
+  bool found_base = false;
+  bool base_is_value = false;
+  std::string base_value;
+  for (; iter->Valid(); iter->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseInternalKey(iter->key(), &ikey) ||
+        user_comparator_->Compare(ikey.user_key, user_key) != 0) {
+      break;
+    }
+    if (range_del != NULL &&
+        range_del->ShouldDelete(ikey.user_key, ikey.sequence)) {
+      ikey.type = kTypeDeletion;
+    }
+    if (ikey.type != kTypeMerge) {
+      found_base = true;
+      base_is_value = (ikey.type == kTypeValue);
+      if (base_is_value) {
+        base_value = iter->value().ToString();
+      }
+      iter->Next();
+      break;
+    }
+    keys_.push_back(iter->key().ToString());
+    operands.push_front(iter->value().ToString());
+  }
+
+  if (found_base || at_bottom) {
+    // The operands can be applied for good
+    std::string value;
+    Slice existing(base_value);
+    Status s = ApplyMergeOperands(merge_operator_, logger_, user_key,
+                                  base_is_value ? &existing : NULL,
+                                  operands, &value);
+    if (!s.ok()) {
+      return s;
+    }
+    keys_.clear();
+    keys_.push_back(std::string());
+    AppendInternalKey(&keys_.back(),
+                      ParsedInternalKey(user_key, sequence, kTypeValue));
+    values_.push_back(value);
+    return s;
+  }
+
+  // Older entries may still lie in other levels, so the operands must be
+  // kept, but may be combined into one.
+  std::string combined = operands[0];
+  std::string tmp;
+  bool ok = true;
+  for (size_t i = 1; ok && i < operands.size(); i++) {
+    tmp.clear();
+    ok = merge_operator_->PartialMerge(user_key, combined, operands[i],
+                                       &tmp, logger_);
+    combined.swap(tmp);
+  }
+  if (ok) {
+    keys_.resize(1);
+    values_.push_back(combined);
+  } else {
+    for (size_t i = operands.size(); i > 0; i--) {
+      values_.push_back(operands[i - 1]);
+    }
+  }
+  return Status::OK();
+}
+
+}  // namespace leveldb
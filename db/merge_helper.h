@@ -0,0 +1,89 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_MERGE_HELPER_H_
+#define STORAGE_LEVELDB_DB_MERGE_HELPER_H_
+
+#include <deque>
+#include <string>
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Comparator;
+class Iterator;
+class Logger;
+class MergeOperator;
+class RangeDelAggregator;
+class Slice;
+
+// Merge operands met by a point lookup, which searches the memtables
+// and tables from the newest to the oldest.
+struct MergeContext {
+  MergeContext(const MergeOperator* op, Logger* log)
+      : merge_operator(op), logger(log) { }
+
+  const MergeOperator* const merge_operator;
+  Logger* const logger;
+  std::deque<std::string> operands;  // Found so far, oldest first
+};
+
+// Store in *value the result of applying "operands", oldest first, to
+// "existing_value", which is NULL if the key has no value before them.
+// Fails with InvalidArgument if "merge_operator" is NULL, and with
+// Corruption if the operator rejects the operands.
+extern Status ApplyMergeOperands(const MergeOperator* merge_operator,
+                                 Logger* logger,
+                                 const Slice& user_key,
+                                 const Slice* existing_value,
+                                 const std::deque<std::string>& operands,
+                                 std::string* value);
+
+// Folds runs of merge operands during compaction.
+class MergeHelper {
+ public:
+  MergeHelper(const Comparator* user_comparator,
+              const MergeOperator* merge_operator,
+              Logger* logger)
+      : user_comparator_(user_comparator),
+        merge_operator_(merge_operator),
+        logger_(logger) { }
+
+  // "iter" is positioned at a merge operand.  Consume it and the older
+  // merge operands for the same user key that follow it, and the value
+  // or deletion that follows them, if any.  An entry deleted by the
+  // tombstones of "*range_del", which may be NULL, counts as a deletion.
+  // If there is one, or if "at_bottom" says that no older entry for the
+  // key exists anywhere, the operands are applied to produce a single
+  // value.  Otherwise they are combined with PartialMerge() where
+  // possible.
+  //
+  // On return, "iter" is positioned at the first entry not consumed,
+  // and keys() and values() hold the entries that replace the consumed
+  // ones, newest first.
+  //
+  // REQUIRES: no snapshot lies between the sequence numbers of the
+  // entries that may be consumed.
+  Status MergeUntil(Iterator* iter, RangeDelAggregator* range_del,
+                    bool at_bottom);
+
+  // Internal keys and values of the result of MergeUntil().
+  const std::deque<std::string>& keys() const { return keys_; }
+  const std::deque<std::string>& values() const { return values_; }
+
+ private:
+  const Comparator* const user_comparator_;
+  const MergeOperator* const merge_operator_;
+  Logger* const logger_;
+  std::deque<std::string> keys_;
+  std::deque<std::string> values_;
+
+  // No copying allowed
+  MergeHelper(const MergeHelper&);
+  void operator=(const MergeHelper&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_MERGE_HELPER_H_
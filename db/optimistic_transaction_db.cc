@@ -0,0 +1,164 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A transaction holds a snapshot of the DB, buffers its writes in a
+// WriteBatchWithIndex so that it reads them back, and remembers every
+// key it read or wrote.  Commit() writes the batch through
+// DBImpl::WriteWithCallback(), whose callback fails the write if any of
+// those keys has been written after the snapshot.  The callback runs
+// while no other write is in progress, so the check and the write are
+// atomic with respect to other writers.
+
+#include "leveldb/optimistic_transaction_db.h"
+
+#include <set>
+#include "db/db_impl.h"
+#include "db/snapshot.h"
+#include "db/write_batch_internal.h"
+#include "db/write_callback.h"
+#include "leveldb/write_batch_with_index.h"
+
+namespace leveldb {
+
+namespace {
+
+class ConflictCheck : public WriteCallback {
+ public:
+  ConflictCheck(const std::set<std::string>* keys, SequenceNumber sequence)
+      : keys_(keys), sequence_(sequence) { }
+
+  virtual Status Callback(DBImpl* db) {
+    Status s;
+    for (std::set<std::string>::const_iterator iter = keys_->begin();
+         s.ok() && iter != keys_->end();
+         ++iter) {
+      s = db->CheckKeyUnchangedSince(*iter, sequence_);
+    }
+    return s;
+  }
+
+ private:
+  const std::set<std::string>* const keys_;
+  const SequenceNumber sequence_;
+};
+
+class TransactionImpl : public Transaction {
+ public:
+  TransactionImpl(DBImpl* db, const Options& options,
+                  const WriteOptions& write_options)
+      : db_(db),
+        write_options_(write_options),
+        batch_(options.comparator),
+        snapshot_(db->GetSnapshot()) {
+  }
+
+  virtual ~TransactionImpl() {
+    if (snapshot_ != NULL) {
+      Rollback();
+    }
+  }
+
+  virtual Status Get(const ReadOptions& options,
+                     const Slice& key,
+                     std::string* value) {
+    assert(snapshot_ != NULL);
+    keys_.insert(key.ToString());
+    ReadOptions read_options = options;
+    read_options.snapshot = snapshot_;
+    return batch_.GetFromBatchAndDB(db_, read_options, key, value);
+  }
+
+  virtual Iterator* NewIterator(const ReadOptions& options) {
+    assert(snapshot_ != NULL);
+    ReadOptions read_options = options;
+    read_options.snapshot = snapshot_;
+    return batch_.NewIteratorWithBase(db_->NewIterator(read_options));
+  }
+
+  virtual void Put(const Slice& key, const Slice& value) {
+    assert(snapshot_ != NULL);
+    keys_.insert(key.ToString());
+    batch_.Put(key, value);
+  }
+
+  virtual void Delete(const Slice& key) {
+    assert(snapshot_ != NULL);
+    keys_.insert(key.ToString());
+    batch_.Delete(key);
+  }
+
+  virtual Status Commit() {
+    assert(snapshot_ != NULL);
+    Status s;
+    WriteBatch* updates = batch_.GetWriteBatch();
+    // Reads alone are consistent with the snapshot; nothing to check.
+    if (WriteBatchInternal::Count(updates) > 0) {
+      ConflictCheck check(
+          &keys_, reinterpret_cast<const SnapshotImpl*>(snapshot_)->number_);
+      s = db_->WriteWithCallback(write_options_, updates, &check);
+    }
+    Rollback();
+    return s;
+  }
+
+  virtual void Rollback() {
+    assert(snapshot_ != NULL);
+    db_->ReleaseSnapshot(snapshot_);
+    snapshot_ = NULL;
+    batch_.Clear();
+    keys_.clear();
+  }
+
+ private:
+  DBImpl* const db_;
+  const WriteOptions write_options_;
+  WriteBatchWithIndex batch_;
+  const Snapshot* snapshot_;     // NULL once the transaction is over
+  std::set<std::string> keys_;   // Keys read or written
+};
+
+class OptimisticTransactionDBImpl : public OptimisticTransactionDB {
+ public:
+  OptimisticTransactionDBImpl(const Options& options, DB* db)
+      : options_(options), db_(db) { }
+
+  virtual ~OptimisticTransactionDBImpl() {
+    delete db_;
+  }
+
+  virtual Transaction* BeginTransaction(const WriteOptions& options) {
+    return new TransactionImpl(static_cast<DBImpl*>(db_), options_,
+                               options);
+  }
+
+  virtual DB* GetBaseDB() {
+    return db_;
+  }
+
+ private:
+  const Options options_;
+  DB* const db_;
+};
+
+}  // namespace
+
+Transaction::~Transaction() {
+}
+
+OptimisticTransactionDB::~OptimisticTransactionDB() {
+}
+
+Status OptimisticTransactionDB::Open(const Options& options,
+                                     const std::string& name,
+                                     OptimisticTransactionDB** dbptr) {
+  *dbptr = NULL;
+  DB* db;
+  Status s = DB::Open(options, name, &db);
+  if (s.ok()) {
+    *dbptr = new OptimisticTransactionDBImpl(options, db);
+  }
+  return s;
+}
+
+}  // namespace leveldb
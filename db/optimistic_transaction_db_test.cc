@@ -0,0 +1,187 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/optimistic_transaction_db.h"
+
+#include "db/db_impl.h"
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class OptimisticTransactionDBTest {
+ public:
+  std::string dbname_;
+  Options options_;
+  OptimisticTransactionDB* txn_db_;
+  DB* db_;
+
+  OptimisticTransactionDBTest() : txn_db_(NULL), db_(NULL) {
+    dbname_ = test::TmpDir() + "/optimistic_transaction_db_test";
+    options_.create_if_missing = true;
+    Reopen();
+  }
+
+  ~OptimisticTransactionDBTest() {
+    delete txn_db_;
+    DestroyDB(dbname_, Options());
+  }
+
+  void Reopen() {
+    delete txn_db_;
+    DestroyDB(dbname_, Options());
+    ASSERT_OK(OptimisticTransactionDB::Open(options_, dbname_, &txn_db_));
+    db_ = txn_db_->GetBaseDB();
+  }
+
+  Transaction* Begin() {
+    return txn_db_->BeginTransaction(WriteOptions());
+  }
+
+  std::string Get(const std::string& key) {
+    std::string value;
+    Status s = db_->Get(ReadOptions(), key, &value);
+    if (s.IsNotFound()) {
+      return "NOT_FOUND";
+    } else if (!s.ok()) {
+      return s.ToString();
+    }
+    return value;
+  }
+
+  std::string Get(Transaction* txn, const std::string& key) {
+    std::string value;
+    Status s = txn->Get(ReadOptions(), key, &value);
+    if (s.IsNotFound()) {
+      return "NOT_FOUND";
+    } else if (!s.ok()) {
+      return s.ToString();
+    }
+    return value;
+  }
+};
+
+TEST(OptimisticTransactionDBTest, Commit) {
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "1"));
+  Transaction* txn = Begin();
+  ASSERT_EQ("1", Get(txn, "a"));
+  txn->Put("a", "2");
+  txn->Put("b", "2");
+  txn->Delete("c");
+
+  // Reads see the transaction's writes, others do not yet
+  ASSERT_EQ("2", Get(txn, "a"));
+  ASSERT_EQ("2", Get(txn, "b"));
+  ASSERT_EQ("1", Get("a"));
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+
+  // Writes to keys the transaction did not touch do not conflict
+  ASSERT_OK(db_->Put(WriteOptions(), "d", "1"));
+
+  Iterator* iter = txn->NewIterator(ReadOptions());
+  std::string contents;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    contents.append(iter->key().ToString() + "=" +
+                    iter->value().ToString() + " ");
+  }
+  delete iter;
+  ASSERT_EQ("a=2 b=2 ", contents);
+
+  ASSERT_OK(txn->Commit());
+  delete txn;
+  ASSERT_EQ("2", Get("a"));
+  ASSERT_EQ("2", Get("b"));
+  ASSERT_EQ("1", Get("d"));
+}
+
+TEST(OptimisticTransactionDBTest, Conflicts) {
+  for (int pipelined = 0; pipelined < 2; pipelined++) {
+    options_.enable_pipelined_write = (pipelined != 0);
+    Reopen();
+    ASSERT_OK(db_->Put(WriteOptions(), "a", "1"));
+
+    // A key that was read is overwritten
+    Transaction* txn = Begin();
+    ASSERT_EQ("1", Get(txn, "a"));
+    txn->Put("b", "txn");
+    ASSERT_OK(db_->Put(WriteOptions(), "a", "2"));
+    ASSERT_TRUE(txn->Commit().IsBusy());
+    delete txn;
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+
+    // A key that was written is deleted
+    txn = Begin();
+    txn->Put("b", "txn");
+    ASSERT_OK(db_->Delete(WriteOptions(), "b"));
+    ASSERT_TRUE(txn->Commit().IsBusy());
+    delete txn;
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+
+    // Of two transactions on the same key, only the first to commit wins
+    Transaction* txn1 = Begin();
+    Transaction* txn2 = Begin();
+    ASSERT_EQ("2", Get(txn1, "a"));
+    ASSERT_EQ("2", Get(txn2, "a"));
+    txn1->Put("a", "txn1");
+    txn2->Put("a", "txn2");
+    ASSERT_OK(txn1->Commit());
+    ASSERT_TRUE(txn2->Commit().IsBusy());
+    delete txn1;
+    delete txn2;
+    ASSERT_EQ("txn1", Get("a"));
+
+    // Reading a key that does not exist guards it as well
+    txn = Begin();
+    ASSERT_EQ("NOT_FOUND", Get(txn, "c"));
+    txn->Put("d", "txn");
+    ASSERT_OK(db_->Put(WriteOptions(), "c", "1"));
+    ASSERT_TRUE(txn->Commit().IsBusy());
+    delete txn;
+    ASSERT_EQ("NOT_FOUND", Get("d"));
+  }
+}
+
+TEST(OptimisticTransactionDBTest, Rollback) {
+  Transaction* txn = Begin();
+  txn->Put("a", "txn");
+  txn->Rollback();
+  delete txn;
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+
+  // Deleting an open transaction rolls it back
+  txn = Begin();
+  txn->Put("a", "txn");
+  delete txn;
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+}
+
+TEST(OptimisticTransactionDBTest, MemTableHistory) {
+  DBImpl* dbi = reinterpret_cast<DBImpl*>(db_);
+
+  // Writes made since the transaction began have been flushed, so a
+  // conflict cannot be ruled out.
+  Transaction* txn = Begin();
+  ASSERT_EQ("NOT_FOUND", Get(txn, "a"));
+  ASSERT_OK(db_->Put(WriteOptions(), "b", "1"));
+  ASSERT_OK(dbi->TEST_CompactMemTable());
+  txn->Put("a", "txn");
+  ASSERT_TRUE(txn->Commit().IsBusy());
+  delete txn;
+
+  // A flush with no write since the transaction began loses nothing
+  txn = Begin();
+  ASSERT_EQ("NOT_FOUND", Get(txn, "a"));
+  ASSERT_OK(dbi->TEST_CompactMemTable());
+  txn->Put("a", "txn");
+  ASSERT_OK(txn->Commit());
+  delete txn;
+  ASSERT_EQ("txn", Get("a"));
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
@@ -0,0 +1,193 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_del.h"
+
+#include <algorithm>
+#include <set>
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+
+namespace leveldb {
+
+SequenceNumber MaxCoveringTombstone(Iterator* iter,
+                                    const Comparator* ucmp,
+                                    const Slice& user_key,
+                                    SequenceNumber snapshot) {
+  SequenceNumber result = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseInternalKey(iter->key(), &ikey)) {
+      continue;
+    }
+    if (ucmp->Compare(ikey.user_key, user_key) > 0) {
+      break;  // This and later tombstones begin after user_key
+    }
+    if (ikey.sequence <= snapshot && ikey.sequence > result &&
+        ucmp->Compare(user_key, iter->value()) < 0) {
+      result = ikey.sequence;
+    }
+  }
+  return result;
+}
+
+void ExtendRangeForTombstone(const InternalKeyComparator& icmp,
+                             const Slice& key,
+                             const Slice& end,
+                             bool empty,
+                             InternalKey* smallest,
+                             InternalKey* largest) {
+  // "end" is excluded, so the range only needs to reach the position
+  // before all the entries for "end".
+  InternalKey limit(end, kMaxSequenceNumber, kTypeRangeDeletion);
+  if (empty || icmp.Compare(key, smallest->Encode()) < 0) {
+    smallest->DecodeFrom(key);
+  }
+  if (empty || icmp.Compare(limit, *largest) > 0) {
+    *largest = limit;
+  }
+}
+
+namespace {
+struct BeginLess {
+  const Comparator* ucmp;
+  bool operator()(const RangeTombstone* a, const RangeTombstone* b) const {
+    return ucmp->Compare(a->begin, b->begin) < 0;
+  }
+};
+
+struct EndLess {
+  const Comparator* ucmp;
+  bool operator()(const RangeTombstone* a, const RangeTombstone* b) const {
+    return ucmp->Compare(a->end, b->end) < 0;
+  }
+};
+
+struct UserKeyLess {
+  const Comparator* ucmp;
+  bool operator()(const std::string& a, const std::string& b) const {
+    return ucmp->Compare(a, b) < 0;
+  }
+  bool operator()(const Slice& a, const std::string& b) const {
+    return ucmp->Compare(a, b) < 0;
+  }
+};
+
+struct UserKeyEqual {
+  const Comparator* ucmp;
+  bool operator()(const std::string& a, const std::string& b) const {
+    return ucmp->Compare(a, b) == 0;
+  }
+};
+}  // namespace
+
+RangeDelAggregator::RangeDelAggregator(const Comparator* ucmp,
+                                       SequenceNumber snapshot)
+    : ucmp_(ucmp),
+      snapshot_(snapshot),
+      fragmented_(true) {
+}
+
+Status RangeDelAggregator::AddTombstones(Iterator* iter) {
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseInternalKey(iter->key(), &ikey) ||
+        ikey.type != kTypeRangeDeletion) {
+      return Status::Corruption("corrupted range tombstone");
+    }
+    RangeTombstone t;
+    t.begin = ikey.user_key.ToString();
+    t.end = iter->value().ToString();
+    t.sequence = ikey.sequence;
+    tombstones_.push_back(t);
+    fragmented_ = false;
+  }
+  return iter->status();
+}
+
+void RangeDelAggregator::Fragment() {
+  std::vector<const RangeTombstone*> by_begin;
+  for (size_t i = 0; i < tombstones_.size(); i++) {
+    const RangeTombstone& t = tombstones_[i];
+    if (t.sequence <= snapshot_ && ucmp_->Compare(t.begin, t.end) < 0) {
+      by_begin.push_back(&t);
+    }
+  }
+  std::vector<const RangeTombstone*> by_end = by_begin;
+  BeginLess begin_less = { ucmp_ };
+  EndLess end_less = { ucmp_ };
+  std::sort(by_begin.begin(), by_begin.end(), begin_less);
+  std::sort(by_end.begin(), by_end.end(), end_less);
+
+  bounds_.clear();
+  for (size_t i = 0; i < by_begin.size(); i++) {
+    bounds_.push_back(by_begin[i]->begin);
+    bounds_.push_back(by_begin[i]->end);
+  }
+  UserKeyLess less = { ucmp_ };
+  UserKeyEqual equal = { ucmp_ };
+  std::sort(bounds_.begin(), bounds_.end(), less);
+  bounds_.erase(std::unique(bounds_.begin(), bounds_.end(), equal),
+                bounds_.end());
+
+  // Sweep over the bounds, keeping the sequence numbers of the
+  // tombstones that cover the fragment starting at each one.
+  sequences_.resize(bounds_.size());
+  std::multiset<SequenceNumber> active;
+  size_t next_begin = 0;
+  size_t next_end = 0;
+  for (size_t i = 0; i < bounds_.size(); i++) {
+    while (next_end < by_end.size() &&
+           ucmp_->Compare(by_end[next_end]->end, bounds_[i]) <= 0) {
+      active.erase(active.find(by_end[next_end]->sequence));
+      next_end++;
+    }
+    while (next_begin < by_begin.size() &&
+           ucmp_->Compare(by_begin[next_begin]->begin, bounds_[i]) <= 0) {
+      active.insert(by_begin[next_begin]->sequence);
+      next_begin++;
+    }
+    sequences_[i] = active.empty() ? 0 : *active.rbegin();
+  }
+  fragmented_ = true;
+}
+
+int RangeDelAggregator::FindFragment(const Slice& user_key) const {
+  UserKeyLess less = { ucmp_ };
+  std::vector<std::string>::const_iterator it =
+      std::upper_bound(bounds_.begin(), bounds_.end(), user_key, less);
+  return static_cast<int>(it - bounds_.begin()) - 1;
+}
+
+bool RangeDelAggregator::ShouldDelete(const Slice& user_key,
+                                      SequenceNumber seq) {
+  if (tombstones_.empty()) {
+    return false;
+  }
+  if (!fragmented_) {
+    Fragment();
+  }
+  const int i = FindFragment(user_key);
+  return i >= 0 && sequences_[i] > seq;
+}
+
+bool RangeDelAggregator::CoversRange(const Slice& smallest,
+                                     const Slice& largest) {
+  if (tombstones_.empty()) {
+    return false;
+  }
+  if (!fragmented_) {
+    Fragment();
+  }
+  for (int i = FindFragment(smallest); i >= 0 && sequences_[i] != 0; i++) {
+    // The last bound ends all tombstones, so sequences_[i] != 0 implies
+    // that bounds_[i+1] exists.
+    if (ucmp_->Compare(largest, bounds_[i + 1]) < 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace leveldb
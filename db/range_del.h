@@ -0,0 +1,93 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A range tombstone deletes the entries for the user keys in [begin,end)
+// whose sequence numbers are smaller than its own.  Range tombstones are
+// kept apart from the other entries: in a second skiplist in memtables,
+// and in the "rangedel" meta block of tables.  Both are sorted by the
+// internal key (begin, sequence, kTypeRangeDeletion) and map it to "end".
+
+#ifndef STORAGE_LEVELDB_DB_RANGE_DEL_H_
+#define STORAGE_LEVELDB_DB_RANGE_DEL_H_
+
+#include <string>
+#include <vector>
+#include "db/dbformat.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Comparator;
+class Iterator;
+
+struct RangeTombstone {
+  std::string begin;
+  std::string end;
+  SequenceNumber sequence;
+};
+
+// Returns the largest sequence number no greater than "snapshot" among
+// the range tombstones yielded by "iter" that cover "user_key", or zero
+// if none does.
+extern SequenceNumber MaxCoveringTombstone(Iterator* iter,
+                                           const Comparator* ucmp,
+                                           const Slice& user_key,
+                                           SequenceNumber snapshot);
+
+// Widen [*smallest,*largest] to the internal keys that a table holding
+// the range tombstone "key" -> "end" must span.  If "empty", the range
+// holds nothing yet and is set to the tombstone's.
+extern void ExtendRangeForTombstone(const InternalKeyComparator& icmp,
+                                    const Slice& key,
+                                    const Slice& end,
+                                    bool empty,
+                                    InternalKey* smallest,
+                                    InternalKey* largest);
+
+// Collects range tombstones and tells which entries they delete for the
+// readers of a snapshot.
+class RangeDelAggregator {
+ public:
+  RangeDelAggregator(const Comparator* ucmp, SequenceNumber snapshot);
+
+  // Add the tombstones yielded by "iter".
+  Status AddTombstones(Iterator* iter);
+
+  // Returns true if no tombstone has been added.
+  bool empty() const { return tombstones_.empty(); }
+
+  // All the tombstones added, including those newer than the snapshot.
+  const std::vector<RangeTombstone>& tombstones() const { return tombstones_; }
+
+  // Returns true if a tombstone visible at the snapshot deletes the
+  // entry for "user_key" with sequence number "seq".
+  bool ShouldDelete(const Slice& user_key, SequenceNumber seq);
+
+  // Returns true if the tombstones visible at the snapshot cover every
+  // user key in [smallest,largest].
+  bool CoversRange(const Slice& smallest, const Slice& largest);
+
+ private:
+  void Fragment();
+  int FindFragment(const Slice& user_key) const;
+
+  const Comparator* const ucmp_;
+  const SequenceNumber snapshot_;
+  std::vector<RangeTombstone> tombstones_;
+
+  // The visible tombstones cut at their bounds into disjoint fragments:
+  // fragment i spans [bounds_[i],bounds_[i+1]), and sequences_[i] is the
+  // largest sequence number of the tombstones covering it, or zero.
+  bool fragmented_;
+  std::vector<std::string> bounds_;
+  std::vector<SequenceNumber> sequences_;
+
+  // No copying allowed
+  RangeDelAggregator(const RangeDelAggregator&);
+  void operator=(const RangeDelAggregator&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_RANGE_DEL_H_
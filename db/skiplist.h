@@ -1,27 +1,28 @@
-
 #ifndef STORAGE_LEVELDB_DB_SKIPLIST_H_
 #define STORAGE_LEVELDB_DB_SKIPLIST_H_
 
 // Thread safety
 // -------------
-// 
-// Writes require external synchronization, most likely a mutex.
+//
+// Writes require external synchronization, most likely a mutex.  The
+// exception is InsertConcurrently(), which may be called from several
+// threads at once (but never concurrently with Insert()).
 // Reads require a guarantee that the SkipList will not be destroyed
 // while the read is in progress.  Apart from that, reads progress
 // without any internal locking or synchronization.
-// 
+//
 // Invariants:
-// 
+//
 // (1) Allocated nodes are never deleted until the SkipList is
 // destroyed.  This is trivially guaranteed by the code since we
 // never delete any skip list nodes.
-// 
+//
 // (2) The contents of a Node except for the next/prev pointers are
 // immutable after the Node has been linked into the SkipList.
 // Only Insert() modifies the list, and it is careful to initialize
 // a node and use release-stores to publish the nodes in one or
 // more lists.
-// 
+//
 // ... prev vs. next pointer ordering ...
 
 #include <assert.h>
@@ -42,12 +43,354 @@ private:
 public:
     // Create a new SkipList object that will use "cmp" for comparing keys,
     // and will allocate memory using "*arena".  Objects allocated in the arena
-    // must remain allocated for the lifetime of the skiplist object.""""
+    // must remain allocated for the lifetime of the skiplist object.
     // 构造函数，cmp指定比较算子，并分配内存
     explicit SkipList(Comparator cmp, Arena* arena);
 
+    // Insert key into the list.
+    // REQUIRES: nothing that compares equal to key is currently in the list.
     void Insert(const Key& key);
 
+    // Like Insert(), but safe to call from several threads at once.
+    // Nodes are linked in with compare-and-swap, one level at a time
+    // from the bottom up, and are allocated with
+    // Arena::AllocateAlignedConcurrently().
+    // REQUIRES: nothing that compares equal to key is currently in the list.
+    // REQUIRES: no concurrent call to Insert().
+    void InsertConcurrently(const Key& key);
+
+    // Returns true iff an entry that compares equal to key is in the list.
+    bool Contains(const Key& key) const;
+
+    // Iteration over the contents of a skip list
+    class Iterator {
+    public:
+        // Initialize an iterator over the specified list.
+        // The returned iterator is not valid.
+        explicit Iterator(const SkipList* list);
+
+        // Returns true iff the iterator is positioned at a valid node.
+        bool Valid() const;
+
+        // Returns the key at the current position.
+        // REQUIRES: Valid()
+        const Key& key() const;
+
+        // Advances to the next position.
+        // REQUIRES: Valid()
+        void Next();
+
+        // Advances to the previous position.
+        // REQUIRES: Valid()
+        void Prev();
+
+        // Advance to the first entry with a key >= target
+        void Seek(const Key& target);
+
+        // Position at the first entry in list.
+        // Final state of iterator is Valid() iff list is not empty.
+        void SeekToFirst();
+
+        // Position at the last entry in list.
+        // Final state of iterator is Valid() iff list is not empty.
+        void SeekToLast();
+
+    private:
+        const SkipList* list_;
+        Node* node_;
+        // Intentionally copyable
+    };
+
+private:
+    enum { kMaxHeight = 12 };
+
+    // Immutable after construction
+    Comparator const compare_;
+    Arena* const arena_;    // Arena used for allocations of nodes
+
+    Node* const head_;
+
+    // Modified only by Insert().  Read racily by readers, but stale
+    // values are ok.
+    port::AtomicPointer max_height_;   // Height of the entire list
+
+    inline int GetMaxHeight() const {
+        return static_cast<int>(
+            reinterpret_cast<intptr_t>(max_height_.NoBarrier_Load()));
+    }
+
+    // Read/written only by Insert().
+    Random rnd_;
+
+    // Random seed used by InsertConcurrently(); advanced with
+    // compare-and-swap.
+    port::AtomicPointer concurrent_seed_;
+
+    Node* NewNode(const Key& key, int height);
+    int RandomHeight();
+    int RandomHeightConcurrently();
+    bool Equal(const Key& a, const Key& b) const { return (compare_(a, b) == 0); }
+
+    // Return true if key is greater than the data stored in "n"
+    bool KeyIsAfterNode(const Key& key, Node* n) const;
+
+    // Return the earliest node that comes at or after key.
+    // Return NULL if there is no such node.
+    //
+    // If prev is non-NULL, fills prev[level] with pointer to previous
+    // node at "level" for every level in [0..max_height_-1].
+    Node* FindGreaterOrEqual(const Key& key, Node** prev) const;
+
+    // Starting at "before", find the adjacent nodes at "level" between
+    // which key belongs.
+    void FindSpliceForLevel(const Key& key, Node* before, int level,
+                            Node** out_prev, Node** out_next) const;
+
+    // Return the latest node with a key < key.
+    // Return head_ if there is no such node.
+    Node* FindLessThan(const Key& key) const;
+
+    // Return the last node in the list.
+    // Return head_ if list is empty.
+    Node* FindLast() const;
+
+    // No copying allowed
+    SkipList(const SkipList&);
+    void operator=(const SkipList&);
+};
+
+// Implementation details follow
+template<typename Key, class Comparator>
+struct SkipList<Key, Comparator>::Node {
+    explicit Node(const Key& k) : key(k) { }
+
+    Key const key;
+
+    // Accessors/mutators for links.  Wrapped in methods so we can
+    // add the appropriate barriers as necessary.
+    Node* Next(int n) {
+        assert(n >= 0);
+        // Use an 'acquire load' so that we observe a fully initialized
+        // version of the returned Node.
+        return reinterpret_cast<Node*>(next_[n].Acquire_Load());
+    }
+    void SetNext(int n, Node* x) {
+        assert(n >= 0);
+        // Use a 'release store' so that anybody who reads through this
+        // pointer observes a fully initialized version of the inserted node.
+        next_[n].Release_Store(x);
+    }
+
+    // No-barrier variants that can be safely used in a few locations.
+    Node* NoBarrier_Next(int n) {
+        assert(n >= 0);
+        return reinterpret_cast<Node*>(next_[n].NoBarrier_Load());
+    }
+    void NoBarrier_SetNext(int n, Node* x) {
+        assert(n >= 0);
+        next_[n].NoBarrier_Store(x);
+    }
+
+    // Link x in at level n iff the current successor is still "expected".
+    bool CASNext(int n, Node* expected, Node* x) {
+        assert(n >= 0);
+        return next_[n].CompareAndSwap(expected, x);
+    }
+
+private:
+    // Array of length equal to the node height.  next_[0] is lowest level link.
+    port::AtomicPointer next_[1];
+};
+
+template<typename Key, class Comparator>
+typename SkipList<Key, Comparator>::Node*
+SkipList<Key, Comparator>::NewNode(const Key& key, int height) {
+    char* mem = arena_->AllocateAligned(
+        sizeof(Node) + sizeof(port::AtomicPointer) * (height - 1));
+    return new (mem) Node(key);
+}
+
+template<typename Key, class Comparator>
+inline SkipList<Key, Comparator>::Iterator::Iterator(const SkipList* list) {
+    list_ = list;
+    node_ = NULL;
+}
+
+template<typename Key, class Comparator>
+inline bool SkipList<Key, Comparator>::Iterator::Valid() const {
+    return node_ != NULL;
+}
+
+template<typename Key, class Comparator>
+inline const Key& SkipList<Key, Comparator>::Iterator::key() const {
+    assert(Valid());
+    return node_->key;
+}
+
+template<typename Key, class Comparator>
+inline void SkipList<Key, Comparator>::Iterator::Next() {
+    assert(Valid());
+    node_ = node_->Next(0);
+}
+
+template<typename Key, class Comparator>
+inline void SkipList<Key, Comparator>::Iterator::Prev() {
+    // Instead of using explicit "prev" links, we just search for the
+    // last node that falls before key.
+    assert(Valid());
+    node_ = list_->FindLessThan(node_->key);
+    if (node_ == list_->head_) {
+        node_ = NULL;
+    }
+}
+
+template<typename Key, class Comparator>
+inline void SkipList<Key, Comparator>::Iterator::Seek(const Key& target) {
+    node_ = list_->FindGreaterOrEqual(target, NULL);
+}
+
+template<typename Key, class Comparator>
+inline void SkipList<Key, Comparator>::Iterator::SeekToFirst() {
+    node_ = list_->head_->Next(0);
+}
+
+template<typename Key, class Comparator>
+inline void SkipList<Key, Comparator>::Iterator::SeekToLast() {
+    node_ = list_->FindLast();
+    if (node_ == list_->head_) {
+        node_ = NULL;
+    }
+}
+
+template<typename Key, class Comparator>
+int SkipList<Key, Comparator>::RandomHeight() {
+    // Increase height with probability 1 in kBranching
+    static const unsigned int kBranching = 4;
+    int height = 1;
+    while (height < kMaxHeight && ((rnd_.Next() % kBranching) == 0)) {
+        height++;
+    }
+    assert(height > 0);
+    assert(height <= kMaxHeight);
+    return height;
+}
+
+template<typename Key, class Comparator>
+int SkipList<Key, Comparator>::RandomHeightConcurrently() {
+    // Same distribution as RandomHeight(), driven by a shared
+    // Park-Miller generator (see util/random.h).
+    static const unsigned int kBranching = 4;
+    static const uint32_t M = 2147483647L;   // 2^31-1
+    static const uint64_t A = 16807;         // bits 14, 8, 7, 5, 2, 1, 0
+    int height = 1;
+    while (height < kMaxHeight) {
+        void* old_seed;
+        uint32_t seed;
+        do {
+            old_seed = concurrent_seed_.NoBarrier_Load();
+            uint64_t product =
+                static_cast<uint32_t>(reinterpret_cast<uintptr_t>(old_seed)) * A;
+            seed = static_cast<uint32_t>((product >> 31) + (product & M));
+            if (seed > M) {
+                seed -= M;
+            }
+        } while (!concurrent_seed_.CompareAndSwap(
+                     old_seed, reinterpret_cast<void*>(seed)));
+        if ((seed % kBranching) != 0) {
+            break;
+        }
+        height++;
+    }
+    assert(height > 0);
+    assert(height <= kMaxHeight);
+    return height;
+}
+
+template<typename Key, class Comparator>
+bool SkipList<Key, Comparator>::KeyIsAfterNode(const Key& key, Node* n) const {
+    // NULL n is considered infinite
+    return (n != NULL) && (compare_(n->key, key) < 0);
+}
+
+template<typename Key, class Comparator>
+typename SkipList<Key, Comparator>::Node*
+SkipList<Key, Comparator>::FindGreaterOrEqual(const Key& key, Node** prev)
+    const {
+    Node* x = head_;
+    int level = GetMaxHeight() - 1;
+    while (true) {
+        Node* next = x->Next(level);
+        if (KeyIsAfterNode(key, next)) {
+            // Keep searching in this list
+            x = next;
+        } else {
+            if (prev != NULL) prev[level] = x;
+            if (level == 0) {
+                return next;
+            } else {
+                // Switch to next list
+                level--;
+            }
+        }
+    }
+}
+
+template<typename Key, class Comparator>
+void SkipList<Key, Comparator>::FindSpliceForLevel(const Key& key,
+                                                   Node* before, int level,
+                                                   Node** out_prev,
+                                                   Node** out_next) const {
+    while (true) {
+        Node* next = before->Next(level);
+        if (KeyIsAfterNode(key, next)) {
+            before = next;
+        } else {
+            *out_prev = before;
+            *out_next = next;
+            return;
+        }
+    }
+}
+
+template<typename Key, class Comparator>
+typename SkipList<Key, Comparator>::Node*
+SkipList<Key, Comparator>::FindLessThan(const Key& key) const {
+    Node* x = head_;
+    int level = GetMaxHeight() - 1;
+    while (true) {
+        assert(x == head_ || compare_(x->key, key) < 0);
+        Node* next = x->Next(level);
+        if (next == NULL || compare_(next->key, key) >= 0) {
+            if (level == 0) {
+                return x;
+            } else {
+                // Switch to next list
+                level--;
+            }
+        } else {
+            x = next;
+        }
+    }
+}
+
+template<typename Key, class Comparator>
+typename SkipList<Key, Comparator>::Node* SkipList<Key, Comparator>::FindLast()
+    const {
+    Node* x = head_;
+    int level = GetMaxHeight() - 1;
+    while (true) {
+        Node* next = x->Next(level);
+        if (next == NULL) {
+            if (level == 0) {
+                return x;
+            } else {
+                // Switch to next list
+                level--;
+            }
+        } else {
+            x = next;
+        }
+    }
 }
 
 // constructor
@@ -55,12 +398,105 @@ template<typename Key, class Comparator>
 SkipList<Key, Comparator>::SkipList(Comparator cmp, Arena* arena)
     : compare_(cmp),
       arena_(arena),
-      head_(NewNode(0, kMaxHeight)),
-      rnd_(oxdeadbeef) {
-          for (int i = 0; i< kMaxHeight; i++) { 
-            head_->SetNext(i, NULL) ;
-          }
-      }
+      head_(NewNode(0 /* any key will do */, kMaxHeight)),
+      max_height_(reinterpret_cast<void*>(1)),
+      rnd_(0xdeadbeef),
+      concurrent_seed_(reinterpret_cast<void*>(0xdeadbeef & 0x7fffffffu)) {
+    for (int i = 0; i < kMaxHeight; i++) {
+        head_->SetNext(i, NULL);
+    }
+}
+
+template<typename Key, class Comparator>
+void SkipList<Key, Comparator>::Insert(const Key& key) {
+    // TODO(opt): We can use a barrier-free variant of FindGreaterOrEqual()
+    // here since Insert() is externally synchronized.
+    Node* prev[kMaxHeight];
+    Node* x = FindGreaterOrEqual(key, prev);
+
+    // Our data structure does not allow duplicate insertion
+    assert(x == NULL || !Equal(key, x->key));
+
+    int height = RandomHeight();
+    if (height > GetMaxHeight()) {
+        for (int i = GetMaxHeight(); i < height; i++) {
+            prev[i] = head_;
+        }
+        // It is ok to mutate max_height_ without any synchronization
+        // with concurrent readers.  A concurrent reader that observes
+        // the new value of max_height_ will see either the old value of
+        // new level pointers from head_ (NULL), or a new value set in
+        // the loop below.  In the former case the reader will
+        // immediately drop to the next level since NULL sorts after all
+        // keys.  In the latter case the reader will use the new node.
+        max_height_.NoBarrier_Store(reinterpret_cast<void*>(height));
+    }
+
+    x = NewNode(key, height);
+    for (int i = 0; i < height; i++) {
+        // NoBarrier_SetNext() suffices since we will add a barrier when
+        // we publish a pointer to "x" in prev[i].
+        x->NoBarrier_SetNext(i, prev[i]->NoBarrier_Next(i));
+        prev[i]->SetNext(i, x);
+    }
+}
+
+template<typename Key, class Comparator>
+void SkipList<Key, Comparator>::InsertConcurrently(const Key& key) {
+    const int height = RandomHeightConcurrently();
+    char* mem = arena_->AllocateAlignedConcurrently(
+        sizeof(Node) + sizeof(port::AtomicPointer) * (height - 1));
+    Node* x = new (mem) Node(key);
+
+    // Raise max_height_ if needed.  Readers that see the new height
+    // before x is linked in just find NULL (or other new nodes) at the
+    // new levels, as in Insert().
+    int max_height = GetMaxHeight();
+    while (height > max_height) {
+        if (max_height_.CompareAndSwap(reinterpret_cast<void*>(max_height),
+                                       reinterpret_cast<void*>(height))) {
+            max_height = height;
+            break;
+        }
+        max_height = GetMaxHeight();
+    }
+
+    // Compute the splice at every level from the top down, reusing the
+    // predecessor found at each level as the start of the next.
+    Node* prev[kMaxHeight];
+    Node* next[kMaxHeight];
+    Node* before = head_;
+    for (int i = max_height - 1; i >= 0; i--) {
+        FindSpliceForLevel(key, before, i, &prev[i], &next[i]);
+        before = prev[i];
+    }
+
+    // Link x in from the bottom up so that it is reachable at level 0
+    // before any higher level.  If another thread linked a node between
+    // prev[i] and next[i] first, recompute the splice at that level
+    // (starting from prev[i], which still precedes key) and retry.
+    for (int i = 0; i < height; i++) {
+        while (true) {
+            // Our data structure does not allow duplicate insertion
+            assert(next[i] == NULL || !Equal(key, next[i]->key));
+            x->NoBarrier_SetNext(i, next[i]);
+            if (prev[i]->CASNext(i, next[i], x)) {
+                break;
+            }
+            FindSpliceForLevel(key, prev[i], i, &prev[i], &next[i]);
+        }
+    }
+}
+
+template<typename Key, class Comparator>
+bool SkipList<Key, Comparator>::Contains(const Key& key) const {
+    Node* x = FindGreaterOrEqual(key, NULL);
+    if (x != NULL && Equal(key, x->key)) {
+        return true;
+    } else {
+        return false;
+    }
+}
 
 } // namespace leveldb
 
@@ -0,0 +1,113 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/memtablerep.h"
+
+#include "db/skiplist.h"
+#include "util/arena.h"
+
+namespace leveldb {
+
+MemTableRep::KeyComparator::~KeyComparator() { }
+
+MemTableRep::~MemTableRep() { }
+
+void MemTableRep::InsertConcurrently(const char* entry) {
+  // Only reached if the caller ignored IsInsertConcurrentlySupported()
+  assert(false);
+  Insert(entry);
+}
+
+const char* MemTableRep::Lookup(const Slice& internal_key,
+                                const char* memtable_key) {
+  Iterator* iter = GetIterator();
+  iter->Seek(internal_key, memtable_key);
+  const char* result = iter->Valid() ? iter->key() : NULL;
+  delete iter;
+  return result;
+}
+
+MemTableRep::Iterator::~Iterator() { }
+
+MemTableRepFactory::~MemTableRepFactory() { }
+
+namespace {
+
+class SkipListRep : public MemTableRep {
+ public:
+  SkipListRep(const MemTableRep::KeyComparator& cmp, Arena* arena)
+      : list_(cmp, arena) {
+  }
+
+  virtual void Insert(const char* entry) {
+    list_.Insert(entry);
+  }
+
+  virtual bool IsInsertConcurrentlySupported() const { return true; }
+
+  virtual void InsertConcurrently(const char* entry) {
+    list_.InsertConcurrently(entry);
+  }
+
+  virtual size_t ApproximateMemoryUsage() {
+    // All nodes are allocated from the arena
+    return 0;
+  }
+
+  virtual MemTableRep::Iterator* GetIterator();
+
+  virtual const char* Lookup(const Slice& internal_key,
+                             const char* memtable_key) {
+    List::Iterator iter(&list_);
+    iter.Seek(memtable_key);
+    return iter.Valid() ? iter.key() : NULL;
+  }
+
+ private:
+  typedef SkipList<const char*, const MemTableRep::KeyComparator&> List;
+
+  class Iterator : public MemTableRep::Iterator {
+   public:
+    explicit Iterator(const List* list) : iter_(list) { }
+
+    virtual bool Valid() const { return iter_.Valid(); }
+    virtual const char* key() const { return iter_.key(); }
+    virtual void Next() { iter_.Next(); }
+    virtual void Prev() { iter_.Prev(); }
+    virtual void SeekToFirst() { iter_.SeekToFirst(); }
+    virtual void SeekToLast() { iter_.SeekToLast(); }
+    virtual void Seek(const Slice& internal_key, const char* memtable_key) {
+      iter_.Seek(memtable_key);
+    }
+
+   private:
+    List::Iterator iter_;
+  };
+
+  List list_;
+};
+
+MemTableRep::Iterator* SkipListRep::GetIterator() {
+  return new Iterator(&list_);
+}
+
+class SkipListRepFactory : public MemTableRepFactory {
+ public:
+  virtual const char* Name() const { return "SkipListRepFactory"; }
+
+  virtual MemTableRep* CreateMemTableRep(
+      const MemTableRep::KeyComparator& cmp, Arena* arena) const {
+    return new SkipListRep(cmp, arena);
+  }
+
+  virtual bool IsInsertConcurrentlySupported() const { return true; }
+};
+
+}  // namespace
+
+MemTableRepFactory* NewSkipListRepFactory() {
+  return new SkipListRepFactory;
+}
+
+}  // namespace leveldb
@@ -7,6 +7,7 @@
 #include "leveldb/env.h"
 #include "util/arena.h"
 #include "util/hash.h"
+#include "util/mutexlock.h"
 #include "util/random.h"
 #include "util/testharness.h"
 
@@ -371,6 +372,76 @@ TEST(SkipTest, Concurrent3) { RunConcurrent(3); }
 TEST(SkipTest, Concurrent4) { RunConcurrent(4); }
 TEST(SkipTest, Concurrent5) { RunConcurrent(5); }
 
+// Several threads call InsertConcurrently() on disjoint keys at once;
+// afterwards every key must be present exactly once and in order.
+namespace {
+struct MultiWriterState {
+  SkipList<Key, Comparator>* list;
+  int num_threads;
+  int keys_per_thread;
+  port::Mutex mu;
+  port::CondVar cv;
+  int running;
+
+  MultiWriterState() : cv(&mu), running(0) { }
+};
+
+struct MultiWriterArg {
+  MultiWriterState* state;
+  int id;
+};
+
+static void MultiWriter(void* arg) {
+  MultiWriterArg* a = reinterpret_cast<MultiWriterArg*>(arg);
+  MultiWriterState* state = a->state;
+  for (int i = 0; i < state->keys_per_thread; i++) {
+    // Interleave the keys of all threads
+    state->list->InsertConcurrently(
+        static_cast<Key>(i) * state->num_threads + a->id);
+  }
+  MutexLock l(&state->mu);
+  state->running--;
+  state->cv.Signal();
+}
+}  // namespace
+
+TEST(SkipTest, ConcurrentInsert) {
+  Arena arena;
+  Comparator cmp;
+  SkipList<Key, Comparator> list(cmp, &arena);
+
+  MultiWriterState state;
+  state.list = &list;
+  state.num_threads = 4;
+  state.keys_per_thread = 20000;
+  state.running = state.num_threads;
+  MultiWriterArg args[4];
+  for (int id = 0; id < state.num_threads; id++) {
+    args[id].state = &state;
+    args[id].id = id;
+    Env::Default()->StartThread(MultiWriter, &args[id]);
+  }
+  {
+    MutexLock l(&state.mu);
+    while (state.running > 0) {
+      state.cv.Wait();
+    }
+  }
+
+  const Key total = static_cast<Key>(state.num_threads) * state.keys_per_thread;
+  SkipList<Key, Comparator>::Iterator iter(&list);
+  iter.SeekToFirst();
+  for (Key k = 0; k < total; k++) {
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(k, iter.key());
+    iter.Next();
+  }
+  ASSERT_TRUE(!iter.Valid());
+  for (Key k = 0; k < total; k += 97) {
+    ASSERT_TRUE(list.Contains(k));
+  }
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
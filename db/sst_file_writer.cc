@@ -0,0 +1,122 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/sst_file_writer.h"
+
+#include "db/dbformat.h"
+#include "leveldb/env.h"
+#include "leveldb/table_builder.h"
+
+namespace leveldb {
+
+struct SstFileWriter::Rep {
+  InternalKeyComparator internal_comparator;
+  InternalFilterPolicy internal_filter_policy;
+  InternalKeySliceTransform internal_prefix_extractor;
+  Options options;  // Uses the internal comparator, filter policy and
+                    // prefix extractor
+  WritableFile* file;
+  TableBuilder* builder;
+  std::string last_key;  // Last user key added
+  uint64_t file_size;
+
+  explicit Rep(const Options& raw_options)
+      : internal_comparator(raw_options.comparator),
+        internal_filter_policy(raw_options.filter_policy),
+        internal_prefix_extractor(raw_options.prefix_extractor),
+        options(raw_options),
+        file(NULL),
+        builder(NULL),
+        file_size(0) {
+    options.comparator = &internal_comparator;
+    if (raw_options.filter_policy != NULL) {
+      options.filter_policy = &internal_filter_policy;
+    }
+    if (raw_options.prefix_extractor != NULL) {
+      options.prefix_extractor = &internal_prefix_extractor;
+    }
+  }
+};
+
+SstFileWriter::SstFileWriter(const Options& options)
+    : rep_(new Rep(options)) {
+}
+
+SstFileWriter::~SstFileWriter() {
+  if (rep_->builder != NULL) {
+    rep_->builder->Abandon();
+    delete rep_->builder;
+  }
+  delete rep_->file;
+  delete rep_;
+}
+
+Status SstFileWriter::Open(const std::string& fname) {
+  if (rep_->file != NULL) {
+    return Status::InvalidArgument("SstFileWriter is already open");
+  }
+  Status s = rep_->options.env->NewWritableFile(fname, &rep_->file);
+  if (s.ok()) {
+    rep_->builder = new TableBuilder(rep_->options, rep_->file);
+  }
+  return s;
+}
+
+Status SstFileWriter::Put(const Slice& key, const Slice& value) {
+  return Add(key, value, false);
+}
+
+Status SstFileWriter::Delete(const Slice& key) {
+  return Add(key, Slice(), true);
+}
+
+// Entries are stored with sequence number zero.  DB::IngestExternalFiles()
+// decides which sequence number they are read with.
+Status SstFileWriter::Add(const Slice& key, const Slice& value,
+                          bool deletion) {
+  if (rep_->builder == NULL) {
+    return Status::InvalidArgument("SstFileWriter is not open");
+  }
+  if (rep_->builder->NumEntries() > 0 &&
+      rep_->internal_comparator.user_comparator()->Compare(
+          key, rep_->last_key) <= 0) {
+    return Status::InvalidArgument("keys must be added in strictly "
+                                   "increasing order", key);
+  }
+  InternalKey ikey(key, 0, deletion ? kTypeDeletion : kTypeValue);
+  rep_->builder->Add(ikey.Encode(), value);
+  rep_->last_key.assign(key.data(), key.size());
+  return rep_->builder->status();
+}
+
+Status SstFileWriter::Finish() {
+  if (rep_->builder == NULL) {
+    return Status::InvalidArgument("SstFileWriter is not open");
+  }
+  if (rep_->builder->NumEntries() == 0) {
+    return Status::InvalidArgument("cannot finish an empty file");
+  }
+  Status s = rep_->builder->Finish();
+  rep_->file_size = rep_->builder->FileSize();
+  delete rep_->builder;
+  rep_->builder = NULL;
+  if (s.ok()) {
+    s = rep_->file->Sync();
+  }
+  if (s.ok()) {
+    s = rep_->file->Close();
+  }
+  delete rep_->file;
+  rep_->file = NULL;
+  return s;
+}
+
+uint64_t SstFileWriter::FileSize() const {
+  if (rep_->builder != NULL) {
+    return rep_->builder->FileSize();
+  }
+  return rep_->file_size;
+}
+
+}  // namespace leveldb
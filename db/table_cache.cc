@@ -4,6 +4,7 @@
 
 #include "db/table_cache.h"
 
+#include <vector>
 #include "db/filename.h"
 #include "leveldb/env.h"
 #include "leveldb/table.h"
@@ -29,6 +30,70 @@ static void UnrefEntry(void* arg1, void* arg2) {
   cache->Release(h);
 }
 
+// Replace the sequence number of internal key "key" by "seq".
+static void SetSequence(const Slice& key, SequenceNumber seq,
+                        std::string* result) {
+  ParsedInternalKey parsed;
+  result->clear();
+  if (ParseInternalKey(key, &parsed)) {
+    parsed.sequence = seq;
+    AppendInternalKey(result, parsed);
+  } else {
+    result->assign(key.data(), key.size());  // Let the caller see corruption
+  }
+}
+
+// Iterator over a table built by SstFileWriter.  Its keys are stored
+// with sequence number zero and are reported with the sequence number
+// the table was ingested with.  A table holds at most one entry per user
+// key, so rewriting the sequence numbers does not change the order.
+class GlobalSeqnoIterator : public Iterator {
+ public:
+  GlobalSeqnoIterator(Iterator* iter, SequenceNumber global_seqno)
+      : iter_(iter), global_seqno_(global_seqno) { }
+  virtual ~GlobalSeqnoIterator() {
+    delete iter_;
+  }
+  virtual bool Valid() const { return iter_->Valid(); }
+  virtual void SeekToFirst() { iter_->SeekToFirst(); Update(); }
+  virtual void SeekToLast() { iter_->SeekToLast(); Update(); }
+  virtual void Seek(const Slice& target) { iter_->Seek(target); Update(); }
+  virtual void Next() { iter_->Next(); Update(); }
+  virtual void Prev() { iter_->Prev(); Update(); }
+  virtual Slice key() const { return key_; }
+  virtual Slice value() const { return iter_->value(); }
+  virtual Status status() const { return iter_->status(); }
+
+ private:
+  void Update() {
+    if (iter_->Valid()) {
+      SetSequence(iter_->key(), global_seqno_, &key_);
+    }
+  }
+
+  Iterator* const iter_;
+  const SequenceNumber global_seqno_;
+  std::string key_;
+};
+
+struct GlobalSeqnoSaver {
+  SequenceNumber global_seqno;
+  SequenceNumber snapshot;  // Sequence number of the key looked up
+  void* arg;
+  bool (*saver)(void*, const Slice&, const Slice&);
+};
+
+static bool SaveWithGlobalSeqno(void* arg, const Slice& k, const Slice& v) {
+  GlobalSeqnoSaver* s = reinterpret_cast<GlobalSeqnoSaver*>(arg);
+  if (s->global_seqno > s->snapshot) {
+    // Ingested after the snapshot being read
+    return false;
+  }
+  std::string key;
+  SetSequence(k, s->global_seqno, &key);
+  return (*s->saver)(s->arg, key, v);
+}
+
 TableCache::TableCache(const std::string& dbname,
                        const Options* options,
                        int entries)
@@ -82,6 +147,7 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
 Iterator* TableCache::NewIterator(const ReadOptions& options,
                                   uint64_t file_number,
                                   uint64_t file_size,
+                                  SequenceNumber global_seqno,
                                   Table** tableptr) {
   if (tableptr != NULL) {
     *tableptr = NULL;
@@ -96,23 +162,84 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
   Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
   Iterator* result = table->NewIterator(options);
   result->RegisterCleanup(&UnrefEntry, cache_, handle);
+  if (global_seqno != 0) {
+    result = new GlobalSeqnoIterator(result, global_seqno);
+  }
   if (tableptr != NULL) {
     *tableptr = table;
   }
   return result;
 }
 
+Iterator* TableCache::NewRangeTombstoneIterator(uint64_t file_number,
+                                                uint64_t file_size) {
+  Cache::Handle* handle = NULL;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+
+  Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+  Iterator* result = table->NewRangeTombstoneIterator();
+  result->RegisterCleanup(&UnrefEntry, cache_, handle);
+  return result;
+}
+
 Status TableCache::Get(const ReadOptions& options,
                        uint64_t file_number,
                        uint64_t file_size,
+                       SequenceNumber global_seqno,
                        const Slice& k,
                        void* arg,
-                       void (*saver)(void*, const Slice&, const Slice&)) {
+                       bool (*saver)(void*, const Slice&, const Slice&)) {
+  Cache::Handle* handle = NULL;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    if (global_seqno != 0) {
+      GlobalSeqnoSaver gs;
+      gs.global_seqno = global_seqno;
+      gs.snapshot = DecodeFixed64(k.data() + k.size() - 8) >> 8;
+      gs.arg = arg;
+      gs.saver = saver;
+      s = t->InternalGet(options, k, &gs, &SaveWithGlobalSeqno);
+    } else {
+      s = t->InternalGet(options, k, arg, saver);
+    }
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+Status TableCache::MultiGet(const ReadOptions& options,
+                            uint64_t file_number,
+                            uint64_t file_size,
+                            SequenceNumber global_seqno,
+                            int n,
+                            const Slice* keys,
+                            void* const* args,
+                            bool (*saver)(void*, const Slice&, const Slice&),
+                            Status* statuses) {
   Cache::Handle* handle = NULL;
   Status s = FindTable(file_number, file_size, &handle);
   if (s.ok()) {
     Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
-    s = t->InternalGet(options, k, arg, saver);
+    if (global_seqno != 0) {
+      std::vector<GlobalSeqnoSaver> gs(n);
+      std::vector<void*> gs_args(n);
+      for (int i = 0; i < n; i++) {
+        gs[i].global_seqno = global_seqno;
+        gs[i].snapshot =
+            DecodeFixed64(keys[i].data() + keys[i].size() - 8) >> 8;
+        gs[i].arg = args[i];
+        gs[i].saver = saver;
+        gs_args[i] = &gs[i];
+      }
+      t->InternalMultiGet(options, n, keys, &gs_args[0],
+                          &SaveWithGlobalSeqno, statuses);
+    } else {
+      t->InternalMultiGet(options, n, keys, args, saver, statuses);
+    }
     cache_->Release(handle);
   }
   return s;
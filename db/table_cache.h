@@ -24,7 +24,9 @@ class TableCache {
   ~TableCache();
 
   // Return an iterator for the specified file number (the corresponding
-  // file length must be exactly "file_size" bytes).  If "tableptr" is
+  // file length must be exactly "file_size" bytes).  If "global_seqno"
+  // is non-zero, the file was built by SstFileWriter and the iterator
+  // reports its keys with that sequence number.  If "tableptr" is
   // non-NULL, also sets "*tableptr" to point to the Table object
   // underlying the returned iterator, or NULL if no Table object underlies
   // the returned iterator.  The returned "*tableptr" object is owned by
@@ -33,16 +35,39 @@ class TableCache {
   Iterator* NewIterator(const ReadOptions& options,
                         uint64_t file_number,
                         uint64_t file_size,
+                        SequenceNumber global_seqno,
                         Table** tableptr = NULL);
 
+  // Return an iterator over the range tombstones of the specified file.
+  Iterator* NewRangeTombstoneIterator(uint64_t file_number,
+                                      uint64_t file_size);
+
   // If a seek to internal key "k" in specified file finds an entry,
-  // call (*handle_result)(arg, found_key, found_value).
+  // call (*handle_result)(arg, found_key, found_value), and again for
+  // each following entry while handle_result returns true.
+  // "global_seqno" is as for NewIterator(); entries it hides from "k"
+  // are not reported.
   Status Get(const ReadOptions& options,
              uint64_t file_number,
              uint64_t file_size,
+             SequenceNumber global_seqno,
              const Slice& k,
              void* arg,
-             void (*handle_result)(void*, const Slice&, const Slice&));
+             bool (*handle_result)(void*, const Slice&, const Slice&));
+
+  // Same as calling Get(keys[i], args[i], handle_result) for i in [0,n),
+  // but with a single lookup of the table.  If the table can be opened,
+  // stores the result of each lookup in statuses[i] and returns OK.
+  // REQUIRES: "keys" are sorted.
+  Status MultiGet(const ReadOptions& options,
+                  uint64_t file_number,
+                  uint64_t file_size,
+                  SequenceNumber global_seqno,
+                  int n,
+                  const Slice* keys,
+                  void* const* args,
+                  bool (*handle_result)(void*, const Slice&, const Slice&),
+                  Status* statuses);
 
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
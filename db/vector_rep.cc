@@ -0,0 +1,243 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/memtablerep.h"
+
+#include <algorithm>
+#include <vector>
+#include "port/port.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+namespace {
+
+typedef std::vector<const char*> Bucket;
+
+// Adapts a MemTableRep::KeyComparator to std::sort() and friends
+struct EntryLess {
+  const MemTableRep::KeyComparator* compare;
+  explicit EntryLess(const MemTableRep::KeyComparator* c) : compare(c) { }
+  bool operator()(const char* a, const char* b) const {
+    return (*compare)(a, b) < 0;
+  }
+};
+
+// An immutable, sorted copy of a prefix of a VectorRep's bucket.  Shared
+// by every reader until entries are appended to the bucket.
+struct SortedBucket {
+  Bucket entries;
+  int refs;    // Protected by the owning VectorRep's mu_
+};
+
+class VectorRep : public MemTableRep {
+ public:
+  VectorRep(const MemTableRep::KeyComparator& cmp, size_t reserve)
+      : compare_(cmp),
+        read_only_(false),
+        sorted_(NULL) {
+    bucket_.reserve(reserve);
+  }
+
+  virtual ~VectorRep() {
+    if (sorted_ != NULL) {
+      UnrefLocked(sorted_);
+    }
+  }
+
+  virtual void Insert(const char* entry) {
+    MutexLock l(&mu_);
+    assert(!read_only_);
+    bucket_.push_back(entry);
+  }
+
+  // Appends are serialized by mu_
+  virtual bool IsInsertConcurrentlySupported() const { return true; }
+
+  virtual void InsertConcurrently(const char* entry) {
+    Insert(entry);
+  }
+
+  virtual void MarkReadOnly() {
+    MutexLock l(&mu_);
+    read_only_ = true;
+  }
+
+  virtual size_t ApproximateMemoryUsage() {
+    MutexLock l(&mu_);
+    size_t usage = sizeof(const char*) * bucket_.capacity();
+    if (sorted_ != NULL) {
+      usage += sizeof(const char*) * sorted_->entries.capacity();
+    }
+    return usage;
+  }
+
+  virtual MemTableRep::Iterator* GetIterator();
+  virtual const char* Lookup(const Slice& internal_key,
+                             const char* memtable_key);
+
+ private:
+  class Iterator;
+
+  const MemTableRep::KeyComparator& compare_;
+  port::Mutex mu_;
+  Bucket bucket_;         // Entries in insertion order
+  bool read_only_;        // No more Insert() calls
+  SortedBucket* sorted_;  // Latest sorted copy of a prefix of bucket_, or NULL
+
+  // Return a sorted copy of every entry inserted so far.  The copy is
+  // only rebuilt when entries were appended since the last one was made,
+  // and then only the new entries are sorted and merged into it.  The
+  // sort and merge run without holding mu_.  The caller must call
+  // Unref() on the result.
+  SortedBucket* Sorted();
+
+  void Unref(SortedBucket* sorted) {
+    MutexLock l(&mu_);
+    UnrefLocked(sorted);
+  }
+
+  // REQUIRES: mu_ is held, or no other thread can reach "sorted"
+  void UnrefLocked(SortedBucket* sorted) {
+    assert(sorted->refs > 0);
+    if (--sorted->refs == 0) {
+      delete sorted;
+    }
+  }
+};
+
+SortedBucket* VectorRep::Sorted() {
+  SortedBucket* base;
+  Bucket tail;
+  {
+    MutexLock l(&mu_);
+    base = sorted_;
+    const size_t done = (base == NULL) ? 0 : base->entries.size();
+    if (base != NULL) {
+      base->refs++;
+      if (done == bucket_.size()) {
+        return base;
+      }
+    }
+    tail.assign(bucket_.begin() + done, bucket_.end());
+  }
+
+  // Sort the new entries and merge them into the previous copy, which
+  // is immutable and so safe to read without mu_.
+  EntryLess less(&compare_);
+  std::sort(tail.begin(), tail.end(), less);
+  SortedBucket* result = new SortedBucket;
+  result->refs = 1;
+  if (base == NULL) {
+    result->entries.swap(tail);
+  } else {
+    result->entries.resize(base->entries.size() + tail.size());
+    std::merge(base->entries.begin(), base->entries.end(),
+               tail.begin(), tail.end(), result->entries.begin(), less);
+  }
+
+  MutexLock l(&mu_);
+  if (base != NULL) {
+    UnrefLocked(base);
+  }
+  // Another reader may have published a longer copy in the meantime
+  if (sorted_ == NULL || sorted_->entries.size() < result->entries.size()) {
+    if (sorted_ != NULL) {
+      UnrefLocked(sorted_);
+    }
+    sorted_ = result;
+    result->refs++;
+  }
+  return result;
+}
+
+// Iterates over a sorted copy of the bucket.
+class VectorRep::Iterator : public MemTableRep::Iterator {
+ public:
+  // Takes over the caller's reference to "sorted"
+  Iterator(VectorRep* rep, SortedBucket* sorted)
+      : rep_(rep),
+        sorted_(sorted),
+        bucket_(&sorted->entries),
+        pos_(bucket_->size()) {
+  }
+
+  virtual ~Iterator() {
+    rep_->Unref(sorted_);
+  }
+
+  virtual bool Valid() const { return pos_ < bucket_->size(); }
+
+  virtual const char* key() const {
+    assert(Valid());
+    return (*bucket_)[pos_];
+  }
+
+  virtual void Next() {
+    assert(Valid());
+    pos_++;
+  }
+
+  virtual void Prev() {
+    assert(Valid());
+    pos_ = (pos_ == 0) ? bucket_->size() : pos_ - 1;
+  }
+
+  virtual void SeekToFirst() { pos_ = 0; }
+
+  virtual void SeekToLast() {
+    pos_ = bucket_->empty() ? 0 : bucket_->size() - 1;
+  }
+
+  virtual void Seek(const Slice& internal_key, const char* memtable_key) {
+    pos_ = std::lower_bound(bucket_->begin(), bucket_->end(), memtable_key,
+                            EntryLess(&rep_->compare_)) - bucket_->begin();
+  }
+
+ private:
+  VectorRep* const rep_;
+  SortedBucket* const sorted_;
+  const Bucket* const bucket_;
+  size_t pos_;
+};
+
+MemTableRep::Iterator* VectorRep::GetIterator() {
+  return new Iterator(this, Sorted());
+}
+
+const char* VectorRep::Lookup(const Slice& internal_key,
+                              const char* memtable_key) {
+  SortedBucket* sorted = Sorted();
+  Bucket::const_iterator pos = std::lower_bound(
+      sorted->entries.begin(), sorted->entries.end(), memtable_key,
+      EntryLess(&compare_));
+  const char* result = (pos == sorted->entries.end()) ? NULL : *pos;
+  Unref(sorted);
+  return result;
+}
+
+class VectorRepFactory : public MemTableRepFactory {
+ public:
+  explicit VectorRepFactory(size_t reserve) : reserve_(reserve) { }
+
+  virtual const char* Name() const { return "VectorRepFactory"; }
+
+  virtual MemTableRep* CreateMemTableRep(
+      const MemTableRep::KeyComparator& cmp, Arena* arena) const {
+    return new VectorRep(cmp, reserve_);
+  }
+
+  virtual bool IsInsertConcurrentlySupported() const { return true; }
+
+ private:
+  const size_t reserve_;
+};
+
+}  // namespace
+
+MemTableRepFactory* NewVectorRepFactory(size_t reserve) {
+  return new VectorRepFactory(reserve);
+}
+
+}  // namespace leveldb
@@ -20,7 +20,9 @@ enum Tag {
   kDeletedFile          = 6,
   kNewFile              = 7,
   // 8 was used for large value refs
-  kPrevLogNumber        = 9
+  kPrevLogNumber        = 9,
+  kIngestedFile         = 10,
+  kRangeDelFile         = 11
 };
 
 void VersionEdit::Clear() {
@@ -76,12 +78,21 @@ void VersionEdit::EncodeTo(std::string* dst) const {
 
   for (size_t i = 0; i < new_files_.size(); i++) {
     const FileMetaData& f = new_files_[i].second;
-    PutVarint32(dst, kNewFile);
+    if (f.global_seqno != 0) {
+      PutVarint32(dst, kIngestedFile);
+    } else if (f.has_range_deletions) {
+      PutVarint32(dst, kRangeDelFile);
+    } else {
+      PutVarint32(dst, kNewFile);
+    }
     PutVarint32(dst, new_files_[i].first);  // level
     PutVarint64(dst, f.number);
     PutVarint64(dst, f.file_size);
     PutLengthPrefixedSlice(dst, f.smallest.Encode());
     PutLengthPrefixedSlice(dst, f.largest.Encode());
+    if (f.global_seqno != 0) {
+      PutVarint64(dst, f.global_seqno);
+    }
   }
 }
 
@@ -186,12 +197,42 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
             GetVarint64(&input, &f.file_size) &&
             GetInternalKey(&input, &f.smallest) &&
             GetInternalKey(&input, &f.largest)) {
+          f.global_seqno = 0;
+          f.has_range_deletions = false;
           new_files_.push_back(std::make_pair(level, f));
         } else {
           msg = "new-file entry";
         }
         break;
 
+      case kRangeDelFile:
+        if (GetLevel(&input, &level) &&
+            GetVarint64(&input, &f.number) &&
+            GetVarint64(&input, &f.file_size) &&
+            GetInternalKey(&input, &f.smallest) &&
+            GetInternalKey(&input, &f.largest)) {
+          f.global_seqno = 0;
+          f.has_range_deletions = true;
+          new_files_.push_back(std::make_pair(level, f));
+        } else {
+          msg = "range-deletion-file entry";
+        }
+        break;
+
+      case kIngestedFile:
+        if (GetLevel(&input, &level) &&
+            GetVarint64(&input, &f.number) &&
+            GetVarint64(&input, &f.file_size) &&
+            GetInternalKey(&input, &f.smallest) &&
+            GetInternalKey(&input, &f.largest) &&
+            GetVarint64(&input, &f.global_seqno)) {
+          f.has_range_deletions = false;
+          new_files_.push_back(std::make_pair(level, f));
+        } else {
+          msg = "ingested-file entry";
+        }
+        break;
+
       default:
         msg = "unknown tag";
         break;
@@ -258,6 +299,13 @@ std::string VersionEdit::DebugString() const {
     r.append(f.smallest.DebugString());
     r.append(" .. ");
     r.append(f.largest.DebugString());
+    if (f.global_seqno != 0) {
+      r.append(" @ ");
+      AppendNumberTo(&r, f.global_seqno);
+    }
+    if (f.has_range_deletions) {
+      r.append(" (range deletions)");
+    }
   }
   r.append("\n}\n");
   return r;
@@ -21,8 +21,12 @@ struct FileMetaData {
   uint64_t file_size;         // File size in bytes
   InternalKey smallest;       // Smallest internal key served by table
   InternalKey largest;        // Largest internal key served by table
+  SequenceNumber global_seqno;  // If non-zero, sequence of every key
+  bool has_range_deletions;     // Whether the table holds range tombstones
 
-  FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) { }
+  FileMetaData()
+      : refs(0), allowed_seeks(1 << 30), file_size(0), global_seqno(0),
+        has_range_deletions(false) { }
 };
 
 class VersionEdit {
@@ -71,6 +75,37 @@ class VersionEdit {
     new_files_.push_back(std::make_pair(level, f));
   }
 
+  // Same as above, for a file whose entries are stored with sequence
+  // number zero and are read as if they had sequence number
+  // "global_seqno" instead (files built by SstFileWriter).  A zero
+  // "global_seqno" means that entries carry their own sequence numbers.
+  void AddFile(int level, uint64_t file,
+               uint64_t file_size,
+               const InternalKey& smallest,
+               const InternalKey& largest,
+               SequenceNumber global_seqno) {
+    FileMetaData f;
+    f.number = file;
+    f.file_size = file_size;
+    f.smallest = smallest;
+    f.largest = largest;
+    f.global_seqno = global_seqno;
+    new_files_.push_back(std::make_pair(level, f));
+  }
+
+  // Same as above, with the number, size, key range and attributes of
+  // "f".
+  void AddFile(int level, const FileMetaData& f) {
+    FileMetaData copy;
+    copy.number = f.number;
+    copy.file_size = f.file_size;
+    copy.smallest = f.smallest;
+    copy.largest = f.largest;
+    copy.global_seqno = f.global_seqno;
+    copy.has_range_deletions = f.has_range_deletions;
+    new_files_.push_back(std::make_pair(level, copy));
+  }
+
   // Delete the specified "file" from the specified "level".
   void DeleteFile(int level, uint64_t file) {
     deleted_files_.insert(std::make_pair(level, file));
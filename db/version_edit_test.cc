@@ -28,6 +28,17 @@ TEST(VersionEditTest, EncodeDecode) {
     edit.AddFile(3, kBig + 300 + i, kBig + 400 + i,
                  InternalKey("foo", kBig + 500 + i, kTypeValue),
                  InternalKey("zoo", kBig + 600 + i, kTypeDeletion));
+    edit.AddFile(5, kBig + 350 + i, kBig + 450 + i,
+                 InternalKey("bar", kBig + 550 + i, kTypeValue),
+                 InternalKey("baz", kBig + 550 + i, kTypeDeletion),
+                 kBig + 550 + i);
+    FileMetaData f;
+    f.number = kBig + 370 + i;
+    f.file_size = kBig + 470 + i;
+    f.smallest = InternalKey("cat", kBig + 570 + i, kTypeRangeDeletion);
+    f.largest = InternalKey("dog", kMaxSequenceNumber, kTypeRangeDeletion);
+    f.has_range_deletions = true;
+    edit.AddFile(6, f);
     edit.DeleteFile(4, kBig + 700 + i);
     edit.SetCompactPointer(i, InternalKey("x", kBig + 900 + i, kTypeValue));
   }
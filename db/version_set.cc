@@ -10,6 +10,8 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/merge_helper.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "leveldb/env.h"
 #include "leveldb/table_builder.h"
@@ -149,29 +151,55 @@ bool SomeFileOverlapsRange(
 // An internal iterator.  For a given version/level pair, yields
 // information about the files in the level.  For a given entry, key()
 // is the largest key that occurs in the file, and value() is an
-// 16-byte value containing the file number and file size, both
-// encoded using EncodeFixed64.
+// 24-byte value containing the file number, file size and global
+// sequence number, all encoded using EncodeFixed64.
+// If "prefix_extractor" is non-NULL, iterators positioned by Seek() stop
+// before the first file that starts past the keys with the prefix of the
+// target (see ReadOptions::prefix_same_as_start).
 class Version::LevelFileNumIterator : public Iterator {
  public:
   LevelFileNumIterator(const InternalKeyComparator& icmp,
-                       const std::vector<FileMetaData*>* flist)
+                       const std::vector<FileMetaData*>* flist,
+                       const SliceTransform* prefix_extractor)
       : icmp_(icmp),
         flist_(flist),
-        index_(flist->size()) {        // Marks as invalid
+        prefix_extractor_(prefix_extractor),
+        index_(flist->size()),        // Marks as invalid
+        prefix_bounded_(false) {
   }
   virtual bool Valid() const {
     return index_ < flist_->size();
   }
   virtual void Seek(const Slice& target) {
     index_ = FindFile(icmp_, *flist_, target);
+    prefix_bounded_ = (prefix_extractor_ != NULL &&
+                       prefix_extractor_->InDomain(target));
+    if (prefix_bounded_) {
+      Slice prefix = ExtractUserKey(prefix_extractor_->Transform(target));
+      prefix_.assign(prefix.data(), prefix.size());
+    }
+  }
+  virtual void SeekToFirst() {
+    index_ = 0;
+    prefix_bounded_ = false;
   }
-  virtual void SeekToFirst() { index_ = 0; }
   virtual void SeekToLast() {
     index_ = flist_->empty() ? 0 : flist_->size() - 1;
+    prefix_bounded_ = false;
   }
   virtual void Next() {
     assert(Valid());
     index_++;
+    if (prefix_bounded_ && Valid()) {
+      // Keys with the prefix are contiguous, so a file that does not
+      // start with one holds none.
+      const Slice smallest = (*flist_)[index_]->smallest.Encode();
+      if (!prefix_extractor_->InDomain(smallest) ||
+          ExtractUserKey(prefix_extractor_->Transform(smallest)) !=
+          Slice(prefix_)) {
+        index_ = flist_->size();
+      }
+    }
   }
   virtual void Prev() {
     assert(Valid());
@@ -189,36 +217,45 @@ class Version::LevelFileNumIterator : public Iterator {
     assert(Valid());
     EncodeFixed64(value_buf_, (*flist_)[index_]->number);
     EncodeFixed64(value_buf_+8, (*flist_)[index_]->file_size);
+    EncodeFixed64(value_buf_+16, (*flist_)[index_]->global_seqno);
     return Slice(value_buf_, sizeof(value_buf_));
   }
   virtual Status status() const { return Status::OK(); }
  private:
   const InternalKeyComparator icmp_;
   const std::vector<FileMetaData*>* const flist_;
+  const SliceTransform* const prefix_extractor_;
   uint32_t index_;
+  bool prefix_bounded_;
+  std::string prefix_;  // User key prefix of the Seek() target
 
-  // Backing store for value().  Holds the file number and size.
-  mutable char value_buf_[16];
+  // Backing store for value().  Holds the file number, size and global
+  // sequence number.
+  mutable char value_buf_[24];
 };
 
 static Iterator* GetFileIterator(void* arg,
                                  const ReadOptions& options,
                                  const Slice& file_value) {
   TableCache* cache = reinterpret_cast<TableCache*>(arg);
-  if (file_value.size() != 16) {
+  if (file_value.size() != 24) {
     return NewErrorIterator(
         Status::Corruption("FileReader invoked with unexpected value"));
   } else {
     return cache->NewIterator(options,
                               DecodeFixed64(file_value.data()),
-                              DecodeFixed64(file_value.data() + 8));
+                              DecodeFixed64(file_value.data() + 8),
+                              DecodeFixed64(file_value.data() + 16));
   }
 }
 
 Iterator* Version::NewConcatenatingIterator(const ReadOptions& options,
                                             int level) const {
+  const SliceTransform* prefix_extractor =
+      options.prefix_same_as_start ? vset_->options_->prefix_extractor : NULL;
   return NewTwoLevelIterator(
-      new LevelFileNumIterator(vset_->icmp_, &files_[level]),
+      new LevelFileNumIterator(vset_->icmp_, &files_[level],
+                               prefix_extractor),
       &GetFileIterator, vset_->table_cache_, options);
 }
 
@@ -228,7 +265,8 @@ void Version::AddIterators(const ReadOptions& options,
   for (size_t i = 0; i < files_[0].size(); i++) {
     iters->push_back(
         vset_->table_cache_->NewIterator(
-            options, files_[0][i]->number, files_[0][i]->file_size));
+            options, files_[0][i]->number, files_[0][i]->file_size,
+            files_[0][i]->global_seqno));
   }
 
   // For levels > 0, we can use a concatenating iterator that sequentially
@@ -241,6 +279,29 @@ void Version::AddIterators(const ReadOptions& options,
   }
 }
 
+static Status AddFileTombstones(TableCache* table_cache,
+                                const std::vector<FileMetaData*>& files,
+                                RangeDelAggregator* range_del) {
+  Status s;
+  for (size_t i = 0; s.ok() && i < files.size(); i++) {
+    if (files[i]->has_range_deletions) {
+      Iterator* iter = table_cache->NewRangeTombstoneIterator(
+          files[i]->number, files[i]->file_size);
+      s = range_del->AddTombstones(iter);
+      delete iter;
+    }
+  }
+  return s;
+}
+
+Status Version::AddRangeTombstones(RangeDelAggregator* range_del) {
+  Status s;
+  for (int level = 0; s.ok() && level < config::kNumLevels; level++) {
+    s = AddFileTombstones(vset_->table_cache_, files_[level], range_del);
+  }
+  return s;
+}
+
 // Callback from TableCache::Get()
 namespace {
 enum SaverState {
@@ -248,27 +309,100 @@ enum SaverState {
   kFound,
   kDeleted,
   kCorrupt,
+  kMerge,     // Found merge operands only; keep searching
 };
 struct Saver {
   SaverState state;
   const Comparator* ucmp;
   Slice user_key;
   std::string* value;
+  MergeContext* merge;
+  Status merge_status;  // Result of applying merge->operands if kFound
+  SequenceNumber tombstone;  // Entries older than this are deleted
 };
 }
-static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
+static bool SaveValue(void* arg, const Slice& ikey, const Slice& v) {
   Saver* s = reinterpret_cast<Saver*>(arg);
   ParsedInternalKey parsed_key;
   if (!ParseInternalKey(ikey, &parsed_key)) {
     s->state = kCorrupt;
-  } else {
-    if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
-      s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
-      if (s->state == kFound) {
-        s->value->assign(v.data(), v.size());
-      }
+  } else if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
+    MergeContext* merge = s->merge;
+    if (parsed_key.sequence < s->tombstone) {
+      parsed_key.type = kTypeDeletion;
+    }
+    switch (parsed_key.type) {
+      case kTypeValue:
+        s->state = kFound;
+        if (merge->operands.empty()) {
+          s->value->assign(v.data(), v.size());
+        } else {
+          s->merge_status = ApplyMergeOperands(
+              merge->merge_operator, merge->logger, s->user_key, &v,
+              merge->operands, s->value);
+        }
+        break;
+      case kTypeDeletion:
+      case kTypeSingleDeletion:
+        if (merge->operands.empty()) {
+          s->state = kDeleted;
+        } else {
+          s->state = kFound;
+          s->merge_status = ApplyMergeOperands(
+              merge->merge_operator, merge->logger, s->user_key, NULL,
+              merge->operands, s->value);
+        }
+        break;
+      case kTypeMerge:
+        // Older entries for the key follow
+        s->state = kMerge;
+        merge->operands.push_front(v.ToString());
+        return true;
+      case kTypeRangeDeletion:
+        s->state = kCorrupt;  // Kept in the range deletion block
+        break;
     }
   }
+  return false;
+}
+
+// Result of a lookup that finds no value for "user_key" beyond the merge
+// operands already collected.
+static Status DeletedValue(MergeContext* merge, const Slice& user_key,
+                           std::string* value) {
+  if (!merge->operands.empty()) {
+    return ApplyMergeOperands(merge->merge_operator, merge->logger,
+                              user_key, NULL, merge->operands, value);
+  }
+  return Status::NotFound(Slice());  // Use an empty error message for speed
+}
+
+// Handle the result of looking for saver.user_key in a table whose range
+// tombstones and those of the tables searched before it delete entries
+// older than "tombstone".  Returns true and stores the result of the
+// lookup in *s if no other table needs to be searched.
+static bool LookupDone(const Saver& saver, SequenceNumber tombstone,
+                       Status* s) {
+  switch (saver.state) {
+    case kNotFound:
+    case kMerge:
+      if (tombstone != 0) {
+        // Older entries for the key are deleted
+        *s = DeletedValue(saver.merge, saver.user_key, saver.value);
+        return true;
+      }
+      return false;  // Keep searching in other files
+    case kFound:
+      *s = saver.merge_status;
+      return true;
+    case kDeleted:
+      *s = Status::NotFound(Slice());  // Use empty error message for speed
+      return true;
+    case kCorrupt:
+      *s = Status::Corruption("corrupted key for ", saver.user_key);
+      return true;
+  }
+  return false;
 }
 
 static bool NewestFirst(FileMetaData* a, FileMetaData* b) {
@@ -323,10 +457,14 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key,
 Status Version::Get(const ReadOptions& options,
                     const LookupKey& k,
                     std::string* value,
-                    GetStats* stats) {
+                    GetStats* stats,
+                    MergeContext* merge) {
   Slice ikey = k.internal_key();
   Slice user_key = k.user_key();
   const Comparator* ucmp = vset_->icmp_.user_comparator();
+  const SequenceNumber snapshot =
+      DecodeFixed64(ikey.data() + ikey.size() - 8) >> 8;
+  SequenceNumber tombstone = 0;  // Newest range tombstone covering user_key
   Status s;
 
   stats->seek_file = NULL;
@@ -391,32 +529,191 @@ Status Version::Get(const ReadOptions& options,
       last_file_read = f;
       last_file_read_level = level;
 
+      if (f->has_range_deletions) {
+        Iterator* iter = vset_->table_cache_->NewRangeTombstoneIterator(
+            f->number, f->file_size);
+        SequenceNumber seq = MaxCoveringTombstone(iter, ucmp, user_key,
+                                                  snapshot);
+        s = iter->status();
+        delete iter;
+        if (!s.ok()) {
+          return s;
+        }
+        if (seq > tombstone) {
+          tombstone = seq;
+        }
+      }
+
       Saver saver;
       saver.state = kNotFound;
       saver.ucmp = ucmp;
       saver.user_key = user_key;
       saver.value = value;
+      saver.merge = merge;
+      saver.tombstone = tombstone;
       s = vset_->table_cache_->Get(options, f->number, f->file_size,
-                                   ikey, &saver, SaveValue);
+                                   f->global_seqno, ikey, &saver, SaveValue);
       if (!s.ok()) {
         return s;
       }
-      switch (saver.state) {
-        case kNotFound:
-          break;      // Keep searching in other files
-        case kFound:
-          return s;
-        case kDeleted:
-          s = Status::NotFound(Slice());  // Use empty error message for speed
-          return s;
-        case kCorrupt:
-          s = Status::Corruption("corrupted key for ", user_key);
-          return s;
+      if (LookupDone(saver, tombstone, &s)) {
+        return s;
       }
     }
   }
 
-  return Status::NotFound(Slice());  // Use an empty error message for speed
+  // No older entry for the key
+  return DeletedValue(merge, user_key, value);
+}
+
+void Version::MultiGetFromFile(const ReadOptions& options, int level,
+                               FileMetaData* f,
+                               const std::vector<GetRequest*>& requests) {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  const int n = static_cast<int>(requests.size());
+  for (int i = 0; i < n; i++) {
+    GetRequest* r = requests[i];
+    if (r->last_file_read != NULL && r->stats.seek_file == NULL) {
+      // More than one seek for this read.  Charge the 1st file.
+      r->stats.seek_file = r->last_file_read;
+      r->stats.seek_file_level = r->last_file_read_level;
+    }
+    r->last_file_read = f;
+    r->last_file_read_level = level;
+  }
+
+  Status s;
+  if (f->has_range_deletions) {
+    Iterator* iter = vset_->table_cache_->NewRangeTombstoneIterator(
+        f->number, f->file_size);
+    for (int i = 0; i < n && iter->status().ok(); i++) {
+      GetRequest* r = requests[i];
+      Slice ikey = r->key->internal_key();
+      SequenceNumber seq = MaxCoveringTombstone(
+          iter, ucmp, r->key->user_key(),
+          DecodeFixed64(ikey.data() + ikey.size() - 8) >> 8);
+      if (seq > r->tombstone) {
+        r->tombstone = seq;
+      }
+    }
+    s = iter->status();
+    delete iter;
+  }
+
+  std::vector<Saver> savers(n);
+  std::vector<Slice> keys(n);
+  std::vector<void*> args(n);
+  for (int i = 0; i < n; i++) {
+    GetRequest* r = requests[i];
+    Saver& saver = savers[i];
+    saver.state = kNotFound;
+    saver.ucmp = ucmp;
+    saver.user_key = r->key->user_key();
+    saver.value = r->value;
+    saver.merge = r->merge;
+    saver.tombstone = r->tombstone;
+    keys[i] = r->key->internal_key();
+    args[i] = &saver;
+  }
+  std::vector<Status> statuses(n);
+  if (s.ok()) {
+    s = vset_->table_cache_->MultiGet(options, f->number, f->file_size,
+                                      f->global_seqno, n, &keys[0], &args[0],
+                                      SaveValue, &statuses[0]);
+  }
+  for (int i = 0; i < n; i++) {
+    GetRequest* r = requests[i];
+    if (!s.ok()) {
+      // The table could not be searched at all, as Get() would find
+      r->status = s;
+      r->done = true;
+    } else if (!statuses[i].ok()) {
+      r->status = statuses[i];
+      r->done = true;
+    } else if (LookupDone(savers[i], r->tombstone, &r->status)) {
+      r->done = true;
+    }
+  }
+}
+
+void Version::MultiGet(const ReadOptions& options,
+                       const std::vector<GetRequest*>& requests) {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  for (size_t i = 0; i < requests.size(); i++) {
+    GetRequest* r = requests[i];
+    r->stats.seek_file = NULL;
+    r->stats.seek_file_level = -1;
+    r->done = false;
+    r->tombstone = 0;
+    r->last_file_read = NULL;
+    r->last_file_read_level = -1;
+  }
+
+  // Search level-by-level as Get() does, each file for the keys that
+  // are still being looked up and may be in it.
+  std::vector<GetRequest*> batch;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    const std::vector<FileMetaData*>& files = files_[level];
+    if (files.empty()) continue;
+
+    if (level == 0) {
+      // Level-0 files may overlap each other, so each key is looked for
+      // in all of those that overlap it, from newest to oldest.
+      std::vector<FileMetaData*> tmp(files);
+      std::sort(tmp.begin(), tmp.end(), NewestFirst);
+      for (size_t j = 0; j < tmp.size(); j++) {
+        FileMetaData* f = tmp[j];
+        batch.clear();
+        for (size_t i = 0; i < requests.size(); i++) {
+          GetRequest* r = requests[i];
+          const Slice user_key = r->key->user_key();
+          if (!r->done &&
+              ucmp->Compare(user_key, f->smallest.user_key()) >= 0 &&
+              ucmp->Compare(user_key, f->largest.user_key()) <= 0) {
+            batch.push_back(r);
+          }
+        }
+        if (!batch.empty()) {
+          MultiGetFromFile(options, level, f, batch);
+        }
+      }
+      continue;
+    }
+
+    // The files of other levels are disjoint and sorted, and so are the
+    // keys, so the keys that fall in the same file are consecutive.
+    uint32_t batch_index = 0;
+    batch.clear();
+    for (size_t i = 0; i < requests.size(); i++) {
+      GetRequest* r = requests[i];
+      if (r->done) continue;
+      uint32_t index = FindFile(vset_->icmp_, files, r->key->internal_key());
+      if (index >= files.size()) {
+        break;  // The following keys are past the last file too
+      }
+      if (ucmp->Compare(r->key->user_key(),
+                        files[index]->smallest.user_key()) < 0) {
+        continue;  // Falls between two files
+      }
+      if (!batch.empty() && index != batch_index) {
+        MultiGetFromFile(options, level, files[batch_index], batch);
+        batch.clear();
+      }
+      batch_index = index;
+      batch.push_back(r);
+    }
+    if (!batch.empty()) {
+      MultiGetFromFile(options, level, files[batch_index], batch);
+    }
+  }
+
+  for (size_t i = 0; i < requests.size(); i++) {
+    GetRequest* r = requests[i];
+    if (!r->done) {
+      // No older entry for the key
+      r->status = DeletedValue(r->merge, r->key->user_key(), r->value);
+    }
+  }
 }
 
 bool Version::UpdateStats(const GetStats& stats) {
@@ -518,6 +815,27 @@ int Version::PickLevelForMemTableOutput(
   return level;
 }
 
+// Store in "*files" the files in "level" that lie entirely in [begin,end]
+void Version::GetFilesInRange(int level,
+                              const Slice* begin,
+                              const Slice* end,
+                              std::vector<FileMetaData*>* files) {
+  assert(level >= 0);
+  assert(level < config::kNumLevels);
+  const Comparator* user_cmp = vset_->icmp_.user_comparator();
+  for (size_t i = 0; i < files_[level].size(); i++) {
+    FileMetaData* f = files_[level][i];
+    if (begin != NULL &&
+        user_cmp->Compare(f->smallest.user_key(), *begin) < 0) {
+      continue;
+    }
+    if (end != NULL && user_cmp->Compare(f->largest.user_key(), *end) > 0) {
+      continue;
+    }
+    files->push_back(f);
+  }
+}
+
 // Store in "*inputs" all files in "level" that overlap [begin,end]
 void Version::GetOverlappingInputs(
     int level,
@@ -932,7 +1250,8 @@ Status VersionSet::Recover(bool *save_manifest) {
   {
     LogReporter reporter;
     reporter.status = &s;
-    log::Reader reader(file, &reporter, true/*checksum*/, 0/*initial_offset*/);
+    log::Reader reader(file, &reporter, true/*checksum*/, 0/*initial_offset*/,
+                       0/*log_number*/);
     Slice record;
     std::string scratch;
     while (reader.ReadRecord(&record, &scratch) && s.ok()) {
@@ -1110,7 +1429,7 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
     const std::vector<FileMetaData*>& files = current_->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
       const FileMetaData* f = files[i];
-      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+      edit.AddFile(level, *f);
     }
   }
 
@@ -1161,7 +1480,8 @@ uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
         // approximate offset of "ikey" within the table.
         Table* tableptr;
         Iterator* iter = table_cache_->NewIterator(
-            ReadOptions(), files[i]->number, files[i]->file_size, &tableptr);
+            ReadOptions(), files[i]->number, files[i]->file_size, 0,
+            &tableptr);
         if (tableptr != NULL) {
           result += tableptr->ApproximateOffsetOf(ikey.Encode());
         }
@@ -1191,6 +1511,18 @@ int64_t VersionSet::NumLevelBytes(int level) const {
   return TotalFileSize(current_->files_[level]);
 }
 
+uint64_t VersionSet::PendingCompactionBytes() const {
+  uint64_t result = 0;
+  for (int level = 1; level < config::kNumLevels - 1; level++) {
+    const double level_bytes = TotalFileSize(current_->files_[level]);
+    const double excess = level_bytes - MaxBytesForLevel(level);
+    if (excess > 0) {
+      result += static_cast<uint64_t>(excess);
+    }
+  }
+  return result;
+}
+
 int64_t VersionSet::MaxNextLevelOverlappingBytes() {
   int64_t result = 0;
   std::vector<FileMetaData*> overlaps;
@@ -1262,12 +1594,14 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
         const std::vector<FileMetaData*>& files = c->inputs_[which];
         for (size_t i = 0; i < files.size(); i++) {
           list[num++] = table_cache_->NewIterator(
-              options, files[i]->number, files[i]->file_size);
+              options, files[i]->number, files[i]->file_size,
+              files[i]->global_seqno);
         }
       } else {
         // Create concatenating iterator for the files from this level
         list[num++] = NewTwoLevelIterator(
-            new Version::LevelFileNumIterator(icmp_, &c->inputs_[which]),
+            new Version::LevelFileNumIterator(icmp_, &c->inputs_[which],
+                                              NULL),
             &GetFileIterator, table_cache_, options);
       }
     }
@@ -1490,6 +1824,26 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
   return true;
 }
 
+bool Compaction::IsBaseLevelForRange(const Slice& begin, const Slice& end) {
+  for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+    if (input_version_->OverlapInLevel(lvl, &begin, &end)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+Status Compaction::AddRangeTombstones(int which,
+                                      RangeDelAggregator* range_del) {
+  return AddFileTombstones(input_version_->vset_->table_cache_,
+                           inputs_[which], range_del);
+}
+
+void Compaction::DropParentInput(int i) {
+  edit_.DeleteFile(level_ + 1, inputs_[1][i]->number);
+  inputs_[1].erase(inputs_[1].begin() + i);
+}
+
 bool Compaction::ShouldStopBefore(const Slice& internal_key) {
   // Scan to find earliest grandparent file that contains key.
   const InternalKeyComparator* icmp = &input_version_->vset_->icmp_;
@@ -30,6 +30,8 @@ namespace log { class Writer; }
 class Compaction;
 class Iterator;
 class MemTable;
+struct MergeContext;
+class RangeDelAggregator;
 class TableBuilder;
 class TableCache;
 class Version;
@@ -63,15 +65,43 @@ class Version {
   // REQUIRES: This version has been saved (see VersionSet::SaveTo)
   void AddIterators(const ReadOptions&, std::vector<Iterator*>* iters);
 
+  // Add the range tombstones of the files of this Version to *range_del.
+  // REQUIRES: lock is not held
+  Status AddRangeTombstones(RangeDelAggregator* range_del);
+
   // Lookup the value for key.  If found, store it in *val and
-  // return OK.  Else return a non-OK status.  Fills *stats.
+  // return OK.  Else return a non-OK status.  Fills *stats.  "merge"
+  // holds the merge operands for key found in the memtables; they and
+  // those found here are applied to the value.
   // REQUIRES: lock is not held
   struct GetStats {
     FileMetaData* seek_file;
     int seek_file_level;
   };
   Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
-             GetStats* stats);
+             GetStats* stats, MergeContext* merge);
+
+  // A lookup of MultiGet().
+  struct GetRequest {
+    const LookupKey* key;
+    std::string* value;
+    MergeContext* merge;
+    Status status;            // Result of the lookup, as returned by Get()
+    GetStats stats;
+
+    // State of the lookup while MultiGet() runs
+    bool done;
+    SequenceNumber tombstone;
+    FileMetaData* last_file_read;
+    int last_file_read_level;
+  };
+
+  // Same as calling Get() for each of "requests", but each table is
+  // searched once for all the keys that reach it, which saves repeated
+  // searches of its filter and index blocks, and repeated reads of its
+  // data blocks.  REQUIRES: "requests" are sorted by user key.
+  // REQUIRES: lock is not held
+  void MultiGet(const ReadOptions&, const std::vector<GetRequest*>& requests);
 
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
@@ -95,6 +125,13 @@ class Version {
       const InternalKey* end,           // NULL means after all keys
       std::vector<FileMetaData*>* inputs);
 
+  // Store in "*files" the files in "level" whose user keys all lie in
+  // [*begin,*end].  NULL bounds are treated as in GetOverlappingInputs().
+  void GetFilesInRange(int level,
+                       const Slice* begin,
+                       const Slice* end,
+                       std::vector<FileMetaData*>* files);
+
   // Returns true iff some file in the specified level overlaps
   // some part of [*smallest_user_key,*largest_user_key].
   // smallest_user_key==NULL represents a key smaller than all keys in the DB.
@@ -129,6 +166,11 @@ class Version {
                           void* arg,
                           bool (*func)(void*, int, FileMetaData*));
 
+  // Look for the keys of "requests" in "f", which lies in "level".
+  void MultiGetFromFile(const ReadOptions& options, int level,
+                        FileMetaData* f,
+                        const std::vector<GetRequest*>& requests);
+
   VersionSet* vset_;            // VersionSet to which this Version belongs
   Version* next_;               // Next version in linked list
   Version* prev_;               // Previous version in linked list
@@ -205,6 +247,10 @@ class VersionSet {
   // Return the combined file size of all files at the specified level.
   int64_t NumLevelBytes(int level) const;
 
+  // Return the number of bytes by which the levels other than level-0
+  // and the last level exceed their size targets in the current version.
+  uint64_t PendingCompactionBytes() const;
+
   // Return the last sequence number.
   uint64_t LastSequence() const { return last_sequence_; }
 
@@ -354,6 +400,18 @@ class Compaction {
   // in levels greater than "level+1".
   bool IsBaseLevelForKey(const Slice& user_key);
 
+  // Same as IsBaseLevelForKey() for all the user keys in [begin,end].
+  bool IsBaseLevelForRange(const Slice& begin, const Slice& end);
+
+  // Add the range tombstones of the inputs at "level()+which" to
+  // *range_del.
+  Status AddRangeTombstones(int which, RangeDelAggregator* range_del);
+
+  // Remove the ith input at "level()+1" from the compaction and record
+  // the deletion of the file in edit().  Used when all its entries are
+  // known to be obsolete, so that it need not be read.
+  void DropParentInput(int i);
+
   // Returns true iff we should stop building the current output
   // before processing "internal_key".
   bool ShouldStopBefore(const Slice& internal_key);
@@ -6,7 +6,10 @@
 //          (kTypeValue 为记录类型，更新or删除,
 //           删除时只有key) )
 //          kTypeValue varstring varstring. kTypeValue |
-//          kTypeValue varstring(key)
+//          kTypeValue varstring(key) |
+//          kTypeMerge varstring(key) varstring(operand) |
+//          kTypeRangeDeletion varstring(begin_key) varstring(end_key) |
+//          kTypeSingleDeletion varstring(key)
 //    varstring :=
 //          len: varint32
 //          data: uint8[len]
@@ -32,6 +35,17 @@ WriteBatch::~WriteBatch() {}
 
 WriteBatch::Handler::~Handler(){}
 
+void WriteBatch::Handler::Merge(const Slice& key, const Slice& value) {
+}
+
+void WriteBatch::Handler::SingleDelete(const Slice& key) {
+    Delete(key);
+}
+
+void WriteBatch::Handler::DeleteRange(const Slice& begin_key,
+                                      const Slice& end_key) {
+}
+
 void WriteBatch::Clear() {
     rep_.clear();
     rep_.resize(kHeader);
@@ -68,6 +82,32 @@ Status WriteBatch::Iterate(Handler* handler) const {
                     return Status::Corruption("bad WriteBatch Delete");
                }
                break;
+
+            case kTypeMerge:
+               if (GetLengthPrefixedSlice(&input, &key) &&
+                  GetLengthPrefixedSlice(&input, &value)) {
+                    handler->Merge(key, value);
+               } else {
+                    return Status::Corruption("bad WriteBatch Merge");
+               }
+               break;
+
+            case kTypeRangeDeletion:
+               if (GetLengthPrefixedSlice(&input, &key) &&
+                  GetLengthPrefixedSlice(&input, &value)) {
+                    handler->DeleteRange(key, value);
+               } else {
+                    return Status::Corruption("bad WriteBatch DeleteRange");
+               }
+               break;
+
+            case kTypeSingleDeletion:
+               if (GetLengthPrefixedSlice(&input, &key)) {
+                    handler->SingleDelete(key);
+               } else {
+                    return Status::Corruption("bad WriteBatch SingleDelete");
+               }
+               break;
              default:
                return Status::Corruption("unknown WriteBatch tag");
         }
@@ -112,18 +152,61 @@ void WriteBatch::Delete(const Slice& key) {
     PutLengthPrefixedSlice(&rep_, key);
 }
 
+void WriteBatch::Merge(const Slice& key, const Slice& value) {
+    WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+    rep_.push_back(static_cast<char>(kTypeMerge));
+    PutLengthPrefixedSlice(&rep_, key);
+    PutLengthPrefixedSlice(&rep_, value);
+}
+
+void WriteBatch::SingleDelete(const Slice& key) {
+    WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+    rep_.push_back(static_cast<char>(kTypeSingleDeletion));
+    PutLengthPrefixedSlice(&rep_, key);
+}
+
+void WriteBatch::DeleteRange(const Slice& begin_key, const Slice& end_key) {
+    WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+    rep_.push_back(static_cast<char>(kTypeRangeDeletion));
+    PutLengthPrefixedSlice(&rep_, begin_key);
+    PutLengthPrefixedSlice(&rep_, end_key);
+}
+
 namespace {
 class MemTableInserter : public WriteBatch::Handler {
 public:
     SequenceNumber sequence_;
     MemTable* mem_;
+    bool concurrent_;
+    bool inplace_update_;
 
     virtual void Put(const Slice& key, const Slice& value) {
-        mem_->Add(sequence_, kTypeValue, key ,value);
-        sequence_++;
+        if (inplace_update_ && mem_->Update(sequence_, key, value)) {
+            sequence_++;
+            return;
+        }
+        Add(kTypeValue, key, value);
     }
     virtual void Delete(const Slice& key) {
-        mem_->Add(sequence_, kTypeDeletion, key, Slice());
+        Add(kTypeDeletion, key, Slice());
+    }
+    virtual void Merge(const Slice& key, const Slice& value) {
+        Add(kTypeMerge, key, value);
+    }
+    virtual void SingleDelete(const Slice& key) {
+        Add(kTypeSingleDeletion, key, Slice());
+    }
+    virtual void DeleteRange(const Slice& begin_key, const Slice& end_key) {
+        Add(kTypeRangeDeletion, begin_key, end_key);
+    }
+
+private:
+    void Add(ValueType type, const Slice& key, const Slice& value) {
+        if (concurrent_) {
+            mem_->AddConcurrently(sequence_, type, key, value);
+        } else {
+            mem_->Add(sequence_, type, key, value);
+        }
         sequence_++;
     }
 };
@@ -131,20 +214,38 @@ public:
 
 Status WriteBatchInternal::InsertInto(const WriteBatch* b,
                                      MemTable* memtable) {
+    return InsertInto(b, memtable, false);
+}
+
+Status WriteBatchInternal::InsertInto(const WriteBatch* b,
+                                     MemTable* memtable,
+                                     bool inplace_update) {
+    MemTableInserter inserter;
+    inserter.sequence_ = WriteBatchInternal::Sequence(b);
+    inserter.mem_ = memtable;
+    inserter.concurrent_ = false;
+    inserter.inplace_update_ = inplace_update;
+    return b->Iterate(&inserter);
+}
+
+Status WriteBatchInternal::InsertIntoConcurrently(const WriteBatch* b,
+                                                 MemTable* memtable) {
     MemTableInserter inserter;
     inserter.sequence_ = WriteBatchInternal::Sequence(b);
     inserter.mem_ = memtable;
+    inserter.concurrent_ = true;
+    inserter.inplace_update_ = false;
     return b->Iterate(&inserter);
 }
 
 void WriteBatchInternal::SetContents(WriteBatch* b, const Slice& contents) {
-    assert(contents.size() > kHeader);
+    assert(contents.size() >= kHeader);
     b->rep_.assign(contents.data(), contents.size());
 }
 
 void WriteBatchInternal::Append(WriteBatch* dst, const WriteBatch* src) {
     SetCount(dst, Count(dst) + Count(src));
-    assert(src->rep_.size() > kHeader);
+    assert(src->rep_.size() >= kHeader);
     dst->rep_.append(src->rep_.data() + kHeader, src->rep_.size() - kHeader);
 }
 
@@ -41,6 +41,16 @@ class WriteBatchInternal {
 
   static Status InsertInto(const WriteBatch* batch, MemTable* memtable);
 
+  // Same as InsertInto(), but if "inplace_update", puts overwrite the
+  // existing value of their key where MemTable::Update() allows it.
+  static Status InsertInto(const WriteBatch* batch, MemTable* memtable,
+                           bool inplace_update);
+
+  // Same as InsertInto(), but uses MemTable::AddConcurrently() so that
+  // several batches may be inserted into "memtable" at once.
+  static Status InsertIntoConcurrently(const WriteBatch* batch,
+                                       MemTable* memtable);
+
   static void Append(WriteBatch* dst, const WriteBatch* src);
 };
 
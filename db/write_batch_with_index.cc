@@ -0,0 +1,303 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// The index is a skiplist of entries that refer to the records of the
+// batch by their offset in its contents, so keys are never copied.
+// Several records for the same key are all indexed, the latest first.
+//
+// Iterators present the batch as a table of internal keys whose
+// sequence number is the record offset plus one, and the base DB
+// iterator as one whose entries all have sequence number zero.  Merging
+// the two and collapsing the result with a DBIter makes the latest
+// batch record for a key hide older ones and the DB's value.
+
+#include "leveldb/write_batch_with_index.h"
+
+#include "db/db_iter.h"
+#include "db/dbformat.h"
+#include "db/skiplist.h"
+#include "db/write_batch_internal.h"
+#include "leveldb/db.h"
+#include "leveldb/iterator.h"
+#include "leveldb/write_batch.h"
+#include "table/merger.h"
+#include "util/arena.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+namespace {
+
+struct IndexEntry {
+  SequenceNumber sequence;  // Offset of the record in the batch plus one
+  const Slice* lookup_key;  // Non-NULL only for lookup targets
+};
+
+// Decode the batch record at "offset" of the batch contents "rep".
+static void DecodeRecord(const Slice& rep, size_t offset,
+                         ValueType* type, Slice* key, Slice* value) {
+  Slice input(rep.data() + offset, rep.size() - offset);
+  *type = static_cast<ValueType>(input[0]);
+  input.remove_prefix(1);
+  GetLengthPrefixedSlice(&input, key);
+  if (*type == kTypeValue) {
+    GetLengthPrefixedSlice(&input, value);
+  } else {
+    *value = Slice();
+  }
+}
+
+// Orders entries by increasing user key, and by decreasing sequence
+// number for the same user key.
+struct IndexComparator {
+  const Comparator* user_comparator;
+  const WriteBatch* batch;
+
+  Slice UserKey(const IndexEntry* e) const {
+    if (e->lookup_key != NULL) {
+      return *e->lookup_key;
+    }
+    ValueType type;
+    Slice key, value;
+    DecodeRecord(WriteBatchInternal::Contents(batch), e->sequence - 1,
+                 &type, &key, &value);
+    return key;
+  }
+
+  int operator()(const IndexEntry* a, const IndexEntry* b) const {
+    int r = user_comparator->Compare(UserKey(a), UserKey(b));
+    if (r == 0) {
+      if (a->sequence > b->sequence) {
+        r = -1;
+      } else if (a->sequence < b->sequence) {
+        r = +1;
+      }
+    }
+    return r;
+  }
+};
+
+typedef SkipList<const IndexEntry*, IndexComparator> Index;
+
+}  // namespace
+
+struct WriteBatchWithIndex::Rep {
+  WriteBatch batch;
+  InternalKeyComparator internal_comparator;
+  IndexComparator index_comparator;
+  Arena* arena;
+  Index* index;
+
+  explicit Rep(const Comparator* comparator)
+      : internal_comparator(comparator),
+        arena(NULL),
+        index(NULL) {
+    index_comparator.user_comparator = comparator;
+    index_comparator.batch = &batch;
+    ResetIndex();
+  }
+
+  ~Rep() {
+    delete index;
+    delete arena;
+  }
+
+  void ResetIndex() {
+    delete index;
+    delete arena;
+    arena = new Arena;
+    index = new Index(index_comparator, arena);
+  }
+
+  // Index the record that starts at "offset" of the batch contents.
+  void AddRecord(size_t offset) {
+    IndexEntry* e = reinterpret_cast<IndexEntry*>(
+        arena->AllocateAligned(sizeof(IndexEntry)));
+    e->sequence = offset + 1;
+    e->lookup_key = NULL;
+    index->Insert(e);
+  }
+
+  enum LookupResult {
+    kNotInBatch,
+    kFoundInBatch,
+    kDeletedInBatch
+  };
+
+  LookupResult Lookup(const Slice& key, std::string* value) const {
+    IndexEntry target;
+    target.sequence = kMaxSequenceNumber;
+    target.lookup_key = &key;
+    Index::Iterator iter(index);
+    iter.Seek(&target);
+    if (!iter.Valid()) {
+      return kNotInBatch;
+    }
+    ValueType type;
+    Slice found_key, found_value;
+    DecodeRecord(WriteBatchInternal::Contents(&batch),
+                 iter.key()->sequence - 1, &type, &found_key, &found_value);
+    if (index_comparator.user_comparator->Compare(found_key, key) != 0) {
+      return kNotInBatch;
+    }
+    if (type == kTypeDeletion) {
+      return kDeletedInBatch;
+    }
+    value->assign(found_value.data(), found_value.size());
+    return kFoundInBatch;
+  }
+};
+
+namespace {
+
+// Presents the batch as a sequence of internal keys (see top of file).
+class BatchIterator : public Iterator {
+ public:
+  BatchIterator(const WriteBatch* batch, const Index* index)
+      : batch_(batch), iter_(index) { }
+
+  virtual bool Valid() const { return iter_.Valid(); }
+  virtual void SeekToFirst() { iter_.SeekToFirst(); Update(); }
+  virtual void SeekToLast() { iter_.SeekToLast(); Update(); }
+  virtual void Next() { iter_.Next(); Update(); }
+  virtual void Prev() { iter_.Prev(); Update(); }
+
+  virtual void Seek(const Slice& target) {
+    ParsedInternalKey parsed;
+    if (!ParseInternalKey(target, &parsed)) {
+      parsed.user_key = ExtractUserKey(target);
+      parsed.sequence = kMaxSequenceNumber;
+    }
+    // A target with sequence number zero sorts after every batch entry
+    // for its user key.
+    IndexEntry target_entry;
+    target_entry.sequence = parsed.sequence;
+    target_entry.lookup_key = &parsed.user_key;
+    iter_.Seek(&target_entry);
+    Update();
+  }
+
+  virtual Slice key() const { return key_; }
+  virtual Slice value() const { return value_; }
+  virtual Status status() const { return Status::OK(); }
+
+ private:
+  void Update() {
+    if (iter_.Valid()) {
+      ParsedInternalKey parsed;
+      parsed.sequence = iter_.key()->sequence;
+      DecodeRecord(WriteBatchInternal::Contents(batch_), parsed.sequence - 1,
+                   &parsed.type, &parsed.user_key, &value_);
+      key_.clear();
+      AppendInternalKey(&key_, parsed);
+    }
+  }
+
+  const WriteBatch* const batch_;
+  Index::Iterator iter_;
+  std::string key_;
+  Slice value_;
+};
+
+// Presents a DB iterator as a sequence of internal keys that all have
+// sequence number zero.
+class BaseIterator : public Iterator {
+ public:
+  explicit BaseIterator(Iterator* base) : base_(base) { }
+  virtual ~BaseIterator() { delete base_; }
+
+  virtual bool Valid() const { return base_->Valid(); }
+  virtual void SeekToFirst() { base_->SeekToFirst(); Update(); }
+  virtual void SeekToLast() { base_->SeekToLast(); Update(); }
+  virtual void Next() { base_->Next(); Update(); }
+  virtual void Prev() { base_->Prev(); Update(); }
+  virtual void Seek(const Slice& target) {
+    // Entries with the target's user key have sequence number zero, so
+    // none of them comes before the target.
+    base_->Seek(ExtractUserKey(target));
+    Update();
+  }
+  virtual Slice key() const { return key_; }
+  virtual Slice value() const { return base_->value(); }
+  virtual Status status() const { return base_->status(); }
+
+ private:
+  void Update() {
+    if (base_->Valid()) {
+      key_.clear();
+      AppendInternalKey(&key_,
+                        ParsedInternalKey(base_->key(), 0, kTypeValue));
+    }
+  }
+
+  Iterator* const base_;
+  std::string key_;
+};
+
+}  // namespace
+
+WriteBatchWithIndex::WriteBatchWithIndex(const Comparator* comparator)
+    : rep_(new Rep(comparator)) {
+}
+
+WriteBatchWithIndex::~WriteBatchWithIndex() {
+  delete rep_;
+}
+
+void WriteBatchWithIndex::Put(const Slice& key, const Slice& value) {
+  const size_t offset = WriteBatchInternal::ByteSize(&rep_->batch);
+  rep_->batch.Put(key, value);
+  rep_->AddRecord(offset);
+}
+
+void WriteBatchWithIndex::Delete(const Slice& key) {
+  const size_t offset = WriteBatchInternal::ByteSize(&rep_->batch);
+  rep_->batch.Delete(key);
+  rep_->AddRecord(offset);
+}
+
+void WriteBatchWithIndex::Clear() {
+  rep_->batch.Clear();
+  rep_->ResetIndex();
+}
+
+WriteBatch* WriteBatchWithIndex::GetWriteBatch() {
+  return &rep_->batch;
+}
+
+Status WriteBatchWithIndex::GetFromBatch(const Slice& key,
+                                         std::string* value) const {
+  if (rep_->Lookup(key, value) == Rep::kFoundInBatch) {
+    return Status::OK();
+  }
+  return Status::NotFound(Slice());
+}
+
+Status WriteBatchWithIndex::GetFromBatchAndDB(DB* db,
+                                              const ReadOptions& options,
+                                              const Slice& key,
+                                              std::string* value) const {
+  switch (rep_->Lookup(key, value)) {
+    case Rep::kFoundInBatch:
+      return Status::OK();
+    case Rep::kDeletedInBatch:
+      return Status::NotFound(Slice());
+    case Rep::kNotInBatch:
+      break;
+  }
+  return db->Get(options, key, value);
+}
+
+Iterator* WriteBatchWithIndex::NewIteratorWithBase(Iterator* base) const {
+  Iterator* children[2];
+  children[0] = new BaseIterator(base);
+  children[1] = new BatchIterator(&rep_->batch, rep_->index);
+  Iterator* merged =
+      NewMergingIterator(&rep_->internal_comparator, children, 2);
+  return NewDBIterator(NULL, rep_->internal_comparator.user_comparator(),
+                       NULL, NULL, NULL, merged, NULL, kMaxSequenceNumber,
+                       0);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,156 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/write_batch_with_index.h"
+
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+#include "leveldb/write_batch.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class WriteBatchWithIndexTest {
+ public:
+  std::string dbname_;
+  DB* db_;
+  WriteBatchWithIndex batch_;
+
+  WriteBatchWithIndexTest() {
+    dbname_ = test::TmpDir() + "/write_batch_with_index_test";
+    DestroyDB(dbname_, Options());
+    Options options;
+    options.create_if_missing = true;
+    ASSERT_OK(DB::Open(options, dbname_, &db_));
+  }
+
+  ~WriteBatchWithIndexTest() {
+    delete db_;
+    DestroyDB(dbname_, Options());
+  }
+
+  std::string Get(const std::string& key) {
+    std::string value;
+    Status s = batch_.GetFromBatchAndDB(db_, ReadOptions(), key, &value);
+    if (s.IsNotFound()) {
+      return "NOT_FOUND";
+    } else if (!s.ok()) {
+      return s.ToString();
+    }
+    return value;
+  }
+
+  std::string GetFromBatch(const std::string& key) {
+    std::string value;
+    Status s = batch_.GetFromBatch(key, &value);
+    return s.ok() ? value : "NOT_FOUND";
+  }
+
+  // Contents of the batch applied to the DB, read forward and backward
+  std::string Contents() {
+    Iterator* iter = batch_.NewIteratorWithBase(
+        db_->NewIterator(ReadOptions()));
+    std::string forward, backward;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      forward.append(iter->key().ToString() + "=" +
+                     iter->value().ToString() + " ");
+    }
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+      backward.insert(0, iter->key().ToString() + "=" +
+                      iter->value().ToString() + " ");
+    }
+    ASSERT_OK(iter->status());
+    delete iter;
+    ASSERT_EQ(forward, backward);
+    return forward;
+  }
+};
+
+TEST(WriteBatchWithIndexTest, GetFromBatch) {
+  ASSERT_EQ("NOT_FOUND", GetFromBatch("a"));
+  batch_.Put("a", "v1");
+  batch_.Put("b", "v1");
+  batch_.Put("a", "v2");
+  batch_.Delete("b");
+  batch_.Put("c", "v1");
+  ASSERT_EQ("v2", GetFromBatch("a"));
+  ASSERT_EQ("NOT_FOUND", GetFromBatch("b"));
+  ASSERT_EQ("v1", GetFromBatch("c"));
+  ASSERT_EQ("NOT_FOUND", GetFromBatch("d"));
+
+  batch_.Put("b", "v3");
+  ASSERT_EQ("v3", GetFromBatch("b"));
+
+  batch_.Clear();
+  ASSERT_EQ("NOT_FOUND", GetFromBatch("a"));
+  batch_.Put("a", "v4");
+  ASSERT_EQ("v4", GetFromBatch("a"));
+}
+
+TEST(WriteBatchWithIndexTest, GetFromBatchAndDB) {
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "db"));
+  ASSERT_OK(db_->Put(WriteOptions(), "b", "db"));
+  batch_.Put("b", "batch");
+  batch_.Delete("a");
+  batch_.Put("c", "batch");
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+  ASSERT_EQ("batch", Get("b"));
+  ASSERT_EQ("batch", Get("c"));
+
+  ASSERT_OK(db_->Put(WriteOptions(), "d", "db"));
+  ASSERT_EQ("db", Get("d"));
+
+  ASSERT_OK(db_->Write(WriteOptions(), batch_.GetWriteBatch()));
+  batch_.Clear();
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+  ASSERT_EQ("batch", Get("b"));
+  ASSERT_EQ("batch", Get("c"));
+}
+
+TEST(WriteBatchWithIndexTest, Iterator) {
+  ASSERT_EQ("", Contents());
+  batch_.Put("b", "v1");
+  ASSERT_EQ("b=v1 ", Contents());
+
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "db"));
+  ASSERT_OK(db_->Put(WriteOptions(), "c", "db"));
+  ASSERT_OK(db_->Put(WriteOptions(), "e", "db"));
+  batch_.Put("b", "v2");
+  batch_.Put("c", "v1");
+  batch_.Delete("e");
+  batch_.Delete("f");
+  batch_.Put("g", "v1");
+  ASSERT_EQ("a=db b=v2 c=v1 g=v1 ", Contents());
+
+  // Seek and change direction across batch and DB entries
+  Iterator* iter = batch_.NewIteratorWithBase(db_->NewIterator(ReadOptions()));
+  iter->Seek("c");
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("c", iter->key().ToString());
+  ASSERT_EQ("v1", iter->value().ToString());
+  iter->Prev();
+  ASSERT_EQ("b", iter->key().ToString());
+  iter->Prev();
+  ASSERT_EQ("a", iter->key().ToString());
+  iter->Next();
+  ASSERT_EQ("b", iter->key().ToString());
+  iter->Seek("d");
+  ASSERT_EQ("g", iter->key().ToString());
+  iter->Prev();
+  ASSERT_EQ("c", iter->key().ToString());
+  iter->Seek("h");
+  ASSERT_TRUE(!iter->Valid());
+  delete iter;
+
+  // Writing the batch gives the same contents
+  ASSERT_OK(db_->Write(WriteOptions(), batch_.GetWriteBatch()));
+  batch_.Clear();
+  ASSERT_EQ("a=db b=v2 c=v1 g=v1 ", Contents());
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
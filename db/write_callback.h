@@ -0,0 +1,29 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_WRITE_CALLBACK_H_
+#define STORAGE_LEVELDB_DB_WRITE_CALLBACK_H_
+
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class DBImpl;
+
+// Decides whether a batch passed to DBImpl::WriteWithCallback() may be
+// written.
+class WriteCallback {
+ public:
+  virtual ~WriteCallback() { }
+
+  // Called by the thread that writes the batch, once every earlier write
+  // has been applied to the memtable and before any later one starts.
+  // db->mutex_ is held.  A non-OK result is returned to the writer
+  // instead of writing the batch.
+  virtual Status Callback(DBImpl* db) = 0;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_WRITE_CALLBACK_H_
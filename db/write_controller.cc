@@ -0,0 +1,103 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include "db/dbformat.h"
+
+namespace leveldb {
+
+// Credit that accumulates while no writes arrive is capped at this much
+// time's worth, so that an idle period cannot be followed by a burst.
+static const uint64_t kMaxCreditMicros = 1000;
+
+static const uint64_t kMicrosPerSecond = 1000000;
+
+const uint64_t WriteController::kMinDelayedWriteRate;
+
+WriteController::WriteController(uint64_t max_delayed_write_rate)
+    : max_delayed_write_rate_(
+          max_delayed_write_rate < kMinDelayedWriteRate ?
+          kMinDelayedWriteRate : max_delayed_write_rate),
+      delayed_write_rate_(0),
+      last_refill_micros_(0),
+      credit_bytes_(0) {
+}
+
+void WriteController::UpdatePressure(int level0_files,
+                                     uint64_t pending_compaction_bytes) {
+  // Pressure ranges from 0 (no delay needed) to 1 (slowest rate).  Each
+  // level-0 file from the slowdown trigger onwards adds an equal step;
+  // the step that would reach the stop trigger is never taken since
+  // writes stop there.
+  double pressure = 0;
+  if (level0_files >= config::kL0_SlowdownWritesTrigger) {
+    pressure = static_cast<double>(
+        level0_files - config::kL0_SlowdownWritesTrigger + 1) /
+        (config::kL0_StopWritesTrigger - config::kL0_SlowdownWritesTrigger + 1);
+  }
+  if (pending_compaction_bytes >= config::kPendingCompactionBytesSlowdown) {
+    double p = static_cast<double>(
+        pending_compaction_bytes - config::kPendingCompactionBytesSlowdown) /
+        (config::kPendingCompactionBytesLimit -
+         config::kPendingCompactionBytesSlowdown);
+    if (p > pressure) {
+      pressure = p;
+    }
+  }
+
+  if (pressure <= 0) {
+    delayed_write_rate_ = 0;
+    return;
+  }
+  uint64_t rate = kMinDelayedWriteRate;
+  if (pressure < 1) {
+    rate = static_cast<uint64_t>(max_delayed_write_rate_ * (1 - pressure));
+    if (rate < kMinDelayedWriteRate) {
+      rate = kMinDelayedWriteRate;
+    }
+  }
+  if (delayed_write_rate_ == 0) {
+    // Start with an empty bucket
+    last_refill_micros_ = 0;
+    credit_bytes_ = 0;
+  }
+  delayed_write_rate_ = rate;
+}
+
+uint64_t WriteController::GetDelay(uint64_t now_micros, uint64_t num_bytes) {
+  if (delayed_write_rate_ == 0) {
+    return 0;
+  }
+  if (last_refill_micros_ == 0) {
+    last_refill_micros_ = now_micros;
+  }
+
+  // Grant credit for the time elapsed since the last refill
+  if (now_micros > last_refill_micros_) {
+    uint64_t elapsed = now_micros - last_refill_micros_;
+    if (elapsed > kMaxCreditMicros) {
+      elapsed = kMaxCreditMicros;
+    }
+    credit_bytes_ += elapsed * delayed_write_rate_ / kMicrosPerSecond;
+    last_refill_micros_ = now_micros;
+  }
+  if (credit_bytes_ >= num_bytes) {
+    credit_bytes_ -= num_bytes;
+    return 0;
+  }
+
+  // Pay for the remainder by sleeping.  Time already promised to earlier
+  // callers is not granted again.
+  uint64_t delay =
+      (num_bytes - credit_bytes_) * kMicrosPerSecond / delayed_write_rate_;
+  credit_bytes_ = 0;
+  last_refill_micros_ += delay;
+  if (last_refill_micros_ <= now_micros) {
+    return 0;
+  }
+  return last_refill_micros_ - now_micros;
+}
+
+}  // namespace leveldb
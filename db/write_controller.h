@@ -0,0 +1,60 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// WriteController paces foreground writes while compaction is falling
+// behind.  Instead of sleeping a fixed amount per write once level-0
+// fills up, writes are admitted through a token bucket whose fill rate
+// shrinks as the compaction debt grows, so latency degrades smoothly
+// before the hard stop is reached.
+//
+// Not thread-safe: the owner must provide external synchronization.
+
+#ifndef STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+#define STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+
+#include <stdint.h>
+
+namespace leveldb {
+
+class WriteController {
+ public:
+  // Writes are never delayed below kMinDelayedWriteRate bytes/second.
+  static const uint64_t kMinDelayedWriteRate = 16 << 10;
+
+  // "max_delayed_write_rate" is the rate allowed under the lightest
+  // compaction pressure that still calls for a delay.
+  explicit WriteController(uint64_t max_delayed_write_rate);
+
+  // Recompute the delayed write rate from the current compaction debt:
+  // the number of level-0 files and the number of bytes by which the
+  // other levels exceed their size targets.
+  void UpdatePressure(int level0_files, uint64_t pending_compaction_bytes);
+
+  // Are writes currently being delayed?
+  bool IsDelayed() const { return delayed_write_rate_ > 0; }
+
+  // Rate in bytes/second at which writes are currently admitted, or
+  // zero if writes are not being delayed.
+  uint64_t delayed_write_rate() const { return delayed_write_rate_; }
+
+  // Return the number of microseconds the caller should sleep before
+  // writing "num_bytes", given that the time is now "now_micros".  The
+  // bytes are charged against the bucket whether or not the caller
+  // actually sleeps.
+  uint64_t GetDelay(uint64_t now_micros, uint64_t num_bytes);
+
+ private:
+  const uint64_t max_delayed_write_rate_;
+  uint64_t delayed_write_rate_;   // Zero if writes are not delayed
+  uint64_t last_refill_micros_;   // Time up to which credit has been granted
+  uint64_t credit_bytes_;         // Bytes that may be written without delay
+
+  // No copying allowed
+  WriteController(const WriteController&);
+  void operator=(const WriteController&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
@@ -0,0 +1,89 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include "db/dbformat.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+static const uint64_t kMaxRate = 1 << 20;  // 1MB/s
+
+class WriteControllerTest { };
+
+TEST(WriteControllerTest, NoDelayWithoutPressure) {
+  WriteController controller(kMaxRate);
+  controller.UpdatePressure(config::kL0_SlowdownWritesTrigger - 1, 0);
+  ASSERT_TRUE(!controller.IsDelayed());
+  ASSERT_EQ(0, controller.delayed_write_rate());
+  ASSERT_EQ(0, controller.GetDelay(1000, 1 << 20));
+}
+
+TEST(WriteControllerTest, RateDropsWithLevel0Files) {
+  WriteController controller(kMaxRate);
+  uint64_t last_rate = kMaxRate;
+  for (int files = config::kL0_SlowdownWritesTrigger;
+       files < config::kL0_StopWritesTrigger;
+       files++) {
+    controller.UpdatePressure(files, 0);
+    ASSERT_TRUE(controller.IsDelayed());
+    ASSERT_LT(controller.delayed_write_rate(), last_rate);
+    ASSERT_GE(controller.delayed_write_rate(),
+              WriteController::kMinDelayedWriteRate);
+    last_rate = controller.delayed_write_rate();
+  }
+  controller.UpdatePressure(0, 0);
+  ASSERT_TRUE(!controller.IsDelayed());
+}
+
+TEST(WriteControllerTest, RateDropsWithPendingCompactionBytes) {
+  WriteController controller(kMaxRate);
+  controller.UpdatePressure(0, config::kPendingCompactionBytesSlowdown - 1);
+  ASSERT_TRUE(!controller.IsDelayed());
+
+  const uint64_t mid = (config::kPendingCompactionBytesSlowdown +
+                        config::kPendingCompactionBytesLimit) / 2;
+  controller.UpdatePressure(0, mid);
+  ASSERT_EQ(kMaxRate / 2, controller.delayed_write_rate());
+
+  controller.UpdatePressure(0, config::kPendingCompactionBytesLimit * 2);
+  ASSERT_EQ(WriteController::kMinDelayedWriteRate,
+            controller.delayed_write_rate());
+}
+
+TEST(WriteControllerTest, TokenBucket) {
+  WriteController controller(kMaxRate);
+  const int kFiles = config::kL0_SlowdownWritesTrigger;
+  controller.UpdatePressure(kFiles, 0);
+  const uint64_t rate = controller.delayed_write_rate();
+
+  // The first write finds an empty bucket and pays for itself
+  uint64_t now = 1000000;
+  ASSERT_EQ(1000000, controller.GetDelay(now, rate));
+
+  // A write issued while the first one is still sleeping is queued
+  // behind it
+  ASSERT_EQ(1500000, controller.GetDelay(now, rate / 2));
+
+  // Once the sleeps are over, writes proceed at the delayed rate
+  now += 1500000;
+  ASSERT_EQ(100000, controller.GetDelay(now, rate / 10));
+
+  // Credit earned while idle is capped, so there is no burst afterwards
+  now += 10000000;
+  ASSERT_EQ(0, controller.GetDelay(now, 10));
+  ASSERT_GT(controller.GetDelay(now, rate / 10), 90000);
+
+  // Changing the pressure keeps the bucket state
+  controller.UpdatePressure(kFiles + 1, 0);
+  ASSERT_LT(controller.delayed_write_rate(), rate);
+  ASSERT_TRUE(controller.IsDelayed());
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
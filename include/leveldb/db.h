@@ -7,6 +7,8 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <string>
+#include <vector>
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
 
@@ -19,6 +21,7 @@ static const int kMinorVersion = 18;
 struct Options;
 struct ReadOptions;
 struct WriteOptions;
+struct IngestExternalFileOptions;
 class WriteBatch;
 
 // Abstract handle to particular state of a DB.
@@ -68,11 +71,54 @@ class DB {
   // Note: consider setting options.sync = true.
   virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
 
+  // Record "value" as a merge operand for "key", to be combined with
+  // the current value of "key" by options.merge_operator when it is
+  // read.  Returns NotSupported if the DB has no merge operator.
+  // Note: consider setting options.sync = true.
+  virtual Status Merge(const WriteOptions& options,
+                       const Slice& key,
+                       const Slice& value);
+
+  // Remove the database entries (if any) for the keys in the range
+  // ["begin_key", "end_key").  Writes a single range tombstone however
+  // many keys the range holds.  Returns OK on success, and a non-OK
+  // status on error.
+  // Note: consider setting options.sync = true.
+  virtual Status DeleteRange(const WriteOptions& options,
+                             const Slice& begin_key,
+                             const Slice& end_key);
+
+  // Remove the database entry (if any) for "key", which must have been
+  // put at most once since it was last deleted, and never merged.
+  // Compactions then drop the deletion together with the put as soon as
+  // they meet, instead of keeping it down to the last level.  If "key"
+  // was put several times, the result is undefined.  Returns OK on
+  // success, and a non-OK status on error.
+  // Note: consider setting options.sync = true.
+  virtual Status SingleDelete(const WriteOptions& options, const Slice& key);
+
   // Apply the specified updates to the database.
   // Returns OK on success, non-OK on failure.
   // Note: consider setting options.sync = true.
   virtual Status Write(const WriteOptions& options, WriteBatch* updates) = 0;
 
+  // Queue the specified updates for application to the database and
+  // return without waiting for them to be applied.  Once the updates
+  // have been applied (or have failed), "(*callback)(arg, status)" is
+  // invoked exactly once, possibly from a different thread and possibly
+  // before WriteAsync() returns.  Writes queued by WriteAsync() are
+  // ordered with respect to each other and to Write() calls in the
+  // order in which they were issued.
+  //
+  // "*updates" must remain live and unmodified until the callback has
+  // been invoked.  The callback must not call back into this DB in a
+  // way that waits for other async writes to complete.
+  //
+  // The default implementation calls Write() and then the callback.
+  virtual void WriteAsync(const WriteOptions& options, WriteBatch* updates,
+                          void (*callback)(void* arg, const Status& s),
+                          void* arg);
+
   // If the database contains an entry for "key" store the
   // corresponding value in *value and return OK.
   //
@@ -83,6 +129,17 @@ class DB {
   virtual Status Get(const ReadOptions& options,
                      const Slice& key, std::string* value) = 0;
 
+  // Look up all of "keys" as Get() would, at the same snapshot.  Sets
+  // (*statuses)[i] to the status Get() would return for keys[i], and
+  // (*values)[i] to its value if that is OK.  Both vectors are resized
+  // to the number of keys.
+  //
+  // The default implementation calls Get() for each key.
+  virtual void MultiGet(const ReadOptions& options,
+                        const std::vector<Slice>& keys,
+                        std::vector<std::string>* values,
+                        std::vector<Status>* statuses);
+
   // Return a heap-allocated iterator over the contents of the database.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
@@ -117,6 +174,16 @@ class DB {
   //     of the sstables that make up the db contents.
   //  "leveldb.approximate-memory-usage" - returns the approximate number of
   //     bytes of memory in use by the DB.
+  //  "leveldb.write-stall-stats" - returns a multi-line string with the
+  //     number and total duration of writes held up because compaction
+  //     was falling behind, broken down by cause.
+  //  "leveldb.delayed-write-rate" - returns the rate in bytes/second at
+  //     which writes were admitted as of the last write, or 0 if writes
+  //     were not being delayed.
+  //  "leveldb.pending-compaction-bytes" - returns the number of bytes by
+  //     which levels exceed their size targets.
+  //  "leveldb.num-wal-syncs" - returns the number of times the log has
+  //     been synced for sync writes since the DB was opened.
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 
   // For each i in [0,n-1], store in "sizes[i]", the approximate
@@ -142,6 +209,48 @@ class DB {
   //    db->CompactRange(NULL, NULL);
   virtual void CompactRange(const Slice* begin, const Slice* end) = 0;
 
+  // Write the contents of the memtables to table files and wait for
+  // that to finish.  Afterwards every write made before the call,
+  // including those made with WriteOptions::disable_wal, survives a
+  // crash.
+  //
+  // The default implementation returns NotSupported.
+  virtual Status Flush();
+
+  // Write log records buffered under Options::manual_wal_flush out to
+  // the operating system.  Does not sync them; use a sync write for
+  // that.
+  //
+  // The default implementation returns NotSupported.
+  virtual Status FlushWAL();
+
+  // Add the table files "files", built by SstFileWriter, to the DB
+  // without writing their entries to the log or the memtable.  The files
+  // must not overlap each other.  Their entries take effect together and
+  // replace older values of the same keys; snapshots taken before the
+  // call do not see them.  Each file goes to the deepest level above all
+  // data that overlaps it, so that compaction does not have to rewrite
+  // it to put it in place.
+  //
+  // The default implementation returns NotSupported.
+  virtual Status IngestExternalFiles(
+      const std::vector<std::string>& files,
+      const IngestExternalFileOptions& options);
+
+  // Delete the table files in levels 1 and above whose keys all lie in
+  // [*begin,*end], by only writing the change to the descriptor.  This
+  // frees space quickly, but does not delete the range: the keys in
+  // level-0 files, in the memtables, and in files that cross the bounds
+  // of the range remain, and older versions of the deleted keys kept in
+  // other files may become visible again.  Use DeleteRange() and
+  // CompactRange() to deal with the keys left.
+  //
+  // begin==NULL is treated as a key before all keys in the database.
+  // end==NULL is treated as a key after all keys in the database.
+  //
+  // The default implementation returns NotSupported.
+  virtual Status DeleteFilesInRange(const Slice* begin, const Slice* end);
+
  private:
   // No copying allowed
   DB(const DB&);
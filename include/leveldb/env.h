@@ -84,6 +84,19 @@ class Env {
   virtual Status NewAppendableFile(const std::string& fname,
                                    WritableFile** result);
 
+  // Rename the existing file "old_fname" to "fname" and open it for
+  // writing from the start, without truncating it.  Whatever the new
+  // contents do not overwrite is left in place.  On success, stores a
+  // pointer to the new file in *result and returns OK.  On failure
+  // stores NULL in *result and returns non-OK.
+  //
+  // The returned file will only be accessed by one thread at a time.
+  //
+  // The default implementation returns NotSupported.
+  virtual Status ReuseWritableFile(const std::string& fname,
+                                   const std::string& old_fname,
+                                   WritableFile** result);
+
   // Returns true iff the named file exists.
   virtual bool FileExists(const std::string& fname) = 0;
 
@@ -197,6 +210,15 @@ class SequentialFile {
   void operator=(const SequentialFile&);
 };
 
+// One of the reads of RandomAccessFile::MultiRead().
+struct ReadRequest {
+  uint64_t offset;  // Input: where to read
+  size_t n;         // Input: how many bytes to read
+  char* scratch;    // Input: where the bytes may be stored
+  Slice result;     // Output: as for Read()
+  Status status;    // Output: as returned by Read()
+};
+
 // A file abstraction for randomly reading the contents of a file.
 class RandomAccessFile {
  public:
@@ -215,6 +237,16 @@ class RandomAccessFile {
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                       char* scratch) const = 0;
 
+  // Perform the "n" reads of "reqs" as Read() would, filling in their
+  // result and status.  Implementations may issue the reads at once, so
+  // that a device serves them in parallel.  Returns OK if every read
+  // succeeded, else the status of a failed one.
+  //
+  // The default implementation calls Read() for each request in turn.
+  //
+  // Safe for concurrent use by multiple threads.
+  virtual Status MultiRead(ReadRequest* reqs, size_t n) const;
+
  private:
   // No copying allowed
   RandomAccessFile(const RandomAccessFile&);
@@ -234,6 +266,22 @@ class WritableFile {
   virtual Status Flush() = 0;
   virtual Status Sync() = 0;
 
+  // Make the data written by completed Flush() calls durable.  Unlike
+  // Sync(), this may be called from another thread concurrently with
+  // Append() and Flush(), which lets a writer keep appending while an
+  // earlier prefix of the file is being synced.
+  //
+  // The default implementation returns NotSupported.
+  virtual Status SyncFlushed();
+
+  // Ask the file to reserve disk space ahead of appends, "size" bytes at
+  // a time, without changing the file's length.  Appends into reserved
+  // space avoid allocating blocks on the way, which makes later syncs
+  // cheaper.  A size of 0 turns this off.
+  //
+  // The default implementation ignores the request.
+  virtual void SetPreallocationBlockSize(size_t size);
+
  private:
   // No copying allowed
   WritableFile(const WritableFile&);
@@ -307,6 +355,10 @@ class EnvWrapper : public Env {
   Status NewAppendableFile(const std::string& f, WritableFile** r) {
     return target_->NewAppendableFile(f, r);
   }
+  Status ReuseWritableFile(const std::string& f, const std::string& old_f,
+                           WritableFile** r) {
+    return target_->ReuseWritableFile(f, old_f, r);
+  }
   bool FileExists(const std::string& f) { return target_->FileExists(f); }
   Status GetChildren(const std::string& dir, std::vector<std::string>* r) {
     return target_->GetChildren(dir, r);
@@ -0,0 +1,147 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A MemTableRep is the in-memory index behind a memtable.  It holds
+// pointers to encoded entries that the memtable allocates from its
+// arena; each entry starts with the varint32-length-prefixed internal
+// key.  The choice of representation trades insert, lookup and scan
+// costs:
+//
+//   NewSkipListRepFactory()      Sorted at all times.  The default.
+//   NewHashSkipListRepFactory()  A skiplist per key prefix.  Fast point
+//                                lookups; full scans are expensive.
+//   NewVectorRepFactory()        Unsorted; reads sort a shared copy.
+//                                Fastest inserts, for bulk loads that
+//                                do not read the active memtable.
+//
+// Thread safety: Insert() calls are externally synchronized.  Reads may
+// run concurrently with each other and with a single Insert().
+
+#ifndef STORAGE_LEVELDB_INCLUDE_MEMTABLEREP_H_
+#define STORAGE_LEVELDB_INCLUDE_MEMTABLEREP_H_
+
+#include <stddef.h>
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class Arena;
+class SliceTransform;
+
+class MemTableRep {
+ public:
+  // Orders encoded entries by their internal keys.
+  class KeyComparator {
+   public:
+    virtual ~KeyComparator();
+
+    // Compare the entries starting at "a" and "b".
+    virtual int operator()(const char* a, const char* b) const = 0;
+  };
+
+  MemTableRep() { }
+  virtual ~MemTableRep();
+
+  // Insert "entry" into the representation.
+  // REQUIRES: nothing that compares equal to entry is currently stored.
+  virtual void Insert(const char* entry) = 0;
+
+  // Return true if InsertConcurrently() is supported.
+  virtual bool IsInsertConcurrentlySupported() const { return false; }
+
+  // Like Insert(), but may be called from several threads at once.
+  // REQUIRES: IsInsertConcurrentlySupported()
+  virtual void InsertConcurrently(const char* entry);
+
+  // Called once the memtable stops accepting writes.
+  virtual void MarkReadOnly() { }
+
+  // Return the number of bytes used by the representation itself, not
+  // counting memory allocated from the memtable's arena.
+  virtual size_t ApproximateMemoryUsage() = 0;
+
+  class Iterator {
+   public:
+    Iterator() { }
+    virtual ~Iterator();
+
+    // Mirrors leveldb::Iterator, but key() returns the encoded entry.
+    virtual bool Valid() const = 0;
+    virtual const char* key() const = 0;
+    virtual void Next() = 0;
+    virtual void Prev() = 0;
+    virtual void SeekToFirst() = 0;
+    virtual void SeekToLast() = 0;
+
+    // Advance to the first entry at or after "memtable_key", an encoded
+    // lookup key whose internal key is "internal_key".
+    virtual void Seek(const Slice& internal_key, const char* memtable_key) = 0;
+
+   private:
+    // No copying allowed
+    Iterator(const Iterator&);
+    void operator=(const Iterator&);
+  };
+
+  // Return an iterator over all the entries in order.  The caller must
+  // delete it before the representation is destroyed.
+  virtual Iterator* GetIterator() = 0;
+
+  // Return the first entry at or after "memtable_key", an encoded
+  // lookup key whose internal key is "internal_key", or NULL if there is
+  // none.  Entries with a different user key than the lookup key may be
+  // ignored.  Used for point lookups.  The default implementation seeks
+  // an iterator returned by GetIterator().
+  virtual const char* Lookup(const Slice& internal_key,
+                             const char* memtable_key);
+
+ private:
+  // No copying allowed
+  MemTableRep(const MemTableRep&);
+  void operator=(const MemTableRep&);
+};
+
+// Creates the MemTableRep of each new memtable.
+class MemTableRepFactory {
+ public:
+  virtual ~MemTableRepFactory();
+
+  // Return the name of the representation, for logging.
+  virtual const char* Name() const = 0;
+
+  // Return a new representation that orders entries with "cmp" and
+  // allocates any memory it needs from "arena".  Both outlive it.
+  virtual MemTableRep* CreateMemTableRep(
+      const MemTableRep::KeyComparator& cmp, Arena* arena) const = 0;
+
+  // Return true if the created representations support
+  // InsertConcurrently().
+  virtual bool IsInsertConcurrentlySupported() const { return false; }
+};
+
+// Return a factory for sorted skiplists.
+extern MemTableRepFactory* NewSkipListRepFactory();
+
+// Return a factory for representations that hash the key prefix given
+// by "transform" into one of "bucket_count" buckets, each holding a
+// sorted skiplist.  Keys outside of the transform's domain are hashed
+// whole.  Point lookups only search one bucket; iterating over the
+// whole memtable first merges every bucket into one sorted list.
+// "transform" must outlive the factory.
+extern MemTableRepFactory* NewHashSkipListRepFactory(
+    const SliceTransform* transform, size_t bucket_count);
+
+// Return a factory for representations that append entries to an
+// unsorted vector.  Reads work on a sorted copy of the vector that is
+// shared between readers and only rebuilt when entries were appended
+// since it was made; a rebuild sorts the new entries and merges them
+// into the previous copy.  Reads that interleave with writes therefore
+// cost time linear in the memtable size each, so use this only for
+// bulk-load workloads that do not read the active memtable.  "reserve"
+// entries are preallocated.
+extern MemTableRepFactory* NewVectorRepFactory(size_t reserve);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_MEMTABLEREP_H_
@@ -0,0 +1,52 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A MergeOperator lets DB::Merge() record an update to a key, such as
+// "add 1" or "append x", without reading the current value first.  The
+// operands written for a key are combined with its value, or with
+// nothing if it has none, when the key is read, and by compactions.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+#define STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+
+#include <deque>
+#include <string>
+
+namespace leveldb {
+
+class Logger;
+class Slice;
+
+class MergeOperator {
+ public:
+  virtual ~MergeOperator();
+
+  // The name of the operator.  If the meaning of the operands changes,
+  // the name must be changed too.
+  virtual const char* Name() const = 0;
+
+  // Apply "operands", oldest first, to "existing_value", which is NULL if
+  // "key" has no value before them.  Stores the result in *new_value and
+  // returns true on success.  Returning false signals corrupt operands:
+  // reads of "key" then fail with a Corruption error.
+  virtual bool FullMerge(const Slice& key,
+                         const Slice* existing_value,
+                         const std::deque<std::string>& operands,
+                         std::string* new_value,
+                         Logger* logger) const = 0;
+
+  // Combine two consecutive operands into one that has the same effect,
+  // storing it in *new_value.  Returns false if that is not possible, in
+  // which case both operands are kept.  The default implementation
+  // always returns false.
+  virtual bool PartialMerge(const Slice& key,
+                            const Slice& older_operand,
+                            const Slice& newer_operand,
+                            std::string* new_value,
+                            Logger* logger) const;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
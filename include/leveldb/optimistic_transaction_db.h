@@ -0,0 +1,95 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// An OptimisticTransactionDB groups reads and writes into transactions
+// without taking any lock while they run.  A transaction reads the DB as
+// of the moment it began, buffers its writes, and applies them
+// atomically on Commit().  Commit() fails with a Busy status, writing
+// nothing, if another write to a key the transaction read or wrote was
+// made after the transaction began; the caller may then retry the whole
+// transaction.
+//
+// Conflicts are detected from the memtables only.  A transaction that
+// outlives the memtables it started under also fails with Busy, so
+// transactions should be short compared to the time it takes to fill
+// the write buffers.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_OPTIMISTIC_TRANSACTION_DB_H_
+#define STORAGE_LEVELDB_INCLUDE_OPTIMISTIC_TRANSACTION_DB_H_
+
+#include <string>
+#include "leveldb/db.h"
+
+namespace leveldb {
+
+// A Transaction must not be used by several threads at once.
+class Transaction {
+ public:
+  Transaction() { }
+
+  // Rolls the transaction back unless it has been committed.
+  virtual ~Transaction();
+
+  // Read "key" from the DB as of the start of the transaction, with the
+  // transaction's own writes applied.  options.snapshot is ignored.
+  virtual Status Get(const ReadOptions& options,
+                     const Slice& key,
+                     std::string* value) = 0;
+
+  // Return an iterator over the same view of the DB as Get().  Keys read
+  // through the iterator are not checked for conflicts.  The transaction
+  // must not be written to while the result is live.
+  virtual Iterator* NewIterator(const ReadOptions& options) = 0;
+
+  // Buffer a write, to be applied on Commit().
+  virtual void Put(const Slice& key, const Slice& value) = 0;
+  virtual void Delete(const Slice& key) = 0;
+
+  // Apply the buffered writes atomically, unless a key that was read by
+  // Get() or written has been written by someone else since the
+  // transaction began.  Returns Busy in that case.  Either way, the
+  // transaction is over and no other method may be called.
+  virtual Status Commit() = 0;
+
+  // Discard the buffered writes.  The transaction is over and no other
+  // method may be called.
+  virtual void Rollback() = 0;
+
+ private:
+  // No copying allowed
+  Transaction(const Transaction&);
+  void operator=(const Transaction&);
+};
+
+class OptimisticTransactionDB {
+ public:
+  // Open the database with the specified "name", as DB::Open() does.
+  // Stores a pointer to a heap-allocated database in *dbptr and returns
+  // OK on success.
+  // Stores NULL in *dbptr and returns a non-OK status on error.
+  // Caller should delete *dbptr when it is no longer needed.
+  static Status Open(const Options& options,
+                     const std::string& name,
+                     OptimisticTransactionDB** dbptr);
+
+  OptimisticTransactionDB() { }
+  virtual ~OptimisticTransactionDB();
+
+  // Start a transaction whose Commit() writes with "options".  The
+  // caller should delete the result, before this object.
+  virtual Transaction* BeginTransaction(const WriteOptions& options) = 0;
+
+  // Return the underlying DB, for reads and writes outside transactions.
+  // The result is owned by this object.
+  virtual DB* GetBaseDB() = 0;
+
+ private:
+  // No copying allowed
+  OptimisticTransactionDB(const OptimisticTransactionDB&);
+  void operator=(const OptimisticTransactionDB&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_OPTIMISTIC_TRANSACTION_DB_H_
@@ -14,6 +14,9 @@ namespace leveldb {
     class Comparator;
     class Env;
     class Logger;
+    class MemTableRepFactory;
+    class MergeOperator;
+    class SliceTransform;
     class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -52,6 +55,61 @@ struct Options {
     // default: 4MB
     size_t write_buffer_size;
 
+    // Maximum number of write buffers (the active memtable plus the
+    // filled ones waiting to be compacted) kept in memory.  Filled
+    // memtables that are waiting together are compacted into a single
+    // level-0 table.  Larger values absorb write bursts without stalls.
+    //
+    // Default: 2
+    int max_write_buffer_number;
+
+    // Creates the in-memory index of each memtable.  See
+    // leveldb/memtablerep.h for the built-in representations.
+    // If NULL, leveldb uses a sorted skiplist.
+    //
+    // Default: NULL
+    const MemTableRepFactory* memtable_factory;
+
+    // Memtables allocate their memory in blocks of this many bytes.
+    // Larger blocks spread a memtable over fewer pages, which speeds up
+    // searches of large memtables, but make a memtable look fuller than
+    // it is by up to a block.  Clipped to [4KB,write_buffer_size/8].
+    //
+    // Default: 4KB
+    size_t arena_block_size;
+
+    // If non-zero, memtable blocks are rounded down to a multiple of
+    // this size, the size of the huge pages of the system (typically
+    // 2MB), and mapped from huge pages.  Reserved huge pages (see
+    // /proc/sys/vm/nr_hugepages) are used when enough are free, and
+    // transparent huge pages otherwise.  Has no effect unless
+    // arena_block_size, as clipped, is at least this size, which takes
+    // a write_buffer_size of at least 8 huge pages.
+    //
+    // Default: 0
+    size_t memtable_huge_page_size;
+
+    // If true, a put whose key already has a value in the active
+    // memtable overwrites that value in place when the new value is no
+    // larger, instead of adding an entry.  Memtables then fill up, and
+    // are flushed, less often under workloads that keep updating the
+    // same keys with values of the same size.  Only done while no
+    // snapshot is held and no iterator over the active memtable is
+    // alive; GetSnapshot() and NewIterator() wait for such writes to
+    // finish.  Ignored by writers that use allow_concurrent_memtable_write.
+    //
+    // Default: false
+    bool inplace_update_support;
+
+    // If positive, each memtable keeps a bloom filter of its user keys
+    // that takes this fraction of write_buffer_size, and point lookups
+    // skip the index of the memtables whose filter rules the key out.
+    // Most lookups of data that is not in the memtables then avoid a
+    // search of their index.  Clipped to [0, 0.25].
+    //
+    // Default: 0
+    double memtable_bloom_size_ratio;
+
     // Number of open files that can used by DB. You may need to
     // increase this if your databases has a large working set (budget 
     // one open file per 2MB of working set).
@@ -105,6 +163,17 @@ struct Options {
     // Default: currently false, but may become true later.
     bool reuse_logs;
 
+    // If non-zero, keep up to this many obsolete log files and reuse
+    // them for new logs instead of creating fresh files.  A reused file
+    // is overwritten in place with records tagged by the new log number,
+    // so recovery ignores whatever the old log left behind them.  Sync
+    // writes to a reused file do not have to allocate blocks or grow the
+    // file.  Old log files are not appended to at open when this is set,
+    // even with reuse_logs.
+    //
+    // Default: 0
+    size_t recycle_log_file_num;
+
     // if non-NULL, user the specified filter to reduce disk reads.
     // Many applications will benifit from passing the result of
     // NewBloomFilterPolicy() here.
@@ -112,6 +181,88 @@ struct Options {
     // Default: NULL
     const FilterPolicy* filter_policy;
 
+    // If non-NULL, the filters of tables also hold the prefixes that
+    // this transform extracts from their keys, so that prefix scans
+    // (see ReadOptions::prefix_same_as_start) can skip the tables that
+    // hold no key with the prefix.  Transform() must return a prefix of
+    // its argument, and keys that share a prefix must be contiguous in
+    // the comparator order.  Has no effect without a filter_policy.
+    //
+    // Default: NULL
+    const SliceTransform* prefix_extractor;
+
+    // If true, tables hold a single filter for all their keys instead of
+    // one filter per 2KB of data blocks.  Get() then probes the filter
+    // once, before searching the index, and the table does not pay the
+    // offset array and size overhead of many small filters.  Tables built
+    // either way can be read regardless of this option.  Has no effect
+    // without a filter_policy.
+    //
+    // Default: false
+    bool full_filter;
+
+    // Combines the operands written by DB::Merge() with the value they
+    // apply to.  Must be set to use DB::Merge(), and must stay the same
+    // (see MergeOperator::Name()) while the DB holds merge operands.
+    //
+    // Default: NULL
+    const MergeOperator* merge_operator;
+
+    // If true, DB::Write() runs as a two-stage pipeline: once a batch
+    // group has been appended to the log, the next group may start its
+    // log append while the earlier group is still being applied to the
+    // memtable.  Sequence numbers still become visible to readers in
+    // commit order.  This improves write throughput when many threads
+    // write concurrently.
+    //
+    // Default: false
+    bool enable_pipelined_write;
+
+    // If true, every writer in a batch group applies its own batch to
+    // the memtable, in parallel with the other writers of the group,
+    // instead of the group leader applying the whole group alone.  The
+    // group's sequence numbers become visible only after all of its
+    // writers are done.
+    //
+    // Default: false
+    bool allow_concurrent_memtable_write;
+
+    // If true, sync writes do not call fsync on the log themselves.  A
+    // dedicated thread syncs the log instead, and each sync write waits
+    // until the log is durable up to its sequence number.  One fsync
+    // then covers all sync groups logged while the previous one ran,
+    // which raises sync write throughput when the device is bound by
+    // fsync count.  A sync write may become visible to readers shortly
+    // before it is durable.  Ignored if the Env's log files do not
+    // support WritableFile::SyncFlushed().
+    //
+    // Default: false
+    bool enable_wal_sync_thread;
+
+    // If true, log records are buffered in memory instead of being
+    // handed to the operating system after every write group.  The
+    // buffer is written out by DB::FlushWAL(), by every sync write, once
+    // it holds wal_buffer_size bytes, and when the log is switched or
+    // the DB is closed.  Writes still in the buffer are lost if the
+    // process crashes.
+    //
+    // Default: false
+    bool manual_wal_flush;
+
+    // With manual_wal_flush, write out the log buffer once it holds at
+    // least this many bytes.
+    //
+    // Default: 64KB
+    size_t wal_buffer_size;
+
+    // Once compaction falls behind (too many level-0 files, or levels
+    // well over their size targets), writes are admitted at a rate of at
+    // most this many bytes per second.  The rate shrinks further as the
+    // compaction backlog grows.
+    //
+    // Default: 16MB/s
+    size_t delayed_write_rate;
+
     //Create an Option object with default values for all fields.
     Options();
 }; // struct Options
@@ -134,10 +285,32 @@ struct ReadOptions {
     // 指定读取的snapshot
     const Snapshot* snapshot;
 
+    // Iterators read the data blocks of a table one at a time until
+    // they have read a few consecutive ones.  They then read ahead in
+    // chunks that double from 8KB up to 256KB while the scan goes on.
+    // If non-zero, iterators instead always read ahead in chunks of
+    // "readahead_size" bytes, which suits scans known to be long.
+    //
+    // Default: 0
+    size_t readahead_size;
+
+    // If true and Options::prefix_extractor is set, an iterator
+    // positioned by Seek(target) only yields the keys that share the
+    // prefix of "target", and becomes invalid past them.  The search
+    // then skips the tables whose filters rule the prefix out.  Such
+    // iterators only move forward: Prev() and SeekToLast() make them
+    // invalid with a NotSupported status.  Targets outside the domain
+    // of the prefix extractor are not bounded.
+    //
+    // Default: false
+    bool prefix_same_as_start;
+
     ReadOptions()
         : verify_checksums(false),
           fill_cache(true),
-          snapshot(NULL){ }
+          snapshot(NULL),
+          readahead_size(0),
+          prefix_same_as_start(false) { }
 }; // struct ReadOptions
 
 struct WriteOptions {
@@ -155,8 +328,32 @@ struct WriteOptions {
     // 是否及时将内存中数据写入磁盘
     bool sync;
 
+    // If true, the write is applied to the memtable without being
+    // appended to the log.  It is lost if the DB is closed or the
+    // process crashes before its memtable has been written to a table
+    // file, while logged writes made before and after it survive.  Call
+    // DB::Flush() to make such writes durable.  Cannot be combined with
+    // sync.
+    //
+    // Default: false
+    bool disable_wal;
+
     WriteOptions()
-        : sync(false) { }
+        : sync(false),
+          disable_wal(false) { }
+};
+
+// Options that control DB::IngestExternalFiles()
+struct IngestExternalFileOptions {
+    // If true, the files are renamed into the DB directory instead of
+    // being copied, so they must be on the same file system as the DB.
+    // On success they no longer exist under their original names.
+    //
+    // Default: false
+    bool move_files;
+
+    IngestExternalFileOptions()
+        : move_files(false) { }
 };
 
 } //namespace leveldb
@@ -0,0 +1,44 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A SliceTransform maps a user key to a shorter key, typically one of
+// its prefixes.  Memtable representations and filters can use it to
+// group keys that share a prefix, e.g. all the columns of one row.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+#define STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+
+#include <stddef.h>
+
+namespace leveldb {
+
+class Slice;
+
+class SliceTransform {
+ public:
+  virtual ~SliceTransform();
+
+  // Return the name of this transformation.  If the transformation
+  // changes in an incompatible way, the name must be changed too.
+  virtual const char* Name() const = 0;
+
+  // Return the transformed version of "key".
+  // REQUIRES: InDomain(key)
+  virtual Slice Transform(const Slice& key) const = 0;
+
+  // Return true iff Transform() may be applied to "key".  Keys outside
+  // of the domain are not grouped with any other key.
+  virtual bool InDomain(const Slice& key) const = 0;
+};
+
+// Return a new transform that maps a key to its first "prefix_len"
+// bytes.  Keys shorter than "prefix_len" are not in its domain.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+extern const SliceTransform* NewFixedPrefixTransform(size_t prefix_len);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
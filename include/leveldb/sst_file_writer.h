@@ -0,0 +1,68 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// SstFileWriter builds a table file outside of any DB, so that it can
+// later be added to a DB with DB::IngestExternalFiles() instead of
+// writing its contents through DB::Write().
+//
+// Multiple threads can invoke const methods on an SstFileWriter without
+// external synchronization, but if any of the threads may call a
+// non-const method, all threads accessing the same SstFileWriter must use
+// external synchronization.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
+#define STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
+
+#include <stdint.h>
+#include <string>
+#include "leveldb/options.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Slice;
+
+class SstFileWriter {
+ public:
+  // "options" must have the comparator of the DB that the file will be
+  // ingested into.  The file is written through options.env and uses
+  // its block size, compression and filter policy.
+  explicit SstFileWriter(const Options& options);
+
+  // Abandons the file if Finish() has not been called.
+  ~SstFileWriter();
+
+  // Create the file "fname" and start adding entries to it.
+  Status Open(const std::string& fname);
+
+  // Add an entry that sets "key" to "value", or deletes "key".
+  // REQUIRES: Open() succeeded and Finish() has not been called
+  // REQUIRES: key is after any previously added key according to the
+  // comparator.
+  Status Put(const Slice& key, const Slice& value);
+  Status Delete(const Slice& key);
+
+  // Write out the rest of the file, sync it and close it.  Fails if no
+  // entry has been added.
+  // REQUIRES: Open() succeeded and Finish() has not been called
+  Status Finish();
+
+  // Size of the file generated so far.  If invoked after a successful
+  // Finish() call, returns the size of the final generated file.
+  uint64_t FileSize() const;
+
+ private:
+  struct Rep;
+  Rep* rep_;
+
+  Status Add(const Slice& key, const Slice& value, bool deletion);
+
+  // No copying allowed
+  SstFileWriter(const SstFileWriter&);
+  void operator=(const SstFileWriter&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
@@ -49,6 +49,9 @@ public:
     static Status IOError(const Slice& msg, const Slice& msg2 = Slice()) { 
         return Status(kIOError, msg, msg2);
     }
+    static Status Busy(const Slice& msg, const Slice& msg2 = Slice()) { 
+        return Status(kBusy, msg, msg2);
+    }
 
     // returns true if the status indicates success.
     bool ok() const { return (state_ == NULL); }
@@ -65,6 +68,10 @@ public:
 
     bool IsInvalidArgument() const { return code() == kInvalidArgument; }
 
+    // returns true if the status indicates that the operation conflicted
+    // with another one and may succeed if retried.
+    bool IsBusy() const { return code() == kBusy; }
+
     // Return a string representation of this status suitable for printing.
     // returns the string "OK" for success.
     std::string ToString() const;
@@ -83,7 +90,8 @@ private:
         kCorruption = 2,
         kNotSupported = 3,
         kInvalidArgument = 4,
-        kIOError = 5
+        kIOError = 5,
+        kBusy = 6
     };
 
     Code code() const {
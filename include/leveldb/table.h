@@ -47,6 +47,10 @@ class Table {
   // call one of the Seek methods on the iterator before using it).
   Iterator* NewIterator(const ReadOptions&) const;
 
+  // Returns a new iterator over the range tombstones of the table (see
+  // TableBuilder::AddRangeTombstone()).  The result is initially invalid.
+  Iterator* NewRangeTombstoneIterator() const;
+
   // Given a key, return an approximate byte offset in the file where
   // the data for that key begins (or would begin if the key were
   // present in the file).  The returned value is in terms of file
@@ -62,18 +66,48 @@ class Table {
   explicit Table(Rep* rep) { rep_ = rep; }
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
 
+  // Reads ahead of the data blocks of a forward scan, on behalf of one
+  // iterator.  BlockReader() takes a Table, ReadaheadBlockReader() one
+  // of these.
+  struct Readahead;
+  static Iterator* ReadaheadBlockReader(void*, const ReadOptions&,
+                                        const Slice&);
+  Iterator* NewBlockIterator(const ReadOptions&, const Slice& index_value,
+                             Readahead* readahead);
+
   // Calls (*handle_result)(arg, ...) with the entry found after a call
-  // to Seek(key).  May not make such a call if filter policy says
-  // that key is not present.
+  // to Seek(key), and then with each following entry for as long as
+  // handle_result returns true.  May not make such a call if filter
+  // policy says that key is not present.
   friend class TableCache;
   Status InternalGet(
       const ReadOptions&, const Slice& key,
       void* arg,
-      void (*handle_result)(void* arg, const Slice& k, const Slice& v));
-
-
-  void ReadMeta(const Footer& footer);
-  void ReadFilter(const Slice& filter_handle_value);
+      bool (*handle_result)(void* arg, const Slice& k, const Slice& v));
+
+  // Same as calling InternalGet(keys[i], args[i], handle_result) for i
+  // in [0,n), storing its result in statuses[i], but the index block is
+  // searched with a single iterator, consecutive keys that fall in the
+  // same data block share one read of it, and the data blocks missing
+  // from the block cache are read with one RandomAccessFile::MultiRead().
+  // REQUIRES: "keys" are sorted.
+  void InternalMultiGet(
+      const ReadOptions&, int n, const Slice* keys,
+      void* const* args,
+      bool (*handle_result)(void* arg, const Slice& k, const Slice& v),
+      Status* statuses);
+
+  // Data blocks read ahead by InternalMultiGet().
+  struct BlockBatch;
+  void ReadBlockBatch(const ReadOptions&, int n, const Slice* keys,
+                      BlockBatch* batch);
+  Iterator* BatchBlockReader(const BlockBatch& batch, const ReadOptions&,
+                             const Slice& index_value);
+
+
+  Status ReadMeta(const Footer& footer);
+  void ReadFilter(const Slice& filter_handle_value, bool full);
+  Status ReadRangeTombstones(const Slice& handle_value);
 
   // No copying allowed
   Table(const Table&);
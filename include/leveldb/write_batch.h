@@ -17,6 +17,17 @@ public:
 
     void Delete(const Slice& key);
 
+    // Record "value" as a merge operand for "key".  See
+    // leveldb/merge_operator.h.
+    void Merge(const Slice& key, const Slice& value);
+
+    // Erase the mapping for "key", which was put at most once.  See
+    // DB::SingleDelete().
+    void SingleDelete(const Slice& key);
+
+    // Erase the mappings of the keys in ["begin_key", "end_key").
+    void DeleteRange(const Slice& begin_key, const Slice& end_key);
+
     void Clear();
 
     class Handler {
@@ -24,6 +35,13 @@ public:
         virtual ~Handler();
         virtual void Put(const Slice& key, const Slice& value) = 0;
         virtual void Delete(const Slice& key) = 0;
+        // The default implementation ignores merge operands.
+        virtual void Merge(const Slice& key, const Slice& value);
+        // The default implementation calls Delete().
+        virtual void SingleDelete(const Slice& key);
+        // The default implementation ignores range deletions.
+        virtual void DeleteRange(const Slice& begin_key,
+                                 const Slice& end_key);
     };
 
     Status Iterate(Handler* handler) const;
@@ -0,0 +1,70 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// WriteBatchWithIndex is a WriteBatch that can also be read from before
+// it is written: an index over its entries serves lookups and
+// iteration, optionally on top of the contents of a DB.
+//
+// Multiple threads can invoke const methods on a WriteBatchWithIndex
+// without external synchronization, but if any of the threads may call a
+// non-const method, all threads accessing the same WriteBatchWithIndex
+// must use external synchronization.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_WRITE_BATCH_WITH_INDEX_H_
+#define STORAGE_LEVELDB_INCLUDE_WRITE_BATCH_WITH_INDEX_H_
+
+#include <string>
+#include "leveldb/comparator.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class DB;
+class Iterator;
+class Slice;
+class WriteBatch;
+struct ReadOptions;
+
+class WriteBatchWithIndex {
+ public:
+  // Keys are ordered by "comparator", which must be the comparator of
+  // any DB the batch is read together with or written to.
+  explicit WriteBatchWithIndex(
+      const Comparator* comparator = BytewiseComparator());
+  ~WriteBatchWithIndex();
+
+  void Put(const Slice& key, const Slice& value);
+  void Delete(const Slice& key);
+  void Clear();
+
+  // Returns the batch to pass to DB::Write().  The result remains owned
+  // by this object and must not be modified directly.
+  WriteBatch* GetWriteBatch();
+
+  // If the batch sets "key", store the value in *value and return OK.
+  // Returns NotFound if the batch deletes "key" or does not touch it.
+  Status GetFromBatch(const Slice& key, std::string* value) const;
+
+  // Read "key" from "db" as if the batch had been written to it.
+  Status GetFromBatchAndDB(DB* db, const ReadOptions& options,
+                           const Slice& key, std::string* value) const;
+
+  // Return an iterator over the contents of "base", an iterator from
+  // DB::NewIterator(), as if the batch had been applied to them.  The
+  // result takes ownership of "base".  The batch must not be changed
+  // while the result is live.
+  Iterator* NewIteratorWithBase(Iterator* base) const;
+
+ private:
+  struct Rep;
+  Rep* rep_;
+
+  // No copying allowed
+  WriteBatchWithIndex(const WriteBatchWithIndex&);
+  void operator=(const WriteBatchWithIndex&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_WRITE_BATCH_WITH_INDEX_H_
@@ -4,7 +4,8 @@
 //
 // A filter block is stored near the end of a Table file.  It contains
 // filters (e.g., bloom filters) for all data blocks in the table combined
-// into a single filter block.
+// into a single filter block, or a single filter for the whole table (see
+// Options::full_filter).
 
 #ifndef STORAGE_LEVELDB_TABLE_FILTER_BLOCK_H_
 #define STORAGE_LEVELDB_TABLE_FILTER_BLOCK_H_
@@ -25,21 +26,32 @@ class FilterPolicy;
 // a special block in the Table.
 //
 // The sequence of calls to FilterBlockBuilder must match the regexp:
-//      (StartBlock AddKey*)* Finish
+//      (StartBlock (AddKey|AddPrefix)*)* Finish
 class FilterBlockBuilder {
  public:
-  explicit FilterBlockBuilder(const FilterPolicy*);
+  // If "full", the block holds a single filter for all the keys, and
+  // StartBlock() has no effect.
+  explicit FilterBlockBuilder(const FilterPolicy*, bool full = false);
 
   void StartBlock(uint64_t block_offset);
   void AddKey(const Slice& key);
+
+  // Add the prefix of a key (see Options::prefix_extractor).  The
+  // prefixes of a filter are passed to the policy after its keys, so
+  // that equal prefixes are adjacent.
+  void AddPrefix(const Slice& prefix);
+
   Slice Finish();
 
  private:
   void GenerateFilter();
 
   const FilterPolicy* policy_;
+  const bool full_;
   std::string keys_;              // Flattened key contents
   std::vector<size_t> start_;     // Starting index in keys_ of each key
+  std::string prefixes_;          // Flattened prefix contents
+  std::vector<size_t> prefix_start_;  // Same as start_, for prefixes_
   std::string result_;            // Filter data computed so far
   std::vector<Slice> tmp_keys_;   // policy_->CreateFilter() argument
   std::vector<uint32_t> filter_offsets_;
@@ -52,11 +64,17 @@ class FilterBlockBuilder {
 class FilterBlockReader {
  public:
  // REQUIRES: "contents" and *policy must stay live while *this is live.
-  FilterBlockReader(const FilterPolicy* policy, const Slice& contents);
+  FilterBlockReader(const FilterPolicy* policy, const Slice& contents,
+                    bool full = false);
   bool KeyMayMatch(uint64_t block_offset, const Slice& key);
 
+  // True if the block holds a single filter for the whole table, in
+  // which case KeyMayMatch() ignores "block_offset".
+  bool full() const { return full_; }
+
  private:
   const FilterPolicy* policy_;
+  const bool full_;
   const char* data_;    // Pointer to filter data (at block-start)
   const char* offset_;  // Pointer to beginning of offset array (at block-end)
   size_t num_;          // Number of entries in offset array
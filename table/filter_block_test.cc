@@ -121,6 +121,38 @@ TEST(FilterBlockTest, MultiChunk) {
   ASSERT_TRUE(! reader.KeyMayMatch(9000, "bar"));
 }
 
+TEST(FilterBlockTest, FullFilter) {
+  FilterBlockBuilder builder(&policy_, true);
+  builder.StartBlock(0);
+  builder.AddKey("foo");
+  builder.AddKey("bar");
+  builder.StartBlock(3100);
+  builder.AddKey("box");
+  builder.StartBlock(9000);
+  builder.AddKey("hello");
+  Slice block = builder.Finish();
+  ASSERT_EQ(16, block.size());  // One hash per key, no offset array
+  FilterBlockReader reader(&policy_, block, true);
+  ASSERT_TRUE(reader.full());
+
+  // The block offset does not matter
+  ASSERT_TRUE(reader.KeyMayMatch(0, "foo"));
+  ASSERT_TRUE(reader.KeyMayMatch(0, "hello"));
+  ASSERT_TRUE(reader.KeyMayMatch(9000, "bar"));
+  ASSERT_TRUE(reader.KeyMayMatch(100000, "box"));
+  ASSERT_TRUE(! reader.KeyMayMatch(0, "missing"));
+  ASSERT_TRUE(! reader.KeyMayMatch(9000, "other"));
+}
+
+TEST(FilterBlockTest, EmptyFullFilter) {
+  FilterBlockBuilder builder(&policy_, true);
+  builder.StartBlock(0);
+  Slice block = builder.Finish();
+  ASSERT_EQ(0, block.size());
+  FilterBlockReader reader(&policy_, block, true);
+  ASSERT_TRUE(! reader.KeyMayMatch(0, "foo"));
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -81,6 +81,19 @@ Status ReadBlock(RandomAccessFile* file,
     delete[] buf;
     return s;
   }
+  return DecodeBlock(options, handle, contents, buf, result);
+}
+
+Status DecodeBlock(const ReadOptions& options,
+                   const BlockHandle& handle,
+                   const Slice& contents,
+                   char* buf,
+                   BlockContents* result) {
+  result->data = Slice();
+  result->cachable = false;
+  result->heap_allocated = false;
+
+  const size_t n = static_cast<size_t>(handle.size());
   if (contents.size() != n + kBlockTrailerSize) {
     delete[] buf;
     return Status::Corruption("truncated block read");
@@ -93,8 +106,7 @@ Status ReadBlock(RandomAccessFile* file,
     const uint32_t actual = crc32c::Value(data, n + 1);
     if (actual != crc) {
       delete[] buf;
-      s = Status::Corruption("block checksum mismatch");
-      return s;
+      return Status::Corruption("block checksum mismatch");
     }
   }
 
@@ -96,6 +96,16 @@ extern Status ReadBlock(RandomAccessFile* file,
                         const BlockHandle& handle,
                         BlockContents* result);
 
+// Same as ReadBlock(), but for a block that has already been read:
+// "contents" holds the handle.size() + kBlockTrailerSize bytes read at
+// handle.offset(), possibly stored in "buf".  Takes ownership of "buf",
+// which must have been allocated with new[].
+extern Status DecodeBlock(const ReadOptions& options,
+                          const BlockHandle& handle,
+                          const Slice& contents,
+                          char* buf,
+                          BlockContents* result);
+
 // Implementation details follow.  Clients should ignore,
 
 inline BlockHandle::BlockHandle()
@@ -4,11 +4,15 @@
 
 #include "leveldb/table.h"
 
+#include <string.h>
+#include <algorithm>
+#include <vector>
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/slice_transform.h"
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
@@ -22,6 +26,7 @@ struct Table::Rep {
     delete filter;
     delete [] filter_data;
     delete index_block;
+    delete range_del_block;
   }
 
   Options options;
@@ -30,9 +35,11 @@ struct Table::Rep {
   uint64_t cache_id;
   FilterBlockReader* filter;
   const char* filter_data;
+  bool prefix_filtered;  // filter holds the prefixes of options.prefix_extractor
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
   Block* index_block;
+  Block* range_del_block;  // NULL if the table has no range tombstones
 };
 
 Status Table::Open(const Options& options,
@@ -79,8 +86,14 @@ Status Table::Open(const Options& options,
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
     rep->filter_data = NULL;
     rep->filter = NULL;
+    rep->prefix_filtered = false;
+    rep->range_del_block = NULL;
     *table = new Table(rep);
-    (*table)->ReadMeta(footer);
+    s = (*table)->ReadMeta(footer);
+    if (!s.ok()) {
+      delete *table;
+      *table = NULL;
+    }
   } else {
     if (index_block) delete index_block;
   }
@@ -88,11 +101,7 @@ Status Table::Open(const Options& options,
   return s;
 }
 
-void Table::ReadMeta(const Footer& footer) {
-  if (rep_->options.filter_policy == NULL) {
-    return;  // Do not need any metadata
-  }
-
+Status Table::ReadMeta(const Footer& footer) {
   // TODO(sanjay): Skip this if footer.metaindex_handle() size indicates
   // it is an empty block.
   ReadOptions opt;
@@ -100,24 +109,48 @@ void Table::ReadMeta(const Footer& footer) {
     opt.verify_checksums = true;
   }
   BlockContents contents;
-  if (!ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents).ok()) {
-    // Do not propagate errors since meta info is not needed for operation
-    return;
+  Status s = ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents);
+  if (!s.ok()) {
+    // Range tombstones are needed for correct reads, but are not known
+    // to be absent unless the metaindex can be read.
+    return s;
   }
   Block* meta = new Block(contents);
 
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
-  key.append(rep_->options.filter_policy->Name());
-  iter->Seek(key);
-  if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+  if (rep_->options.filter_policy != NULL) {
+    std::string key = "filter.";
+    key.append(rep_->options.filter_policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      // Do not propagate errors since the filter is not needed for
+      // operation
+      ReadFilter(iter->value(), false);
+    } else {
+      key = "fullfilter.";
+      key.append(rep_->options.filter_policy->Name());
+      iter->Seek(key);
+      if (iter->Valid() && iter->key() == Slice(key)) {
+        ReadFilter(iter->value(), true);
+      }
+    }
+    if (rep_->filter != NULL && rep_->options.prefix_extractor != NULL) {
+      key = "prefix.";
+      key.append(rep_->options.prefix_extractor->Name());
+      iter->Seek(key);
+      rep_->prefix_filtered = (iter->Valid() && iter->key() == Slice(key));
+    }
+  }
+  iter->Seek("rangedel");
+  if (iter->Valid() && iter->key() == Slice("rangedel")) {
+    s = ReadRangeTombstones(iter->value());
   }
   delete iter;
   delete meta;
+  return s;
 }
 
-void Table::ReadFilter(const Slice& filter_handle_value) {
+void Table::ReadFilter(const Slice& filter_handle_value, bool full) {
   Slice v = filter_handle_value;
   BlockHandle filter_handle;
   if (!filter_handle.DecodeFrom(&v).ok()) {
@@ -137,7 +170,25 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   if (block.heap_allocated) {
     rep_->filter_data = block.data.data();     // Will need to delete later
   }
-  rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
+  rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data,
+                                       full);
+}
+
+Status Table::ReadRangeTombstones(const Slice& handle_value) {
+  Slice v = handle_value;
+  BlockHandle handle;
+  Status s = handle.DecodeFrom(&v);
+  if (!s.ok()) {
+    return s;
+  }
+  ReadOptions opt;
+  opt.verify_checksums = true;
+  BlockContents block;
+  s = ReadBlock(rep_->file, opt, handle, &block);
+  if (s.ok()) {
+    rep_->range_del_block = new Block(block);
+  }
+  return s;
 }
 
 Table::~Table() {
@@ -159,13 +210,130 @@ static void ReleaseBlock(void* arg, void* h) {
   cache->Release(handle);
 }
 
-// Convert an index iterator value (i.e., an encoded BlockHandle)
-// into an iterator over the contents of the corresponding block.
+struct Table::Readahead {
+  static const size_t kInitialSize = 8 * 1024;
+  static const size_t kMaxSize = 256 * 1024;
+
+  Table* const table;
+  const bool fixed;          // Set if ReadOptions::readahead_size is
+  size_t size;               // Of the next chunk to read
+  int sequential;            // Blocks reached in order, up to 2
+  uint64_t next_offset;      // Offset of the block after the last one
+  char* scratch;
+  size_t capacity;           // Of scratch
+  uint64_t chunk_offset;
+  Slice chunk;               // Read at chunk_offset, maybe into scratch
+
+  Readahead(Table* t, size_t readahead_size)
+      : table(t),
+        fixed(readahead_size > 0),
+        size(fixed ? readahead_size : kInitialSize),
+        sequential(0),
+        next_offset(0),
+        scratch(NULL),
+        capacity(0),
+        chunk_offset(0) {
+  }
+
+  ~Readahead() {
+    delete[] scratch;
+  }
+
+  static void Delete(void* arg, void* ignored) {
+    delete reinterpret_cast<Readahead*>(arg);
+  }
+
+  // Note that the scan reaches the block at "handle", which may come
+  // from the block cache.
+  void Track(const BlockHandle& handle) {
+    if (handle.offset() == next_offset) {
+      if (sequential < 2) {
+        sequential++;
+      }
+    } else {
+      // A seek: start over
+      sequential = 0;
+      if (!fixed) {
+        size = kInitialSize;
+      }
+    }
+    next_offset = handle.offset() + handle.size() + kBlockTrailerSize;
+  }
+
+  // Same as ReadBlock(), but reads ahead once the scan looks sequential.
+  Status Read(const ReadOptions& options, const BlockHandle& handle,
+              BlockContents* result) {
+    RandomAccessFile* file = table->rep_->file;
+    if (!fixed && sequential < 2) {
+      return ReadBlock(file, options, handle, result);
+    }
+
+    const size_t n = static_cast<size_t>(handle.size()) + kBlockTrailerSize;
+    if (handle.offset() < chunk_offset ||
+        handle.offset() + n > chunk_offset + chunk.size()) {
+      // Data blocks precede the metaindex block, so do not read past it.
+      const uint64_t limit = table->rep_->metaindex_handle.offset();
+      size_t len = size;
+      if (handle.offset() + len > limit) {
+        len = (handle.offset() < limit) ? limit - handle.offset() : 0;
+      }
+      if (len < n) {
+        len = n;
+      }
+      if (capacity < len) {
+        delete[] scratch;
+        scratch = new char[len];
+        capacity = len;
+      }
+      chunk_offset = handle.offset();
+      Status s = file->Read(chunk_offset, len, &chunk, scratch);
+      if (!s.ok()) {
+        chunk = Slice();
+        return s;
+      }
+      if (!fixed && size < kMaxSize) {
+        size *= 2;
+      }
+    }
+
+    // The block outlives the chunk, so it is copied out of scratch.  A
+    // file that returned a pointer to its own memory, such as an
+    // mmapped one, keeps serving the block from there.
+    const char* data = chunk.data() + (handle.offset() - chunk_offset);
+    size_t available = chunk.size() - (handle.offset() - chunk_offset);
+    if (available > n) {
+      available = n;
+    }
+    char* buf = new char[n];
+    if (chunk.data() == scratch) {
+      memcpy(buf, data, available);
+      data = buf;
+    }
+    return DecodeBlock(options, handle, Slice(data, available), buf, result);
+  }
+};
+
 Iterator* Table::BlockReader(void* arg,
                              const ReadOptions& options,
                              const Slice& index_value) {
   Table* table = reinterpret_cast<Table*>(arg);
-  Cache* block_cache = table->rep_->options.block_cache;
+  return table->NewBlockIterator(options, index_value, NULL);
+}
+
+Iterator* Table::ReadaheadBlockReader(void* arg,
+                                      const ReadOptions& options,
+                                      const Slice& index_value) {
+  Readahead* readahead = reinterpret_cast<Readahead*>(arg);
+  return readahead->table->NewBlockIterator(options, index_value, readahead);
+}
+
+// Convert an index iterator value (i.e., an encoded BlockHandle)
+// into an iterator over the contents of the corresponding block.
+// Reads through "readahead" unless it is NULL.
+Iterator* Table::NewBlockIterator(const ReadOptions& options,
+                                  const Slice& index_value,
+                                  Readahead* readahead) {
+  Cache* block_cache = rep_->options.block_cache;
   Block* block = NULL;
   Cache::Handle* cache_handle = NULL;
 
@@ -176,17 +344,22 @@ Iterator* Table::BlockReader(void* arg,
   // can add more features in the future.
 
   if (s.ok()) {
+    if (readahead != NULL) {
+      readahead->Track(handle);
+    }
     BlockContents contents;
     if (block_cache != NULL) {
       char cache_key_buffer[16];
-      EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
+      EncodeFixed64(cache_key_buffer, rep_->cache_id);
       EncodeFixed64(cache_key_buffer+8, handle.offset());
       Slice key(cache_key_buffer, sizeof(cache_key_buffer));
       cache_handle = block_cache->Lookup(key);
       if (cache_handle != NULL) {
         block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
       } else {
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
+        s = (readahead != NULL)
+            ? readahead->Read(options, handle, &contents)
+            : ReadBlock(rep_->file, options, handle, &contents);
         if (s.ok()) {
           block = new Block(contents);
           if (contents.cachable && options.fill_cache) {
@@ -196,7 +369,9 @@ Iterator* Table::BlockReader(void* arg,
         }
       }
     } else {
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
+      s = (readahead != NULL)
+          ? readahead->Read(options, handle, &contents)
+          : ReadBlock(rep_->file, options, handle, &contents);
       if (s.ok()) {
         block = new Block(contents);
       }
@@ -205,7 +380,7 @@ Iterator* Table::BlockReader(void* arg,
 
   Iterator* iter;
   if (block != NULL) {
-    iter = block->NewIterator(table->rep_->options.comparator);
+    iter = block->NewIterator(rep_->options.comparator);
     if (cache_handle == NULL) {
       iter->RegisterCleanup(&DeleteBlock, block, NULL);
     } else {
@@ -217,41 +392,298 @@ Iterator* Table::BlockReader(void* arg,
   return iter;
 }
 
+namespace {
+// Wraps the iterator of a table whose filter holds the prefixes of its
+// keys.  Seek() finds nothing, without reading a data block, when the
+// filter rules out the prefix of the target: the first key with the
+// prefix at or after the target would lie in the block that holds the
+// target.  A full filter is checked without searching the index.
+class PrefixCheckIterator : public Iterator {
+ public:
+  PrefixCheckIterator(Iterator* iter, Iterator* index_iter,
+                      FilterBlockReader* filter,
+                      const SliceTransform* prefix_extractor)
+      : iter_(iter),
+        index_iter_(index_iter),
+        filter_(filter),
+        prefix_extractor_(prefix_extractor),
+        ruled_out_(false) {
+  }
+  virtual ~PrefixCheckIterator() {
+    delete iter_;
+    delete index_iter_;
+  }
+
+  virtual bool Valid() const { return !ruled_out_ && iter_->Valid(); }
+  virtual Slice key() const { return iter_->key(); }
+  virtual Slice value() const { return iter_->value(); }
+  virtual Status status() const {
+    return ruled_out_ ? index_iter_->status() : iter_->status();
+  }
+
+  virtual void Seek(const Slice& target) {
+    ruled_out_ = false;
+    if (prefix_extractor_->InDomain(target)) {
+      const Slice prefix = prefix_extractor_->Transform(target);
+      if (filter_->full()) {
+        ruled_out_ = !filter_->KeyMayMatch(0, prefix);
+      } else {
+        index_iter_->Seek(target);
+        if (index_iter_->Valid()) {
+          Slice input = index_iter_->value();
+          BlockHandle handle;
+          ruled_out_ = (handle.DecodeFrom(&input).ok() &&
+                        !filter_->KeyMayMatch(handle.offset(), prefix));
+        }
+      }
+      if (ruled_out_) {
+        return;
+      }
+    }
+    iter_->Seek(target);
+  }
+  virtual void SeekToFirst() {
+    ruled_out_ = false;
+    iter_->SeekToFirst();
+  }
+  virtual void SeekToLast() {
+    ruled_out_ = false;
+    iter_->SeekToLast();
+  }
+  virtual void Next() { iter_->Next(); }
+  virtual void Prev() { iter_->Prev(); }
+
+ private:
+  Iterator* const iter_;
+  Iterator* const index_iter_;
+  FilterBlockReader* const filter_;
+  const SliceTransform* const prefix_extractor_;
+  bool ruled_out_;
+};
+}  // namespace
+
 Iterator* Table::NewIterator(const ReadOptions& options) const {
-  return NewTwoLevelIterator(
+  Readahead* readahead = new Readahead(const_cast<Table*>(this),
+                                       options.readahead_size);
+  Iterator* iter = NewTwoLevelIterator(
       rep_->index_block->NewIterator(rep_->options.comparator),
-      &Table::BlockReader, const_cast<Table*>(this), options);
+      &Table::ReadaheadBlockReader, readahead, options);
+  iter->RegisterCleanup(&Readahead::Delete, readahead, NULL);
+  if (options.prefix_same_as_start && rep_->prefix_filtered) {
+    iter = new PrefixCheckIterator(
+        iter, rep_->index_block->NewIterator(rep_->options.comparator),
+        rep_->filter, rep_->options.prefix_extractor);
+  }
+  return iter;
+}
+
+Iterator* Table::NewRangeTombstoneIterator() const {
+  if (rep_->range_del_block == NULL) {
+    return NewEmptyIterator();
+  }
+  return rep_->range_del_block->NewIterator(rep_->options.comparator);
 }
 
 Status Table::InternalGet(const ReadOptions& options, const Slice& k,
                           void* arg,
-                          void (*saver)(void*, const Slice&, const Slice&)) {
+                          bool (*saver)(void*, const Slice&, const Slice&)) {
   Status s;
+  InternalMultiGet(options, 1, &k, &arg, saver, &s);
+  return s;
+}
+
+// The blocks are held until the lookups are done, even those inserted
+// in the block cache, which might evict them otherwise.
+struct Table::BlockBatch {
+  struct Entry {
+    uint64_t offset;
+    Block* block;
+    Cache::Handle* cache_handle;  // NULL if the block is not cached
+  };
+  Cache* block_cache;
+  std::vector<Entry> blocks;  // Sorted by offset
+
+  static bool OffsetLess(const Entry& a, const Entry& b) {
+    return a.offset < b.offset;
+  }
+
+  BlockBatch() : block_cache(NULL) { }
+  ~BlockBatch() {
+    for (size_t i = 0; i < blocks.size(); i++) {
+      if (blocks[i].cache_handle != NULL) {
+        block_cache->Release(blocks[i].cache_handle);
+      } else {
+        delete blocks[i].block;
+      }
+    }
+  }
+};
+
+void Table::ReadBlockBatch(const ReadOptions& options, int n,
+                           const Slice* keys, BlockBatch* batch) {
+  Cache* block_cache = rep_->options.block_cache;
+  batch->block_cache = block_cache;
+  char cache_key_buffer[16];
+  EncodeFixed64(cache_key_buffer, rep_->cache_id);
+  const Slice cache_key(cache_key_buffer, sizeof(cache_key_buffer));
+
+  // Find the blocks that the lookups will read.  The keys are sorted, so
+  // the keys of a block are consecutive.
+  std::vector<BlockHandle> handles;
   Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
-  iiter->Seek(k);
-  if (iiter->Valid()) {
+  FilterBlockReader* filter = rep_->filter;
+  for (int i = 0; i < n; i++) {
+    if (filter != NULL && filter->full() &&
+        !filter->KeyMayMatch(0, keys[i])) {
+      continue;
+    }
+    iiter->Seek(keys[i]);
+    if (!iiter->Valid()) {
+      break;
+    }
+    Slice input = iiter->value();
+    BlockHandle handle;
+    if (!handle.DecodeFrom(&input).ok() ||
+        (!handles.empty() && handles.back().offset() == handle.offset())) {
+      continue;
+    }
+    if (filter != NULL && !filter->full() &&
+        !filter->KeyMayMatch(handle.offset(), keys[i])) {
+      continue;
+    }
+    if (block_cache != NULL) {
+      EncodeFixed64(cache_key_buffer + 8, handle.offset());
+      Cache::Handle* h = block_cache->Lookup(cache_key);
+      if (h != NULL) {
+        block_cache->Release(h);
+        continue;
+      }
+    }
+    handles.push_back(handle);
+  }
+  delete iiter;
+  if (handles.size() < 2) {
+    return;  // Nothing to gain over BlockReader()
+  }
+
+  std::vector<ReadRequest> reqs(handles.size());
+  for (size_t i = 0; i < handles.size(); i++) {
+    reqs[i].offset = handles[i].offset();
+    reqs[i].n = static_cast<size_t>(handles[i].size()) + kBlockTrailerSize;
+    reqs[i].scratch = new char[reqs[i].n];
+  }
+  rep_->file->MultiRead(&reqs[0], reqs.size());
+
+  // Blocks that fail to read or decode are left out; the lookups read
+  // them again and report the error.
+  for (size_t i = 0; i < handles.size(); i++) {
+    if (!reqs[i].status.ok()) {
+      delete[] reqs[i].scratch;
+      continue;
+    }
+    BlockContents contents;
+    if (!DecodeBlock(options, handles[i], reqs[i].result, reqs[i].scratch,
+                     &contents).ok()) {
+      continue;
+    }
+    BlockBatch::Entry entry;
+    entry.offset = handles[i].offset();
+    entry.block = new Block(contents);
+    entry.cache_handle = NULL;
+    if (block_cache != NULL && contents.cachable && options.fill_cache) {
+      EncodeFixed64(cache_key_buffer + 8, entry.offset);
+      entry.cache_handle = block_cache->Insert(
+          cache_key, entry.block, entry.block->size(), &DeleteCachedBlock);
+    }
+    batch->blocks.push_back(entry);
+  }
+}
+
+Iterator* Table::BatchBlockReader(const BlockBatch& batch,
+                                  const ReadOptions& options,
+                                  const Slice& index_value) {
+  Slice input = index_value;
+  BlockHandle handle;
+  if (!batch.blocks.empty() && handle.DecodeFrom(&input).ok()) {
+    BlockBatch::Entry target;
+    target.offset = handle.offset();
+    std::vector<BlockBatch::Entry>::const_iterator it = std::lower_bound(
+        batch.blocks.begin(), batch.blocks.end(), target,
+        &BlockBatch::OffsetLess);
+    if (it != batch.blocks.end() && it->offset == handle.offset()) {
+      return it->block->NewIterator(rep_->options.comparator);
+    }
+  }
+  return BlockReader(this, options, index_value);
+}
+
+void Table::InternalMultiGet(const ReadOptions& options, int n,
+                             const Slice* keys, void* const* args,
+                             bool (*saver)(void*, const Slice&, const Slice&),
+                             Status* statuses) {
+  BlockBatch batch;
+  if (n > 1) {
+    ReadBlockBatch(options, n, keys, &batch);
+  }
+
+  for (int i = 0; i < n; i++) {
+    statuses[i] = Status::OK();
+  }
+  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* block_iter = NULL;
+  std::string block_handle;  // Index entry of the block read by block_iter
+  FilterBlockReader* filter = rep_->filter;
+  for (int i = 0; i < n; i++) {
+    const Slice& k = keys[i];
+    if (filter != NULL && filter->full() && !filter->KeyMayMatch(0, k)) {
+      continue;  // Not found, without searching the index
+    }
+    iiter->Seek(k);
+    if (!iiter->Valid()) {
+      // The following keys are past the end of the table too
+      for (int j = i; j < n; j++) {
+        statuses[j] = iiter->status();
+      }
+      break;
+    }
     Slice handle_value = iiter->value();
-    FilterBlockReader* filter = rep_->filter;
     BlockHandle handle;
-    if (filter != NULL &&
+    if (filter != NULL && !filter->full() &&
         handle.DecodeFrom(&handle_value).ok() &&
         !filter->KeyMayMatch(handle.offset(), k)) {
-      // Not found
-    } else {
-      Iterator* block_iter = BlockReader(this, options, iiter->value());
-      block_iter->Seek(k);
-      if (block_iter->Valid()) {
-        (*saver)(arg, block_iter->key(), block_iter->value());
-      }
-      s = block_iter->status();
+      continue;  // Not found
+    }
+    if (block_iter == NULL || iiter->value() != Slice(block_handle)) {
       delete block_iter;
+      block_iter = BatchBlockReader(batch, options, iiter->value());
+      block_handle = iiter->value().ToString();
+    }
+    block_iter->Seek(k);
+    // The saver asks for more entries while it finds merge operands,
+    // which may continue in the following blocks.
+    while (block_iter->Valid() &&
+           (*saver)(args[i], block_iter->key(), block_iter->value())) {
+      block_iter->Next();
+      if (!block_iter->Valid() && block_iter->status().ok()) {
+        iiter->Next();
+        if (iiter->Valid()) {
+          delete block_iter;
+          block_iter = BatchBlockReader(batch, options, iiter->value());
+          block_handle = iiter->value().ToString();
+          block_iter->SeekToFirst();
+        } else {
+          statuses[i] = iiter->status();
+        }
+      }
+    }
+    // A block that cannot be read fails the lookups that need it, but
+    // not the others.
+    if (statuses[i].ok()) {
+      statuses[i] = block_iter->status();
     }
   }
-  if (s.ok()) {
-    s = iiter->status();
-  }
+  delete block_iter;
   delete iiter;
-  return s;
 }
 
 
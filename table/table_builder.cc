@@ -9,6 +9,7 @@
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/slice_transform.h"
 #include "table/block_builder.h"
 #include "table/filter_block.h"
 #include "table/format.h"
@@ -29,6 +30,8 @@ struct TableBuilder::Rep {
   int64_t num_entries;
   bool closed;          // Either Finish() or Abandon() has been called.
   FilterBlockBuilder* filter_block;
+  BlockBuilder range_del_block;
+  int64_t num_range_tombstones;
 
   // We do not emit the index entry for a block until we have seen the
   // first key for the next data block.  This allows us to use shorter
@@ -54,7 +57,10 @@ struct TableBuilder::Rep {
         num_entries(0),
         closed(false),
         filter_block(opt.filter_policy == NULL ? NULL
-                     : new FilterBlockBuilder(opt.filter_policy)),
+                     : new FilterBlockBuilder(opt.filter_policy,
+                                              opt.full_filter)),
+        range_del_block(&options),
+        num_range_tombstones(0),
         pending_index_entry(false) {
     index_block_options.block_restart_interval = 1;
   }
@@ -108,6 +114,10 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
 
   if (r->filter_block != NULL) {
     r->filter_block->AddKey(key);
+    const SliceTransform* prefix_extractor = r->options.prefix_extractor;
+    if (prefix_extractor != NULL && prefix_extractor->InDomain(key)) {
+      r->filter_block->AddPrefix(prefix_extractor->Transform(key));
+    }
   }
 
   r->last_key.assign(key.data(), key.size());
@@ -120,6 +130,14 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   }
 }
 
+void TableBuilder::AddRangeTombstone(const Slice& key, const Slice& value) {
+  Rep* r = rep_;
+  assert(!r->closed);
+  if (!ok()) return;
+  r->range_del_block.Add(key, value);
+  r->num_range_tombstones++;
+}
+
 void TableBuilder::Flush() {
   Rep* r = rep_;
   assert(!r->closed);
@@ -202,7 +220,8 @@ Status TableBuilder::Finish() {
   assert(!r->closed);
   r->closed = true;
 
-  BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+  BlockHandle filter_block_handle, range_del_block_handle;
+  BlockHandle metaindex_block_handle, index_block_handle;
 
   // Write filter block
   if (ok() && r->filter_block != NULL) {
@@ -210,16 +229,36 @@ Status TableBuilder::Finish() {
                   &filter_block_handle);
   }
 
+  // Write range tombstone block
+  if (ok() && r->num_range_tombstones > 0) {
+    WriteBlock(&r->range_del_block, &range_del_block_handle);
+  }
+
   // Write metaindex block
   if (ok()) {
-    BlockBuilder meta_index_block(&r->options);
+    // Meta block names are looked up in bytewise order
+    Options meta_index_options = r->options;
+    meta_index_options.comparator = BytewiseComparator();
+    BlockBuilder meta_index_block(&meta_index_options);
     if (r->filter_block != NULL) {
-      // Add mapping from "filter.Name" to location of filter data
-      std::string key = "filter.";
+      // Add mapping from "filter.Name", or "fullfilter.Name" for a
+      // single filter, to location of filter data
+      std::string key = r->options.full_filter ? "fullfilter." : "filter.";
       key.append(r->options.filter_policy->Name());
       std::string handle_encoding;
       filter_block_handle.EncodeTo(&handle_encoding);
       meta_index_block.Add(key, handle_encoding);
+      if (r->options.prefix_extractor != NULL) {
+        // Tells readers that the filters hold the prefixes too
+        key = "prefix.";
+        key.append(r->options.prefix_extractor->Name());
+        meta_index_block.Add(key, handle_encoding);
+      }
+    }
+    if (r->num_range_tombstones > 0) {
+      std::string handle_encoding;
+      range_del_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add("rangedel", handle_encoding);
     }
 
     // TODO(postrelease): Add stats and other meta blocks
@@ -263,6 +302,10 @@ uint64_t TableBuilder::NumEntries() const {
   return rep_->num_entries;
 }
 
+uint64_t TableBuilder::NumRangeTombstones() const {
+  return rep_->num_range_tombstones;
+}
+
 uint64_t TableBuilder::FileSize() const {
   return rep_->offset;
 }
@@ -4,12 +4,35 @@
 
 #include "util/arena.h"
 #include <assert.h>
+#if defined(OS_LINUX)
+#include <sys/mman.h>
+#endif
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
-static const int kBlockSize = 4096;
+static const size_t kMinBlockSize = 4096;
+static const size_t kMaxBlockSize = 1u << 30;
 
-Arena::Arena() : memory_usage_(0) {
+static size_t ClipBlockSize(size_t block_size) {
+  if (block_size < kMinBlockSize) return kMinBlockSize;
+  if (block_size > kMaxBlockSize) return kMaxBlockSize;
+  // Keep the blocks that follow a block aligned
+  return (block_size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+}
+
+Arena::Arena()
+    : block_size_(kMinBlockSize),
+      huge_page_size_(0),
+      memory_usage_(0) {
+  alloc_ptr_ = NULL;  // First allocation will allocate a block
+  alloc_bytes_remaining_ = 0;
+}
+
+Arena::Arena(size_t block_size, size_t huge_page_size)
+    : block_size_(ClipBlockSize(block_size)),
+      huge_page_size_(huge_page_size),
+      memory_usage_(0) {
   alloc_ptr_ = NULL;  // First allocation will allocate a block
   alloc_bytes_remaining_ = 0;
 }
@@ -18,10 +41,15 @@ Arena::~Arena() {
   for (size_t i = 0; i < blocks_.size(); i++) {
     delete[] blocks_[i];
   }
+#if defined(OS_LINUX)
+  for (size_t i = 0; i < mapped_blocks_.size(); i++) {
+    munmap(mapped_blocks_[i].first, mapped_blocks_[i].second);
+  }
+#endif
 }
 
 char* Arena::AllocateFallback(size_t bytes) {
-  if (bytes > kBlockSize / 4) {
+  if (bytes > block_size_ / 4) {
     // Object is more than a quarter of our block size.  Allocate it separately
     // to avoid wasting too much space in leftover bytes.
     char* result = AllocateNewBlock(bytes);
@@ -29,8 +57,20 @@ char* Arena::AllocateFallback(size_t bytes) {
   }
 
   // We waste the remaining space in the current block.
-  alloc_ptr_ = AllocateNewBlock(kBlockSize);
-  alloc_bytes_remaining_ = kBlockSize;
+  if (huge_page_size_ > 0 && huge_page_size_ <= block_size_) {
+    // Rounding down keeps the blocks within the size the owner allows
+    size_t block_bytes = (block_size_ / huge_page_size_) * huge_page_size_;
+    alloc_ptr_ = AllocateHugePageBlock(block_bytes);
+    if (alloc_ptr_ != NULL) {
+      alloc_bytes_remaining_ = block_bytes;
+      char* result = alloc_ptr_;
+      alloc_ptr_ += bytes;
+      alloc_bytes_remaining_ -= bytes;
+      return result;
+    }
+  }
+  alloc_ptr_ = AllocateNewBlock(block_size_);
+  alloc_bytes_remaining_ = block_size_;
 
   char* result = alloc_ptr_;
   alloc_ptr_ += bytes;
@@ -57,6 +97,47 @@ char* Arena::AllocateAligned(size_t bytes) {
   return result;
 }
 
+char* Arena::AllocateConcurrently(size_t bytes) {
+  MutexLock l(&mu_);
+  return Allocate(bytes);
+}
+
+char* Arena::AllocateAlignedConcurrently(size_t bytes) {
+  MutexLock l(&mu_);
+  return AllocateAligned(bytes);
+}
+
+// Returns NULL if no memory could be mapped.
+char* Arena::AllocateHugePageBlock(size_t block_bytes) {
+#if defined(OS_LINUX)
+  void* addr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  // Only succeeds if enough huge pages are reserved
+  addr = mmap(NULL, block_bytes, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+  if (addr == MAP_FAILED) {
+    addr = mmap(NULL, block_bytes, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+      return NULL;
+    }
+#ifdef MADV_HUGEPAGE
+    // Ask for transparent huge pages; a failure just leaves small pages
+    madvise(addr, block_bytes, MADV_HUGEPAGE);
+#endif
+  }
+  char* result = reinterpret_cast<char*>(addr);
+  mapped_blocks_.push_back(std::make_pair(result, block_bytes));
+  memory_usage_.NoBarrier_Store(
+      reinterpret_cast<void*>(MemoryUsage() + block_bytes +
+                              sizeof(std::pair<char*, size_t>)));
+  return result;
+#else
+  return NULL;
+#endif
+}
+
 char* Arena::AllocateNewBlock(size_t block_bytes) {
   char* result = new char[block_bytes];
   blocks_.push_back(result);
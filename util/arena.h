@@ -5,6 +5,7 @@
 #ifndef STORAGE_LEVELDB_UTIL_ARENA_H_
 #define STORAGE_LEVELDB_UTIL_ARENA_H_
 
+#include <utility>
 #include <vector>
 #include <assert.h>
 #include <stddef.h>
@@ -15,7 +16,17 @@ namespace leveldb {
 
 class Arena {
  public:
+  // Memory is carved out of blocks of 4KB.
   Arena();
+
+  // Memory is carved out of blocks of "block_size" bytes, clipped to
+  // [4KB,1GB].  If "huge_page_size" is non-zero and no larger than the
+  // blocks, the blocks are rounded down to a multiple of it and mapped
+  // from huge pages if the OS has some to spare, or else from memory
+  // that the OS is asked to back with transparent huge pages.  Blocks
+  // come from the heap if mapping fails.
+  Arena(size_t block_size, size_t huge_page_size);
+
   ~Arena();
 
   // Return a pointer to a newly allocated memory block of "bytes" bytes.
@@ -24,6 +35,12 @@ class Arena {
   // Allocate memory with the normal alignment guarantees provided by malloc
   char* AllocateAligned(size_t bytes);
 
+  // Thread-safe variants of Allocate() and AllocateAligned().  They may
+  // be called from several threads at once, but not concurrently with
+  // the unsynchronized variants above.
+  char* AllocateConcurrently(size_t bytes);
+  char* AllocateAlignedConcurrently(size_t bytes);
+
   // Returns an estimate of the total memory usage of data allocated
   // by the arena.
   size_t MemoryUsage() const {
@@ -33,6 +50,10 @@ class Arena {
  private:
   char* AllocateFallback(size_t bytes);
   char* AllocateNewBlock(size_t block_bytes);
+  char* AllocateHugePageBlock(size_t block_bytes);
+
+  const size_t block_size_;
+  const size_t huge_page_size_;
 
   // Allocation state
   char* alloc_ptr_;
@@ -41,9 +62,15 @@ class Arena {
   // Array of new[] allocated memory blocks
   std::vector<char*> blocks_;
 
+  // Blocks mapped by AllocateHugePageBlock() and their sizes
+  std::vector<std::pair<char*, size_t> > mapped_blocks_;
+
   // Total memory usage of the arena.
   port::AtomicPointer memory_usage_;
 
+  // Serializes the *Concurrently() allocation methods
+  port::Mutex mu_;
+
   // No copying allowed
   Arena(const Arena&);
   void operator=(const Arena&);
@@ -4,6 +4,7 @@
 
 #include "util/arena.h"
 
+#include <string.h>
 #include "util/random.h"
 #include "util/testharness.h"
 
@@ -61,6 +62,51 @@ TEST(ArenaTest, Simple) {
   }
 }
 
+TEST(ArenaTest, BlockSize) {
+  Arena arena(1 << 20, 0);
+  char* first = arena.Allocate(100);
+  ASSERT_GE(arena.MemoryUsage(), 1 << 20);
+  ASSERT_LT(arena.MemoryUsage(), (1 << 20) + 100);
+
+  // Small allocations are carved out of the same block
+  for (int i = 0; i < 1000; i++) {
+    char* r = arena.AllocateAligned(1000);
+    ASSERT_TRUE(r > first && r < first + (1 << 20));
+  }
+  ASSERT_LT(arena.MemoryUsage(), (1 << 20) + 100);
+
+  // Too small a block size is raised to the minimum
+  Arena small(1, 0);
+  small.Allocate(1);
+  ASSERT_GE(small.MemoryUsage(), 4096);
+}
+
+TEST(ArenaTest, HugePage) {
+  // Blocks are rounded down to the huge page size, whether or not the
+  // system has huge pages to spare.
+  const size_t kHugePageSize = 2 << 20;
+  Arena arena(kHugePageSize + (1 << 20), kHugePageSize);
+  std::vector<char*> allocated;
+  for (int i = 0; i < 5000; i++) {
+    char* r = arena.AllocateAligned(1000);
+    ASSERT_EQ(0, reinterpret_cast<uintptr_t>(r) & (sizeof(void*) - 1));
+    memset(r, i % 256, 1000);
+    allocated.push_back(r);
+  }
+  ASSERT_GE(arena.MemoryUsage(), 5000 * 1000);
+  ASSERT_LE(arena.MemoryUsage(), 3 * kHugePageSize + 4096);
+  for (size_t i = 0; i < allocated.size(); i++) {
+    for (int b = 0; b < 1000; b++) {
+      ASSERT_EQ(int(allocated[i][b]) & 0xff, i % 256);
+    }
+  }
+
+  // Blocks smaller than a huge page are not rounded up
+  Arena small(1 << 20, kHugePageSize);
+  small.Allocate(100);
+  ASSERT_LT(small.MemoryUsage(), (1 << 20) + 100);
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -0,0 +1,81 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/dynamic_bloom.h"
+
+#include <assert.h>
+#include <string.h>
+#include "util/arena.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+static uint32_t BloomHash(const Slice& key) {
+  return Hash(key.data(), key.size(), 0xbc9f1d34);
+}
+
+DynamicBloom::DynamicBloom(Arena* arena, size_t total_bits, int num_probes)
+    : num_probes_(num_probes) {
+  assert(num_probes > 0);
+  size_t blocks = (total_bits + kBlockBits - 1) / kBlockBits;
+  if (blocks == 0) blocks = 1;
+  num_blocks_ = static_cast<uint32_t>(blocks);
+
+  // Align the filter on a cache line so that each block spans just one
+  const size_t kBlockBytes = kBlockBits / 8;
+  char* raw = arena->AllocateAligned(num_blocks_ * kBlockBytes +
+                                     kBlockBytes - 1);
+  const uintptr_t misalignment =
+      reinterpret_cast<uintptr_t>(raw) % kBlockBytes;
+  data_ = raw + (misalignment == 0 ? 0 : kBlockBytes - misalignment);
+  memset(data_, 0, num_blocks_ * kBlockBytes);
+}
+
+// Picks the block from other bits of "h" than the probes use first.
+char* DynamicBloom::Block(uint32_t h) const {
+  const uint32_t rotated = (h >> 11) | (h << 21);
+  return data_ + (rotated % num_blocks_) * (kBlockBits / 8);
+}
+
+void DynamicBloom::Add(const Slice& key) {
+  uint32_t h = BloomHash(key);
+  char* block = Block(h);
+  const uint32_t delta = (h >> 17) | (h << 15);  // Rotate right 17 bits
+  for (int i = 0; i < num_probes_; i++) {
+    const uint32_t bitpos = h % kBlockBits;
+    block[bitpos / 8] |= (1 << (bitpos % 8));
+    h += delta;
+  }
+}
+
+void DynamicBloom::AddConcurrently(const Slice& key) {
+  uint32_t h = BloomHash(key);
+  char* block = Block(h);
+  const uint32_t delta = (h >> 17) | (h << 15);
+  for (int i = 0; i < num_probes_; i++) {
+    const uint32_t bitpos = h % kBlockBits;
+    const char mask = static_cast<char>(1 << (bitpos % 8));
+    // Skip the locked instruction when the bit is already set
+    if ((block[bitpos / 8] & mask) == 0) {
+      __sync_fetch_and_or(&block[bitpos / 8], mask);
+    }
+    h += delta;
+  }
+}
+
+bool DynamicBloom::MayContain(const Slice& key) const {
+  uint32_t h = BloomHash(key);
+  const char* block = Block(h);
+  const uint32_t delta = (h >> 17) | (h << 15);
+  for (int i = 0; i < num_probes_; i++) {
+    const uint32_t bitpos = h % kBlockBits;
+    if ((block[bitpos / 8] & (1 << (bitpos % 8))) == 0) {
+      return false;
+    }
+    h += delta;
+  }
+  return true;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,51 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_DYNAMIC_BLOOM_H_
+#define STORAGE_LEVELDB_UTIL_DYNAMIC_BLOOM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class Arena;
+
+// A bloom filter that keys can be added to at any time, unlike the
+// filters built by a FilterPolicy.  All the probes for a key fall in
+// the same cache line, so a check costs at most one cache miss.
+class DynamicBloom {
+ public:
+  // Allocate a filter of about "total_bits" bits from "arena", which
+  // must outlive the filter.
+  DynamicBloom(Arena* arena, size_t total_bits, int num_probes);
+
+  void Add(const Slice& key);
+
+  // Same as Add(), but may be called from several threads at once.
+  // REQUIRES: no concurrent call to Add().
+  void AddConcurrently(const Slice& key);
+
+  // Returns false if "key" was surely never added.  May be called
+  // concurrently with the Add*() methods.
+  bool MayContain(const Slice& key) const;
+
+ private:
+  enum { kBlockBits = 512 };  // One cache line
+
+  char* Block(uint32_t h) const;
+
+  const int num_probes_;
+  uint32_t num_blocks_;
+  char* data_;
+
+  // No copying allowed
+  DynamicBloom(const DynamicBloom&);
+  void operator=(const DynamicBloom&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_DYNAMIC_BLOOM_H_
@@ -0,0 +1,123 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/dynamic_bloom.h"
+
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/arena.h"
+#include "util/coding.h"
+#include "util/mutexlock.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+static Slice Key(int i, char* buffer) {
+  EncodeFixed32(buffer, i);
+  return Slice(buffer, sizeof(uint32_t));
+}
+
+class DynamicBloomTest { };
+
+TEST(DynamicBloomTest, Empty) {
+  Arena arena;
+  DynamicBloom bloom(&arena, 100, 6);
+  ASSERT_TRUE(!bloom.MayContain("hello"));
+  ASSERT_TRUE(!bloom.MayContain("world"));
+}
+
+TEST(DynamicBloomTest, Small) {
+  Arena arena;
+  DynamicBloom bloom(&arena, 100, 6);
+  bloom.Add("hello");
+  bloom.Add("world");
+  ASSERT_TRUE(bloom.MayContain("hello"));
+  ASSERT_TRUE(bloom.MayContain("world"));
+  ASSERT_TRUE(!bloom.MayContain("x"));
+  ASSERT_TRUE(!bloom.MayContain("foo"));
+}
+
+TEST(DynamicBloomTest, VaryingLengths) {
+  char buffer[sizeof(int)];
+  for (int length = 1; length <= 10000; length = length * 10) {
+    Arena arena;
+    DynamicBloom bloom(&arena, length * 10, 6);
+    for (int i = 0; i < length; i++) {
+      bloom.Add(Key(i, buffer));
+    }
+    for (int i = 0; i < length; i++) {
+      ASSERT_TRUE(bloom.MayContain(Key(i, buffer)))
+          << "Length " << length << "; key " << i;
+    }
+
+    // Check false positive rate
+    int result = 0;
+    for (int i = 0; i < 10000; i++) {
+      if (bloom.MayContain(Key(i + 1000000000, buffer))) {
+        result++;
+      }
+    }
+    const double rate = result / 10000.0;
+    fprintf(stderr, "False positives: %5.2f%% @ length = %6d\n",
+            rate * 100.0, length);
+    ASSERT_LE(rate, 0.03);  // Must not be over 3%
+  }
+}
+
+namespace {
+struct AddState {
+  DynamicBloom* bloom;
+  port::AtomicPointer next;  // Next thread index
+  port::Mutex mu;
+  int done;
+};
+
+static const int kNumThreads = 4;
+static const int kKeysPerThread = 10000;
+
+static void AddThread(void* arg) {
+  AddState* state = reinterpret_cast<AddState*>(arg);
+  int id;
+  {
+    MutexLock l(&state->mu);
+    id = reinterpret_cast<uintptr_t>(state->next.NoBarrier_Load());
+    state->next.NoBarrier_Store(reinterpret_cast<void*>(id + 1));
+  }
+  char buffer[sizeof(int)];
+  for (int i = 0; i < kKeysPerThread; i++) {
+    state->bloom->AddConcurrently(Key(id * kKeysPerThread + i, buffer));
+  }
+  MutexLock l(&state->mu);
+  state->done++;
+}
+}  // namespace
+
+TEST(DynamicBloomTest, Concurrent) {
+  Arena arena;
+  DynamicBloom bloom(&arena, kNumThreads * kKeysPerThread * 10, 6);
+  AddState state;
+  state.bloom = &bloom;
+  state.next.NoBarrier_Store(NULL);
+  state.done = 0;
+  for (int i = 0; i < kNumThreads; i++) {
+    Env::Default()->StartThread(AddThread, &state);
+  }
+  while (true) {
+    {
+      MutexLock l(&state.mu);
+      if (state.done == kNumThreads) break;
+    }
+    Env::Default()->SleepForMicroseconds(1000);
+  }
+  char buffer[sizeof(int)];
+  for (int i = 0; i < kNumThreads * kKeysPerThread; i++) {
+    ASSERT_TRUE(bloom.MayContain(Key(i, buffer))) << "key " << i;
+  }
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
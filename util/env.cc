@@ -13,15 +13,41 @@ Status Env::NewAppendableFile(const std::string& fname, WritableFile** result) {
   return Status::NotSupported("NewAppendableFile", fname);
 }
 
+Status Env::ReuseWritableFile(const std::string& fname,
+                              const std::string& old_fname,
+                              WritableFile** result) {
+  *result = NULL;
+  return Status::NotSupported("ReuseWritableFile", fname);
+}
+
 SequentialFile::~SequentialFile() {
 }
 
 RandomAccessFile::~RandomAccessFile() {
 }
 
+Status RandomAccessFile::MultiRead(ReadRequest* reqs, size_t n) const {
+  Status result;
+  for (size_t i = 0; i < n; i++) {
+    ReadRequest* r = &reqs[i];
+    r->status = Read(r->offset, r->n, &r->result, r->scratch);
+    if (!r->status.ok() && result.ok()) {
+      result = r->status;
+    }
+  }
+  return result;
+}
+
 WritableFile::~WritableFile() {
 }
 
+Status WritableFile::SyncFlushed() {
+  return Status::NotSupported("SyncFlushed");
+}
+
+void WritableFile::SetPreallocationBlockSize(size_t size) {
+}
+
 Logger::~Logger() {
 }
 
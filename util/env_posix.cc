@@ -17,9 +17,14 @@
 #include <unistd.h>
 #include <deque>
 #include <set>
+#if defined(LEVELDB_IO_URING)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
 #include "leveldb/env.h"
 #include "leveldb/slice.h"
 #include "port/port.h"
+#include "util/env_posix_test_helper.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
 #include "util/posix_logger.h"
@@ -65,6 +70,387 @@ class PosixSequentialFile: public SequentialFile {
   }
 };
 
+// Set by EnvPosixTestHelper::SetReadOnlyMMapLimit().  A negative value
+// selects the default limit.
+static int mmap_limit = -1;
+
+// Set by EnvPosixTestHelper::SetIoUringEnabled().
+static bool io_uring_enabled = true;
+
+// Set by EnvPosixTestHelper::SetIoUringReadUnsupported().
+static bool io_uring_read_unsupported = false;
+
+// Non-NULL once the kernel refused to set up io_uring, or does not
+// support its reads.  Any non-NULL value is ok.
+static port::AtomicPointer io_uring_refused;
+
+static Status PosixRead(const std::string& fname, int fd, uint64_t offset,
+                        size_t n, Slice* result, char* scratch) {
+  Status s;
+  ssize_t r = pread(fd, scratch, n, static_cast<off_t>(offset));
+  *result = Slice(scratch, (r < 0) ? 0 : r);
+  if (r < 0) {
+    // An error: return a non-ok status
+    s = IOError(fname, errno);
+  }
+  return s;
+}
+
+static Status FirstError(const ReadRequest* reqs, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    if (!reqs[i].status.ok()) {
+      return reqs[i].status;
+    }
+  }
+  return Status::OK();
+}
+
+#if defined(LEVELDB_IO_URING)
+// A minimal io_uring instance, driven through the system calls so that
+// liburing is not needed.  Each thread that issues a MultiRead() gets
+// its own, so no locking is required.
+class IoUring {
+ public:
+  // The number of reads submitted at once.
+  static const unsigned kDepth = 64;
+
+  // Returns NULL if the kernel does not support io_uring, or its
+  // IORING_OP_READ requests (added in Linux 5.6).
+  static IoUring* Create() {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = syscall(__NR_io_uring_setup, kDepth, &p);
+    if (fd < 0) {
+      return NULL;
+    }
+    IoUring* ring = new IoUring(fd, p);
+    if (!ring->ok_ || !ring->SupportsRead()) {
+      delete ring;
+      return NULL;
+    }
+    return ring;
+  }
+
+  ~IoUring() {
+    if (sqes_ != MAP_FAILED) {
+      munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+      munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != MAP_FAILED) {
+      munmap(sq_ring_, sq_ring_size_);
+    }
+    close(fd_);
+  }
+
+  // Returns false once the ring has failed; it must then not be used.
+  bool usable() const { return !broken_; }
+
+  // Read reqs[0,n-1] from "fd" and wait for all of them.  If the ring
+  // fails, the reads it did not perform are left with a NULL result.
+  // REQUIRES: n <= kDepth
+  void Read(const std::string& fname, int fd, ReadRequest* reqs, size_t n) {
+    // This thread is the only producer, so the tail needs no ordering
+    // on load; the release store publishes the entries to the kernel.
+    unsigned tail = *sq_tail_;
+    for (size_t i = 0; i < n; i++) {
+      const unsigned index = tail & *sq_mask_;
+      struct io_uring_sqe* sqe = &sqes_[index];
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = io_uring_read_unsupported ? IORING_OP_LAST
+                                              : IORING_OP_READ;
+      sqe->fd = fd;
+      sqe->off = reqs[i].offset;
+      sqe->addr = reinterpret_cast<uintptr_t>(reqs[i].scratch);
+      sqe->len = reqs[i].n;
+      sqe->user_data = i;
+      sq_array_[index] = index;
+      tail++;
+    }
+    __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+
+    size_t submitted = 0;
+    size_t completed = 0;
+    bool submitting = true;
+    while (completed < n) {
+      const size_t to_submit = submitting ? n - submitted : 0;
+      int r = syscall(__NR_io_uring_enter, fd_, to_submit, 1,
+                      IORING_ENTER_GETEVENTS, NULL, 0);
+      const int err = errno;
+      if (r > 0) {
+        submitted += r;
+      }
+      // The kernel completes the reads in flight whether or not the
+      // call succeeded, so drain the queue before any retry.
+      completed += Reap(fname, fd, reqs);
+      if (r < 0 && err != EINTR) {
+        // Submit nothing more, but wait for the reads in flight: the
+        // kernel may still write to their buffers.
+        submitting = false;
+      }
+      if (!submitting && submitted == completed) {
+        // Nothing is in flight, so the caller may finish the remaining
+        // reads another way.  The entries left in the submission queue
+        // would be picked up by a later call, so the ring is retired.
+        broken_ = true;
+        return;
+      }
+    }
+    if (unsupported_) {
+      broken_ = true;
+    }
+  }
+
+ private:
+  // Record the completed reads of reqs[] and return their number.
+  size_t Reap(const std::string& fname, int fd, ReadRequest* reqs) {
+    size_t count = 0;
+    unsigned head = *cq_head_;
+    const unsigned cq_tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    for (; head != cq_tail; head++) {
+      const struct io_uring_cqe* cqe = &cqes_[head & *cq_mask_];
+      ReadRequest* req = &reqs[cqe->user_data];
+      if (cqe->res == -EINVAL) {
+        // The kernel does not know the request, although the probe
+        // passed: leave the read to the caller, and io_uring aside
+        // from now on.
+        unsupported_ = true;
+        io_uring_refused.Release_Store(&io_uring_refused);
+      } else if (cqe->res < 0) {
+        req->result = Slice(req->scratch, 0);
+        req->status = IOError(fname, -cqe->res);
+      } else if (static_cast<size_t>(cqe->res) < req->n) {
+        // A short read may end before the end of the file, unlike
+        // pread(), so finish it the usual way.
+        req->status = PosixRead(fname, fd, req->offset, req->n,
+                                &req->result, req->scratch);
+      } else {
+        req->result = Slice(req->scratch, cqe->res);
+      }
+      count++;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    return count;
+  }
+
+  // Returns true if the kernel supports IORING_OP_READ.  Kernels
+  // without IORING_REGISTER_PROBE predate it.
+  bool SupportsRead() const {
+    const size_t size = sizeof(struct io_uring_probe) +
+                        256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe =
+        static_cast<struct io_uring_probe*>(calloc(1, size));
+    const int r = syscall(__NR_io_uring_register, fd_,
+                          IORING_REGISTER_PROBE, probe, 256);
+    const bool supported =
+        r >= 0 && probe->last_op >= IORING_OP_READ &&
+        (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) != 0;
+    free(probe);
+    return supported;
+  }
+
+  IoUring(int fd, const struct io_uring_params& p)
+      : fd_(fd),
+        ok_(false),
+        broken_(false),
+        unsupported_(false),
+        sq_ring_(MAP_FAILED),
+        cq_ring_(MAP_FAILED),
+        sqes_(static_cast<struct io_uring_sqe*>(MAP_FAILED)) {
+    sq_ring_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = p.cq_off.cqes +
+                    p.cq_entries * sizeof(struct io_uring_cqe);
+    sqes_size_ = p.sq_entries * sizeof(struct io_uring_sqe);
+    const bool single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap && cq_ring_size_ > sq_ring_size_) {
+      sq_ring_size_ = cq_ring_size_;
+    }
+    sq_ring_ = mmap(NULL, sq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+      return;
+    }
+    if (single_mmap) {
+      cq_ring_ = sq_ring_;
+    } else {
+      cq_ring_ = mmap(NULL, cq_ring_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+      if (cq_ring_ == MAP_FAILED) {
+        return;
+      }
+    }
+    sqes_ = static_cast<struct io_uring_sqe*>(
+        mmap(NULL, sqes_size_, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES));
+    if (sqes_ == MAP_FAILED) {
+      return;
+    }
+
+    char* sq = static_cast<char*>(sq_ring_);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    char* cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + p.cq_off.cqes);
+    ok_ = true;
+  }
+
+  const int fd_;
+  bool ok_;
+  bool broken_;
+  bool unsupported_;  // A read failed with EINVAL
+
+  void* sq_ring_;
+  void* cq_ring_;
+  struct io_uring_sqe* sqes_;
+  size_t sq_ring_size_;
+  size_t cq_ring_size_;
+  size_t sqes_size_;
+
+  unsigned* sq_tail_;
+  unsigned* sq_mask_;
+  unsigned* sq_array_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned* cq_mask_;
+  struct io_uring_cqe* cqes_;
+
+  // No copying allowed
+  IoUring(const IoUring&);
+  void operator=(const IoUring&);
+};
+
+static pthread_once_t io_uring_once = PTHREAD_ONCE_INIT;
+static pthread_key_t io_uring_key;
+
+static void DeleteIoUring(void* ring) {
+  delete reinterpret_cast<IoUring*>(ring);
+}
+
+static void InitIoUringKey() {
+  if (pthread_key_create(&io_uring_key, &DeleteIoUring) != 0) {
+    io_uring_refused.Release_Store(&io_uring_refused);
+  }
+}
+
+// Returns the ring of the calling thread, or NULL if io_uring is not to
+// be used.
+static IoUring* ThreadIoUring() {
+  if (!io_uring_enabled || io_uring_refused.Acquire_Load() != NULL) {
+    return NULL;
+  }
+  pthread_once(&io_uring_once, InitIoUringKey);
+  if (io_uring_refused.Acquire_Load() != NULL) {
+    return NULL;
+  }
+  IoUring* ring = reinterpret_cast<IoUring*>(
+      pthread_getspecific(io_uring_key));
+  if (ring == NULL) {
+    ring = IoUring::Create();
+    if (ring == NULL) {
+      // Not supported by the kernel, or forbidden by a seccomp filter
+      io_uring_refused.Release_Store(&io_uring_refused);
+      return NULL;
+    }
+    pthread_setspecific(io_uring_key, ring);
+  } else if (!ring->usable()) {
+    return NULL;
+  }
+  return ring;
+}
+#endif  // defined(LEVELDB_IO_URING)
+
+// Serves MultiRead() when io_uring is not available, by spreading the
+// reads of a batch over a few threads.  The caller takes part too, so a
+// batch makes progress even when all the threads are busy.
+class ReadPool {
+ public:
+  ReadPool() : work_cv_(&mu_), done_cv_(&mu_), started_(false) { }
+
+  void Read(const std::string& fname, int fd, ReadRequest* reqs, size_t n) {
+    Batch batch = { &fname, fd, n };
+    MutexLock l(&mu_);
+    if (!started_) {
+      started_ = true;
+      for (int i = 0; i < kThreads; i++) {
+        pthread_t t;
+        if (pthread_create(&t, NULL, &ReadPool::ThreadWrapper, this) == 0) {
+          pthread_detach(t);
+        }
+      }
+    }
+    for (size_t i = 0; i < n; i++) {
+      Item item = { &batch, &reqs[i] };
+      queue_.push_back(item);
+    }
+    work_cv_.SignalAll();
+    while (batch.remaining > 0) {
+      if (queue_.empty()) {
+        done_cv_.Wait();
+      } else {
+        RunFront();
+      }
+    }
+  }
+
+ private:
+  static const int kThreads = 8;
+
+  struct Batch {
+    const std::string* fname;
+    int fd;
+    size_t remaining;
+  };
+  struct Item {
+    Batch* batch;
+    ReadRequest* req;
+  };
+
+  // Perform the read at the front of the queue.
+  // REQUIRES: mu_ is held and queue_ is not empty
+  void RunFront() {
+    Item item = queue_.front();
+    queue_.pop_front();
+    mu_.Unlock();
+    ReadRequest* r = item.req;
+    r->status = PosixRead(*item.batch->fname, item.batch->fd, r->offset,
+                          r->n, &r->result, r->scratch);
+    mu_.Lock();
+    if (--item.batch->remaining == 0) {
+      done_cv_.SignalAll();
+    }
+  }
+
+  void Run() {
+    MutexLock l(&mu_);
+    while (true) {
+      while (queue_.empty()) {
+        work_cv_.Wait();
+      }
+      RunFront();
+    }
+  }
+
+  static void* ThreadWrapper(void* arg) {
+    reinterpret_cast<ReadPool*>(arg)->Run();
+    return NULL;
+  }
+
+  port::Mutex mu_;
+  port::CondVar work_cv_;
+  port::CondVar done_cv_;
+  bool started_;
+  std::deque<Item> queue_;
+};
+
+static pthread_once_t read_pool_once = PTHREAD_ONCE_INIT;
+static ReadPool* read_pool;
+static void InitReadPool() { read_pool = new ReadPool; }
+
 // pread() based random-access
 class PosixRandomAccessFile: public RandomAccessFile {
  private:
@@ -78,14 +464,40 @@ class PosixRandomAccessFile: public RandomAccessFile {
 
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                       char* scratch) const {
-    Status s;
-    ssize_t r = pread(fd_, scratch, n, static_cast<off_t>(offset));
-    *result = Slice(scratch, (r < 0) ? 0 : r);
-    if (r < 0) {
-      // An error: return a non-ok status
-      s = IOError(filename_, errno);
+    return PosixRead(filename_, fd_, offset, n, result, scratch);
+  }
+
+  virtual Status MultiRead(ReadRequest* reqs, size_t n) const {
+    if (n <= 1) {
+      return RandomAccessFile::MultiRead(reqs, n);
     }
-    return s;
+    for (size_t i = 0; i < n; i++) {
+      reqs[i].result = Slice(NULL, 0);
+      reqs[i].status = Status::OK();
+    }
+#if defined(LEVELDB_IO_URING)
+    IoUring* ring = ThreadIoUring();
+    if (ring != NULL) {
+      for (size_t i = 0; i < n && ring->usable(); i += IoUring::kDepth) {
+        const size_t count = std::min<size_t>(n - i, IoUring::kDepth);
+        ring->Read(filename_, fd_, reqs + i, count);
+      }
+      if (ring->usable()) {
+        return FirstError(reqs, n);
+      }
+      // Finish the reads the ring gave up on
+      for (size_t i = 0; i < n; i++) {
+        if (reqs[i].result.data() == NULL) {
+          reqs[i].status = Read(reqs[i].offset, reqs[i].n, &reqs[i].result,
+                                reqs[i].scratch);
+        }
+      }
+      return FirstError(reqs, n);
+    }
+#endif
+    pthread_once(&read_pool_once, InitReadPool);
+    read_pool->Read(filename_, fd_, reqs, n);
+    return FirstError(reqs, n);
   }
 };
 
@@ -96,7 +508,8 @@ class MmapLimiter {
  public:
   // Up to 1000 mmaps for 64-bit binaries; none for smaller pointer sizes.
   MmapLimiter() {
-    SetAllowed(sizeof(void*) >= 8 ? 1000 : 0);
+    SetAllowed(mmap_limit >= 0 ? mmap_limit :
+               sizeof(void*) >= 8 ? 1000 : 0);
   }
 
   // If another mmap slot is available, acquire it and return true.
@@ -170,16 +583,39 @@ class PosixMmapReadableFile: public RandomAccessFile {
     }
     return s;
   }
+
+  // The data is copied by page faults, one page at a time, so ask the
+  // kernel to start reading all the ranges before touching any.
+  virtual Status MultiRead(ReadRequest* reqs, size_t n) const {
+    if (n > 1) {
+      const uintptr_t page_size = getpagesize();
+      for (size_t i = 0; i < n; i++) {
+        if (reqs[i].offset + reqs[i].n <= length_) {
+          uintptr_t start = reqs[i].offset & ~(page_size - 1);
+          madvise(reinterpret_cast<char*>(mmapped_region_) + start,
+                  reqs[i].offset + reqs[i].n - start, MADV_WILLNEED);
+        }
+      }
+    }
+    return RandomAccessFile::MultiRead(reqs, n);
+  }
 };
 
 class PosixWritableFile : public WritableFile {
  private:
   std::string filename_;
   FILE* file_;
+  uint64_t filesize_;                  // Bytes appended so far
+  uint64_t allocated_;                 // Bytes reserved by fallocate()
+  size_t preallocation_block_size_;
 
  public:
   PosixWritableFile(const std::string& fname, FILE* f)
-      : filename_(fname), file_(f) { }
+      : filename_(fname),
+        file_(f),
+        filesize_(0),
+        allocated_(0),
+        preallocation_block_size_(0) { }
 
   ~PosixWritableFile() {
     if (file_ != NULL) {
@@ -189,13 +625,38 @@ class PosixWritableFile : public WritableFile {
   }
 
   virtual Status Append(const Slice& data) {
+    if (filesize_ + data.size() > allocated_ &&
+        preallocation_block_size_ > 0) {
+      Preallocate(filesize_ + data.size());
+    }
     size_t r = fwrite_unlocked(data.data(), 1, data.size(), file_);
+    filesize_ += r;
     if (r != data.size()) {
       return IOError(filename_, errno);
     }
     return Status::OK();
   }
 
+  virtual void SetPreallocationBlockSize(size_t size) {
+    preallocation_block_size_ = size;
+  }
+
+  // Reserve whole blocks of preallocation_block_size_ bytes up to at
+  // least "size".  Failures only mean the file grows the usual way.
+  void Preallocate(uint64_t size) {
+    const uint64_t block = preallocation_block_size_;
+    const uint64_t new_allocated = (size + block - 1) / block * block;
+#if defined(OS_LINUX)
+    if (fallocate(fileno(file_), FALLOC_FL_KEEP_SIZE, allocated_,
+                  new_allocated - allocated_) != 0) {
+      // Most likely unsupported by the file system; stop trying.
+      preallocation_block_size_ = 0;
+      return;
+    }
+#endif
+    allocated_ = new_allocated;
+  }
+
   virtual Status Close() {
     Status result;
     if (fclose(file_) != 0) {
@@ -251,6 +712,16 @@ class PosixWritableFile : public WritableFile {
     }
     return s;
   }
+
+  virtual Status SyncFlushed() {
+    // Only touches the file descriptor, never the stdio buffer, so it is
+    // safe to run while another thread appends.
+    Status s = SyncDirIfManifest();
+    if (s.ok() && fdatasync(fileno(file_)) != 0) {
+      s = Status::IOError(filename_, strerror(errno));
+    }
+    return s;
+  }
 };
 
 static int LockOrUnlock(int fd, bool lock) {
@@ -363,6 +834,23 @@ class PosixEnv : public Env {
     return s;
   }
 
+  virtual Status ReuseWritableFile(const std::string& fname,
+                                   const std::string& old_fname,
+                                   WritableFile** result) {
+    *result = NULL;
+    if (rename(old_fname.c_str(), fname.c_str()) != 0) {
+      return IOError(old_fname, errno);
+    }
+    Status s;
+    FILE* f = fopen(fname.c_str(), "r+");
+    if (f == NULL) {
+      s = IOError(fname, errno);
+    } else {
+      *result = new PosixWritableFile(fname, f);
+    }
+    return s;
+  }
+
   virtual bool FileExists(const std::string& fname) {
     return access(fname.c_str(), F_OK) == 0;
   }
@@ -610,6 +1098,19 @@ static pthread_once_t once = PTHREAD_ONCE_INIT;
 static Env* default_env;
 static void InitDefaultEnv() { default_env = new PosixEnv; }
 
+void EnvPosixTestHelper::SetReadOnlyMMapLimit(int limit) {
+  assert(default_env == NULL);
+  mmap_limit = limit;
+}
+
+void EnvPosixTestHelper::SetIoUringEnabled(bool enabled) {
+  io_uring_enabled = enabled;
+}
+
+void EnvPosixTestHelper::SetIoUringReadUnsupported() {
+  io_uring_read_unsupported = true;
+}
+
 Env* Env::Default() {
   pthread_once(&once, InitDefaultEnv);
   return default_env;
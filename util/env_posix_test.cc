@@ -0,0 +1,140 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/env_posix_test_helper.h"
+#include "util/mutexlock.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class EnvPosixTest {
+ public:
+  Env* env_;
+  std::string fname_;
+  std::string contents_;
+
+  EnvPosixTest() : env_(Env::Default()) {
+    fname_ = test::TmpDir() + "/env_posix_test.data";
+    contents_.resize(1 << 20);
+    for (size_t i = 0; i < contents_.size(); i++) {
+      contents_[i] = static_cast<char>(i * 7 + (i >> 12));
+    }
+    ASSERT_OK(WriteStringToFile(env_, contents_, fname_));
+  }
+
+  ~EnvPosixTest() {
+    env_->DeleteFile(fname_);
+  }
+
+  static void SetReadOnlyMMapLimit(int limit) {
+    EnvPosixTestHelper::SetReadOnlyMMapLimit(limit);
+  }
+
+  static void SetIoUringEnabled(bool enabled) {
+    EnvPosixTestHelper::SetIoUringEnabled(enabled);
+  }
+
+  static void SetIoUringReadUnsupported() {
+    EnvPosixTestHelper::SetIoUringReadUnsupported();
+  }
+
+  // Read "n" ranges of "size" bytes with one MultiRead(), the last of
+  // them running past the end of the file, and check the results.
+  void CheckMultiRead(int n, size_t size) {
+    RandomAccessFile* file;
+    ASSERT_OK(env_->NewRandomAccessFile(fname_, &file));
+    std::vector<ReadRequest> reqs(n);
+    std::vector<std::string> scratch(n);
+    for (int i = 0; i < n; i++) {
+      scratch[i].resize(size);
+      reqs[i].offset = (static_cast<uint64_t>(i) * 104729) %
+                       (contents_.size() - size);
+      reqs[i].n = size;
+      reqs[i].scratch = &scratch[i][0];
+    }
+    reqs[n - 1].offset = contents_.size() - size / 2;
+    ASSERT_OK(file->MultiRead(&reqs[0], reqs.size()));
+    for (int i = 0; i < n; i++) {
+      ASSERT_OK(reqs[i].status);
+      const size_t len = std::min<size_t>(size,
+                                          contents_.size() - reqs[i].offset);
+      ASSERT_EQ(contents_.substr(reqs[i].offset, len),
+                reqs[i].result.ToString());
+    }
+    delete file;
+  }
+};
+
+TEST(EnvPosixTest, MultiRead) {
+  SetIoUringEnabled(true);
+  CheckMultiRead(1, 4096);
+  CheckMultiRead(2, 100);
+  CheckMultiRead(200, 4096);
+}
+
+TEST(EnvPosixTest, MultiReadWithoutIoUring) {
+  SetIoUringEnabled(false);
+  CheckMultiRead(2, 100);
+  CheckMultiRead(200, 4096);
+  SetIoUringEnabled(true);
+}
+
+namespace {
+struct ReaderState {
+  EnvPosixTest* test;
+  port::Mutex mu;
+  port::CondVar cv;
+  int running;
+
+  ReaderState() : cv(&mu) { }
+};
+
+static void ReadManyTimes(void* arg) {
+  ReaderState* state = reinterpret_cast<ReaderState*>(arg);
+  for (int i = 0; i < 20; i++) {
+    state->test->CheckMultiRead(50, 1000);
+  }
+  MutexLock l(&state->mu);
+  state->running--;
+  state->cv.Signal();
+}
+}  // namespace
+
+TEST(EnvPosixTest, ConcurrentMultiRead) {
+  for (int use_io_uring = 1; use_io_uring >= 0; use_io_uring--) {
+    SetIoUringEnabled(use_io_uring);
+    ReaderState state;
+    state.test = this;
+    state.running = 4;
+    for (int i = 0; i < 4; i++) {
+      env_->StartThread(&ReadManyTimes, &state);
+    }
+    MutexLock l(&state.mu);
+    while (state.running > 0) {
+      state.cv.Wait();
+    }
+  }
+  SetIoUringEnabled(true);
+}
+
+// Must come last: io_uring stays off for the rest of the process.
+TEST(EnvPosixTest, MultiReadWithoutReadOpcode) {
+  SetIoUringReadUnsupported();
+  CheckMultiRead(2, 100);
+  CheckMultiRead(200, 4096);
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  // Serve every file with pread(), so that MultiRead() goes to io_uring
+  // or the thread pool rather than to the mapped files.
+  leveldb::EnvPosixTest::SetReadOnlyMMapLimit(0);
+  return leveldb::test::RunAllTests();
+}
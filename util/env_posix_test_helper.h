@@ -0,0 +1,34 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_ENV_POSIX_TEST_HELPER_H_
+#define STORAGE_LEVELDB_UTIL_ENV_POSIX_TEST_HELPER_H_
+
+namespace leveldb {
+
+class EnvPosixTest;
+
+// A helper for the POSIX Env to facilitate testing.
+class EnvPosixTestHelper {
+ private:
+  friend class EnvPosixTest;
+
+  // Set the maximum number of read-only files that will be mapped via mmap.
+  // Must be called before creating an Env.
+  static void SetReadOnlyMMapLimit(int limit);
+
+  // Set whether RandomAccessFile::MultiRead() may use io_uring, where the
+  // build and the kernel support it.  Must not be called while reads are
+  // in progress.
+  static void SetIoUringEnabled(bool enabled);
+
+  // Make io_uring reads fail with EINVAL, as on kernels that have
+  // io_uring but not its IORING_OP_READ requests.  io_uring is then
+  // left aside for good, as it would be on such a kernel.
+  static void SetIoUringReadUnsupported();
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_ENV_POSIX_TEST_HELPER_H_
@@ -17,13 +17,29 @@ Options::Options()
       env(Env::Default()),
       info_log(NULL),
       write_buffer_size(4<<20),
+      max_write_buffer_number(2),
+      memtable_factory(NULL),
+      arena_block_size(4096),
+      memtable_huge_page_size(0),
+      inplace_update_support(false),
+      memtable_bloom_size_ratio(0),
       max_open_files(1000),
       block_cache(NULL),
       block_size(4096),
       block_restart_interval(16),
       compression(kSnappyCompression),
       reuse_logs(false),
-      filter_policy(NULL) {
+      recycle_log_file_num(0),
+      filter_policy(NULL),
+      prefix_extractor(NULL),
+      full_filter(false),
+      merge_operator(NULL),
+      enable_pipelined_write(false),
+      allow_concurrent_memtable_write(false),
+      enable_wal_sync_thread(false),
+      manual_wal_flush(false),
+      wal_buffer_size(64 << 10),
+      delayed_write_rate(16 << 20) {
 }
 
 }  // namespace leveldb
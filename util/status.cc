@@ -2,8 +2,6 @@
 #include "port/port.h"
 #include "leveldb/status.h"
 
-#include <iostream>
-
 namespace leveldb{
 
 const char* Status::CopyState(const char* state) {
@@ -33,10 +31,6 @@ Status::Status(Code code, const Slice& msg, const Slice& msg2) {
     const uint32_t len2 = msg2.size();
     const uint32_t size = len1 + (len2 ? (2 + len2) : 0);
 
-    // for debug
-    std::cout << "status.cc, len1:"<< len1 << " len2:" << len2
-              <<" size:" << size << std::endl;
-
     char* result = new char[size + 5];
     memcpy(result, &size, sizeof(size));
     result[4] = static_cast<char>(code);
@@ -47,9 +41,6 @@ Status::Status(Code code, const Slice& msg, const Slice& msg2) {
          memcpy(result + 7 +len1, msg2.data(), len2);
     }
     state_ = result;
-
-    // for debug
-    std::cout << "result:" << result << std::endl;
 }
 
 std::string Status::ToString() const {
@@ -77,6 +68,9 @@ std::string Status::ToString() const {
             case kIOError:
                 type = "IO error: ";
                 break;
+            case kBusy:
+                type = "Busy: ";
+                break;
             default:
                 snprintf(tmp, sizeof(tmp),"Unknown code(%d): ",
                        static_cast<int>(code()));